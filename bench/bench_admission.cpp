@@ -0,0 +1,165 @@
+#include <QtTest>
+#include "admissioncontrol.h"
+
+// Admission checks sit in front of every CreateSession, SelectSources and
+// Start, so they have to stay a hash lookup no matter how many apps there
+// are, and refusing must be just as cheap.
+class BenchAdmission : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void admitCost_data();
+    void admitCost();
+    void refuseCost();
+    void limits();
+    void rate();
+    void globalRefusalIsFree();
+    void quietAppsForgotten();
+};
+
+static QStringList makeApps(int count)
+{
+    QStringList apps;
+    for (int i = 0; i < count; ++i) {
+        apps.append(QStringLiteral("org.example.App%1").arg(i));
+    }
+    return apps;
+}
+
+void BenchAdmission::admitCost_data()
+{
+    QTest::addColumn<int>("apps");
+    QTest::newRow("10") << 10;
+    QTest::newRow("10000") << 10000;
+}
+
+void BenchAdmission::admitCost()
+{
+    QFETCH(int, apps);
+    const QStringList ids = makeApps(apps);
+
+    AdmissionControl admission({ 4, 4, 1e9, 0 }, { 0, 0, 0, 0 });
+    for (const QString &id : ids) {
+        QCOMPARE(admission.admitSession(id), AdmissionControl::Admitted);
+    }
+
+    int i = 0;
+    QBENCHMARK {
+        const QString &id = ids.at(i++ % apps);
+        admission.admitSession(id);
+        admission.releaseSession(id);
+    }
+}
+
+void BenchAdmission::refuseCost()
+{
+    AdmissionControl admission({ 1, 0, 0, 0 }, { 0, 0, 0, 0 });
+    const QString id = QStringLiteral("org.example.Looping");
+    QCOMPARE(admission.admitSession(id), AdmissionControl::Admitted);
+
+    QBENCHMARK {
+        admission.admitSession(id);
+    }
+    QVERIFY(admission.rejections(AdmissionControl::TooManySessions) > 0);
+}
+
+void BenchAdmission::limits()
+{
+    AdmissionControl admission({ 2, 1, 0, 0 }, { 3, 0, 0, 0 });
+    const QString a = QStringLiteral("org.example.A");
+    const QString b = QStringLiteral("org.example.B");
+
+    QCOMPARE(admission.admitSession(a), AdmissionControl::Admitted);
+    QCOMPARE(admission.admitSession(a), AdmissionControl::Admitted);
+    QCOMPARE(admission.admitSession(a), AdmissionControl::TooManySessions);
+
+    // Per app first, then everyone together
+    QCOMPARE(admission.admitSession(b), AdmissionControl::Admitted);
+    QCOMPARE(admission.admitSession(b), AdmissionControl::TooManySessions);
+
+    QCOMPARE(admission.admitStream(a), AdmissionControl::Admitted);
+    QCOMPARE(admission.admitStream(a), AdmissionControl::TooManyStreams);
+    QCOMPARE(admission.admitStream(b), AdmissionControl::Admitted);
+
+    admission.releaseSession(a);
+    QCOMPARE(admission.admitSession(b), AdmissionControl::Admitted);
+
+    QCOMPARE(admission.rejections(AdmissionControl::TooManySessions), quint64(2));
+    QCOMPARE(admission.rejections(AdmissionControl::TooManyStreams), quint64(1));
+
+    // Nothing held, nothing kept
+    admission.releaseStream(a);
+    admission.releaseSession(a);
+    admission.releaseStream(b);
+    admission.releaseSession(b);
+    admission.releaseSession(b);
+    const QVariantMap stats = admission.stats();
+    QCOMPARE(stats.value("sessions").toInt(), 0);
+    QCOMPARE(stats.value("streams").toInt(), 0);
+    QCOMPARE(stats.value("apps").toInt(), 0);
+}
+
+void BenchAdmission::rate()
+{
+    // Burst of three, then one every 100 ms
+    AdmissionControl admission({ 0, 0, 10, 3 }, { 0, 0, 0, 0 });
+    const QString a = QStringLiteral("org.example.A");
+    const QString b = QStringLiteral("org.example.B");
+
+    for (int i = 0; i < 3; ++i) {
+        QCOMPARE(admission.admitRequest(a), AdmissionControl::Admitted);
+    }
+    QCOMPARE(admission.admitRequest(a), AdmissionControl::RateLimited);
+
+    // Someone else's bucket is untouched
+    QCOMPARE(admission.admitRequest(b), AdmissionControl::Admitted);
+
+    QTest::qWait(150);
+    QCOMPARE(admission.admitRequest(a), AdmissionControl::Admitted);
+    QCOMPARE(admission.rejections(AdmissionControl::RateLimited), quint64(1));
+}
+
+void BenchAdmission::globalRefusalIsFree()
+{
+    // Two per app and hardly any refill, one at once for everyone together
+    AdmissionControl admission({ 0, 0, 0.1, 2 }, { 0, 0, 10, 1 });
+    const QString a = QStringLiteral("org.example.A");
+    const QString b = QStringLiteral("org.example.B");
+
+    QCOMPARE(admission.admitRequest(b), AdmissionControl::Admitted);
+    QCOMPARE(admission.admitRequest(a), AdmissionControl::RateLimited);
+    QCOMPARE(admission.admitRequest(a), AdmissionControl::RateLimited);
+
+    // Once the global bucket has refilled, a still has both of its own
+    for (int i = 0; i < 2; ++i) {
+        QTest::qWait(150);
+        QCOMPARE(admission.admitRequest(a), AdmissionControl::Admitted);
+    }
+    QTest::qWait(150);
+    QCOMPARE(admission.admitRequest(a), AdmissionControl::RateLimited);
+}
+
+void BenchAdmission::quietAppsForgotten()
+{
+    // Refill in 20 ms, so apps go quiet quickly
+    AdmissionControl admission({ 0, 0, 100, 2 }, { 0, 0, 0, 0 });
+    const QStringList ids = makeApps(500);
+
+    // Only ever requests, half of them refused
+    for (const QString &id : ids) {
+        admission.admitRequest(id);
+        admission.admitRequest(id);
+        admission.admitRequest(id);
+    }
+    QVERIFY(admission.rejections(AdmissionControl::RateLimited) > 0);
+
+    QTest::qWait(50);
+    for (int i = 0; i < 100; ++i) {
+        admission.admitRequest(ids.first());
+    }
+    QVERIFY(admission.stats().value("apps").toInt() <= 1);
+}
+
+QTEST_GUILESS_MAIN(BenchAdmission)
+#include "bench_admission.moc"
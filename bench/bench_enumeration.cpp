@@ -0,0 +1,231 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include "fakecompositor.h"
+#include "desktopentry.h"
+#include "mutterdisplayconfig.h"
+#include "muttershellintrospect.h"
+#include "sourceselector.h"
+
+// Per-request hot paths of the picker: enumerating monitors and windows,
+// resolving app names from desktop files and building the QML model.
+//
+// The D-Bus benchmarks need a private session bus so the fake compositor can
+// own the Mutter names:
+//     dbus-run-session -- ./bench_enumeration
+// A demarshalled QDBusArgument can only be walked once, so those benchmarks
+// include the round trip to the fake compositor on every iteration.
+class BenchEnumeration : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void getMonitors_data();
+    void getMonitors();
+    void getWindows_data();
+    void getWindows();
+    void findDisplayName_data();
+    void findDisplayName();
+    void buildSources_data();
+    void buildSources();
+    void buildModel_data();
+    void buildModel();
+    void compositorGone();
+
+private:
+    static void writeDesktopFiles(const QString &dir, int count);
+};
+
+void BenchEnumeration::getMonitors_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("1") << 1;
+    QTest::newRow("3") << 3;
+    QTest::newRow("8") << 8;
+}
+
+void BenchEnumeration::getMonitors()
+{
+    QFETCH(int, count);
+
+    FakeCompositor compositor({ count, 0 });
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterDisplayConfig displayConfig;
+    QCOMPARE(displayConfig.getMonitors().size(), count);
+
+    QBENCHMARK {
+        displayConfig.getMonitors();
+    }
+}
+
+void BenchEnumeration::getWindows_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("10") << 10;
+    QTest::newRow("150") << 150;
+    QTest::newRow("1000") << 1000;
+}
+
+void BenchEnumeration::getWindows()
+{
+    QFETCH(int, count);
+
+    FakeCompositor compositor({ 0, count });
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterShellIntrospect shellIntrospect;
+    QCOMPARE(shellIntrospect.getWindows().size(), count);
+
+    QBENCHMARK {
+        shellIntrospect.getWindows();
+    }
+}
+
+void BenchEnumeration::writeDesktopFiles(const QString &dir, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        QFile file(QStringLiteral("%1/org.example.App%2.desktop").arg(dir).arg(i));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QStringLiteral(
+            "[Desktop Entry]\n"
+            "Type=Application\n"
+            "Name=Example App %1\n"
+            "GenericName=Example\n"
+            "Comment=An application that exists to be searched for\n"
+            "Exec=example-app-%1 %U\n"
+            "Icon=org.example.App%1\n"
+            "Categories=Utility;\n"
+            "StartupWMClass=example-app-%1\n"
+            "\n"
+            "[Desktop Action new-window]\n"
+            "Name=New Window\n"
+            "Exec=example-app-%1 --new-window\n").arg(i).toUtf8());
+    }
+}
+
+void BenchEnumeration::findDisplayName_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<QString>("identifier");
+
+    for (int count : { 50, 200, 1000 }) {
+        QTest::addRow("%d files, desktop id", count) << count << QStringLiteral("org.example.App%1").arg(count - 1);
+        QTest::addRow("%d files, wm class", count) << count << QStringLiteral("example-app-%1").arg(count - 1);
+        QTest::addRow("%d files, miss", count) << count << QStringLiteral("does-not-exist");
+    }
+}
+
+void BenchEnumeration::findDisplayName()
+{
+    QFETCH(int, count);
+    QFETCH(QString, identifier);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    writeDesktopFiles(dir.path(), count);
+
+    const std::vector<std::string> searchPaths = { dir.path().toStdString() + "/" };
+    const std::string id = identifier.toStdString();
+
+    QBENCHMARK {
+        ::findDisplayName(id, searchPaths);
+    }
+}
+
+static QVector<MonitorInfo> syntheticMonitors(int count)
+{
+    QVector<MonitorInfo> monitors;
+    for (int i = 0; i < count; ++i) {
+        MonitorInfo monitor;
+        monitor.connector = QStringLiteral("DP-%1").arg(i + 1);
+        monitor.displayName = QStringLiteral("Fake Display %1").arg(i + 1);
+        monitor.currentWidth = 2560;
+        monitor.currentHeight = 1440;
+        monitor.currentRefreshRate = 143.998;
+        monitor.isBuiltin = false;
+        monitors.append(monitor);
+    }
+    return monitors;
+}
+
+static QVector<WindowInfo> syntheticWindows(int count)
+{
+    QVector<WindowInfo> windows;
+    for (int i = 0; i < count; ++i) {
+        windows.append({ quint64(i + 1), QStringLiteral("Fake window %1").arg(i), QStringLiteral("org.example.App%1").arg(i % 16) });
+    }
+    return windows;
+}
+
+void BenchEnumeration::buildSources_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("10") << 10;
+    QTest::newRow("150") << 150;
+    QTest::newRow("1000") << 1000;
+}
+
+void BenchEnumeration::buildSources()
+{
+    QFETCH(int, count);
+
+    const QVector<MonitorInfo> monitors = syntheticMonitors(2);
+    const QVector<WindowInfo> windows = syntheticWindows(count);
+
+    QBENCHMARK {
+        SourceSelector::buildSources(monitors, windows);
+    }
+}
+
+void BenchEnumeration::buildModel_data()
+{
+    buildSources_data();
+}
+
+void BenchEnumeration::buildModel()
+{
+    QFETCH(int, count);
+
+    const QVector<SourceSelector::Source> sources =
+        SourceSelector::buildSources(syntheticMonitors(2), syntheticWindows(count));
+
+    QBENCHMARK {
+        QObject parent;
+        SourceSelector::buildModel(sources, &parent);
+    }
+}
+
+void BenchEnumeration::compositorGone()
+{
+    FakeCompositor compositor({ 2, 10 });
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterDisplayConfig displayConfig;
+    MutterShellIntrospect shellIntrospect;
+    QTRY_VERIFY(displayConfig.isAvailable());
+
+    // Niri crashed: calls must fail right away, not after the D-Bus timeout
+    compositor.stop();
+    QTRY_VERIFY(!displayConfig.isAvailable());
+
+    QBENCHMARK {
+        QVERIFY(displayConfig.getMonitors().isEmpty());
+        QVERIFY(shellIntrospect.getWindows().isEmpty());
+    }
+
+    // And work again, through fresh proxies, once it's back
+    QVERIFY(compositor.start());
+    QTRY_VERIFY(displayConfig.isAvailable());
+    QCOMPARE(displayConfig.getMonitors().size(), 2);
+    QCOMPARE(shellIntrospect.getWindows().size(), 10);
+}
+
+QTEST_GUILESS_MAIN(BenchEnumeration)
+#include "bench_enumeration.moc"
@@ -0,0 +1,303 @@
+#include <QtTest>
+#include <QDBusConnection>
+#include <QDBusMetaType>
+#include <QTemporaryDir>
+#include <memory>
+#include "externalpicker.h"
+#include "fakeportal.h"
+#include "portalconfig.h"
+#include "quickbench.h"
+#include "screencast.h"
+
+// SelectSources through a shell registered as external picker, against the
+// built-in picker, and the fallbacks when the shell is slow or goes away.
+//
+//     dbus-run-session -- ./bench_externalpicker
+static const QString PickerInterface = QStringLiteral("org.freedesktop.impl.portal.desktop.uni.Picker");
+
+// The shell's side, on its own connection so it has a name of its own
+class FakeShell : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.impl.portal.desktop.uni.PickerClient")
+
+public:
+    enum Mode {
+        Choose, // shows it, then picks choice
+        Hold,   // shows it and waits for the user, forever
+        Ignore, // never answers Pick
+    };
+
+    FakeShell(Mode mode, const QString &choice = QString())
+        : mode(mode)
+        , choice(choice)
+        , m_name(QStringLiteral("picker-shell-%1").arg(++s_instances))
+        , m_bus(QDBusConnection::connectToBus(QDBusConnection::SessionBus, m_name))
+    {
+        qDBusRegisterMetaType<QList<QVariantMap>>();
+        m_bus.registerObject(QStringLiteral("/org/example/Shell/Picker"), this, QDBusConnection::ExportAllSlots);
+    }
+
+    ~FakeShell() override
+    {
+        m_bus.unregisterObject(QStringLiteral("/org/example/Shell/Picker"));
+        QDBusConnection::disconnectFromBus(m_name);
+    }
+
+    bool registerPicker()
+    {
+        QDBusMessage msg = QDBusMessage::createMethodCall(QDBusConnection::sessionBus().baseService(), FakePortal::Path,
+                                                          PickerInterface, QStringLiteral("RegisterPicker"));
+        msg.setArguments({ QVariant::fromValue(QDBusObjectPath("/org/example/Shell/Picker")) });
+
+        // The portal answers from this thread
+        QEventLoop loop;
+        QDBusPendingCallWatcher watcher(m_bus.asyncCall(msg));
+        connect(&watcher, &QDBusPendingCallWatcher::finished, &loop, &QEventLoop::quit);
+        if (!watcher.isFinished()) {
+            loop.exec();
+        }
+        return watcher.reply().arguments().value(0).toBool();
+    }
+
+    Mode mode;
+    QString choice;
+    int picks = 0;
+    int cancels = 0;
+    QStringList offered; // ids in the last Pick
+
+public slots:
+    bool Pick(const QDBusObjectPath &handle, const QString &appId, const QList<QVariantMap> &sources,
+              const QVariantMap &options, const QDBusMessage &message)
+    {
+        Q_UNUSED(appId)
+        Q_UNUSED(options)
+
+        ++picks;
+        offered.clear();
+        for (const QVariantMap &source : sources) {
+            offered.append(source.value("id").toString());
+        }
+
+        if (mode == Ignore) {
+            message.setDelayedReply(true);
+            return false;
+        }
+        if (mode == Choose) {
+            QDBusMessage picked = QDBusMessage::createMethodCall(QDBusConnection::sessionBus().baseService(), FakePortal::Path,
+                                                                 PickerInterface, QStringLiteral("Picked"));
+            picked.setArguments({ QVariant::fromValue(handle), 0u, choice });
+            m_bus.send(picked);
+        }
+        return true;
+    }
+
+    void Cancel(const QDBusObjectPath &handle)
+    {
+        Q_UNUSED(handle)
+        ++cancels;
+    }
+
+private:
+    static inline int s_instances = 0;
+    QString m_name;
+    QDBusConnection m_bus;
+};
+
+class BenchExternalPicker : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void cleanup();
+    void selectSources_data();
+    void selectSources();
+    void catalogCached();
+    void fallbackOnTimeout();
+    void fallbackWhenShellLeaves();
+    void closeCancelsShell();
+
+private:
+    // CreateSession then SelectSources, the response of the last one
+    int select(FakeFrontend &frontend, const QString &token);
+    int start(FakeFrontend &frontend, const QString &token);
+
+    QTemporaryDir m_home;
+    std::unique_ptr<FakePortal> m_portal;
+    ExternalPicker *m_picker = nullptr;
+    int m_tokens = 0;
+};
+
+void BenchExternalPicker::initTestCase()
+{
+    // Never the user's own config and usage files
+    QVERIFY(m_home.isValid());
+    qputenv("XDG_CONFIG_HOME", m_home.filePath("config").toUtf8());
+    qputenv("XDG_STATE_HOME", m_home.filePath("state").toUtf8());
+    QVERIFY(QDir().mkpath(QFileInfo(PortalConfig::path()).path()));
+    {
+        QFile config(PortalConfig::path());
+        QVERIFY(config.open(QIODevice::WriteOnly));
+        config.write("[Picker]\ntimeout_ms=300\n");
+    }
+    PortalConfig::reload();
+    QCOMPARE(PortalConfig::instance().pickerTimeoutMs, 300);
+
+    m_portal = std::make_unique<FakePortal>(FakeCompositor::Config { 2, 20 });
+    if (!m_portal->start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    m_picker = new ExternalPicker(m_portal->service());
+    m_portal->adaptor()->setExternalPicker(m_picker);
+}
+
+void BenchExternalPicker::cleanupTestCase()
+{
+    m_picker = nullptr;
+    m_portal.reset();
+}
+
+void BenchExternalPicker::cleanup()
+{
+    // Every test brings its own shell
+    QTRY_VERIFY_WITH_TIMEOUT(!m_picker->isRegistered(), 2000);
+}
+
+static const QString AppId = QStringLiteral("org.example.Meeting");
+
+int BenchExternalPicker::select(FakeFrontend &frontend, const QString &token)
+{
+    if (FakePortal::createSession(frontend, token, AppId) != 0) {
+        return -1;
+    }
+    return FakePortal::selectSources(frontend, token, AppId, 1u | 2u);
+}
+
+int BenchExternalPicker::start(FakeFrontend &frontend, const QString &token)
+{
+    return FakePortal::startSession(frontend, token, AppId);
+}
+
+void BenchExternalPicker::selectSources_data()
+{
+    QTest::addColumn<bool>("external");
+
+    QTest::newRow("external picker") << true;
+    QTest::newRow("built-in picker") << false;
+}
+
+void BenchExternalPicker::selectSources()
+{
+    QFETCH(bool, external);
+
+    qputenv("UNI_PORTAL_AUTOCONFIRM", "DP-1");
+    FakeFrontend frontend(QDBusConnection::sessionBus().baseService(), QStringLiteral("picker-frontend"));
+    std::unique_ptr<FakeShell> shell;
+    if (external) {
+        shell = std::make_unique<FakeShell>(FakeShell::Choose, QStringLiteral("DP-1"));
+        QVERIFY(shell->registerPicker());
+    }
+
+    // The first one fills the catalog
+    QString token = QStringLiteral("select%1").arg(++m_tokens);
+    QCOMPARE(select(frontend, token), 0);
+    QCOMPARE(start(frontend, token), 0);
+
+    QBENCHMARK {
+        QCOMPARE(select(frontend, QStringLiteral("select%1").arg(++m_tokens)), 0);
+    }
+
+    if (external) {
+        QVERIFY(shell->picks > 1);
+        QVERIFY(shell->offered.contains(QStringLiteral("DP-1")));
+    }
+}
+
+void BenchExternalPicker::catalogCached()
+{
+    FakeFrontend frontend(QDBusConnection::sessionBus().baseService(), QStringLiteral("picker-frontend"));
+    FakeShell shell(FakeShell::Choose, QStringLiteral("3"));
+    QVERIFY(shell.registerPicker());
+    QTRY_VERIFY_WITH_TIMEOUT(m_picker->catalog()->isFresh(), 2000);
+
+    // Nothing changed, nothing asked
+    const quint64 refreshes = m_picker->catalog()->refreshes();
+    for (int i = 0; i < 10; ++i) {
+        QCOMPARE(select(frontend, QStringLiteral("cached%1").arg(++m_tokens)), 0);
+    }
+    QCOMPARE(m_picker->catalog()->refreshes(), refreshes);
+    QVERIFY(shell.offered.contains(QStringLiteral("7")));
+
+    // A closed window is gone from the next Pick
+    m_portal->compositor().closeWindow(7);
+    QTRY_VERIFY_WITH_TIMEOUT(!m_picker->catalog()->isFresh(), 2000);
+
+    QElapsedTimer timer;
+    timer.start();
+    QCOMPARE(select(frontend, QStringLiteral("cached%1").arg(++m_tokens)), 0);
+    qInfo("SelectSources with the catalog refreshed: %lld ms", timer.elapsed());
+    QCOMPARE(m_picker->catalog()->refreshes(), refreshes + 1);
+    QVERIFY(!shell.offered.contains(QStringLiteral("7")));
+    QVERIFY(shell.offered.contains(QStringLiteral("3")));
+}
+
+void BenchExternalPicker::fallbackOnTimeout()
+{
+    qputenv("UNI_PORTAL_AUTOCONFIRM", "DP-2");
+    FakeFrontend frontend(QDBusConnection::sessionBus().baseService(), QStringLiteral("picker-frontend"));
+    FakeShell shell(FakeShell::Ignore);
+    QVERIFY(shell.registerPicker());
+
+    QElapsedTimer timer;
+    timer.start();
+    const QString token = QStringLiteral("timeout%1").arg(++m_tokens);
+    QCOMPARE(select(frontend, token), 0);
+    QVERIFY(timer.elapsed() >= 300);
+    qInfo("Built-in picker answered %lld ms after a shell that never did", timer.elapsed());
+
+    // Our own picker's choice made it into the session
+    QCOMPARE(shell.picks, 1);
+    QCOMPARE(start(frontend, token), 0);
+}
+
+void BenchExternalPicker::fallbackWhenShellLeaves()
+{
+    qputenv("UNI_PORTAL_AUTOCONFIRM", "DP-1");
+    FakeFrontend frontend(QDBusConnection::sessionBus().baseService(), QStringLiteral("picker-frontend"));
+    auto *shell = new FakeShell(FakeShell::Hold);
+    QVERIFY(shell->registerPicker());
+
+    // Gone while it's showing the sources, like a crashing shell
+    QTimer::singleShot(200, this, [&shell]() {
+        QCOMPARE(shell->picks, 1);
+        delete std::exchange(shell, nullptr);
+    });
+
+    const QString token = QStringLiteral("leave%1").arg(++m_tokens);
+    QCOMPARE(select(frontend, token), 0);
+    QVERIFY(!shell);
+    QCOMPARE(start(frontend, token), 0);
+}
+
+void BenchExternalPicker::closeCancelsShell()
+{
+    FakeFrontend frontend(QDBusConnection::sessionBus().baseService(), QStringLiteral("picker-frontend"));
+    FakeShell shell(FakeShell::Hold);
+    QVERIFY(shell.registerPicker());
+
+    // The app gives up while the shell is still showing it
+    const QString token = QStringLiteral("close%1").arg(++m_tokens);
+    QTimer::singleShot(200, this, [this, &frontend, token]() {
+        frontend.call(FakePortal::requestPath(token, "s").path(), QStringLiteral("org.freedesktop.impl.portal.Request"),
+                      QStringLiteral("Close"), {});
+    });
+
+    QCOMPARE(select(frontend, token), 2);
+    QTRY_COMPARE_WITH_TIMEOUT(shell.cancels, 1, 2000);
+}
+
+UNI_QUICK_BENCH_MAIN(BenchExternalPicker)
+#include "bench_externalpicker.moc"
@@ -0,0 +1,153 @@
+#include <QtTest>
+#include <QElapsedTimer>
+#include "fakecompositor.h"
+#include "inputbatcher.h"
+#include "mutterremotedesktop.h"
+
+// Remote desktop input at the rate a high polling rate mouse produces it.
+// The batcher should send about one motion message per frame, not one per
+// event, without losing any of the movement.
+//
+//     dbus-run-session -- ./bench_input
+class BenchInput : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void relativeMotion_data();
+    void relativeMotion();
+    void buttonsStayOrdered();
+
+private:
+    // Through the same async calls as portal Start
+    static QString startSession(MutterRemoteDesktop &remoteDesktop);
+    // Calls on one connection arrive in order, so a blocking round trip means
+    // every fire-and-forget message before it has been handled
+    static void roundTrip(const QString &sessionPath);
+};
+
+QString BenchInput::startSession(MutterRemoteDesktop &remoteDesktop)
+{
+    QString sessionPath;
+    bool created = false;
+    remoteDesktop.createSessionAsync(CompositorCallTimeoutMs, &remoteDesktop,
+                                     [&](const QString &path, const QString &, const QDBusError &) {
+                                         sessionPath = path;
+                                         created = true;
+                                     });
+    if (!QTest::qWaitFor([&] { return created; }) || sessionPath.isEmpty()) {
+        return QString();
+    }
+
+    bool started = false;
+    QDBusError error;
+    remoteDesktop.startSessionAsync(sessionPath, CompositorCallTimeoutMs, &remoteDesktop,
+                                    [&](const QDBusError &e) {
+                                        error = e;
+                                        started = true;
+                                    });
+    if (!QTest::qWaitFor([&] { return started; }) || error.isValid()) {
+        return QString();
+    }
+    return sessionPath;
+}
+
+void BenchInput::roundTrip(const QString &sessionPath)
+{
+    QDBusMessage get = QDBusMessage::createMethodCall(
+        MutterRemoteDesktopInterface::staticInterfaceName(), sessionPath,
+        QStringLiteral("org.freedesktop.DBus.Properties"), QStringLiteral("Get"));
+    get.setArguments({ QLatin1String(MutterRemoteDesktopSessionInterface::staticInterfaceName()),
+                       QStringLiteral("SessionId") });
+    QDBusConnection::sessionBus().call(get);
+}
+
+void BenchInput::relativeMotion_data()
+{
+    QTest::addColumn<int>("rateHz");
+    QTest::newRow("125 Hz") << 125;
+    QTest::newRow("1000 Hz") << 1000;
+}
+
+void BenchInput::relativeMotion()
+{
+    QFETCH(int, rateHz);
+
+    FakeCompositor compositor({ 0, 0 });
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterRemoteDesktop remoteDesktop;
+    const QString sessionPath = startSession(remoteDesktop);
+    QVERIFY(!sessionPath.isEmpty());
+
+    InputBatcher batcher(&remoteDesktop, sessionPath);
+
+    // One second of a mouse moving right and a little down
+    const int events = rateHz;
+    int sent = 0;
+    QTimer source;
+    source.setTimerType(Qt::PreciseTimer);
+    source.setInterval(1000 / rateHz);
+    connect(&source, &QTimer::timeout, this, [&] {
+        batcher.pointerMotion(1.0, 0.5);
+        if (++sent == events) {
+            source.stop();
+        }
+    });
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    source.start();
+    QTRY_COMPARE_WITH_TIMEOUT(sent, events, 5000);
+    batcher.flush();
+
+    roundTrip(sessionPath);
+    const qint64 durationMs = elapsed.elapsed();
+
+    const FakeInputStats stats = compositor.inputStats();
+    QCOMPARE(stats.motionDx, events * 1.0);
+    QCOMPARE(stats.motionDy, events * 0.5);
+
+    // Never more than one message per frame, give or take the first one
+    const int frameBudget = int(durationMs / 16) + 2;
+    QVERIFY2(stats.motionMessages <= frameBudget,
+             qPrintable(QStringLiteral("%1 messages for %2 ms").arg(stats.motionMessages).arg(durationMs)));
+
+    qInfo("%d events -> %d messages in %lld ms", events, stats.motionMessages, durationMs);
+    QTest::setBenchmarkResult(stats.motionMessages, QTest::Events);
+
+    remoteDesktop.stopSessionAsync(sessionPath);
+}
+
+void BenchInput::buttonsStayOrdered()
+{
+    FakeCompositor compositor({ 0, 0 });
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterRemoteDesktop remoteDesktop;
+    const QString sessionPath = startSession(remoteDesktop);
+    QVERIFY(!sessionPath.isEmpty());
+
+    InputBatcher batcher(&remoteDesktop, sessionPath);
+
+    // A drag: the motion before the release has to land before it
+    for (int i = 0; i < 10; ++i) {
+        batcher.pointerMotion(2.0, 0);
+    }
+    batcher.sendNow("NotifyPointerButton", { 0x110, false });
+
+    roundTrip(sessionPath);
+    const FakeInputStats stats = compositor.inputStats();
+    QCOMPARE(stats.motionDx, 20.0);
+    QCOMPARE(stats.buttonMessages, 1);
+    QCOMPARE(batcher.messagesSent(), quint64(stats.messages));
+
+    remoteDesktop.stopSessionAsync(sessionPath);
+}
+
+QTEST_GUILESS_MAIN(BenchInput)
+#include "bench_input.moc"
@@ -0,0 +1,87 @@
+#include <QtTest>
+#include <QDBusConnection>
+#include <memory>
+#include "fakeportal.h"
+#include "objectcounter.h"
+#include "quickbench.h"
+
+// Sessions nobody can use anymore go away by themselves: when the caller
+// drops off the bus, and when the captured window closes.
+//
+//     dbus-run-session -- ./bench_orphans
+class BenchOrphans : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void callerLeaves();
+    void capturedWindowCloses();
+
+private:
+    std::unique_ptr<FakePortal> m_portal;
+};
+
+static const QString AppId = QStringLiteral("org.example.Orphans");
+
+void BenchOrphans::initTestCase()
+{
+    m_portal = std::make_unique<FakePortal>(FakeCompositor::Config { 1, 5 });
+    if (!m_portal->start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+}
+
+void BenchOrphans::cleanupTestCase()
+{
+    m_portal.reset();
+}
+
+void BenchOrphans::callerLeaves()
+{
+    qputenv("UNI_PORTAL_AUTOCONFIRM", "DP-1");
+    const int sessionsBefore = ObjectCounter::count("PortalSession");
+
+    FakeFrontend staying(QDBusConnection::sessionBus().baseService(), QStringLiteral("orphans-staying"));
+    QCOMPARE(FakePortal::screenCast(staying, QStringLiteral("stay"), AppId, 1), 0);
+
+    QElapsedTimer timer;
+    {
+        FakeFrontend leaving(QDBusConnection::sessionBus().baseService(), QStringLiteral("orphans-leaving"));
+        QCOMPARE(FakePortal::screenCast(leaving, QStringLiteral("leave1"), AppId, 1), 0);
+        QCOMPARE(FakePortal::screenCast(leaving, QStringLiteral("leave2"), AppId, 1), 0);
+        QCOMPARE(m_portal->compositor().liveScreenCastSessions(), 3);
+        timer.start();
+    }
+
+    // Only the sessions of the caller that left
+    QTRY_COMPARE_WITH_TIMEOUT(m_portal->compositor().liveScreenCastSessions(), 1, 2000);
+    QTRY_COMPARE_WITH_TIMEOUT(ObjectCounter::count("PortalSession"), sessionsBefore + 1, 2000);
+    qInfo("Orphaned sessions stopped %lld ms after their caller left", timer.elapsed());
+}
+
+void BenchOrphans::capturedWindowCloses()
+{
+    qputenv("UNI_PORTAL_AUTOCONFIRM", "3");
+    const int sessionsBefore = ObjectCounter::count("PortalSession");
+
+    FakeFrontend frontend(QDBusConnection::sessionBus().baseService(), QStringLiteral("orphans-window"));
+    QCOMPARE(FakePortal::screenCast(frontend, QStringLiteral("window"), AppId, 2), 0);
+    QCOMPARE(m_portal->compositor().liveScreenCastSessions(), 1);
+
+    // Some other window closing leaves it alone
+    m_portal->compositor().closeWindow(4);
+    QTest::qWait(200);
+    QCOMPARE(m_portal->compositor().liveScreenCastSessions(), 1);
+
+    QElapsedTimer timer;
+    timer.start();
+    m_portal->compositor().closeWindow(3);
+    QTRY_COMPARE_WITH_TIMEOUT(m_portal->compositor().liveScreenCastSessions(), 0, 2000);
+    QTRY_COMPARE_WITH_TIMEOUT(ObjectCounter::count("PortalSession"), sessionsBefore, 2000);
+    qInfo("Session stopped %lld ms after its window closed", timer.elapsed());
+}
+
+UNI_QUICK_BENCH_MAIN(BenchOrphans)
+#include "bench_orphans.moc"
@@ -0,0 +1,142 @@
+#include <QtTest>
+#include <QQuickWindow>
+#include "fakecompositor.h"
+#include "quickbench.h"
+#include "sourceselector.h"
+#include <memory>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Picker startup, measured from SourceSelector::show() (fresh QML engine,
+// component load, window creation) until the first frame has been swapped.
+// Runs offscreen with the software scene graph unless told otherwise:
+//     dbus-run-session -- ./bench_picker
+class BenchPicker : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void timeToFirstFrame_data();
+    void timeToFirstFrame();
+    void cpuTimePerOpen_data();
+    void cpuTimePerOpen();
+    void sourcesStreamIn_data();
+    void sourcesStreamIn();
+};
+
+static qint64 processCpuTimeUs()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return (qint64(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000
+           + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+void BenchPicker::timeToFirstFrame_data()
+{
+    QTest::addColumn<int>("windows");
+    QTest::newRow("10 windows") << 10;
+    QTest::newRow("150 windows") << 150;
+}
+
+void BenchPicker::timeToFirstFrame()
+{
+    QFETCH(int, windows);
+
+    // With no bus the picker just comes up empty, which still measures startup
+    FakeCompositor compositor({ 2, windows });
+    if (!compositor.start()) {
+        qWarning("Fake compositor unavailable, measuring whatever the session provides");
+    }
+
+    QBENCHMARK {
+        SourceSelector selector(nullptr, QStringLiteral("org.example.Bench"));
+
+        // Watching before anything is shown, or the first swap could be missed
+        std::unique_ptr<QSignalSpy> swapped;
+        connect(&selector, &SourceSelector::windowCreated, this, [&swapped](QQuickWindow *window) {
+            swapped = std::make_unique<QSignalSpy>(window, &QQuickWindow::frameSwapped);
+        });
+
+        QElapsedTimer timer;
+        timer.start();
+        selector.show();
+
+        QQuickWindow *window = selector.window();
+        QVERIFY2(window && swapped, "SourceSelector.qml did not create a window");
+        QVERIFY(swapped->count() > 0 || swapped->wait(5000));
+        qDebug() << "first frame after" << timer.elapsed() << "ms";
+
+        window->hide();
+    }
+}
+
+void BenchPicker::cpuTimePerOpen_data()
+{
+    timeToFirstFrame_data();
+}
+
+// CPU (user + system, all threads) spent on one picker that stays open for
+// two seconds: startup, the entry animations, and whatever it burns while
+// idle afterwards. Reported as CPUTicks, counted in clock ticks (_SC_CLK_TCK,
+// usually 100 a second); the log line has the same figure in ms.
+void BenchPicker::cpuTimePerOpen()
+{
+    QFETCH(int, windows);
+
+    FakeCompositor compositor({ 2, windows });
+    if (!compositor.start()) {
+        qWarning("Fake compositor unavailable, measuring whatever the session provides");
+    }
+
+    constexpr int VisibleMs = 2000;
+
+    SourceSelector selector(nullptr, QStringLiteral("org.example.Bench"));
+
+    const qint64 before = processCpuTimeUs();
+    selector.show();
+
+    QQuickWindow *window = selector.window();
+    QVERIFY2(window, "SourceSelector.qml did not create a window");
+
+    std::atomic<int> frames{0};
+    connect(window, &QQuickWindow::frameSwapped, window, [&frames]() { ++frames; }, Qt::DirectConnection);
+
+    QTest::qWait(VisibleMs);
+    window->hide();
+
+    const qint64 cpuUs = processCpuTimeUs() - before;
+    qInfo("%d frames, %.1f ms CPU over %d ms", frames.load(), cpuUs / 1000.0, VisibleMs);
+    QTest::setBenchmarkResult(cpuUs * sysconf(_SC_CLK_TCK) / 1e6, QTest::CPUTicks);
+}
+
+void BenchPicker::sourcesStreamIn_data()
+{
+    timeToFirstFrame_data();
+}
+
+// The window comes up before enumeration is done; this is how long the rows
+// take to follow, monitors first
+void BenchPicker::sourcesStreamIn()
+{
+    QFETCH(int, windows);
+
+    FakeCompositor compositor({ 2, windows });
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    QBENCHMARK {
+        SourceSelector selector(nullptr, QStringLiteral("org.example.Bench"));
+        QSignalSpy complete(&selector, &SourceSelector::sourcesComplete);
+
+        selector.show();
+        QVERIFY(selector.window());
+        QVERIFY(complete.count() > 0 || complete.wait(5000));
+
+        selector.window()->hide();
+    }
+}
+
+UNI_QUICK_BENCH_MAIN(BenchPicker)
+#include "bench_picker.moc"
@@ -0,0 +1,199 @@
+#include <QtTest>
+#include <QElapsedTimer>
+#include "fakebackend.h"
+#include "jobrunner.h"
+#include "objectcounter.h"
+#include "portalobjects.h"
+#include "screencast.h"
+#include "startjob.h"
+
+// The portal's own share of a screencast: CreateSession, Start and teardown
+// against the in-process compositor, on a bus that isn't connected. Set
+// against bench_start, which pays for D-Bus round trips on top.
+class BenchPipeline : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void startJob();
+    void delays();
+    void requestPipeline_data();
+    void requestPipeline();
+    void requestObjects_data();
+    void requestObjects();
+};
+
+// How Request and Session objects used to be exported, one of each per call
+class LegacyObject : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.impl.portal.Request")
+
+public:
+    using QDBusAbstractAdaptor::QDBusAbstractAdaptor;
+
+public slots:
+    void Close() { emit closed(); }
+
+signals:
+    void closed();
+};
+
+static QDBusMessage incoming(const QString &method)
+{
+    return QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.impl.portal.desktop.uni"),
+                                          QStringLiteral("/org/freedesktop/portal/desktop"),
+                                          QStringLiteral("org.freedesktop.impl.portal.ScreenCast"), method);
+}
+
+void BenchPipeline::startJob()
+{
+    FakeBackend backend;
+
+    QBENCHMARK {
+        StartJob job(&backend, firstMonitor());
+        QCOMPARE(runJob(job), 0);
+        QVERIFY(job.nodeId() != 0);
+        backend.stopSessionAsync(job.niriSessionPath());
+    }
+
+    QCOMPARE(backend.liveSessions(), 0);
+}
+
+void BenchPipeline::delays()
+{
+    // Every step waits exactly what it's told, so a run is 7 ms and then some
+    FakeBackend backend({ 2, 1, 1, 3 });
+
+    QElapsedTimer timer;
+    timer.start();
+    StartJob job(&backend, firstMonitor());
+    QCOMPARE(runJob(job), 0);
+    QVERIFY(timer.elapsed() >= 7);
+    QCOMPARE(backend.calls(), quint64(3));
+    QCOMPARE(backend.nodesAnnounced(), quint64(1));
+
+    backend.stopSessionAsync(job.niriSessionPath());
+    QCOMPARE(backend.liveSessions(), 0);
+}
+
+void BenchPipeline::requestPipeline_data()
+{
+    QTest::addColumn<int>("sessions");
+    QTest::newRow("1") << 1;
+    QTest::newRow("100 at once") << 100;
+}
+
+void BenchPipeline::requestPipeline()
+{
+    QFETCH(int, sessions);
+
+    // Never connected, so exporting objects and replying cost no bus traffic
+    const QDBusConnection offline = QDBusConnection::connectToBus(
+        QStringLiteral("unix:path=/nonexistent/uni-bench"), QStringLiteral("uni-bench-offline"));
+    QVERIFY(!offline.isConnected());
+
+    FakeBackend backend;
+    QObject service;
+    ScreenCast *screenCast = new ScreenCast(&service, &backend, offline);
+
+    const QString appId = QStringLiteral("org.example.Pipeline");
+    const QString base = QStringLiteral("/org/freedesktop/portal/desktop/");
+    const int sessionsBefore = ObjectCounter::count("PortalSession");
+    const int jobsBefore = ObjectCounter::count("StartJob");
+    quint64 round = 0;
+
+    QBENCHMARK {
+        ++round;
+        const quint64 nodesBefore = backend.nodesAnnounced();
+
+        for (int i = 0; i < sessions; ++i) {
+            const QString token = QStringLiteral("r%1_%2").arg(round).arg(i);
+            const QDBusObjectPath session(base + QStringLiteral("session/1_1/") + token);
+            QVariantMap results;
+
+            QCOMPARE(screenCast->CreateSession(QDBusObjectPath(base + QStringLiteral("request/1_1/c") + token),
+                                               session, appId, {}, incoming("CreateSession"), results), 0u);
+            screenCast->selectSource(session.path(), QStringLiteral("DP-1"), false, 2);
+            QCOMPARE(screenCast->Start(QDBusObjectPath(base + QStringLiteral("request/1_1/t") + token),
+                                       session, appId, QString(), {}, incoming("Start"), results), 0u);
+        }
+
+        // Start replies from within the node announcement
+        QDeadlineTimer deadline(5000);
+        while (backend.nodesAnnounced() < nodesBefore + quint64(sessions) && !deadline.hasExpired()) {
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 10);
+        }
+        QCOMPARE(backend.nodesAnnounced(), nodesBefore + quint64(sessions));
+
+        // Niri ends them, which takes the portal sessions down too
+        backend.closeAllSessions();
+        QCoreApplication::processEvents();
+        QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    }
+
+    QCOMPARE(backend.liveSessions(), 0);
+    QCOMPARE(ObjectCounter::count("PortalSession"), sessionsBefore);
+    QCOMPARE(ObjectCounter::count("StartJob"), jobsBefore);
+    QVERIFY(screenCast->streamStats().isEmpty());
+    QCOMPARE(screenCast->admissionStats().value("sessions").toInt(), 0);
+
+    QDBusConnection::disconnectFromBus(QStringLiteral("uni-bench-offline"));
+}
+
+void BenchPipeline::requestObjects_data()
+{
+    QTest::addColumn<bool>("table");
+    QTest::newRow("QObject per path") << false;
+    QTest::newRow("PortalObjects") << true;
+}
+
+void BenchPipeline::requestObjects()
+{
+    QFETCH(bool, table);
+
+    // Exporting is local work, but only a connected bus does it at all
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    if (!bus.isConnected()) {
+        QSKIP("No session bus, run under dbus-run-session");
+    }
+
+    PortalObjects objects(bus);
+    const QString request = PortalObjects::RequestRoot + QStringLiteral("/1_1/bench");
+    const QString session = PortalObjects::SessionRoot + QStringLiteral("/1_1/bench");
+    // Nothing else may be registered below the table's roots
+    const QString legacyRequest = QStringLiteral("/org/example/legacy/request/1_1/bench");
+    const QString legacySession = QStringLiteral("/org/example/legacy/session/1_1/bench");
+    int closed = 0;
+
+    // What CreateSession and a session's Close come down to, minus the rest
+    QBENCHMARK {
+        if (table) {
+            objects.addRequest(request);
+            objects.addSession(session, [&closed]() { ++closed; });
+            objects.remove(request);
+            objects.closeSession(session);
+        } else {
+            QObject *requestObj = new QObject;
+            new LegacyObject(requestObj);
+            bus.registerObject(legacyRequest, requestObj, QDBusConnection::ExportAdaptors);
+            QObject *sessionObj = new QObject;
+            auto *adaptor = new LegacyObject(sessionObj);
+            QObject::connect(adaptor, &LegacyObject::closed, [&closed]() { ++closed; });
+            bus.registerObject(legacySession, sessionObj, QDBusConnection::ExportAdaptors);
+
+            bus.unregisterObject(legacyRequest);
+            delete requestObj;
+            adaptor->Close();
+            bus.unregisterObject(legacySession);
+            delete sessionObj;
+        }
+    }
+
+    QVERIFY(closed > 0);
+    QCOMPARE(objects.requests(), 0);
+    QCOMPARE(objects.sessions(), 0);
+}
+
+QTEST_GUILESS_MAIN(BenchPipeline)
+#include "bench_pipeline.moc"
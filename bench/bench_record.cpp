@@ -0,0 +1,89 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include "callrecorder.h"
+
+// What recording a call costs the portal, and that uni-replay reads back
+// what was written.
+class BenchRecord : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void recordCost();
+    void roundTrip();
+};
+
+static QDBusMessage incoming(const QString &sender, const QString &method)
+{
+    return QDBusMessage::createMethodCall(sender, QStringLiteral("/org/freedesktop/portal/desktop"),
+                                          QStringLiteral("org.freedesktop.impl.portal.ScreenCast"), method);
+}
+
+void BenchRecord::recordCost()
+{
+    QTemporaryDir dir;
+    QVERIFY(CallRecorder::instance().open(dir.filePath(QStringLiteral("cost.rec"))));
+
+    const QDBusMessage message = incoming(QStringLiteral(":1.42"), QStringLiteral("SelectSources"));
+    const QString session = QStringLiteral("/org/freedesktop/portal/desktop/session/1_42/bench");
+    const QVariantMap options = { { "types", 3u }, { "cursor_mode", 2u }, { "multiple", false } };
+
+    QBENCHMARK {
+        CallRecorder::instance().record(message, session, QStringLiteral("org.example.Meeting"), options);
+    }
+
+    CallRecorder::instance().close();
+}
+
+void BenchRecord::roundTrip()
+{
+    QTemporaryDir dir;
+    const QString path = dir.filePath(QStringLiteral("trip.rec"));
+    CallRecorder &recorder = CallRecorder::instance();
+    QVERIFY(recorder.open(path));
+
+    const QString first = QStringLiteral("/org/freedesktop/portal/desktop/session/1_7/a");
+    const QString second = QStringLiteral("/org/freedesktop/portal/desktop/session/1_8/b");
+    const QString appId = QStringLiteral("org.example.Meeting");
+
+    recorder.record(incoming(QStringLiteral(":1.7"), QStringLiteral("CreateSession")), first, appId);
+    recorder.record(incoming(QStringLiteral(":1.8"), QStringLiteral("CreateSession")), second, appId);
+    recorder.record(incoming(QStringLiteral(":1.7"), QStringLiteral("SelectSources")), first, appId,
+                    { { "types", 2u }, { "cursor_mode", 4u } });
+    recorder.record(incoming(QStringLiteral(":1.7"), QStringLiteral("Start")), first, appId);
+    recorder.record(incoming(QStringLiteral(":1.7"), QStringLiteral("GetUserInfo")), first, appId); // not ours
+    recorder.record(incoming(QStringLiteral(":1.7"), QStringLiteral("Close")), first);
+    recorder.close();
+
+    QList<CallRecorder::Call> calls;
+    QVERIFY(CallRecorder::read(path, calls));
+    QCOMPARE(calls.size(), 5);
+
+    QCOMPARE(calls[0].method, CallRecorder::CreateSession);
+    QCOMPARE(calls[0].client, quint16(0));
+    QCOMPARE(calls[1].client, quint16(1));
+    QVERIFY(calls[0].session != calls[1].session);
+    QCOMPARE(calls[2].method, CallRecorder::SelectSources);
+    QCOMPARE(calls[2].session, calls[0].session);
+    QCOMPARE(calls[2].options.value("cursor_mode").toUInt(), 4u);
+    QCOMPARE(calls[3].appId, appId);
+    QCOMPARE(calls[4].method, CallRecorder::Close);
+    QCOMPARE(calls[4].session, calls[0].session);
+
+    for (int i = 1; i < calls.size(); ++i) {
+        QVERIFY(calls[i].offsetUs >= calls[i - 1].offsetUs);
+    }
+
+    // A recording cut short mid-record keeps what came before
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(file.size() - 3));
+    file.close();
+
+    calls.clear();
+    QVERIFY(CallRecorder::read(path, calls));
+    QCOMPARE(calls.size(), 4);
+}
+
+QTEST_GUILESS_MAIN(BenchRecord)
+#include "bench_record.moc"
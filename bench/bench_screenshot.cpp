@@ -0,0 +1,129 @@
+#include <QtTest>
+#include <QBuffer>
+#include <QPainter>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include "screenshotencoder.h"
+
+// PNG encoding of a captured frame, the slow part of a screenshot. Frames are
+// synthetic but desktop-like: flat panels, gradients, text-ish noise.
+class BenchScreenshot : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void encodePng_data();
+    void encodePng();
+    void uniqueNames();
+    void compositeMonitors();
+
+private:
+    static QImage makeFrame(const QSize &size);
+};
+
+QImage BenchScreenshot::makeFrame(const QSize &size)
+{
+    // Same layout as a BGRx PipeWire buffer
+    QImage frame(size, QImage::Format_RGB32);
+
+    QPainter painter(&frame);
+    QLinearGradient wallpaper(0, 0, size.width(), size.height());
+    wallpaper.setColorAt(0, QColor(40, 60, 110));
+    wallpaper.setColorAt(1, QColor(150, 80, 120));
+    painter.fillRect(frame.rect(), wallpaper);
+
+    // A few windows with "text" on them
+    QRandomGenerator random(42);
+    const int windows = 6;
+    for (int i = 0; i < windows; ++i) {
+        const QRect window(size.width() * i / (windows + 2), size.height() * i / (windows + 4),
+                           size.width() / 2, size.height() / 2);
+        painter.fillRect(window, QColor(245, 245, 245));
+        painter.fillRect(window.x(), window.y(), window.width(), 32, QColor(220, 220, 225));
+
+        for (int line = window.y() + 48; line < window.bottom() - 16; line += 20) {
+            for (int x = window.x() + 16; x < window.right() - 16; x += 9) {
+                if (random.bounded(4) != 0) {
+                    painter.fillRect(x, line, 7, 12, QColor(30, 30, 30, 80 + random.bounded(170)));
+                }
+            }
+        }
+    }
+
+    return frame;
+}
+
+void BenchScreenshot::encodePng_data()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::newRow("1080p") << QSize(1920, 1080);
+    QTest::newRow("4K") << QSize(3840, 2160);
+    QTest::newRow("8K") << QSize(7680, 4320);
+}
+
+void BenchScreenshot::encodePng()
+{
+    QFETCH(QSize, size);
+
+    const QImage frame = makeFrame(size);
+    QByteArray encoded;
+    encoded.reserve(frame.sizeInBytes() / 4);
+
+    QBENCHMARK {
+        encoded.clear();
+        QBuffer buffer(&encoded);
+        buffer.open(QIODevice::WriteOnly);
+        QVERIFY(ScreenshotEncoder::writePng(frame, &buffer));
+    }
+
+    qInfo("%dx%d: %lld KiB", size.width(), size.height(), qlonglong(encoded.size() / 1024));
+
+    QImage decoded;
+    QVERIFY(decoded.loadFromData(encoded, "png"));
+    QCOMPARE(decoded.size(), size);
+}
+
+void BenchScreenshot::uniqueNames()
+{
+    // Never the user's own Pictures
+    QTemporaryDir home;
+    QVERIFY(home.isValid());
+    qputenv("HOME", home.path().toUtf8());
+    qputenv("XDG_CONFIG_HOME", home.filePath(QStringLiteral(".config")).toUtf8());
+
+    // Same second, so both want the same name
+    const QString first = ScreenshotEncoder::claimPath();
+    const QString second = ScreenshotEncoder::claimPath();
+    QVERIFY(!first.isEmpty());
+    QVERIFY(!second.isEmpty());
+    QVERIFY(first != second);
+    QVERIFY(QFile::exists(first));
+    QVERIFY(QFile::exists(second));
+}
+
+void BenchScreenshot::compositeMonitors()
+{
+    // A 4K panel at scale 2 left of a 1080p one at scale 1, both 1920
+    // logical pixels wide
+    QImage left(3840, 2160, QImage::Format_RGB32);
+    left.fill(Qt::red);
+    QImage right(1920, 1080, QImage::Format_RGB32);
+    right.fill(Qt::blue);
+
+    const QImage image = ScreenshotEncoder::composite({
+        { left, QPoint(0, 0), 2.0 },
+        { right, QPoint(1920, 0), 1.0 },
+    });
+
+    // Everything at the highest scale
+    QCOMPARE(image.size(), QSize(7680, 2160));
+    QCOMPARE(image.pixelColor(100, 100), QColor(Qt::red));
+    QCOMPARE(image.pixelColor(5000, 100), QColor(Qt::blue));
+    QCOMPARE(image.pixelColor(5000, 2100), QColor(Qt::blue));
+
+    // One monitor is passed through untouched
+    QCOMPARE(ScreenshotEncoder::composite({ { right, QPoint(1920, 0), 1.0 } }), right);
+}
+
+QTEST_GUILESS_MAIN(BenchScreenshot)
+#include "bench_screenshot.moc"
@@ -0,0 +1,122 @@
+#include <QtTest>
+#include "sourcesearchindex.h"
+#include "sourcemodel.h"
+
+// Type-to-filter in the picker. Every keystroke has to stay well below a
+// millisecond with a thousand rows.
+class BenchSearch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void buildIndex_data();
+    void buildIndex();
+    void query_data();
+    void query();
+    void typeIntoModel_data();
+    void typeIntoModel();
+
+private:
+    static QVector<SourceSelector::Source> makeSources(int count);
+};
+
+QVector<SourceSelector::Source> BenchSearch::makeSources(int count)
+{
+    static const char *const apps[] = {
+        "org.mozilla.firefox", "org.telegram.desktop", "code-oss", "org.kde.dolphin",
+        "com.obsproject.Studio", "kitty", "org.gnome.Nautilus", "thunderbird",
+    };
+
+    QVector<SourceSelector::Source> sources;
+    sources.append({ SourceSelector::Monitor, QStringLiteral("DP-1"), QStringLiteral("Dell U2720Q (3840x2160 @ 60.00 Hz)"), {} });
+    sources.append({ SourceSelector::Monitor, QStringLiteral("eDP-1"), QStringLiteral("Built-in display (2880x1800 @ 120.00 Hz)"), {} });
+
+    for (int i = 0; sources.size() < count; ++i) {
+        const QString appId = QString::fromLatin1(apps[i % 8]);
+        sources.append({ SourceSelector::Window, QString::number(i + 1),
+                         QStringLiteral("Document %1 - project notes, draft %2").arg(i).arg(i % 7), appId });
+    }
+    return sources;
+}
+
+void BenchSearch::buildIndex_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("150") << 150;
+    QTest::newRow("1000") << 1000;
+}
+
+void BenchSearch::buildIndex()
+{
+    QFETCH(int, count);
+    const auto sources = makeSources(count);
+
+    QBENCHMARK {
+        SourceSearchIndex index;
+        for (const auto &source : sources) {
+            index.add({ source.displayName, source.appId, source.id });
+        }
+    }
+}
+
+void BenchSearch::query_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::newRow("1 char") << QStringLiteral("d");
+    QTest::newRow("app id") << QStringLiteral("firefox");
+    QTest::newRow("title") << QStringLiteral("document 99");
+    QTest::newRow("connector") << QStringLiteral("edp");
+    QTest::newRow("miss") << QStringLiteral("zzzzzz");
+}
+
+void BenchSearch::query()
+{
+    QFETCH(QString, text);
+
+    SourceSearchIndex index;
+    for (const auto &source : makeSources(1000)) {
+        index.add({ source.displayName, source.appId, source.id });
+    }
+
+    QBENCHMARK {
+        index.query(text);
+    }
+}
+
+void BenchSearch::typeIntoModel_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("ranked");
+    QTest::newRow("document 42") << QStringLiteral("document 42") << false;
+    QTest::newRow("telegram") << QStringLiteral("telegram") << false;
+    // Some rows shared before, so results have to be put in usage order
+    QTest::newRow("document 42, ranked") << QStringLiteral("document 42") << true;
+    QTest::newRow("telegram, ranked") << QStringLiteral("telegram") << true;
+}
+
+void BenchSearch::typeIntoModel()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, ranked);
+
+    auto sources = makeSources(1000);
+    if (ranked) {
+        for (int i = 0; i < sources.size(); i += 7) {
+            sources[i].lastUsed = 1700000000000 + i;
+        }
+    }
+
+    SourceModel model;
+    model.setSources(sources);
+
+    // One iteration types the whole word key by key and clears it again
+    QBENCHMARK {
+        for (qsizetype i = 1; i <= text.size(); ++i) {
+            model.setFilter(text.left(i));
+        }
+        model.setFilter(QString());
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchSearch)
+#include "bench_search.moc"
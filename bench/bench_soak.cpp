@@ -0,0 +1,148 @@
+#include <QtTest>
+#include <QDBusConnection>
+#include "fakeportal.h"
+#include "objectcounter.h"
+#include "quickbench.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+
+// Soak test: thousands of CreateSession/SelectSources/Start/Close cycles over
+// D-Bus against the fake compositor, with the picker auto-confirmed
+// offscreen. Fails when RSS or the live per-request objects keep growing
+// after warm-up.
+//
+//     dbus-run-session -- ./bench_soak
+//     UNI_SOAK_CYCLES=20000 UNI_SOAK_RSS_LIMIT_KB=2048 dbus-run-session -- ./bench_soak
+class BenchSoak : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void selectStartClose();
+};
+
+// Allocation hook for the whole process, read per request below
+static std::atomic<quint64> s_allocations{0};
+
+void *operator new(std::size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+static qint64 rssKb()
+{
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.value(1).toLongLong() * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int envInt(const char *name, int fallback)
+{
+    bool ok = false;
+    const int value = qEnvironmentVariableIntValue(name, &ok);
+    return ok ? value : fallback;
+}
+
+struct PhaseStats {
+    const char *name;
+    quint64 allocations = 0;
+};
+
+// Let deleteLater()s from the last cycle run before taking a sample
+static void settle()
+{
+    for (int i = 0; i < 3; ++i) {
+        QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+}
+
+void BenchSoak::selectStartClose()
+{
+    const int cycles = envInt("UNI_SOAK_CYCLES", 2000);
+    const int warmup = qMax(10, cycles / 10);
+    const qint64 rssLimitKb = envInt("UNI_SOAK_RSS_LIMIT_KB", 8192);
+
+    FakePortal portal({ 2, 10 });
+    if (!portal.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    // Nobody to click the picker
+    qputenv("UNI_PORTAL_AUTOCONFIRM", "1");
+
+    FakeFrontend frontend(QDBusConnection::sessionBus().baseService(), QStringLiteral("soak-frontend"));
+    const QString appId = QStringLiteral("org.example.Soak");
+
+    PhaseStats phases[] = { { "CreateSession" }, { "SelectSources" }, { "Start" }, { "Close" } };
+    auto timed = [&](PhaseStats &phase, auto &&call) {
+        const quint64 before = s_allocations.load(std::memory_order_relaxed);
+        const int response = call();
+        phase.allocations += s_allocations.load(std::memory_order_relaxed) - before;
+        return response;
+    };
+
+    qint64 baselineRss = 0;
+    QVariantMap baselineObjects;
+
+    for (int i = 0; i < cycles; ++i) {
+        const QString token = QStringLiteral("soak%1").arg(i);
+
+        QCOMPARE(timed(phases[0], [&] { return FakePortal::createSession(frontend, token, appId); }), 0);
+        QCOMPARE(timed(phases[1], [&] { return FakePortal::selectSources(frontend, token, appId, 1); }), 0);
+        QCOMPARE(timed(phases[2], [&] { return FakePortal::startSession(frontend, token, appId); }), 0);
+        QCOMPARE(timed(phases[3], [&] { return FakePortal::closeSession(frontend, token); }), 0);
+
+        if (i + 1 == warmup) {
+            settle();
+            baselineRss = rssKb();
+            baselineObjects = ObjectCounter::snapshot();
+            for (PhaseStats &phase : phases) {
+                phase.allocations = 0;
+            }
+        }
+        if (i + 1 > warmup && (i + 1) % qMax(1, cycles / 10) == 0) {
+            settle();
+            qInfo("cycle %5d: RSS %lld kB (%+lld), %d pickers alive", i + 1, rssKb(),
+                  rssKb() - baselineRss, ObjectCounter::count("SourceSelector"));
+        }
+    }
+
+    settle();
+    QTRY_COMPARE_WITH_TIMEOUT(portal.compositor().liveScreenCastSessions(), 0, 5000);
+    settle();
+
+    const int measured = cycles - warmup;
+    for (const PhaseStats &phase : phases) {
+        qInfo("%-14s %8.1f allocations per call", phase.name, measured ? double(phase.allocations) / measured : 0.0);
+    }
+
+    // Per-request objects must be back where they were after warm-up
+    const QVariantMap objects = ObjectCounter::snapshot();
+    for (auto it = objects.cbegin(); it != objects.cend(); ++it) {
+        const int before = baselineObjects.value(it.key()).toInt();
+        QVERIFY2(it.value().toInt() <= before,
+                 qPrintable(QStringLiteral("%1: %2 alive, %3 after warm-up").arg(it.key()).arg(it.value().toInt()).arg(before)));
+    }
+
+    const qint64 growthKb = rssKb() - baselineRss;
+    qInfo("RSS grew %lld kB over %d cycles after warm-up", growthKb, measured);
+    QVERIFY2(growthKb <= rssLimitKb,
+             qPrintable(QStringLiteral("RSS grew %1 kB, limit %2 kB").arg(growthKb).arg(rssLimitKb)));
+    QTest::setBenchmarkResult(double(growthKb) * 1024, QTest::BytesAllocated);
+}
+
+UNI_QUICK_BENCH_MAIN(BenchSoak)
+#include "bench_soak.moc"
@@ -0,0 +1,176 @@
+#include <QtTest>
+#include <QElapsedTimer>
+#include "fakecompositor.h"
+#include "jobrunner.h"
+#include "mutterscreencast.h"
+#include "startjob.h"
+#include "nirisignalrouter.h"
+
+// Portal Start against the stand-in compositor: how long the happy path
+// takes, and that retries, deadlines and cancellation leave no Niri sessions
+// behind.
+//
+//     dbus-run-session -- ./bench_start
+class BenchStart : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void startLatency();
+    void streamParameters();
+    void missingStreamRetries();
+    void cancelRollsBack_data();
+    void cancelRollsBack();
+    void signalRules();
+};
+
+void BenchStart::startLatency()
+{
+    FakeCompositor compositor({ 1, 0 });
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterScreenCast screenCast;
+
+    QBENCHMARK {
+        StartJob job(&screenCast, firstMonitor());
+        QCOMPARE(runJob(job), 0);
+        QVERIFY(job.nodeId() != 0);
+        QCOMPARE(job.attempts(), 1);
+        screenCast.stopSessionAsync(job.niriSessionPath());
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(compositor.liveScreenCastSessions(), 0, 2000);
+}
+
+void BenchStart::streamParameters()
+{
+    FakeCompositor compositor({ 1, 0 });
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterScreenCast screenCast;
+    StartJob job(&screenCast, firstMonitor());
+    QCOMPARE(runJob(job), 0);
+
+    // What building Start's results costs per stream, no bus traffic
+    QVariantMap parameters;
+    QBENCHMARK {
+        parameters = screenCast.getStreamParameters(job.streamPath());
+    }
+
+    const QDBusArgument size = parameters.value("size").value<QDBusArgument>();
+    int width = 0, height = 0;
+    size.beginStructure();
+    size >> width >> height;
+    size.endStructure();
+    QCOMPARE(QSize(width, height), QSize(2560, 1440));
+
+    screenCast.stopSessionAsync(job.niriSessionPath());
+}
+
+void BenchStart::missingStreamRetries()
+{
+    // A compositor that never hands over the node
+    FakeCompositor::Config config { 1, 0 };
+    config.streamDelayMs = 60000;
+    FakeCompositor compositor(config);
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterScreenCast screenCast;
+    const int deadlineMs = StartJob::StreamTimeoutMs * 2 + 500;
+    StartJob job(&screenCast, firstMonitor(), deadlineMs);
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    QCOMPARE(runJob(job, deadlineMs * 2), 2);
+
+    // Out of attempts right around the deadline, and not much later
+    QCOMPARE(job.attempts(), StartJob::MaxAttempts);
+    QVERIFY2(elapsed.elapsed() < deadlineMs + 500, qPrintable(QString::number(elapsed.elapsed())));
+    QTRY_COMPARE_WITH_TIMEOUT(compositor.liveScreenCastSessions(), 0, 2000);
+
+    qInfo("gave up after %d attempts in %lld ms", job.attempts(), elapsed.elapsed());
+}
+
+void BenchStart::cancelRollsBack_data()
+{
+    QTest::addColumn<bool>("afterRecord");
+    // CreateSession still in flight: the late reply gets its session stopped
+    QTest::newRow("during CreateSession") << false;
+    // Waiting for the node: the job stops what it made itself
+    QTest::newRow("waiting for node") << true;
+}
+
+void BenchStart::cancelRollsBack()
+{
+    QFETCH(bool, afterRecord);
+
+    FakeCompositor::Config config { 1, 0 };
+    config.streamDelayMs = 60000;
+    FakeCompositor compositor(config);
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterScreenCast screenCast;
+    bool finished = false;
+
+    auto *job = new StartJob(&screenCast, firstMonitor());
+    job->start([&](uint) { finished = true; });
+
+    if (afterRecord) {
+        QTRY_VERIFY_WITH_TIMEOUT(!job->streamPath().isEmpty(), 2000);
+        QCOMPARE(compositor.liveScreenCastSessions(), 1);
+        job->cancel();
+    }
+    delete job;
+
+    QTRY_COMPARE_WITH_TIMEOUT(compositor.createdScreenCastSessions(), 1, 2000);
+    QTRY_COMPARE_WITH_TIMEOUT(compositor.liveScreenCastSessions(), 0, 2000);
+    QVERIFY(!finished);
+}
+
+void BenchStart::signalRules()
+{
+    FakeCompositor compositor({ 1, 0 });
+    if (!compositor.start()) {
+        QSKIP("Could not claim the compositor names, run under dbus-run-session");
+    }
+
+    MutterScreenCast screenCast;
+    NiriSignalRouter &router = NiriSignalRouter::instance();
+    const int listenersBefore = router.listeners();
+
+    // Many sessions at once must not add a match rule each
+    QList<StartJob *> jobs;
+    for (int i = 0; i < 20; ++i) {
+        auto *job = new StartJob(&screenCast, firstMonitor());
+        QCOMPARE(runJob(*job), 0);
+        jobs.append(job);
+    }
+    const int rules = router.subscriptions();
+    QVERIFY(router.listeners() > listenersBefore);
+
+    QBENCHMARK_ONCE {
+        StartJob job(&screenCast, firstMonitor());
+        QCOMPARE(runJob(job), 0);
+        screenCast.stopSessionAsync(job.niriSessionPath());
+    }
+    QCOMPARE(router.subscriptions(), rules);
+
+    for (StartJob *job : std::as_const(jobs)) {
+        screenCast.stopSessionAsync(job->niriSessionPath());
+        delete job;
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(compositor.liveScreenCastSessions(), 0, 2000);
+    QTRY_COMPARE_WITH_TIMEOUT(router.listeners(), listenersBefore, 2000);
+    QCOMPARE(router.subscriptions(), rules);
+}
+
+QTEST_GUILESS_MAIN(BenchStart)
+#include "bench_start.moc"
@@ -0,0 +1,301 @@
+#include <QtTest>
+#include "streammonitor.h"
+
+#ifdef HAVE_PIPEWIRE
+#include <pipewire/pipewire.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/param/buffers.h>
+#include <cstring>
+#endif
+
+// The stream monitor against a local PipeWire: a fake 30 fps video source
+// standing in for the compositor, and a consumer standing in for the app.
+// Skipped without a PipeWire daemon, e.g.
+//     pipewire & ./bench_streammonitor
+class BenchStreamMonitor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void healthyStream();
+    void removedStream();
+    void statsLookup();
+};
+
+#ifdef HAVE_PIPEWIRE
+
+// Driver stream producing BGRx frames at a fixed rate, plus a consumer that
+// hands every buffer straight back
+class FakeVideoSource
+{
+public:
+    static constexpr int Width = 320;
+    static constexpr int Height = 240;
+    static constexpr int Fps = 30;
+
+    FakeVideoSource()
+    {
+        pw_init(nullptr, nullptr);
+        m_loop = pw_thread_loop_new("fake-video-source", nullptr);
+        m_context = pw_context_new(pw_thread_loop_get_loop(m_loop), nullptr, 0);
+        pw_thread_loop_start(m_loop);
+
+        pw_thread_loop_lock(m_loop);
+        m_core = pw_context_connect(m_context, nullptr, 0);
+        pw_thread_loop_unlock(m_loop);
+    }
+
+    ~FakeVideoSource()
+    {
+        pw_thread_loop_lock(m_loop);
+        destroyStreams();
+        if (m_core) {
+            pw_core_disconnect(m_core);
+        }
+        pw_thread_loop_unlock(m_loop);
+        pw_thread_loop_stop(m_loop);
+        pw_context_destroy(m_context);
+        pw_thread_loop_destroy(m_loop);
+    }
+
+    bool isConnected() const { return m_core; }
+
+    // Node id of the source once it's up, 0 on failure
+    uint start()
+    {
+        pw_thread_loop_lock(m_loop);
+
+        m_source = pw_stream_new(m_core, "uni-fake-video-source",
+            pw_properties_new(PW_KEY_MEDIA_CLASS, "Video/Source", nullptr));
+        pw_stream_add_listener(m_source, &m_sourceListener, &sourceEvents, this);
+
+        uint8_t buffer[1024];
+        spa_pod_builder builder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+        spa_rectangle size { Width, Height };
+        spa_fraction rate { Fps, 1 };
+        const spa_pod *params[] = {
+            static_cast<const spa_pod *>(spa_pod_builder_add_object(&builder,
+                SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+                SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
+                SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+                SPA_FORMAT_VIDEO_format, SPA_POD_Id(SPA_VIDEO_FORMAT_BGRx),
+                SPA_FORMAT_VIDEO_size, SPA_POD_Rectangle(&size),
+                SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&rate))),
+        };
+
+        pw_stream_connect(m_source, PW_DIRECTION_OUTPUT, PW_ID_ANY,
+            static_cast<pw_stream_flags>(PW_STREAM_FLAG_DRIVER | PW_STREAM_FLAG_MAP_BUFFERS),
+            params, 1);
+
+        // The node id is known once the stream reached the server
+        while (pw_stream_get_node_id(m_source) == SPA_ID_INVALID) {
+            pw_thread_loop_wait(m_loop);
+        }
+        const uint nodeId = pw_stream_get_node_id(m_source);
+
+        m_consumer = pw_stream_new(m_core, "uni-fake-consumer",
+            pw_properties_new(PW_KEY_MEDIA_TYPE, "Video", PW_KEY_MEDIA_CATEGORY, "Capture", nullptr));
+        pw_stream_add_listener(m_consumer, &m_consumerListener, &consumerEvents, this);
+        pw_stream_connect(m_consumer, PW_DIRECTION_INPUT, nodeId,
+            static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS),
+            params, 1);
+
+        // Frames on a timer, like a compositor repainting
+        m_timer = pw_loop_add_timer(pw_thread_loop_get_loop(m_loop), onTimer, this);
+        timespec interval { 0, 1000000000L / Fps };
+        pw_loop_update_timer(pw_thread_loop_get_loop(m_loop), m_timer, &interval, &interval, false);
+
+        pw_thread_loop_unlock(m_loop);
+        return nodeId;
+    }
+
+    // Like the compositor dropping the stream
+    void stop()
+    {
+        pw_thread_loop_lock(m_loop);
+        destroyStreams();
+        pw_thread_loop_unlock(m_loop);
+    }
+
+private:
+    void destroyStreams()
+    {
+        if (m_timer) {
+            pw_loop_destroy_source(pw_thread_loop_get_loop(m_loop), m_timer);
+            m_timer = nullptr;
+        }
+        if (m_consumer) {
+            pw_stream_destroy(m_consumer);
+            m_consumer = nullptr;
+        }
+        if (m_source) {
+            pw_stream_destroy(m_source);
+            m_source = nullptr;
+        }
+    }
+
+    static void onSourceStateChanged(void *data, pw_stream_state, pw_stream_state, const char *)
+    {
+        auto *self = static_cast<FakeVideoSource *>(data);
+        pw_thread_loop_signal(self->m_loop, false);
+    }
+
+    static void onSourceParamChanged(void *data, uint32_t id, const spa_pod *param)
+    {
+        auto *self = static_cast<FakeVideoSource *>(data);
+        if (!param || id != SPA_PARAM_Format) {
+            return;
+        }
+
+        uint8_t buffer[256];
+        spa_pod_builder builder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+        const spa_pod *params[] = {
+            static_cast<const spa_pod *>(spa_pod_builder_add_object(&builder,
+                SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+                SPA_PARAM_BUFFERS_buffers, SPA_POD_Int(4),
+                SPA_PARAM_BUFFERS_blocks, SPA_POD_Int(1),
+                SPA_PARAM_BUFFERS_size, SPA_POD_Int(Width * Height * 4),
+                SPA_PARAM_BUFFERS_stride, SPA_POD_Int(Width * 4),
+                SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(1 << SPA_DATA_MemPtr))),
+        };
+        pw_stream_update_params(self->m_source, params, 1);
+    }
+
+    static void onSourceProcess(void *data)
+    {
+        auto *self = static_cast<FakeVideoSource *>(data);
+        pw_buffer *buffer = pw_stream_dequeue_buffer(self->m_source);
+        if (!buffer) {
+            return;
+        }
+
+        spa_data &frame = buffer->buffer->datas[0];
+        if (frame.data) {
+            memset(frame.data, (self->m_frame++ * 8) & 0xff, Width * Height * 4);
+            frame.chunk->offset = 0;
+            frame.chunk->stride = Width * 4;
+            frame.chunk->size = Width * Height * 4;
+        }
+        pw_stream_queue_buffer(self->m_source, buffer);
+    }
+
+    static void onConsumerProcess(void *data)
+    {
+        auto *self = static_cast<FakeVideoSource *>(data);
+        if (pw_buffer *buffer = pw_stream_dequeue_buffer(self->m_consumer)) {
+            pw_stream_queue_buffer(self->m_consumer, buffer);
+        }
+    }
+
+    static void onTimer(void *data, uint64_t expirations)
+    {
+        Q_UNUSED(expirations)
+        auto *self = static_cast<FakeVideoSource *>(data);
+        if (self->m_source) {
+            pw_stream_trigger_process(self->m_source);
+        }
+    }
+
+    static constexpr pw_stream_events sourceEvents = {
+        .version = PW_VERSION_STREAM_EVENTS,
+        .state_changed = onSourceStateChanged,
+        .param_changed = onSourceParamChanged,
+        .process = onSourceProcess,
+    };
+    static constexpr pw_stream_events consumerEvents = {
+        .version = PW_VERSION_STREAM_EVENTS,
+        .process = onConsumerProcess,
+    };
+
+    pw_thread_loop *m_loop = nullptr;
+    pw_context *m_context = nullptr;
+    pw_core *m_core = nullptr;
+    pw_stream *m_source = nullptr;
+    pw_stream *m_consumer = nullptr;
+    spa_hook m_sourceListener {};
+    spa_hook m_consumerListener {};
+    spa_source *m_timer = nullptr;
+    int m_frame = 0;
+};
+
+void BenchStreamMonitor::healthyStream()
+{
+    StreamMonitor monitor;
+    FakeVideoSource source;
+    if (!monitor.isConnected() || !source.isConnected()) {
+        QSKIP("No PipeWire daemon to talk to");
+    }
+
+    const uint nodeId = source.start();
+    QVERIFY(nodeId != 0);
+
+    QSignalSpy stalled(&monitor, &StreamMonitor::stalled);
+    monitor.setSampleInterval(250);
+    monitor.watch(nodeId);
+
+    QTRY_COMPARE_WITH_TIMEOUT(monitor.stats(nodeId).state, QStringLiteral("running"), 5000);
+    QTRY_VERIFY_WITH_TIMEOUT(monitor.stats(nodeId).frames >= FakeVideoSource::Fps, 5000);
+
+    const StreamMonitor::Stats stats = monitor.stats(nodeId);
+    QCOMPARE(stats.format, QStringLiteral("BGRx"));
+    QCOMPARE(stats.size, QSize(FakeVideoSource::Width, FakeVideoSource::Height));
+    QCOMPARE(stats.negotiatedFps, double(FakeVideoSource::Fps));
+    QVERIFY(stats.measuredFps > 0);
+    QVERIFY(stats.lastFrameAgoMs >= 0 && stats.lastFrameAgoMs < 1000);
+    QCOMPARE(stalled.count(), 0);
+
+    qInfo("%s %dx%d, %.1f fps measured, %llu frames, %llu xruns", qPrintable(stats.format),
+          stats.size.width(), stats.size.height(), stats.measuredFps,
+          qulonglong(stats.frames), qulonglong(stats.xruns));
+}
+
+void BenchStreamMonitor::removedStream()
+{
+    StreamMonitor monitor;
+    FakeVideoSource source;
+    if (!monitor.isConnected() || !source.isConnected()) {
+        QSKIP("No PipeWire daemon to talk to");
+    }
+
+    const uint nodeId = source.start();
+    QVERIFY(nodeId != 0);
+
+    QSignalSpy stalled(&monitor, &StreamMonitor::stalled);
+    monitor.setSampleInterval(100);
+    monitor.watch(nodeId);
+    QTRY_VERIFY_WITH_TIMEOUT(monitor.stats(nodeId).frames > 0, 5000);
+
+    source.stop();
+
+    QTRY_COMPARE_WITH_TIMEOUT(stalled.count(), 1, 2000);
+    QCOMPARE(stalled.first().at(0).toUInt(), nodeId);
+    QCOMPARE(stalled.first().at(1).toString(), QStringLiteral("node removed"));
+}
+
+void BenchStreamMonitor::statsLookup()
+{
+    StreamMonitor monitor;
+    FakeVideoSource source;
+    if (!monitor.isConnected() || !source.isConnected()) {
+        QSKIP("No PipeWire daemon to talk to");
+    }
+
+    const uint nodeId = source.start();
+    monitor.watch(nodeId);
+
+    // What a StreamStats call costs per stream, the loop lock included
+    QBENCHMARK {
+        monitor.stats(nodeId);
+    }
+}
+
+#else
+
+void BenchStreamMonitor::healthyStream() { QSKIP("Built without PipeWire"); }
+void BenchStreamMonitor::removedStream() { QSKIP("Built without PipeWire"); }
+void BenchStreamMonitor::statsLookup() { QSKIP("Built without PipeWire"); }
+
+#endif // HAVE_PIPEWIRE
+
+QTEST_GUILESS_MAIN(BenchStreamMonitor)
+#include "bench_streammonitor.moc"
@@ -0,0 +1,112 @@
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "chrometrace.h"
+#include "tracering.h"
+
+// What a span costs with the Chrome trace off and on, and that the export
+// is a trace a viewer can open: one named track per thread, balanced spans.
+class BenchTrace : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanup();
+    void spanCost_data();
+    void spanCost();
+    void exportedTrace();
+};
+
+void BenchTrace::cleanup()
+{
+    ChromeTrace::instance().setEnabled(false);
+}
+
+void BenchTrace::spanCost_data()
+{
+    QTest::addColumn<bool>("enabled");
+    QTest::newRow("off") << false;
+    QTest::newRow("on") << true;
+}
+
+void BenchTrace::spanCost()
+{
+    QFETCH(bool, enabled);
+    ChromeTrace::instance().setEnabled(enabled);
+
+    const QString request = QStringLiteral("/org/freedesktop/portal/desktop/session/1_23/bench");
+    QBENCHMARK {
+        TraceSpan span("bench", request);
+    }
+
+    // Not the point here, just don't let the buffer fill up over iterations
+    ChromeTrace::instance().clear();
+}
+
+void BenchTrace::exportedTrace()
+{
+    ChromeTrace &trace = ChromeTrace::instance();
+    trace.setEnabled(true);
+
+    const QString request = QStringLiteral("/org/freedesktop/portal/desktop/session/1_23/trace");
+    {
+        TraceSpan outer("CreateSession", request);
+        TraceSpan inner("SourceSelector.qml", request);
+        traceEvent("source-selected", request, 1);
+    }
+    traceAsyncBegin("Start", request);
+
+    QThread worker;
+    worker.setObjectName(QStringLiteral("bench-worker"));
+    worker.start();
+    QMetaObject::invokeMethod(&worker, [] {
+        TraceSpan span("frame");
+    }, Qt::BlockingQueuedConnection);
+    worker.quit();
+    worker.wait();
+
+    traceAsyncEnd("Start", request);
+    trace.setEnabled(false);
+
+    // Off means off
+    TraceSpan ignored("ignored");
+
+    const QJsonDocument document = QJsonDocument::fromJson(trace.toJson());
+    QVERIFY(document.isObject());
+
+    QHash<int, QString> threads;
+    QHash<QString, int> phases;
+    QHash<int, int> depth;
+    for (const QJsonValue &value : document.object().value("traceEvents").toArray()) {
+        const QJsonObject event = value.toObject();
+        const QString phase = event.value("ph").toString();
+        const int tid = event.value("tid").toInt();
+        QVERIFY(event.value("name").toString() != QLatin1String("ignored"));
+
+        if (phase == QLatin1String("M")) {
+            threads.insert(tid, event.value("args").toObject().value("name").toString());
+            continue;
+        }
+        ++phases[phase];
+        if (phase == QLatin1String("B")) {
+            ++depth[tid];
+        } else if (phase == QLatin1String("E")) {
+            QVERIFY(--depth[tid] >= 0);
+        }
+    }
+
+    QVERIFY(threads.values().contains(QStringLiteral("main")));
+    QVERIFY(threads.values().contains(QStringLiteral("bench-worker")));
+    QCOMPARE(phases.value("B"), 3);
+    QCOMPARE(phases.value("E"), 3);
+    QCOMPARE(phases.value("b"), 1);
+    QCOMPARE(phases.value("e"), 1);
+    QCOMPARE(phases.value("i"), 1);
+    for (int open : std::as_const(depth)) {
+        QCOMPARE(open, 0);
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchTrace)
+#include "bench_trace.moc"
@@ -0,0 +1,126 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include "sourcemodel.h"
+#include "usagestats.h"
+
+// Sources an app shared before come first in its picker, most recent on
+// top, and that survives a restart.
+class BenchUsage : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void persists();
+    void trimmed();
+    void rowOrder();
+    void lookupCost();
+
+private:
+    QTemporaryDir m_state;
+};
+
+void BenchUsage::initTestCase()
+{
+    // Never the user's own file
+    QVERIFY(m_state.isValid());
+    qputenv("XDG_STATE_HOME", m_state.path().toUtf8());
+    UsageStats::instance().reload();
+}
+
+void BenchUsage::persists()
+{
+    const QString app = QStringLiteral("org.example.Meeting");
+    const QString monitor = QStringLiteral("monitor:DEL/DELL U2720Q/ABC123");
+
+    UsageStats::instance().recordUse(app, monitor);
+    UsageStats::instance().recordUse(app, monitor);
+
+    // Written a bit later, off the pick
+    QVERIFY(!QFile::exists(UsageStats::path()));
+    QTRY_VERIFY(QFile::exists(UsageStats::path()));
+
+    UsageStats::instance().reload();
+    QVERIFY(UsageStats::instance().lastUsed(app, monitor) > 0);
+    QCOMPARE(UsageStats::instance().useCount(app, monitor), 2);
+
+    // Per app
+    QCOMPARE(UsageStats::instance().lastUsed(QStringLiteral("org.example.Other"), monitor), 0);
+}
+
+void BenchUsage::trimmed()
+{
+    const QString app = QStringLiteral("org.example.Busy");
+    for (int i = 0; i < UsageStats::MaxSourcesPerApp + 10; ++i) {
+        UsageStats::instance().recordUse(app, QStringLiteral("window:org.example.App%1").arg(i));
+        QTest::qWait(2); // distinct timestamps
+    }
+
+    UsageStats::instance().reload();
+    int kept = 0;
+    for (int i = 0; i < UsageStats::MaxSourcesPerApp + 10; ++i) {
+        kept += UsageStats::instance().lastUsed(app, QStringLiteral("window:org.example.App%1").arg(i)) > 0;
+    }
+    QCOMPARE(kept, UsageStats::MaxSourcesPerApp);
+
+    // The newest stay
+    QVERIFY(UsageStats::instance().lastUsed(app, QStringLiteral("window:org.example.App%1").arg(UsageStats::MaxSourcesPerApp + 9)) > 0);
+    QCOMPARE(UsageStats::instance().lastUsed(app, QStringLiteral("window:org.example.App0")), 0);
+}
+
+void BenchUsage::rowOrder()
+{
+    using Source = SourceSelector::Source;
+    auto source = [](SourceSelector::SourceType type, const char *id, const char *name, qint64 lastUsed) {
+        Source s{ type, QLatin1String(id), QLatin1String(name), {} };
+        s.lastUsed = lastUsed;
+        return s;
+    };
+
+    SourceModel model;
+    model.setSources({
+        source(SourceSelector::Monitor, "DP-1", "Dell", 0),
+        source(SourceSelector::Monitor, "eDP-1", "Built-in", 0),
+        source(SourceSelector::Window, "7", "Slides - draft", 200),
+        source(SourceSelector::Window, "8", "Terminal", 0),
+    });
+
+    auto ids = [&model]() {
+        QStringList rows;
+        for (int row = 0; row < model.rowCount(); ++row) {
+            rows.append(model.data(model.index(row), SourceModel::SourceIdRole).toString());
+        }
+        return rows;
+    };
+
+    QCOMPARE(ids(), QStringList({ "7", "DP-1", "eDP-1", "8" }));
+
+    // Arriving late still goes where it belongs
+    model.appendSource(source(SourceSelector::Window, "9", "Slides - final", 300));
+    model.appendSource(source(SourceSelector::Window, "10", "Browser", 0));
+    QCOMPARE(ids(), QStringList({ "9", "7", "DP-1", "eDP-1", "8", "10" }));
+    QCOMPARE(model.sourceIndex(0), 4);
+
+    // Filtering keeps the order, and so does clearing the filter again
+    model.setFilter(QStringLiteral("sl"));
+    QCOMPARE(ids(), QStringList({ "9", "7" }));
+    model.setFilter(QStringLiteral("slides"));
+    QCOMPARE(ids(), QStringList({ "9", "7" }));
+    model.setFilter(QString());
+    QCOMPARE(ids(), QStringList({ "9", "7", "DP-1", "eDP-1", "8", "10" }));
+}
+
+void BenchUsage::lookupCost()
+{
+    const QString app = QStringLiteral("org.example.Meeting");
+    const QString key = QStringLiteral("window:org.mozilla.firefox");
+    UsageStats::instance().recordUse(app, key);
+
+    // Paid once per picker row
+    QBENCHMARK {
+        UsageStats::instance().lastUsed(app, key);
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchUsage)
+#include "bench_usage.moc"
@@ -0,0 +1,156 @@
+#include "fakebackend.h"
+#include <QPoint>
+#include <QPointer>
+#include <QSize>
+#include <QTimer>
+
+static const QDBusError NoSuchSession(QDBusError::UnknownObject, QStringLiteral("No such session"));
+
+FakeBackend::FakeBackend(const Delays &delays, QObject *parent)
+    : CompositorBackend(parent)
+    , m_delays(delays)
+{
+}
+
+void FakeBackend::later(int ms, QObject *context, std::function<void()> f)
+{
+    auto guarded = [context = QPointer<QObject>(context), f = std::move(f)]() {
+        if (context) {
+            f();
+        }
+    };
+
+    if (ms <= 0) {
+        QMetaObject::invokeMethod(this, guarded, Qt::QueuedConnection);
+    } else {
+        QTimer::singleShot(ms, this, guarded);
+    }
+}
+
+QString FakeBackend::addStream(const QString &sessionPath)
+{
+    const QString streamPath = QStringLiteral("/org/gnome/Mutter/ScreenCast/Stream/u%1").arg(++m_nextId);
+    m_sessions[sessionPath].streams.append(streamPath);
+    m_streamSessions.insert(streamPath, sessionPath);
+    return streamPath;
+}
+
+QString FakeBackend::recordMonitor(const QString &sessionPath, const QString &connector, uint cursorMode)
+{
+    Q_UNUSED(connector)
+    Q_UNUSED(cursorMode)
+    ++m_calls;
+    return m_sessions.contains(sessionPath) ? addStream(sessionPath) : QString();
+}
+
+QString FakeBackend::recordWindow(const QString &sessionPath, uint64_t windowId, uint cursorMode)
+{
+    Q_UNUSED(windowId)
+    Q_UNUSED(cursorMode)
+    ++m_calls;
+    return m_sessions.contains(sessionPath) ? addStream(sessionPath) : QString();
+}
+
+QVariantMap FakeBackend::getStreamParameters(const QString &streamPath)
+{
+    if (!m_streamSessions.contains(streamPath)) {
+        return QVariantMap();
+    }
+    return { { "position", QPoint(0, 0) }, { "size", QSize(1920, 1080) } };
+}
+
+void FakeBackend::createSessionAsync(const QVariantMap &properties, int timeoutMs,
+                                     QObject *context, PathCallback done)
+{
+    Q_UNUSED(properties)
+    Q_UNUSED(timeoutMs)
+    ++m_calls;
+
+    const QString sessionPath = QStringLiteral("/org/gnome/Mutter/ScreenCast/Session/u%1").arg(++m_nextId);
+    m_sessions.insert(sessionPath, {});
+
+    // Like the real one: created for nobody, stopped again
+    later(m_delays.createMs, this, [this, context = QPointer<QObject>(context), done, sessionPath]() {
+        if (!context) {
+            stopSessionAsync(sessionPath);
+            return;
+        }
+        done(sessionPath, QDBusError());
+    });
+}
+
+void FakeBackend::recordMonitorAsync(const QString &sessionPath, const QString &connector, uint cursorMode,
+                                     int timeoutMs, QObject *context, PathCallback done)
+{
+    Q_UNUSED(timeoutMs)
+    if (!m_sessions.contains(sessionPath)) {
+        later(0, context, [done]() { done(QString(), NoSuchSession); });
+        return;
+    }
+
+    const QString streamPath = recordMonitor(sessionPath, connector, cursorMode);
+    later(m_delays.recordMs, context, [done, streamPath]() { done(streamPath, QDBusError()); });
+}
+
+void FakeBackend::recordWindowAsync(const QString &sessionPath, uint64_t windowId, uint cursorMode,
+                                    int timeoutMs, QObject *context, PathCallback done)
+{
+    Q_UNUSED(timeoutMs)
+    if (!m_sessions.contains(sessionPath)) {
+        later(0, context, [done]() { done(QString(), NoSuchSession); });
+        return;
+    }
+
+    const QString streamPath = recordWindow(sessionPath, windowId, cursorMode);
+    later(m_delays.recordMs, context, [done, streamPath]() { done(streamPath, QDBusError()); });
+}
+
+void FakeBackend::startSessionAsync(const QString &sessionPath, int timeoutMs,
+                                    QObject *context, DoneCallback done)
+{
+    Q_UNUSED(timeoutMs)
+    ++m_calls;
+    if (!m_sessions.contains(sessionPath)) {
+        later(0, context, [done]() { done(NoSuchSession); });
+        return;
+    }
+
+    later(m_delays.startMs, context, [done]() { done(QDBusError()); });
+
+    // Nodes follow Start, for whoever still has the session by then
+    later(m_delays.startMs + m_delays.nodeMs, this, [this, sessionPath]() {
+        const auto session = m_sessions.constFind(sessionPath);
+        if (session == m_sessions.cend()) {
+            return;
+        }
+        for (const QString &streamPath : session->streams) {
+            emit pipeWireStreamAdded(streamPath, m_nextNode++);
+            ++m_nodesAnnounced;
+        }
+    });
+}
+
+void FakeBackend::stopSessionAsync(const QString &sessionPath)
+{
+    const auto session = m_sessions.constFind(sessionPath);
+    if (session == m_sessions.cend()) {
+        return;
+    }
+
+    ++m_calls;
+    for (const QString &streamPath : session->streams) {
+        m_streamSessions.remove(streamPath);
+    }
+    m_sessions.erase(session);
+}
+
+void FakeBackend::closeAllSessions()
+{
+    const QStringList sessions = m_sessions.keys();
+    m_sessions.clear();
+    m_streamSessions.clear();
+
+    for (const QString &sessionPath : sessions) {
+        emit sessionClosed(sessionPath);
+    }
+}
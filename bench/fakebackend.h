@@ -0,0 +1,66 @@
+#ifndef FAKEBACKEND_H
+#define FAKEBACKEND_H
+
+#include "compositorbackend.h"
+#include <QHash>
+#include <QStringList>
+
+// In-process stand-in for MutterScreenCast. No bus, no threads: every step
+// answers from the event loop after a fixed delay, 0 meaning the next turn,
+// and ids count up from the start. What's left to measure is the portal.
+class FakeBackend : public CompositorBackend
+{
+    Q_OBJECT
+
+public:
+    struct Delays {
+        int createMs = 0;
+        int recordMs = 0;
+        int startMs = 0;
+        int nodeMs = 0; // after Start replied
+    };
+
+    explicit FakeBackend(const Delays &delays = {}, QObject *parent = nullptr);
+
+    bool isAvailable() const override { return true; }
+
+    QString recordMonitor(const QString &sessionPath, const QString &connector, uint cursorMode = 0);
+    QString recordWindow(const QString &sessionPath, uint64_t windowId, uint cursorMode = 0);
+    QVariantMap getStreamParameters(const QString &streamPath) override;
+
+    void createSessionAsync(const QVariantMap &properties, int timeoutMs,
+                            QObject *context, PathCallback done) override;
+    void recordMonitorAsync(const QString &sessionPath, const QString &connector, uint cursorMode,
+                            int timeoutMs, QObject *context, PathCallback done) override;
+    void recordWindowAsync(const QString &sessionPath, uint64_t windowId, uint cursorMode,
+                           int timeoutMs, QObject *context, PathCallback done) override;
+    void startSessionAsync(const QString &sessionPath, int timeoutMs,
+                           QObject *context, DoneCallback done) override;
+    void stopSessionAsync(const QString &sessionPath) override;
+
+    // The compositor ending every session, as if it restarted
+    void closeAllSessions();
+
+    int liveSessions() const { return int(m_sessions.size()); }
+    quint64 calls() const { return m_calls; }
+    quint64 nodesAnnounced() const { return m_nodesAnnounced; }
+
+private:
+    struct Session {
+        QStringList streams;
+    };
+
+    // f() after ms, unless context went away meanwhile
+    void later(int ms, QObject *context, std::function<void()> f);
+    QString addStream(const QString &sessionPath);
+
+    Delays m_delays;
+    QHash<QString, Session> m_sessions;
+    QHash<QString, QString> m_streamSessions; // stream path -> session path
+    quint64 m_nextId = 0;
+    uint m_nextNode = 100;
+    quint64 m_calls = 0;
+    quint64 m_nodesAnnounced = 0;
+};
+
+#endif // FAKEBACKEND_H
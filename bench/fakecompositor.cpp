@@ -0,0 +1,473 @@
+#include "fakecompositor.h"
+#include <QDBusConnectionInterface>
+#include <QDBusMetaType>
+#include <QDBusMessage>
+#include <QDBusError>
+#include <QSize>
+#include <QPoint>
+#include <QTimer>
+#include <QPointer>
+
+static const char *const FakeBusName = "uni-fake-compositor";
+
+static const QStringList FakeServices = {
+    QStringLiteral("org.gnome.Mutter.DisplayConfig"),
+    QStringLiteral("org.gnome.Shell.Introspect"),
+    QStringLiteral("org.gnome.Mutter.ScreenCast"),
+    QStringLiteral("org.gnome.Mutter.RemoteDesktop"),
+};
+
+static const QDBusConnection::RegisterOptions ExportAll =
+    QDBusConnection::ExportAllSlots | QDBusConnection::ExportAllSignals | QDBusConnection::ExportAllProperties;
+
+QDBusArgument &operator<<(QDBusArgument &arg, const FakeMonitorSpec &spec)
+{
+    arg.beginStructure();
+    arg << spec.connector << spec.vendor << spec.product << spec.serial;
+    arg.endStructure();
+    return arg;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &arg, FakeMonitorSpec &spec)
+{
+    arg.beginStructure();
+    arg >> spec.connector >> spec.vendor >> spec.product >> spec.serial;
+    arg.endStructure();
+    return arg;
+}
+
+QDBusArgument &operator<<(QDBusArgument &arg, const FakeMode &mode)
+{
+    arg.beginStructure();
+    arg << mode.id << mode.width << mode.height << mode.refreshRate << mode.preferredScale
+        << mode.supportedScales << mode.properties;
+    arg.endStructure();
+    return arg;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &arg, FakeMode &mode)
+{
+    arg.beginStructure();
+    arg >> mode.id >> mode.width >> mode.height >> mode.refreshRate >> mode.preferredScale
+        >> mode.supportedScales >> mode.properties;
+    arg.endStructure();
+    return arg;
+}
+
+QDBusArgument &operator<<(QDBusArgument &arg, const FakeMonitor &monitor)
+{
+    arg.beginStructure();
+    arg << monitor.spec << monitor.modes << monitor.properties;
+    arg.endStructure();
+    return arg;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &arg, FakeMonitor &monitor)
+{
+    arg.beginStructure();
+    arg >> monitor.spec >> monitor.modes >> monitor.properties;
+    arg.endStructure();
+    return arg;
+}
+
+QDBusArgument &operator<<(QDBusArgument &arg, const FakeLogicalMonitor &monitor)
+{
+    arg.beginStructure();
+    arg << monitor.x << monitor.y << monitor.scale << monitor.transform << monitor.primary
+        << monitor.monitors << monitor.properties;
+    arg.endStructure();
+    return arg;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &arg, FakeLogicalMonitor &monitor)
+{
+    arg.beginStructure();
+    arg >> monitor.x >> monitor.y >> monitor.scale >> monitor.transform >> monitor.primary
+        >> monitor.monitors >> monitor.properties;
+    arg.endStructure();
+    return arg;
+}
+
+void FakeDisplayConfig::GetCurrentState()
+{
+    // (u a((ssss)a(siiddada{sv})a{sv}) a(iiduba(ssss)a{sv}) a{sv})
+    setDelayedReply(true);
+
+    QList<FakeLogicalMonitor> logicalMonitors;
+    int x = 0;
+    for (const FakeMonitor &monitor : monitors) {
+        FakeLogicalMonitor logical;
+        logical.x = x;
+        logical.primary = logicalMonitors.isEmpty();
+        logical.monitors.append(monitor.spec);
+        logicalMonitors.append(logical);
+        x += monitor.modes.isEmpty() ? 0 : monitor.modes.first().width;
+    }
+
+    QDBusMessage reply = message().createReply();
+    reply << 1u
+          << QVariant::fromValue(monitors)
+          << QVariant::fromValue(logicalMonitors)
+          << QVariantMap();
+    connection().send(reply);
+}
+
+QDBusObjectPath FakeScreenCast::CreateSession(const QVariantMap &properties)
+{
+    const QString path = QStringLiteral("/org/gnome/Mutter/ScreenCast/Session/u%1").arg(++m_state->nextObjectId);
+    auto *session = new FakeScreenCastSession(m_state, path, this);
+    connection().registerObject(path, session, ExportAll);
+    ++m_state->createdScreenCastSessions;
+    ++m_state->liveScreenCastSessions;
+
+    // Linked sessions are started through their remote desktop session
+    const QString remoteDesktopId = properties.value("remote-desktop-session-id").toString();
+    if (!remoteDesktopId.isEmpty()) {
+        session->m_linked = true;
+        m_state->linkedScreenCasts.insert(remoteDesktopId, session);
+    }
+
+    return QDBusObjectPath(path);
+}
+
+QDBusObjectPath FakeScreenCastSession::addStream(const QVariantMap &parameters)
+{
+    const QString path = QStringLiteral("/org/gnome/Mutter/ScreenCast/Stream/u%1").arg(++m_state->nextObjectId);
+    auto *stream = new FakeScreenCastStream(parameters, this);
+    connection().registerObject(path, stream, ExportAll);
+    m_streams.append({ path, stream });
+    return QDBusObjectPath(path);
+}
+
+QDBusObjectPath FakeScreenCastSession::RecordMonitor(const QString &connector, const QVariantMap &properties)
+{
+    Q_UNUSED(connector)
+    Q_UNUSED(properties)
+    return addStream({ { "position", QPoint(0, 0) }, { "size", QSize(2560, 1440) } });
+}
+
+QDBusObjectPath FakeScreenCastSession::RecordWindow(const QVariantMap &properties)
+{
+    Q_UNUSED(properties)
+    return addStream({ { "size", QSize(1280, 720) } });
+}
+
+void FakeScreenCastSession::startStreams()
+{
+    for (const auto &stream : std::as_const(m_streams)) {
+        const uint node = m_state->nextNodeId++;
+        QPointer<FakeScreenCastStream> target = stream.second;
+        QTimer::singleShot(m_state->streamDelayMs, this, [target, node] {
+            if (target) {
+                emit target->PipeWireStreamAdded(node);
+            }
+        });
+    }
+}
+
+void FakeScreenCastSession::Start()
+{
+    if (m_linked) {
+        sendErrorReply(QDBusError::Failed, "Linked sessions are started through the remote desktop session");
+        return;
+    }
+    startStreams();
+}
+
+void FakeScreenCastSession::close()
+{
+    if (m_closed) {
+        return;
+    }
+    m_closed = true;
+    --m_state->liveScreenCastSessions;
+
+    emit Closed();
+
+    QDBusConnection bus = QDBusConnection(QString::fromLatin1(FakeBusName));
+    for (const auto &stream : std::as_const(m_streams)) {
+        bus.unregisterObject(stream.first);
+    }
+    bus.unregisterObject(m_path);
+
+    for (auto it = m_state->linkedScreenCasts.begin(); it != m_state->linkedScreenCasts.end(); ) {
+        it = it.value() == this ? m_state->linkedScreenCasts.erase(it) : std::next(it);
+    }
+    deleteLater();
+}
+
+void FakeScreenCastSession::Stop()
+{
+    close();
+}
+
+QDBusObjectPath FakeRemoteDesktop::CreateSession()
+{
+    const int id = ++m_state->nextObjectId;
+    const QString path = QStringLiteral("/org/gnome/Mutter/RemoteDesktop/Session/u%1").arg(id);
+    auto *session = new FakeRemoteDesktopSession(m_state, path, QStringLiteral("fake-rd-%1").arg(id), this);
+    connection().registerObject(path, session, ExportAll);
+    return QDBusObjectPath(path);
+}
+
+void FakeRemoteDesktopSession::Start()
+{
+    if (FakeScreenCastSession *screenCast = m_state->linkedScreenCasts.value(m_id)) {
+        screenCast->startStreams();
+    }
+}
+
+void FakeRemoteDesktopSession::Stop()
+{
+    if (FakeScreenCastSession *screenCast = m_state->linkedScreenCasts.value(m_id)) {
+        screenCast->close();
+    }
+
+    emit Closed();
+    connection().unregisterObject(m_path);
+    deleteLater();
+}
+
+void FakeRemoteDesktopSession::count()
+{
+    QMutexLocker locker(&m_state->statsMutex);
+    m_state->inputStats.messages++;
+}
+
+void FakeRemoteDesktopSession::NotifyPointerMotionRelative(double dx, double dy)
+{
+    QMutexLocker locker(&m_state->statsMutex);
+    m_state->inputStats.messages++;
+    m_state->inputStats.motionMessages++;
+    m_state->inputStats.motionDx += dx;
+    m_state->inputStats.motionDy += dy;
+}
+
+void FakeRemoteDesktopSession::NotifyPointerMotionAbsolute(const QString &stream, double x, double y)
+{
+    Q_UNUSED(stream)
+    Q_UNUSED(x)
+    Q_UNUSED(y)
+    QMutexLocker locker(&m_state->statsMutex);
+    m_state->inputStats.messages++;
+    m_state->inputStats.motionMessages++;
+}
+
+void FakeRemoteDesktopSession::NotifyPointerButton(int button, bool state)
+{
+    Q_UNUSED(button)
+    Q_UNUSED(state)
+    QMutexLocker locker(&m_state->statsMutex);
+    m_state->inputStats.messages++;
+    m_state->inputStats.buttonMessages++;
+}
+
+void FakeRemoteDesktopSession::NotifyPointerAxis(double dx, double dy, uint flags)
+{
+    Q_UNUSED(dx)
+    Q_UNUSED(dy)
+    Q_UNUSED(flags)
+    count();
+}
+
+void FakeRemoteDesktopSession::NotifyPointerAxisDiscrete(uint axis, int steps)
+{
+    Q_UNUSED(axis)
+    Q_UNUSED(steps)
+    count();
+}
+
+void FakeRemoteDesktopSession::NotifyKeyboardKeycode(uint keycode, bool state)
+{
+    Q_UNUSED(keycode)
+    Q_UNUSED(state)
+    count();
+}
+
+void FakeRemoteDesktopSession::NotifyKeyboardKeysym(uint keysym, bool state)
+{
+    Q_UNUSED(keysym)
+    Q_UNUSED(state)
+    count();
+}
+
+void FakeRemoteDesktopSession::NotifyTouchDown(const QString &stream, uint slot, double x, double y)
+{
+    Q_UNUSED(stream)
+    Q_UNUSED(slot)
+    Q_UNUSED(x)
+    Q_UNUSED(y)
+    count();
+}
+
+void FakeRemoteDesktopSession::NotifyTouchMotion(const QString &stream, uint slot, double x, double y)
+{
+    Q_UNUSED(stream)
+    Q_UNUSED(slot)
+    Q_UNUSED(x)
+    Q_UNUSED(y)
+    count();
+}
+
+void FakeRemoteDesktopSession::NotifyTouchUp(uint slot)
+{
+    Q_UNUSED(slot)
+    count();
+}
+
+FakeCompositor::FakeCompositor(const Config &config, QObject *parent)
+    : QObject(parent)
+    , m_config(config)
+    , m_bus(QString::fromLatin1(FakeBusName))
+    , m_displayConfig(new FakeDisplayConfig)
+    , m_shellIntrospect(new FakeShellIntrospect)
+    , m_screenCast(new FakeScreenCast(&m_state))
+    , m_remoteDesktop(new FakeRemoteDesktop(&m_state))
+{
+    qDBusRegisterMetaType<FakeMonitorSpec>();
+    qDBusRegisterMetaType<QList<FakeMonitorSpec>>();
+    qDBusRegisterMetaType<FakeMode>();
+    qDBusRegisterMetaType<QList<FakeMode>>();
+    qDBusRegisterMetaType<FakeMonitor>();
+    qDBusRegisterMetaType<QList<FakeMonitor>>();
+    qDBusRegisterMetaType<FakeLogicalMonitor>();
+    qDBusRegisterMetaType<QList<FakeLogicalMonitor>>();
+    qDBusRegisterMetaType<FakeWindowMap>();
+
+    m_displayConfig->monitors = makeMonitors(m_config.monitors);
+    m_shellIntrospect->windows = makeWindows(m_config.windows);
+    m_state.streamDelayMs = m_config.streamDelayMs;
+
+    // Calls are delivered to the thread the receiving object lives in
+    m_displayConfig->moveToThread(&m_thread);
+    m_shellIntrospect->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_displayConfig, &QObject::deleteLater);
+    connect(&m_thread, &QThread::finished, m_shellIntrospect, &QObject::deleteLater);
+    for (QObject *object : { static_cast<QObject *>(m_screenCast), static_cast<QObject *>(m_remoteDesktop) }) {
+        object->moveToThread(&m_thread);
+        connect(&m_thread, &QThread::finished, object, &QObject::deleteLater);
+    }
+    m_thread.start();
+}
+
+FakeCompositor::~FakeCompositor()
+{
+    stop();
+    m_thread.quit();
+    m_thread.wait();
+}
+
+bool FakeCompositor::start()
+{
+    if (m_started) {
+        return true;
+    }
+
+    m_bus = QDBusConnection::connectToBus(QDBusConnection::SessionBus, QString::fromLatin1(FakeBusName));
+    if (!m_bus.isConnected()) {
+        return false;
+    }
+
+    if (!m_bus.registerObject("/org/gnome/Mutter/DisplayConfig", m_displayConfig, QDBusConnection::ExportAllSlots)
+        || !m_bus.registerObject("/org/gnome/Shell/Introspect", m_shellIntrospect,
+                                QDBusConnection::ExportAllSlots | QDBusConnection::ExportAllSignals)
+        || !m_bus.registerObject("/org/gnome/Mutter/ScreenCast", m_screenCast, ExportAll)
+        || !m_bus.registerObject("/org/gnome/Mutter/RemoteDesktop", m_remoteDesktop, ExportAll)) {
+        stop();
+        return false;
+    }
+
+    // Refuse to shadow a running compositor
+    for (const QString &service : FakeServices) {
+        if (!m_bus.registerService(service)) {
+            stop();
+            return false;
+        }
+    }
+
+    m_started = true;
+    return true;
+}
+
+void FakeCompositor::stop()
+{
+    if (!m_bus.isConnected()) {
+        return;
+    }
+
+    for (const QString &service : FakeServices) {
+        m_bus.unregisterService(service);
+    }
+    // Session objects are registered below these, take them down too
+    m_bus.unregisterObject("/org/gnome/Mutter/DisplayConfig");
+    m_bus.unregisterObject("/org/gnome/Shell/Introspect");
+    m_bus.unregisterObject("/org/gnome/Mutter/ScreenCast", QDBusConnection::UnregisterTree);
+    m_bus.unregisterObject("/org/gnome/Mutter/RemoteDesktop", QDBusConnection::UnregisterTree);
+    QDBusConnection::disconnectFromBus(QString::fromLatin1(FakeBusName));
+    m_bus = QDBusConnection(QString::fromLatin1(FakeBusName));
+    m_started = false;
+}
+
+void FakeCompositor::closeWindow(qulonglong id)
+{
+    FakeShellIntrospect *introspect = m_shellIntrospect;
+    QMetaObject::invokeMethod(introspect, [introspect, id]() {
+        introspect->windows.remove(id);
+        emit introspect->WindowsChanged();
+    }, Qt::BlockingQueuedConnection);
+}
+
+FakeInputStats FakeCompositor::inputStats()
+{
+    QMutexLocker locker(&m_state.statsMutex);
+    return m_state.inputStats;
+}
+
+QList<FakeMonitor> FakeCompositor::makeMonitors(int count)
+{
+    QList<FakeMonitor> monitors;
+
+    for (int i = 0; i < count; ++i) {
+        FakeMonitor monitor;
+        monitor.spec = { QStringLiteral("DP-%1").arg(i + 1), QStringLiteral("FAK"),
+                         QStringLiteral("Fake Display %1").arg(i + 1), QStringLiteral("%1").arg(1000 + i) };
+
+        // A realistic handful of modes, the first one current
+        const QList<QSize> sizes = { {2560, 1440}, {1920, 1080}, {1680, 1050}, {1280, 720} };
+        for (const QSize &size : sizes) {
+            for (double rate : { 144.0, 60.0 }) {
+                FakeMode mode;
+                mode.id = QStringLiteral("%1x%2@%3").arg(size.width()).arg(size.height()).arg(rate);
+                mode.width = size.width();
+                mode.height = size.height();
+                mode.refreshRate = rate;
+                mode.supportedScales = { 1.0, 1.25, 1.5, 2.0 };
+                if (monitor.modes.isEmpty()) {
+                    mode.properties["is-current"] = true;
+                    mode.properties["is-preferred"] = true;
+                }
+                monitor.modes.append(mode);
+            }
+        }
+
+        monitor.properties["display-name"] = QStringLiteral("Fake Display %1").arg(i + 1);
+        monitor.properties["is-builtin"] = (i == 0);
+        monitors.append(monitor);
+    }
+
+    return monitors;
+}
+
+FakeWindowMap FakeCompositor::makeWindows(int count)
+{
+    FakeWindowMap windows;
+
+    for (int i = 0; i < count; ++i) {
+        QVariantMap properties;
+        properties["title"] = QStringLiteral("Fake window %1 - some document title.txt").arg(i);
+        properties["app-id"] = QStringLiteral("org.example.App%1").arg(i % 16);
+        windows.insert(qulonglong(i + 1), properties);
+    }
+
+    return windows;
+}
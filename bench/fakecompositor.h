@@ -0,0 +1,287 @@
+#ifndef FAKECOMPOSITOR_H
+#define FAKECOMPOSITOR_H
+
+#include <QObject>
+#include <QThread>
+#include <QDBusConnection>
+#include <QDBusContext>
+#include <QDBusArgument>
+#include <QVariantMap>
+#include <QList>
+#include <QMap>
+#include <QHash>
+#include <QMutex>
+#include <QDBusObjectPath>
+#include <atomic>
+
+// Stand-in for the bits of Niri's Mutter-style D-Bus API the portal talks to.
+// It owns its own session bus connection and serves from a worker thread, so
+// the portal code under test can keep making blocking calls from the main
+// thread. Meant to run under dbus-run-session, where the names are free.
+
+struct FakeMode {
+    QString id;
+    int width = 0;
+    int height = 0;
+    double refreshRate = 0;
+    double preferredScale = 1.0;
+    QList<double> supportedScales;
+    QVariantMap properties;
+};
+
+struct FakeMonitorSpec {
+    QString connector;
+    QString vendor;
+    QString product;
+    QString serial;
+};
+
+struct FakeMonitor {
+    FakeMonitorSpec spec;
+    QList<FakeMode> modes;
+    QVariantMap properties;
+};
+
+struct FakeLogicalMonitor {
+    int x = 0;
+    int y = 0;
+    double scale = 1.0;
+    uint transform = 0;
+    bool primary = false;
+    QList<FakeMonitorSpec> monitors;
+    QVariantMap properties;
+};
+
+using FakeWindowMap = QMap<qulonglong, QVariantMap>;
+
+QDBusArgument &operator<<(QDBusArgument &arg, const FakeMonitorSpec &spec);
+const QDBusArgument &operator>>(const QDBusArgument &arg, FakeMonitorSpec &spec);
+QDBusArgument &operator<<(QDBusArgument &arg, const FakeMode &mode);
+const QDBusArgument &operator>>(const QDBusArgument &arg, FakeMode &mode);
+QDBusArgument &operator<<(QDBusArgument &arg, const FakeMonitor &monitor);
+const QDBusArgument &operator>>(const QDBusArgument &arg, FakeMonitor &monitor);
+QDBusArgument &operator<<(QDBusArgument &arg, const FakeLogicalMonitor &monitor);
+const QDBusArgument &operator>>(const QDBusArgument &arg, FakeLogicalMonitor &monitor);
+
+class FakeDisplayConfig : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.gnome.Mutter.DisplayConfig")
+
+public:
+    QList<FakeMonitor> monitors;
+
+public slots:
+    void GetCurrentState();
+};
+
+class FakeShellIntrospect : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.gnome.Shell.Introspect")
+
+public:
+    FakeWindowMap windows;
+
+public slots:
+    FakeWindowMap GetWindows() { return windows; }
+
+signals:
+    void WindowsChanged();
+};
+
+// What the stand-in remote desktop sessions received, summed over all sessions
+struct FakeInputStats {
+    int messages = 0;
+    int motionMessages = 0;
+    double motionDx = 0;
+    double motionDy = 0;
+    int buttonMessages = 0;
+};
+
+class FakeScreenCastSession;
+class FakeRemoteDesktopSession;
+
+// State shared by the stand-in objects, all of which live on the worker thread
+struct FakeCompositorState {
+    int streamDelayMs = 0;
+    uint nextNodeId = 100;
+    int nextObjectId = 0;
+    QHash<QString, FakeScreenCastSession *> linkedScreenCasts; // remote desktop session id -> session
+    std::atomic<int> createdScreenCastSessions{0};
+    std::atomic<int> liveScreenCastSessions{0};
+
+    QMutex statsMutex;
+    FakeInputStats inputStats;
+};
+
+class FakeScreenCastStream : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.gnome.Mutter.ScreenCast.Stream")
+    Q_PROPERTY(QVariantMap Parameters READ parameters)
+
+public:
+    explicit FakeScreenCastStream(const QVariantMap &parameters, QObject *parent = nullptr)
+        : QObject(parent), m_parameters(parameters) {}
+
+    QVariantMap parameters() const { return m_parameters; }
+
+signals:
+    void PipeWireStreamAdded(uint node_id);
+
+private:
+    QVariantMap m_parameters;
+};
+
+class FakeScreenCastSession : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.gnome.Mutter.ScreenCast.Session")
+
+public:
+    FakeScreenCastSession(FakeCompositorState *state, const QString &path, QObject *parent = nullptr)
+        : QObject(parent), m_state(state), m_path(path) {}
+
+    QString path() const { return m_path; }
+    void startStreams();
+    void close();
+
+public slots:
+    QDBusObjectPath RecordMonitor(const QString &connector, const QVariantMap &properties);
+    QDBusObjectPath RecordWindow(const QVariantMap &properties);
+    void Start();
+    void Stop();
+
+signals:
+    void Closed();
+
+private:
+    QDBusObjectPath addStream(const QVariantMap &parameters);
+
+    FakeCompositorState *m_state;
+    QString m_path;
+    QList<QPair<QString, FakeScreenCastStream *>> m_streams;
+    bool m_linked = false;
+    bool m_closed = false;
+    friend class FakeScreenCast;
+};
+
+class FakeScreenCast : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.gnome.Mutter.ScreenCast")
+    Q_PROPERTY(int Version READ version)
+
+public:
+    explicit FakeScreenCast(FakeCompositorState *state) : m_state(state) {}
+    int version() const { return 4; }
+
+public slots:
+    QDBusObjectPath CreateSession(const QVariantMap &properties);
+
+private:
+    FakeCompositorState *m_state;
+};
+
+class FakeRemoteDesktopSession : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.gnome.Mutter.RemoteDesktop.Session")
+    Q_PROPERTY(QString SessionId READ sessionId)
+
+public:
+    FakeRemoteDesktopSession(FakeCompositorState *state, const QString &path, const QString &id, QObject *parent = nullptr)
+        : QObject(parent), m_state(state), m_path(path), m_id(id) {}
+
+    QString sessionId() const { return m_id; }
+
+public slots:
+    void Start();
+    void Stop();
+    void NotifyPointerMotionRelative(double dx, double dy);
+    void NotifyPointerMotionAbsolute(const QString &stream, double x, double y);
+    void NotifyPointerButton(int button, bool state);
+    void NotifyPointerAxis(double dx, double dy, uint flags);
+    void NotifyPointerAxisDiscrete(uint axis, int steps);
+    void NotifyKeyboardKeycode(uint keycode, bool state);
+    void NotifyKeyboardKeysym(uint keysym, bool state);
+    void NotifyTouchDown(const QString &stream, uint slot, double x, double y);
+    void NotifyTouchMotion(const QString &stream, uint slot, double x, double y);
+    void NotifyTouchUp(uint slot);
+
+signals:
+    void Closed();
+
+private:
+    void count();
+
+    FakeCompositorState *m_state;
+    QString m_path;
+    QString m_id;
+};
+
+class FakeRemoteDesktop : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.gnome.Mutter.RemoteDesktop")
+    Q_PROPERTY(uint SupportedDeviceTypes READ supportedDeviceTypes)
+
+public:
+    explicit FakeRemoteDesktop(FakeCompositorState *state) : m_state(state) {}
+    uint supportedDeviceTypes() const { return 1 | 2 | 4; }
+
+public slots:
+    QDBusObjectPath CreateSession();
+
+private:
+    FakeCompositorState *m_state;
+};
+
+class FakeCompositor : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Config {
+        int monitors = 2;
+        int windows = 20;
+        int streamDelayMs = 0; // between Start and PipeWireStreamAdded
+    };
+
+    explicit FakeCompositor(const Config &config, QObject *parent = nullptr);
+    ~FakeCompositor() override;
+
+    // Claim the compositor names on the session bus. Fails when there is no
+    // session bus or a real compositor already owns them.
+    bool start();
+    void stop();
+
+    FakeInputStats inputStats();
+    // Drop a window and tell everyone, like closing it would
+    void closeWindow(qulonglong id);
+    // Screencast sessions created and not stopped yet, to check for leaks
+    int createdScreenCastSessions() const { return m_state.createdScreenCastSessions; }
+    int liveScreenCastSessions() const { return m_state.liveScreenCastSessions; }
+
+    static QList<FakeMonitor> makeMonitors(int count);
+    static FakeWindowMap makeWindows(int count);
+
+private:
+    Config m_config;
+    QThread m_thread;
+    QDBusConnection m_bus;
+    FakeCompositorState m_state;
+    FakeDisplayConfig *m_displayConfig;
+    FakeShellIntrospect *m_shellIntrospect;
+    FakeScreenCast *m_screenCast;
+    FakeRemoteDesktop *m_remoteDesktop;
+    bool m_started = false;
+};
+
+Q_DECLARE_METATYPE(FakeMonitorSpec)
+Q_DECLARE_METATYPE(FakeMode)
+Q_DECLARE_METATYPE(FakeMonitor)
+Q_DECLARE_METATYPE(FakeLogicalMonitor)
+
+#endif // FAKECOMPOSITOR_H
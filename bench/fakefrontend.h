@@ -0,0 +1,51 @@
+#ifndef FAKEFRONTEND_H
+#define FAKEFRONTEND_H
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDebug>
+#include <QEventLoop>
+
+// Portal frontend stand-in on its own connection. Calls go out async and
+// wait in a local loop, since the backend answers from this same thread.
+// Destroying it drops the connection, like a crashed frontend would.
+class FakeFrontend
+{
+public:
+    FakeFrontend(const QString &backend, const QString &connectionName)
+        : m_bus(QDBusConnection::connectToBus(QDBusConnection::SessionBus, connectionName))
+        , m_backend(backend)
+        , m_name(connectionName)
+    {}
+
+    ~FakeFrontend() { QDBusConnection::disconnectFromBus(m_name); }
+
+    // The reply's response code, or -1 when it errored or timed out
+    int call(const QString &path, const QString &interface, const QString &method, const QVariantList &args)
+    {
+        QDBusMessage msg = QDBusMessage::createMethodCall(m_backend, path, interface, method);
+        msg.setArguments(args);
+
+        QEventLoop loop;
+        QDBusPendingCallWatcher watcher(m_bus.asyncCall(msg, 10000));
+        QObject::connect(&watcher, &QDBusPendingCallWatcher::finished, &loop, &QEventLoop::quit);
+        if (!watcher.isFinished()) {
+            loop.exec();
+        }
+
+        const QDBusMessage reply = watcher.reply();
+        if (reply.type() != QDBusMessage::ReplyMessage) {
+            qWarning() << method << "failed:" << reply.errorMessage();
+            return -1;
+        }
+        return reply.arguments().isEmpty() ? 0 : reply.arguments().first().toInt();
+    }
+
+private:
+    QDBusConnection m_bus;
+    QString m_backend;
+    QString m_name;
+};
+
+#endif // FAKEFRONTEND_H
@@ -0,0 +1,78 @@
+#include "fakeportal.h"
+#include "portalobjects.h"
+#include "screencast.h"
+
+const QString FakePortal::Path = QStringLiteral("/org/freedesktop/portal/desktop");
+const QString FakePortal::ScreenCastInterface = QStringLiteral("org.freedesktop.impl.portal.ScreenCast");
+
+FakePortal::FakePortal(const FakeCompositor::Config &config)
+    : m_compositor(config)
+{
+}
+
+FakePortal::~FakePortal()
+{
+    if (m_exported) {
+        QDBusConnection::sessionBus().unregisterObject(Path);
+    }
+}
+
+bool FakePortal::start()
+{
+    if (!m_compositor.start()) {
+        return false;
+    }
+
+    // Only once the compositor is there, like at login
+    m_screenCast = new ScreenCast(&m_service);
+    m_exported = QDBusConnection::sessionBus().registerObject(Path, &m_service, QDBusConnection::ExportAdaptors);
+    return m_exported;
+}
+
+QDBusObjectPath FakePortal::requestPath(const QString &token, const char *step)
+{
+    return QDBusObjectPath(PortalObjects::RequestRoot + QStringLiteral("/1_1/") + token + QLatin1String(step));
+}
+
+QDBusObjectPath FakePortal::sessionPath(const QString &token)
+{
+    return QDBusObjectPath(PortalObjects::SessionRoot + QStringLiteral("/1_1/") + token);
+}
+
+int FakePortal::createSession(FakeFrontend &frontend, const QString &token, const QString &appId)
+{
+    return frontend.call(Path, ScreenCastInterface, QStringLiteral("CreateSession"),
+                         { QVariant::fromValue(requestPath(token, "c")), QVariant::fromValue(sessionPath(token)),
+                           appId, QVariantMap() });
+}
+
+int FakePortal::selectSources(FakeFrontend &frontend, const QString &token, const QString &appId, uint types)
+{
+    return frontend.call(Path, ScreenCastInterface, QStringLiteral("SelectSources"),
+                         { QVariant::fromValue(requestPath(token, "s")), QVariant::fromValue(sessionPath(token)),
+                           appId, QVariantMap { { "types", types } } });
+}
+
+int FakePortal::startSession(FakeFrontend &frontend, const QString &token, const QString &appId)
+{
+    return frontend.call(Path, ScreenCastInterface, QStringLiteral("Start"),
+                         { QVariant::fromValue(requestPath(token, "t")), QVariant::fromValue(sessionPath(token)),
+                           appId, QString(), QVariantMap() });
+}
+
+int FakePortal::closeSession(FakeFrontend &frontend, const QString &token)
+{
+    return frontend.call(sessionPath(token).path(), QStringLiteral("org.freedesktop.impl.portal.Session"),
+                         QStringLiteral("Close"), {});
+}
+
+int FakePortal::screenCast(FakeFrontend &frontend, const QString &token, const QString &appId, uint types)
+{
+    if (int response = createSession(frontend, token, appId); response != 0) {
+        return response;
+    }
+    if (int response = selectSources(frontend, token, appId, types); response != 0) {
+        return response;
+    }
+    return startSession(frontend, token, appId);
+}
@@ -0,0 +1,54 @@
+#ifndef FAKEPORTAL_H
+#define FAKEPORTAL_H
+
+#include "fakecompositor.h"
+#include "fakefrontend.h"
+#include <QDBusObjectPath>
+#include <QObject>
+
+class ScreenCast;
+
+// The ScreenCast portal where the frontend looks for it, with the fake
+// compositor behind it. Benches drive it through a FakeFrontend; request and
+// session paths are made up from a token per session.
+class FakePortal
+{
+public:
+    static const QString Path;
+    static const QString ScreenCastInterface;
+
+    explicit FakePortal(const FakeCompositor::Config &config);
+    ~FakePortal();
+
+    // Claim the compositor names and export the portal. Fails when there is
+    // no session bus or a real compositor owns the names.
+    bool start();
+
+    FakeCompositor &compositor() { return m_compositor; }
+    // The exported object, parent for anything else it should serve
+    QObject *service() { return &m_service; }
+    // Null until start()
+    ScreenCast *adaptor() const { return m_screenCast; }
+
+    // <request root>/1_1/<token><step>, step "c", "s" or "t" for the call
+    static QDBusObjectPath requestPath(const QString &token, const char *step);
+    static QDBusObjectPath sessionPath(const QString &token);
+
+    // One call each, its response code
+    static int createSession(FakeFrontend &frontend, const QString &token, const QString &appId);
+    static int selectSources(FakeFrontend &frontend, const QString &token, const QString &appId, uint types);
+    static int startSession(FakeFrontend &frontend, const QString &token, const QString &appId);
+    static int closeSession(FakeFrontend &frontend, const QString &token);
+
+    // CreateSession, SelectSources and Start: the response of the first one
+    // that fails, or of Start
+    static int screenCast(FakeFrontend &frontend, const QString &token, const QString &appId, uint types);
+
+private:
+    FakeCompositor m_compositor;
+    QObject m_service;
+    ScreenCast *m_screenCast = nullptr;
+    bool m_exported = false;
+};
+
+#endif // FAKEPORTAL_H
@@ -0,0 +1,22 @@
+#include "jobrunner.h"
+#include <QCoreApplication>
+#include <QDeadlineTimer>
+
+StartJob::Source firstMonitor()
+{
+    StartJob::Source source;
+    source.id = QStringLiteral("DP-1");
+    return source;
+}
+
+int runJob(StartJob &job, int timeoutMs)
+{
+    int response = -1;
+    job.start([&](uint result) { response = int(result); });
+
+    QDeadlineTimer deadline(timeoutMs);
+    while (response < 0 && !deadline.hasExpired()) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 10);
+    }
+    return response;
+}
@@ -0,0 +1,14 @@
+#ifndef JOBRUNNER_H
+#define JOBRUNNER_H
+
+#include "startjob.h"
+
+// DP-1, the first monitor of both fake compositors
+StartJob::Source firstMonitor();
+
+// Run a job to completion, -1 if it didn't finish within timeoutMs. Spins
+// the event loop rather than waiting in steps like QTRY does, which would
+// swamp what's measured.
+int runJob(StartJob &job, int timeoutMs = 5000);
+
+#endif // JOBRUNNER_H
@@ -0,0 +1,32 @@
+#ifndef QUICKBENCH_H
+#define QUICKBENCH_H
+
+#include "renderpacing.h"
+#include <QApplication>
+#include <QtQml/qqmlextensionplugin.h>
+#include <QtTest>
+
+Q_IMPORT_QML_PLUGIN(SourceSelectorModulePlugin)
+
+// main() for the benches that show the picker. Offscreen with the software
+// scene graph unless told otherwise, so they measure the scene graph and not
+// the display server.
+#define UNI_QUICK_BENCH_MAIN(TestObject) \
+    int main(int argc, char **argv) \
+    { \
+        if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) { \
+            qputenv("QT_QPA_PLATFORM", "offscreen"); \
+        } \
+        if (!qEnvironmentVariableIsSet("QT_QUICK_BACKEND")) { \
+            qputenv("QT_QUICK_BACKEND", "software"); \
+        } \
+        RenderPacing::configure(); \
+        \
+        QApplication app(argc, argv); \
+        app.setQuitOnLastWindowClosed(false); \
+        \
+        TestObject bench; \
+        return QTest::qExec(&bench, argc, argv); \
+    }
+
+#endif // QUICKBENCH_H
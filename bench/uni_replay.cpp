@@ -0,0 +1,330 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusObjectPath>
+#include <QDBusPendingCallWatcher>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include "callrecorder.h"
+#include "fakecompositor.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+// Plays a call recording (UNI_PORTAL_RECORD) back against the portal, as
+// fast or as slow as asked and from as many clients at once, with the fake
+// compositor standing in for Niri and the picker confirmed automatically.
+//
+//     UNI_PORTAL_RECORD=/tmp/meeting.rec /usr/libexec/xdg-desktop-portal-uni
+//     dbus-run-session -- ./uni-replay --daemon build/xdg-desktop-portal-uni \
+//         --clients 8 --speed 10 /tmp/meeting.rec
+
+static const QString PortalService = QStringLiteral("org.freedesktop.impl.portal.desktop.uni");
+static const QString PortalPath = QStringLiteral("/org/freedesktop/portal/desktop");
+
+namespace {
+
+struct Options {
+    double speed = 1.0; // 0 doesn't wait at all
+    int clients = 1;
+    int timeoutMs = 30000;
+};
+
+// The calls of one recorded session, in order
+using Script = QList<CallRecorder::Call>;
+
+struct Sample {
+    CallRecorder::Method method;
+    qint64 latencyUs;
+};
+
+class Replay : public QObject
+{
+    Q_OBJECT
+
+public:
+    Replay(const QList<Script> &scripts, const Options &options)
+        : m_scripts(scripts), m_options(options)
+    {}
+
+    ~Replay() override
+    {
+        for (const QString &name : std::as_const(m_connections)) {
+            QDBusConnection::disconnectFromBus(name);
+        }
+    }
+
+    void start()
+    {
+        m_clock.start();
+        for (int client = 0; client < m_options.clients; ++client) {
+            const QString name = QStringLiteral("replay-%1").arg(client);
+            QDBusConnection::connectToBus(QDBusConnection::SessionBus, name);
+            m_connections.append(name);
+
+            for (int script = 0; script < m_scripts.size(); ++script) {
+                ++m_running;
+                schedule(client, script, 0);
+            }
+        }
+        if (m_running == 0) {
+            emit finished();
+        }
+    }
+
+    void report(QTextStream &out) const;
+
+signals:
+    void finished();
+
+private:
+    void schedule(int client, int script, int step);
+    void send(int client, int script, int step);
+
+    QList<Script> m_scripts;
+    Options m_options;
+    QStringList m_connections;
+    QElapsedTimer m_clock;
+    int m_running = 0;
+    quint64 m_requests = 0;
+
+    QList<Sample> m_samples;
+    int m_errors = 0;
+    int m_refused = 0; // replied, but with a non-zero response
+};
+
+void Replay::schedule(int client, int script, int step)
+{
+    const Script &calls = m_scripts.at(script);
+    if (step >= calls.size()) {
+        if (--m_running == 0) {
+            emit finished();
+        }
+        return;
+    }
+
+    // Never before its turn in the recording, never before the previous
+    // call of the same session got its reply
+    qint64 delayMs = 0;
+    if (m_options.speed > 0) {
+        const qint64 dueMs = qint64(calls.at(step).offsetUs / 1000.0 / m_options.speed);
+        delayMs = qMax<qint64>(0, dueMs - m_clock.elapsed());
+    }
+    QTimer::singleShot(delayMs, Qt::PreciseTimer, this, [this, client, script, step]() {
+        send(client, script, step);
+    });
+}
+
+void Replay::send(int client, int script, int step)
+{
+    const CallRecorder::Call &call = m_scripts.at(script).at(step);
+
+    // Fresh handles per client, the portal never sees the recorded ones
+    const QString token = QStringLiteral("replay_%1").arg(client);
+    const QDBusObjectPath session(PortalPath + QStringLiteral("/session/%1/s%2").arg(token).arg(call.session));
+    const QDBusObjectPath request(PortalPath + QStringLiteral("/request/%1/r%2").arg(token).arg(++m_requests));
+
+    QDBusMessage msg;
+    switch (call.method) {
+    case CallRecorder::CreateSession:
+    case CallRecorder::SelectSources:
+        msg = QDBusMessage::createMethodCall(PortalService, PortalPath,
+                                             QStringLiteral("org.freedesktop.impl.portal.ScreenCast"),
+                                             QLatin1String(CallRecorder::methodName(call.method)));
+        msg.setArguments({ QVariant::fromValue(request), QVariant::fromValue(session), call.appId,
+                           QVariant::fromValue(call.options) });
+        break;
+    case CallRecorder::Start:
+        msg = QDBusMessage::createMethodCall(PortalService, PortalPath,
+                                             QStringLiteral("org.freedesktop.impl.portal.ScreenCast"),
+                                             QStringLiteral("Start"));
+        msg.setArguments({ QVariant::fromValue(request), QVariant::fromValue(session), call.appId,
+                           QString(), QVariant::fromValue(call.options) });
+        break;
+    case CallRecorder::Close:
+        msg = QDBusMessage::createMethodCall(PortalService, session.path(),
+                                             QStringLiteral("org.freedesktop.impl.portal.Session"),
+                                             QStringLiteral("Close"));
+        break;
+    }
+
+    QDBusConnection bus(m_connections.at(client));
+    QElapsedTimer latency;
+    latency.start();
+
+    auto *watcher = new QDBusPendingCallWatcher(bus.asyncCall(msg, m_options.timeoutMs), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this,
+            [this, watcher, latency, method = call.method, client, script, step]() {
+                watcher->deleteLater();
+                m_samples.append({ method, latency.nsecsElapsed() / 1000 });
+
+                const QDBusMessage reply = watcher->reply();
+                if (reply.type() != QDBusMessage::ReplyMessage) {
+                    ++m_errors;
+                    qWarning() << CallRecorder::methodName(method) << "failed:" << reply.errorMessage();
+                } else if (!reply.arguments().isEmpty() && reply.arguments().first().toUInt() != 0) {
+                    ++m_refused;
+                }
+
+                schedule(client, script, step + 1);
+            });
+}
+
+static double percentile(const QList<qint64> &sorted, double p)
+{
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+    const qsizetype index = qBound<qsizetype>(0, qsizetype(std::ceil(p * sorted.size())) - 1, sorted.size() - 1);
+    return sorted.at(index) / 1000.0;
+}
+
+void Replay::report(QTextStream &out) const
+{
+    const double seconds = m_clock.elapsed() / 1000.0;
+    out << QStringLiteral("%1 calls from %2 sessions x %3 clients in %4 s, %5 calls/s, %6 errors, %7 refused\n")
+               .arg(m_samples.size())
+               .arg(m_scripts.size())
+               .arg(m_options.clients)
+               .arg(seconds, 0, 'f', 2)
+               .arg(seconds > 0 ? m_samples.size() / seconds : 0.0, 0, 'f', 1)
+               .arg(m_errors)
+               .arg(m_refused);
+
+    for (int method = CallRecorder::CreateSession; method <= CallRecorder::Close; ++method) {
+        QList<qint64> latencies;
+        for (const Sample &sample : m_samples) {
+            if (sample.method == method) {
+                latencies.append(sample.latencyUs);
+            }
+        }
+        if (latencies.isEmpty()) {
+            continue;
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        out << QStringLiteral("  %1 %2 calls  p50 %3 ms  p95 %4 ms  p99 %5 ms  max %6 ms\n")
+                   .arg(QLatin1String(CallRecorder::methodName(CallRecorder::Method(method))), -14)
+                   .arg(latencies.size(), 6)
+                   .arg(percentile(latencies, 0.50), 0, 'f', 2)
+                   .arg(percentile(latencies, 0.95), 0, 'f', 2)
+                   .arg(percentile(latencies, 0.99), 0, 'f', 2)
+                   .arg(latencies.last() / 1000.0, 0, 'f', 2);
+    }
+}
+
+// One script per recorded (client, session), each keeping its calls' order
+QList<Script> splitSessions(const QList<CallRecorder::Call> &calls)
+{
+    QList<Script> scripts;
+    QHash<quint64, int> index;
+    for (const CallRecorder::Call &call : calls) {
+        const quint64 key = (quint64(call.client) << 32) | call.session;
+        auto it = index.find(key);
+        if (it == index.end()) {
+            it = index.insert(key, int(scripts.size()));
+            scripts.append({});
+        }
+        scripts[*it].append(call);
+    }
+    return scripts;
+}
+
+bool waitForService(int timeoutMs)
+{
+    QElapsedTimer waited;
+    waited.start();
+    while (!QDBusConnection::sessionBus().interface()->isServiceRegistered(PortalService)) {
+        if (waited.elapsed() > timeoutMs) {
+            return false;
+        }
+        QThread::msleep(20);
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Replay a portal call recording and report latencies"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("recording"), QStringLiteral("File written with UNI_PORTAL_RECORD"));
+    const QCommandLineOption speedOption(QStringLiteral("speed"),
+        QStringLiteral("Playback speed, 1 is as recorded, 0 as fast as replies come back"), QStringLiteral("factor"), QStringLiteral("1"));
+    const QCommandLineOption clientsOption(QStringLiteral("clients"),
+        QStringLiteral("Copies of the recording played at once, each from its own connection"), QStringLiteral("count"), QStringLiteral("1"));
+    const QCommandLineOption daemonOption(QStringLiteral("daemon"),
+        QStringLiteral("Portal binary to start, otherwise a running one is used"), QStringLiteral("path"));
+    const QCommandLineOption timeoutOption(QStringLiteral("timeout"),
+        QStringLiteral("Per-call timeout"), QStringLiteral("ms"), QStringLiteral("30000"));
+    const QCommandLineOption windowsOption(QStringLiteral("windows"),
+        QStringLiteral("Windows the fake compositor reports"), QStringLiteral("count"), QStringLiteral("10"));
+    parser.addOptions({ speedOption, clientsOption, daemonOption, timeoutOption, windowsOption });
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    QList<CallRecorder::Call> calls;
+    if (!CallRecorder::read(parser.positionalArguments().first(), calls)) {
+        return 1;
+    }
+
+    Options options;
+    options.speed = qMax(0.0, parser.value(speedOption).toDouble());
+    options.clients = qMax(1, parser.value(clientsOption).toInt());
+    options.timeoutMs = qMax(1, parser.value(timeoutOption).toInt());
+
+    FakeCompositor compositor({ 2, parser.value(windowsOption).toInt() });
+    if (!compositor.start()) {
+        qWarning("Could not claim the compositor names, run under dbus-run-session");
+        return 1;
+    }
+
+    // Headless: offscreen picker that takes the first source by itself
+    QProcess daemon;
+    if (parser.isSet(daemonOption)) {
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert(QStringLiteral("QT_QPA_PLATFORM"), QStringLiteral("offscreen"));
+        env.insert(QStringLiteral("QT_QUICK_BACKEND"), QStringLiteral("software"));
+        env.insert(QStringLiteral("UNI_PORTAL_AUTOCONFIRM"), QStringLiteral("first"));
+        env.remove(QStringLiteral("UNI_PORTAL_RECORD"));
+        daemon.setProcessEnvironment(env);
+        daemon.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        daemon.start(parser.value(daemonOption), {});
+        if (!daemon.waitForStarted()) {
+            qWarning() << "Could not start" << parser.value(daemonOption) << daemon.errorString();
+            return 1;
+        }
+    }
+
+    if (!waitForService(5000)) {
+        qWarning() << PortalService << "is not on the bus";
+        return 1;
+    }
+
+    Replay replay(splitSessions(calls), options);
+    QObject::connect(&replay, &Replay::finished, &app, &QCoreApplication::quit, Qt::QueuedConnection);
+    replay.start();
+    app.exec();
+
+    QTextStream out(stdout);
+    replay.report(out);
+
+    if (daemon.state() != QProcess::NotRunning) {
+        daemon.terminate();
+        daemon.waitForFinished(3000);
+    }
+    return 0;
+}
+
+#include "uni_replay.moc"
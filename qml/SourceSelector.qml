@@ -1,3 +1,5 @@
+pragma ComponentBehavior: Bound
+
 import QtQuick
 import QtQuick.Controls.Universal 2.12
 import QtQuick.Layouts
@@ -15,30 +17,87 @@ BaseSidebarShellOverlay {
     signal sourceSelected(int index)
     signal cancelled
 
-    property var model
+    required property SourceModel sourceModel
+    required property SourceSelector selectorApi
+    required property string requestAppId
+
+    // Rows are filtered, so map them back before reporting the choice
+    function confirm(row: int) {
+        if (row < 0 || row >= listView.count)
+            return
+        root.sourceSelected(root.sourceModel.sourceIndex(row))
+        root.closeAnimation()
+    }
+
+    function cancel() {
+        root.cancelled()
+        root.closeAnimation()
+    }
 
     mainContent: ColumnLayout {
         anchors.fill: parent
         spacing: 0
 
+        TextField {
+            id: searchField
+            Layout.fillWidth: true
+            Layout.topMargin: 25
+            placeholderText: "Type to search"
+            focus: true
+
+            Component.onCompleted: {
+                searchField.forceActiveFocus()
+            }
+
+            onTextChanged: {
+                root.sourceModel.filterText = text
+                listView.currentIndex = listView.count > 0 ? 0 : -1
+            }
+
+            Keys.onDownPressed: {
+                listView.moved = true
+                listView.incrementCurrentIndex()
+            }
+            Keys.onUpPressed: {
+                listView.moved = true
+                listView.decrementCurrentIndex()
+            }
+            Keys.onReturnPressed: root.confirm(listView.currentIndex)
+            Keys.onEnterPressed: root.confirm(listView.currentIndex)
+            Keys.onEscapePressed: {
+                if (text.length > 0)
+                    clear()
+                else
+                    root.cancel()
+            }
+        }
+
         ListView {
             id: listView
             Layout.fillWidth: true
             Layout.fillHeight: true
-            Layout.topMargin: 25
+            Layout.topMargin: 12
 
             clip: true
             currentIndex: 0
-            focus: true
 
-            Component.onCompleted: {
-                listView.forceActiveFocus()
+            // Row 0 is the likeliest source. One that was shared before can
+            // still arrive after others and take row 0, keep it highlighted
+            // until the user picks something else.
+            property bool moved: false
+
+            Connections {
+                target: root.sourceModel
+                function onRowsInserted(parent: var, first: int) {
+                    if (first === 0 && !listView.moved)
+                        listView.currentIndex = 0
+                }
             }
 
             keyNavigationEnabled: true
             keyNavigationWraps: true
 
-            model: sourceModel
+            model: root.sourceModel
 
             highlight: Rectangle {
                 color: "transparent"
@@ -46,39 +105,64 @@ BaseSidebarShellOverlay {
 
             delegate: PressableListDelegate {
                 id: sourceDelegate
+
+                required property int index
+                required property int type
+                required property string displayName
+                required property string iconName
+
                 width: listView.width
                 height: 56
                 padding: 20
 
                 activeAndHighlighted: listView.currentIndex == index
 
-                onClicked: listView.currentIndex = index
-                onDoubleClicked: {
-                    root.sourceSelected(index)
-                    root.closeAnimation()
+                onClicked: {
+                    listView.moved = true
+                    listView.currentIndex = index
                 }
-
-                contentItem: UniLabel {
-                    text: (model.type == 0 ? "[Monitor] " : "") + model.displayName
-                    font.pointSize: 13
-                    leftPadding: 20
-                    rightPadding: 24
-                    animDelay: 100 + (index * 70)
-                    animDuration: 200
-                    verticalAlignment: Text.AlignVCenter
+                onDoubleClicked: root.confirm(index)
+
+                contentItem: RowLayout {
+                    spacing: 0
+
+                    Image {
+                        Layout.leftMargin: 20
+                        Layout.preferredWidth: 24
+                        Layout.preferredHeight: 24
+                        // Looked up and decoded off the GUI thread
+                        source: "image://appicon/" + sourceDelegate.iconName
+                        sourceSize: Qt.size(24, 24)
+                        asynchronous: true
+                        fillMode: Image.PreserveAspectFit
+                    }
+
+                    UniLabel {
+                        Layout.fillWidth: true
+                        text: (sourceDelegate.type === SourceSelector.Monitor ? "[Monitor] " : "") + sourceDelegate.displayName
+                        font.pointSize: 13
+                        leftPadding: 12
+                        rightPadding: 24
+                        // Capped so long lists don't keep animating in for seconds
+                        animDelay: 100 + (Math.min(sourceDelegate.index, 8) * 70)
+                        animDuration: 200
+                        verticalAlignment: Text.AlignVCenter
+                    }
                 }
             }
 
             ScrollBar.vertical: ScrollBar {}
 
-            Keys.onReturnPressed: {
-                root.sourceSelected(currentIndex)
-                root.closeAnimation()
-            }
+            Keys.onReturnPressed: root.confirm(currentIndex)
+            Keys.onEscapePressed: root.cancel()
 
-            Keys.onEscapePressed: {
-                root.cancelled()
-                root.closeAnimation()
+            // Typing anywhere in the list goes to the search field
+            Keys.onPressed: (event: KeyEvent) => {
+                if (event.text.length > 0 && event.text.charCodeAt(0) >= 32) {
+                    searchField.forceActiveFocus()
+                    searchField.insert(searchField.length, event.text)
+                    event.accepted = true
+                }
             }
         }
 
@@ -89,19 +173,13 @@ BaseSidebarShellOverlay {
 
             UniButton {
                 text: "Cancel"
-                onClicked: {
-                    root.cancelled()
-                    root.closeAnimation()
-                }
+                onClicked: root.cancel()
             }
 
             UniButton {
-                text: "Share to " + selectorApi.getAppDisplayName(requestAppId)
+                text: "Share to " + root.selectorApi.getAppDisplayName(root.requestAppId)
                 highlighted: true
-                onClicked: {
-                    root.sourceSelected(listView.currentIndex)
-                    root.closeAnimation()
-                }
+                onClicked: root.confirm(listView.currentIndex)
             }
         }
     }
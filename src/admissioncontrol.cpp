@@ -0,0 +1,198 @@
+#include "admissioncontrol.h"
+#include "logging.h"
+#include "tracering.h"
+#include <QDeadlineTimer>
+
+static qint64 nowMs()
+{
+    return QDeadlineTimer::current().deadline();
+}
+
+AdmissionControl::AdmissionControl(const Limits &perApp, const Limits &global)
+    : m_perApp(perApp)
+    , m_global(global)
+{
+    // A rate without a burst allows one second's worth at once
+    for (Limits *limits : { &m_perApp, &m_global }) {
+        if (limits->rate > 0 && limits->burst <= 0) {
+            limits->burst = qMax(1, int(limits->rate));
+        }
+    }
+}
+
+void AdmissionControl::refill(Bucket &bucket, const Limits &limits, qint64 now)
+{
+    if (limits.rate <= 0) {
+        return;
+    }
+
+    if (bucket.tokens < 0) {
+        bucket.tokens = limits.burst;
+    } else {
+        bucket.tokens = qMin<double>(limits.burst, bucket.tokens + (now - bucket.refilledMs) * limits.rate / 1000.0);
+    }
+    bucket.refilledMs = now;
+}
+
+bool AdmissionControl::hasToken(const Bucket &bucket, const Limits &limits)
+{
+    return limits.rate <= 0 || bucket.tokens >= 1;
+}
+
+AdmissionControl::Verdict AdmissionControl::reject(Verdict verdict, const QString &appId)
+{
+    ++m_rejections[verdict];
+    qCDebug(lcScreenCast) << "Refused" << appId << verdictName(verdict);
+    traceEvent("admission-refused", appId, verdict);
+    return verdict;
+}
+
+AdmissionControl::Verdict AdmissionControl::admitRequest(const QString &appId)
+{
+    const qint64 now = nowMs();
+    if (++m_requestsSinceSweep >= SweepEvery) {
+        sweep(now);
+    }
+
+    auto it = m_apps.find(appId);
+    if (it == m_apps.end()) {
+        it = m_apps.insert(appId, Usage());
+    }
+    refill(it->bucket, m_perApp, now);
+    refill(m_total.bucket, m_global, now);
+
+    // Both or neither: one noisy app can't drain the global bucket, and a
+    // request the global one refuses doesn't cost the app a token
+    if (!hasToken(it->bucket, m_perApp) || !hasToken(m_total.bucket, m_global)) {
+        prune(it, now);
+        return reject(RateLimited, appId);
+    }
+    if (m_perApp.rate > 0) {
+        it->bucket.tokens -= 1;
+    }
+    if (m_global.rate > 0) {
+        m_total.bucket.tokens -= 1;
+    }
+
+    prune(it, now);
+    return Admitted;
+}
+
+AdmissionControl::Verdict AdmissionControl::admitSession(const QString &appId)
+{
+    const Verdict rate = admitRequest(appId);
+    if (rate != Admitted) {
+        return rate;
+    }
+
+    auto app = m_apps.find(appId);
+    if (app == m_apps.end()) {
+        app = m_apps.insert(appId, Usage());
+    }
+    if ((m_perApp.sessions > 0 && app->sessions >= m_perApp.sessions)
+        || (m_global.sessions > 0 && m_total.sessions >= m_global.sessions)) {
+        prune(app, nowMs());
+        return reject(TooManySessions, appId);
+    }
+
+    ++app->sessions;
+    ++m_total.sessions;
+    return Admitted;
+}
+
+AdmissionControl::Verdict AdmissionControl::admitStream(const QString &appId)
+{
+    const Verdict rate = admitRequest(appId);
+    if (rate != Admitted) {
+        return rate;
+    }
+
+    auto app = m_apps.find(appId);
+    if (app == m_apps.end()) {
+        app = m_apps.insert(appId, Usage());
+    }
+    if ((m_perApp.streams > 0 && app->streams >= m_perApp.streams)
+        || (m_global.streams > 0 && m_total.streams >= m_global.streams)) {
+        prune(app, nowMs());
+        return reject(TooManyStreams, appId);
+    }
+
+    ++app->streams;
+    ++m_total.streams;
+    return Admitted;
+}
+
+void AdmissionControl::releaseSession(const QString &appId)
+{
+    auto it = m_apps.find(appId);
+    if (it == m_apps.end() || it->sessions == 0) {
+        return;
+    }
+    --it->sessions;
+    --m_total.sessions;
+    prune(it, nowMs());
+}
+
+void AdmissionControl::releaseStream(const QString &appId)
+{
+    auto it = m_apps.find(appId);
+    if (it == m_apps.end() || it->streams == 0) {
+        return;
+    }
+    --it->streams;
+    --m_total.streams;
+    prune(it, nowMs());
+}
+
+bool AdmissionControl::isIdle(const Usage &usage, qint64 now) const
+{
+    if (usage.sessions > 0 || usage.streams > 0) {
+        return false;
+    }
+
+    // Dropping a bucket that isn't full yet would hand out a fresh burst
+    const Bucket &bucket = usage.bucket;
+    return m_perApp.rate <= 0 || bucket.tokens < 0
+        || bucket.tokens + (now - bucket.refilledMs) * m_perApp.rate / 1000.0 >= m_perApp.burst;
+}
+
+void AdmissionControl::prune(QHash<QString, Usage>::iterator it, qint64 now)
+{
+    if (isIdle(*it, now)) {
+        m_apps.erase(it);
+    }
+}
+
+void AdmissionControl::sweep(qint64 now)
+{
+    m_requestsSinceSweep = 0;
+    for (auto it = m_apps.begin(); it != m_apps.end(); ) {
+        it = isIdle(*it, now) ? m_apps.erase(it) : std::next(it);
+    }
+}
+
+QVariantMap AdmissionControl::stats() const
+{
+    QVariantMap rejected;
+    for (int verdict = TooManySessions; verdict <= RateLimited; ++verdict) {
+        rejected.insert(QLatin1String(verdictName(Verdict(verdict))), m_rejections[verdict]);
+    }
+
+    return {
+        { "rejected", rejected },
+        { "sessions", m_total.sessions },
+        { "streams", m_total.streams },
+        { "apps", int(m_apps.size()) },
+    };
+}
+
+const char *AdmissionControl::verdictName(Verdict verdict)
+{
+    switch (verdict) {
+    case Admitted: return "admitted";
+    case TooManySessions: return "too_many_sessions";
+    case TooManyStreams: return "too_many_streams";
+    case RateLimited: return "rate_limited";
+    }
+    return "?";
+}
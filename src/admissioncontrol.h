@@ -0,0 +1,76 @@
+#ifndef ADMISSIONCONTROL_H
+#define ADMISSIONCONTROL_H
+
+#include "portalconfig.h"
+#include <QHash>
+#include <QString>
+#include <QVariantMap>
+#include <array>
+
+// Limits on what one app, and everyone together, may ask of the compositor:
+// concurrent sessions and streams, and a token bucket on the request rate.
+// Checked before anything goes to Niri, so a client stuck in a
+// CreateSession/Start loop only ever costs a hash lookup and a counter.
+class AdmissionControl
+{
+public:
+    using Limits = PortalConfig::Limits;
+
+    enum Verdict {
+        Admitted,
+        TooManySessions,
+        TooManyStreams,
+        RateLimited,
+    };
+
+    AdmissionControl(const Limits &perApp, const Limits &global);
+
+    // Each takes one request token, and for sessions and streams a slot that
+    // the matching release gives back
+    Verdict admitRequest(const QString &appId);
+    Verdict admitSession(const QString &appId);
+    Verdict admitStream(const QString &appId);
+    void releaseSession(const QString &appId);
+    void releaseStream(const QString &appId);
+
+    // Rejections by reason plus what's held right now, for the Debug interface
+    QVariantMap stats() const;
+    quint64 rejections(Verdict verdict) const { return m_rejections[verdict]; }
+
+    static const char *verdictName(Verdict verdict);
+
+private:
+    struct Bucket {
+        double tokens = -1; // full on first use
+        qint64 refilledMs = 0;
+    };
+
+    struct Usage {
+        int sessions = 0;
+        int streams = 0;
+        Bucket bucket;
+    };
+
+    // Every this many requests, drop the apps that went quiet
+    static constexpr int SweepEvery = 64;
+
+    static void refill(Bucket &bucket, const Limits &limits, qint64 nowMs);
+    static bool hasToken(const Bucket &bucket, const Limits &limits);
+    Verdict reject(Verdict verdict, const QString &appId);
+    // Holding nothing and the bucket has refilled, nothing to remember
+    bool isIdle(const Usage &usage, qint64 nowMs) const;
+    // Forget idle apps, so the table doesn't grow with every app id ever
+    // seen: one right away, all of them now and then for the apps that only
+    // ever made requests or were refused
+    void prune(QHash<QString, Usage>::iterator it, qint64 nowMs);
+    void sweep(qint64 nowMs);
+
+    Limits m_perApp;
+    Limits m_global;
+    QHash<QString, Usage> m_apps;
+    Usage m_total;
+    int m_requestsSinceSweep = 0;
+    std::array<quint64, RateLimited + 1> m_rejections{};
+};
+
+#endif // ADMISSIONCONTROL_H
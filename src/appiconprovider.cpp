@@ -0,0 +1,224 @@
+#include "appiconprovider.h"
+#include "desktopentry.h"
+#include "logging.h"
+#include <QFileInfo>
+#include <QIcon>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QSettings>
+#include <algorithm>
+
+// Enough for a few hundred 48px icons
+static constexpr qsizetype IconCacheBytes = 8 * 1024 * 1024;
+static constexpr int DefaultIconSize = 48;
+
+AppIconCache &AppIconCache::instance()
+{
+    static AppIconCache cache;
+    return cache;
+}
+
+AppIconCache::AppIconCache()
+    : m_images(IconCacheBytes)
+{
+    // Decoding is short and bursty, two threads keep up with scrolling
+    m_pool.setMaxThreadCount(2);
+    m_pool.setObjectName(QStringLiteral("AppIconPool"));
+}
+
+bool AppIconCache::lookup(const QString &key, QImage *image)
+{
+    QMutexLocker locker(&m_mutex);
+    if (QImage *cached = m_images.object(key)) {
+        *image = *cached;
+        return true;
+    }
+    return false;
+}
+
+void AppIconCache::insert(const QString &key, const QImage &image)
+{
+    QMutexLocker locker(&m_mutex);
+    m_images.insert(key, new QImage(image), qMax<qsizetype>(1, image.sizeInBytes()));
+}
+
+bool AppIconCache::lookupPath(const QString &appId, QString *path)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_paths.constFind(appId);
+    if (it == m_paths.constEnd()) {
+        return false;
+    }
+    *path = it.value();
+    return true;
+}
+
+void AppIconCache::insertPath(const QString &appId, const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    m_paths.insert(appId, path);
+}
+
+AppIconProvider::AppIconProvider()
+    // QIcon's theme settings belong to the GUI thread, grab them up front
+    : m_themeName(QIcon::themeName())
+    , m_themeSearchPaths(QIcon::themeSearchPaths())
+{
+}
+
+QQuickImageResponse *AppIconProvider::requestImageResponse(const QString &id, const QSize &requestedSize)
+{
+    auto *response = new AppIconResponse(id, requestedSize, m_themeName, m_themeSearchPaths);
+    AppIconCache::instance().pool()->start(response);
+    return response;
+}
+
+AppIconResponse::AppIconResponse(const QString &id, const QSize &requestedSize,
+                                 const QString &themeName, const QStringList &themeSearchPaths)
+    : m_id(id)
+    , m_requestedSize(requestedSize)
+    , m_themeName(themeName)
+    , m_themeSearchPaths(themeSearchPaths)
+{
+    // Qt deletes the response once it has seen finished()
+    setAutoDelete(false);
+}
+
+QQuickTextureFactory *AppIconResponse::textureFactory() const
+{
+    return QQuickTextureFactory::textureFactoryForImage(m_image);
+}
+
+void AppIconResponse::run()
+{
+    const QSize target = m_requestedSize.isValid() && !m_requestedSize.isEmpty()
+                             ? m_requestedSize
+                             : QSize(DefaultIconSize, DefaultIconSize);
+    const QString key = QStringLiteral("%1@%2x%3").arg(m_id).arg(target.width()).arg(target.height());
+
+    AppIconCache &cache = AppIconCache::instance();
+    if (m_cancelled || cache.lookup(key, &m_image)) {
+        emit finished();
+        return;
+    }
+
+    QString path;
+    if (!cache.lookupPath(m_id, &path)) {
+        path = resolveIconPath(m_id, qMax(target.width(), target.height()), m_themeName, m_themeSearchPaths);
+        cache.insertPath(m_id, path);
+    }
+
+    if (!path.isEmpty() && !m_cancelled) {
+        QImageReader reader(path);
+        QSize scaled = reader.size();
+        if (scaled.isValid()) {
+            scaled.scale(target, Qt::KeepAspectRatio);
+        } else {
+            scaled = target;
+        }
+        // SVG renders straight at the target size, bitmaps get scaled below
+        reader.setScaledSize(scaled);
+
+        m_image = reader.read();
+        if (m_image.isNull()) {
+            qCDebug(lcSelector) << "Failed to decode icon" << path << reader.errorString();
+        } else {
+            if (m_image.width() > target.width() || m_image.height() > target.height()) {
+                m_image = m_image.scaled(target, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            }
+            cache.insert(key, m_image);
+        }
+    }
+
+    emit finished();
+}
+
+static QStringList themeChain(const QString &themeName, const QStringList &searchPaths)
+{
+    QStringList themes;
+    QStringList pending{ themeName };
+
+    while (!pending.isEmpty() && themes.size() < 8) {
+        const QString theme = pending.takeFirst();
+        if (theme.isEmpty() || themes.contains(theme)) {
+            continue;
+        }
+        themes.append(theme);
+
+        for (const QString &base : searchPaths) {
+            const QString index = base + QLatin1Char('/') + theme + QStringLiteral("/index.theme");
+            if (QFileInfo::exists(index)) {
+                QSettings settings(index, QSettings::IniFormat);
+                pending += settings.value(QStringLiteral("Icon Theme/Inherits")).toStringList();
+                break;
+            }
+        }
+    }
+
+    if (!themes.contains(QStringLiteral("hicolor"))) {
+        themes.append(QStringLiteral("hicolor"));
+    }
+    return themes;
+}
+
+QString AppIconResponse::resolveIconPath(const QString &appId, int size,
+                                         const QString &themeName, const QStringList &themeSearchPaths)
+{
+    // Windows report an app id, the desktop entry knows the actual icon
+    QString iconName = appId;
+    const DesktopEntry entry = findDesktopEntry(appId.toStdString(), applicationSearchPaths());
+    if (entry.found && !entry.icon.empty()) {
+        iconName = QString::fromStdString(entry.icon);
+    }
+
+    if (QFileInfo(iconName).isAbsolute()) {
+        return QFileInfo::exists(iconName) ? iconName : QString();
+    }
+
+    // Closest fixed size first, scalable when nothing fits
+    QList<int> sizes{ 16, 22, 24, 32, 48, 64, 96, 128, 256, 512 };
+    std::sort(sizes.begin(), sizes.end(), [size](int a, int b) {
+        const int da = a >= size ? a - size : (size - a) * 4; // upscaling looks worse
+        const int db = b >= size ? b - size : (size - b) * 4;
+        return da < db;
+    });
+
+    for (const QString &theme : themeChain(themeName, themeSearchPaths)) {
+        for (const QString &base : themeSearchPaths) {
+            const QString themeDir = base + QLatin1Char('/') + theme + QLatin1Char('/');
+            if (!QFileInfo::exists(themeDir)) {
+                continue;
+            }
+
+            for (int candidate : sizes) {
+                for (const QString &layout : { QStringLiteral("%1x%1/apps/"), QStringLiteral("apps/%1/"),
+                                               QStringLiteral("%1x%1/devices/"), QStringLiteral("devices/%1/") }) {
+                    const QString dir = themeDir + layout.arg(candidate);
+                    for (const char *extension : { ".png", ".svg" }) {
+                        const QString path = dir + iconName + QLatin1String(extension);
+                        if (QFileInfo::exists(path)) {
+                            return path;
+                        }
+                    }
+                }
+            }
+
+            for (const QString &layout : { QStringLiteral("scalable/apps/"), QStringLiteral("apps/scalable/"),
+                                           QStringLiteral("scalable/devices/"), QStringLiteral("devices/scalable/") }) {
+                const QString path = themeDir + layout + iconName + QStringLiteral(".svg");
+                if (QFileInfo::exists(path)) {
+                    return path;
+                }
+            }
+        }
+    }
+
+    for (const char *extension : { ".png", ".svg", ".xpm" }) {
+        const QString path = QStringLiteral("/usr/share/pixmaps/") + iconName + QLatin1String(extension);
+        if (QFileInfo::exists(path)) {
+            return path;
+        }
+    }
+
+    return QString();
+}
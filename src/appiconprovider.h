@@ -0,0 +1,79 @@
+#ifndef APPICONPROVIDER_H
+#define APPICONPROVIDER_H
+
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QQuickAsyncImageProvider>
+#include <QRunnable>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+
+// Decoded app icons, shared by every picker the portal opens. The cache is
+// bounded by decoded bytes and evicts least recently used icons first.
+class AppIconCache
+{
+public:
+    static AppIconCache &instance();
+
+    bool lookup(const QString &key, QImage *image);
+    void insert(const QString &key, const QImage &image);
+
+    // appId -> icon file, empty when nothing was found
+    bool lookupPath(const QString &appId, QString *path);
+    void insertPath(const QString &appId, const QString &path);
+
+    QThreadPool *pool() { return &m_pool; }
+
+private:
+    AppIconCache();
+
+    QMutex m_mutex;
+    QCache<QString, QImage> m_images;
+    QHash<QString, QString> m_paths;
+    QThreadPool m_pool;
+};
+
+// image://appicon/<app id or icon name>
+//
+// The desktop entry lookup, icon theme search and decoding all happen on the
+// cache's worker pool, at the size the delegate asked for.
+class AppIconProvider : public QQuickAsyncImageProvider
+{
+public:
+    AppIconProvider();
+
+    QQuickImageResponse *requestImageResponse(const QString &id, const QSize &requestedSize) override;
+
+private:
+    QString m_themeName;
+    QStringList m_themeSearchPaths;
+};
+
+class AppIconResponse : public QQuickImageResponse, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    AppIconResponse(const QString &id, const QSize &requestedSize,
+                    const QString &themeName, const QStringList &themeSearchPaths);
+
+    QQuickTextureFactory *textureFactory() const override;
+    void cancel() override { m_cancelled = true; }
+    void run() override;
+
+    static QString resolveIconPath(const QString &appId, int size,
+                                   const QString &themeName, const QStringList &themeSearchPaths);
+
+private:
+    QString m_id;
+    QSize m_requestedSize;
+    QString m_themeName;
+    QStringList m_themeSearchPaths;
+    QImage m_image;
+    std::atomic<bool> m_cancelled{false};
+};
+
+#endif // APPICONPROVIDER_H
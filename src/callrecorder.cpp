@@ -0,0 +1,142 @@
+#include "callrecorder.h"
+#include "logging.h"
+
+static constexpr quint32 Magic = 0x554e4952; // "UNIR"
+static constexpr quint32 FormatVersion = 1;
+
+CallRecorder &CallRecorder::instance()
+{
+    static CallRecorder recorder;
+    return recorder;
+}
+
+bool CallRecorder::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(lcPortal) << "Could not record calls to" << path << m_file.errorString();
+        return false;
+    }
+
+    m_stream.setDevice(&m_file);
+    m_stream.setVersion(QDataStream::Qt_6_0);
+    m_stream << Magic << FormatVersion;
+    m_file.flush();
+
+    qCInfo(lcPortal) << "Recording calls to" << path;
+    return true;
+}
+
+void CallRecorder::close()
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    m_stream.setDevice(nullptr);
+    m_file.close();
+    m_clock.invalidate();
+    m_clients.clear();
+    m_sessions.clear();
+    m_nextSession = 0;
+}
+
+void CallRecorder::record(const QDBusMessage &message, const QString &sessionHandle,
+                          const QString &appId, const QVariantMap &options)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    static const QHash<QString, Method> methods = {
+        { QStringLiteral("CreateSession"), CreateSession },
+        { QStringLiteral("SelectSources"), SelectSources },
+        { QStringLiteral("Start"), Start },
+        { QStringLiteral("Close"), Close },
+    };
+    const auto method = methods.constFind(message.member());
+    if (method == methods.cend()) {
+        return;
+    }
+
+    if (!m_clock.isValid()) {
+        m_clock.start();
+    }
+
+    const quint16 client = m_clients.value(message.service(), quint16(m_clients.size()));
+    m_clients.insert(message.service(), client);
+
+    quint32 session;
+    if (*method == Close) {
+        session = m_sessions.contains(sessionHandle) ? m_sessions.take(sessionHandle) : m_nextSession++;
+    } else {
+        auto it = m_sessions.find(sessionHandle);
+        if (it == m_sessions.end()) {
+            it = m_sessions.insert(sessionHandle, m_nextSession++);
+        }
+        session = *it;
+    }
+
+    // Nested D-Bus values don't survive QDataStream, and none of the
+    // screencast options are nested
+    QVariantMap plain;
+    for (auto it = options.cbegin(); it != options.cend(); ++it) {
+        if (it->metaType().id() < QMetaType::User) {
+            plain.insert(it.key(), *it);
+        }
+    }
+
+    m_stream << qint64(m_clock.nsecsElapsed() / 1000) << client << quint8(*method) << session
+             << appId << plain;
+
+    // A crashed portal still leaves a usable recording
+    m_file.flush();
+}
+
+bool CallRecorder::read(const QString &path, QList<Call> &calls)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(lcPortal) << "Could not open" << path << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != Magic || version != FormatVersion) {
+        qCWarning(lcPortal) << path << "is not a call recording, or from another version";
+        return false;
+    }
+
+    while (!stream.atEnd()) {
+        Call call;
+        quint8 method = 0;
+        stream >> call.offsetUs >> call.client >> method >> call.session >> call.appId >> call.options;
+        if (stream.status() != QDataStream::Ok || method > Close) {
+            // Cut short, e.g. the portal died mid-write
+            qCWarning(lcPortal) << path << "ends in a partial record, keeping" << calls.size() << "calls";
+            break;
+        }
+        call.method = Method(method);
+        calls.append(call);
+    }
+
+    return true;
+}
+
+const char *CallRecorder::methodName(Method method)
+{
+    switch (method) {
+    case CreateSession: return "CreateSession";
+    case SelectSources: return "SelectSources";
+    case Start: return "Start";
+    case Close: return "Close";
+    }
+    return "?";
+}
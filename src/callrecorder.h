@@ -0,0 +1,63 @@
+#ifndef CALLRECORDER_H
+#define CALLRECORDER_H
+
+#include <QDataStream>
+#include <QDBusMessage>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QVariantMap>
+
+// Records the screencast calls the portal receives, with their arrival
+// times, so uni-replay can play the same load back later. Off unless the
+// portal is started with UNI_PORTAL_RECORD=<file>.
+//
+// The file is a QDataStream: a header, then one small record per call.
+// Senders and session handles are stored as indexes, options only with
+// their plain values. Nothing that identifies the user goes in besides
+// app ids.
+class CallRecorder
+{
+public:
+    enum Method : quint8 {
+        CreateSession,
+        SelectSources,
+        Start,
+        Close,
+    };
+
+    struct Call {
+        qint64 offsetUs = 0; // since the first recorded call
+        quint16 client = 0;
+        Method method = CreateSession;
+        quint32 session = 0;
+        QString appId;
+        QVariantMap options;
+    };
+
+    static CallRecorder &instance();
+    static bool enabled() { return instance().m_file.isOpen(); }
+
+    bool open(const QString &path);
+    void close();
+
+    // Main thread only, like the adaptors calling it
+    void record(const QDBusMessage &message, const QString &sessionHandle,
+                const QString &appId = {}, const QVariantMap &options = {});
+
+    static bool read(const QString &path, QList<Call> &calls);
+    static const char *methodName(Method method);
+
+private:
+    CallRecorder() = default;
+
+    QFile m_file;
+    QDataStream m_stream;
+    QElapsedTimer m_clock;
+    QHash<QString, quint16> m_clients;  // by unique bus name
+    QHash<QString, quint32> m_sessions; // by handle, until closed
+    quint32 m_nextSession = 0;
+};
+
+#endif // CALLRECORDER_H
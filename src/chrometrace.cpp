@@ -0,0 +1,202 @@
+#include "chrometrace.h"
+#include "logging.h"
+#include <QCoreApplication>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+qint64 nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+std::atomic<bool> ChromeTrace::s_enabled{false};
+
+ChromeTrace &ChromeTrace::instance()
+{
+    static ChromeTrace trace;
+    return trace;
+}
+
+void ChromeTrace::setEnabled(bool enabled)
+{
+    if (enabled) {
+        clear();
+    }
+    s_enabled.store(enabled, std::memory_order_relaxed);
+    qCDebug(lcPortal) << "Chrome trace" << (enabled ? "on" : "off");
+}
+
+void ChromeTrace::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    for (const auto &buffer : m_buffers) {
+        QMutexLocker bufferLocker(&buffer->mutex);
+        buffer->events.clear();
+    }
+    m_dropped = 0;
+}
+
+ChromeTrace::ThreadBuffer *ChromeTrace::buffer()
+{
+    // The buffers outlive their threads, so a trace still shows what a
+    // finished pool thread did
+    thread_local ThreadBuffer *local = nullptr;
+    if (local) {
+        return local;
+    }
+
+    auto buffer = std::make_unique<ThreadBuffer>();
+    QThread *thread = QThread::currentThread();
+
+    QMutexLocker locker(&m_mutex);
+    buffer->tid = int(m_buffers.size()) + 1;
+    if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()) {
+        buffer->threadName = "main";
+    } else if (!thread->objectName().isEmpty()) {
+        buffer->threadName = thread->objectName().toUtf8();
+    } else {
+        buffer->threadName = "thread-" + QByteArray::number(buffer->tid);
+    }
+
+    local = buffer.get();
+    m_buffers.push_back(std::move(buffer));
+    return local;
+}
+
+void ChromeTrace::record(char phase, const char *name, QStringView request, quint64 id, qint64 value)
+{
+    if (!enabled()) {
+        return;
+    }
+
+    Event event;
+    event.timestampNs = nowNs();
+    event.name = name;
+    event.phase = phase;
+    event.id = id;
+    event.value = value;
+
+    // Same as the trace ring: paths and app ids are ASCII
+    const qsizetype length = std::min<qsizetype>(request.size(), RequestSize - 1);
+    for (qsizetype i = 0; i < length; ++i) {
+        const char16_t c = request[i].unicode();
+        event.request[i] = c < 0x80 ? char(c) : '?';
+    }
+    event.request[length] = '\0';
+
+    ThreadBuffer *local = buffer();
+    QMutexLocker locker(&local->mutex);
+    if (local->events.size() >= MaxEventsPerThread) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    local->events.append(event);
+}
+
+void ChromeTrace::begin(const char *name, QStringView request)
+{
+    record('B', name, request, 0, 0);
+}
+
+void ChromeTrace::end(const char *name)
+{
+    record('E', name, {}, 0, 0);
+}
+
+void ChromeTrace::asyncBegin(const char *name, QStringView request, quint64 id)
+{
+    record('b', name, request, id ? id : qHash(request), 0);
+}
+
+void ChromeTrace::asyncEnd(const char *name, QStringView request, quint64 id)
+{
+    record('e', name, request, id ? id : qHash(request), 0);
+}
+
+void ChromeTrace::instant(const char *name, QStringView request, qint64 value)
+{
+    record('i', name, request, 0, value);
+}
+
+QByteArray ChromeTrace::toJson() const
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+
+    QMutexLocker locker(&m_mutex);
+    for (const auto &buffer : m_buffers) {
+        QMutexLocker bufferLocker(&buffer->mutex);
+
+        events.append(QJsonObject{
+            { "name", "thread_name" },
+            { "ph", "M" },
+            { "pid", pid },
+            { "tid", buffer->tid },
+            { "args", QJsonObject{ { "name", QString::fromUtf8(buffer->threadName) } } },
+        });
+
+        for (const Event &event : std::as_const(buffer->events)) {
+            QJsonObject object{
+                { "name", QLatin1String(event.name) },
+                { "cat", "portal" },
+                { "ph", QString(QLatin1Char(event.phase)) },
+                { "ts", event.timestampNs / 1000.0 },
+                { "pid", pid },
+                { "tid", buffer->tid },
+            };
+
+            QJsonObject args;
+            if (event.request[0]) {
+                args.insert("request", QLatin1String(event.request));
+            }
+
+            switch (event.phase) {
+            case 'b':
+            case 'e':
+                object.insert("id", QStringLiteral("0x%1").arg(event.id, 0, 16));
+                break;
+            case 'i':
+                object.insert("s", "t");
+                args.insert("value", event.value);
+                break;
+            default:
+                break;
+            }
+
+            if (!args.isEmpty()) {
+                object.insert("args", args);
+            }
+            events.append(object);
+        }
+    }
+
+    return QJsonDocument(QJsonObject{
+        { "traceEvents", events },
+        { "displayTimeUnit", "ms" },
+    }).toJson(QJsonDocument::Compact);
+}
+
+bool ChromeTrace::write(const QString &path) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(toJson()) < 0 || !file.commit()) {
+        qCWarning(lcPortal) << "Could not write trace to" << path << file.errorString();
+        return false;
+    }
+
+    if (dropped() > 0) {
+        qCWarning(lcPortal) << "Trace in" << path << "is missing" << dropped() << "events, buffers were full";
+    }
+    return true;
+}
@@ -0,0 +1,123 @@
+#ifndef CHROMETRACE_H
+#define CHROMETRACE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QStringView>
+#include <QtGlobal>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Opt-in begin/end tracer for following one request phase by phase, written
+// out as Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Off by
+// default, where every call is a single relaxed load. When on, each thread
+// appends to its own buffer, so the render thread never waits on the GUI one.
+//
+//     busctl --user call org.freedesktop.impl.portal.desktop.uni /org/freedesktop/portal/desktop \
+//         org.freedesktop.impl.portal.desktop.uni.Debug SetTracing b true
+//     ... share something ...
+//     busctl --user call ... WriteTrace s /tmp/portal.json
+class ChromeTrace
+{
+public:
+    static constexpr int RequestSize = 64;
+    static constexpr int MaxEventsPerThread = 1 << 16;
+
+    static ChromeTrace &instance();
+
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Turning it on starts from an empty trace
+    void setEnabled(bool enabled);
+    void clear();
+
+    // Nested spans on the calling thread, use TraceSpan
+    void begin(const char *name, QStringView request = {});
+    void end(const char *name);
+
+    // Spans across event loop iterations, e.g. a call and its reply. Ends
+    // pair with the begin of the same name and id; without an id the request
+    // is the id.
+    void asyncBegin(const char *name, QStringView request, quint64 id = 0);
+    void asyncEnd(const char *name, QStringView request, quint64 id = 0);
+
+    void instant(const char *name, QStringView request = {}, qint64 value = 0);
+
+    QByteArray toJson() const;
+    bool write(const QString &path) const;
+
+    // Events lost to full buffers since the last clear()
+    int dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Event {
+        qint64 timestampNs;
+        const char *name; // must be a string literal
+        char phase;
+        quint64 id;
+        qint64 value;
+        char request[RequestSize];
+    };
+
+    struct ThreadBuffer {
+        QMutex mutex; // only contended while exporting
+        QList<Event> events;
+        int tid = 0;
+        QByteArray threadName;
+    };
+
+    ChromeTrace() = default;
+
+    ThreadBuffer *buffer();
+    void record(char phase, const char *name, QStringView request, quint64 id, qint64 value);
+
+    static std::atomic<bool> s_enabled;
+
+    mutable QMutex m_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers; // never shrinks, threads keep a pointer
+    std::atomic<int> m_dropped{0};
+};
+
+// Scoped span, nothing recorded when tracing is off
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, QStringView request = {})
+        : m_name(ChromeTrace::enabled() ? name : nullptr)
+    {
+        if (m_name) {
+            ChromeTrace::instance().begin(m_name, request);
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (m_name) {
+            ChromeTrace::instance().end(m_name);
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *m_name;
+};
+
+inline void traceAsyncBegin(const char *name, QStringView request, quint64 id = 0)
+{
+    if (ChromeTrace::enabled()) {
+        ChromeTrace::instance().asyncBegin(name, request, id);
+    }
+}
+
+inline void traceAsyncEnd(const char *name, QStringView request, quint64 id = 0)
+{
+    if (ChromeTrace::enabled()) {
+        ChromeTrace::instance().asyncEnd(name, request, id);
+    }
+}
+
+#endif // CHROMETRACE_H
@@ -0,0 +1,84 @@
+#include "desktopentry.h"
+#include <fstream>
+#include <filesystem>
+#include <cstdlib>
+
+struct ParsedEntry {
+    std::string name;
+    std::string icon;
+    std::string wmClass;
+};
+
+// Reads just the [Desktop Entry] keys we care about, in one pass
+static ParsedEntry parseDesktopFile(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    std::string line;
+    bool inDesktopEntry = false;
+    ParsedEntry parsed;
+    
+    while (std::getline(file, line)) {
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        
+        if (line == "[Desktop Entry]") {
+            inDesktopEntry = true;
+        } else if (line[0] == '[') {
+            if (inDesktopEntry) {
+                break; // only actions and such follow
+            }
+        } else if (!inDesktopEntry) {
+            continue;
+        } else if (parsed.name.empty() && line.find("Name=") == 0) {
+            parsed.name = line.substr(5);
+        } else if (parsed.icon.empty() && line.find("Icon=") == 0) {
+            parsed.icon = line.substr(5);
+        } else if (parsed.wmClass.empty() && line.find("StartupWMClass=") == 0) {
+            parsed.wmClass = line.substr(15);
+        }
+    }
+    return parsed;
+}
+
+std::vector<std::string> applicationSearchPaths() {
+    std::vector<std::string> searchPaths;
+    
+    if (const char* home = std::getenv("HOME")) {
+        searchPaths.push_back(std::string(home) + "/.local/share/applications/");
+    }
+    searchPaths.push_back("/usr/local/share/applications/");
+    searchPaths.push_back("/usr/share/applications/");
+    
+    return searchPaths;
+}
+
+DesktopEntry findDesktopEntry(const std::string& identifier, const std::vector<std::string>& searchPaths) {
+    // Search through all desktop files
+    for (const auto& searchPath : searchPaths) {
+        std::error_code error;
+        if (!std::filesystem::exists(searchPath, error)) continue;
+        
+        for (const auto& entry : std::filesystem::directory_iterator(searchPath, error)) {
+            if (entry.path().extension() != ".desktop") continue;
+            
+            std::string filename = entry.path().filename().string();
+            
+            // Check if filename matches (desktop ID), or else StartupWMClass
+            bool idMatches = filename == identifier || filename == identifier + ".desktop";
+            ParsedEntry parsed = parseDesktopFile(entry.path());
+            if (idMatches || parsed.wmClass == identifier) {
+                return { parsed.name, parsed.icon, true };
+            }
+        }
+    }
+    
+    return {};
+}
+
+std::string findDisplayName(const std::string& identifier) {
+    return findDisplayName(identifier, applicationSearchPaths());
+}
+
+std::string findDisplayName(const std::string& identifier, const std::vector<std::string>& searchPaths) {
+    DesktopEntry entry = findDesktopEntry(identifier, searchPaths);
+    return entry.found ? entry.name : identifier;
+}
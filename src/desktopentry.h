@@ -0,0 +1,24 @@
+#ifndef DESKTOPENTRY_H
+#define DESKTOPENTRY_H
+
+#include <string>
+#include <vector>
+
+struct DesktopEntry {
+    std::string name;
+    std::string icon; // Icon=, a theme icon name or an absolute path
+    bool found = false;
+};
+
+// $HOME/.local/share/applications, /usr/local/share/applications, /usr/share/applications
+std::vector<std::string> applicationSearchPaths();
+
+// Look up a desktop entry by desktop ID or StartupWMClass
+DesktopEntry findDesktopEntry(const std::string& identifier, const std::vector<std::string>& searchPaths);
+
+// Resolve a desktop ID or StartupWMClass to the entry's Name=.
+// Falls back to the identifier itself when nothing matches.
+std::string findDisplayName(const std::string& identifier);
+std::string findDisplayName(const std::string& identifier, const std::vector<std::string>& searchPaths);
+
+#endif // DESKTOPENTRY_H
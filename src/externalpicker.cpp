@@ -0,0 +1,198 @@
+#include "externalpicker.h"
+#include "chrometrace.h"
+#include "logging.h"
+#include "portalconfig.h"
+#include "tracering.h"
+#include "usagestats.h"
+#include <QDBusMetaType>
+#include <QDBusPendingCallWatcher>
+
+static const QString PickerClientInterface = QStringLiteral("org.freedesktop.impl.portal.desktop.uni.PickerClient");
+
+ExternalPicker::ExternalPicker(QObject *parent, const QDBusConnection &bus)
+    : QDBusAbstractAdaptor(parent)
+    , m_bus(bus)
+    , m_catalog(new SourceCatalog(bus, this))
+    , m_watcher(new QDBusServiceWatcher(this))
+{
+    // aa{sv} for Pick's sources
+    qDBusRegisterMetaType<QList<QVariantMap>>();
+
+    m_watcher->setConnection(m_bus);
+    m_watcher->setWatchMode(QDBusServiceWatcher::WatchForUnregistration);
+    connect(m_watcher, &QDBusServiceWatcher::serviceUnregistered, this, &ExternalPicker::onPickerGone);
+}
+
+bool ExternalPicker::RegisterPicker(const QDBusObjectPath &path, const QDBusMessage &message)
+{
+    const QString sender = message.service();
+    if (!m_picker.isEmpty() && m_picker != sender) {
+        qCWarning(lcSelector) << "Refused picker" << sender << "," << m_picker << "is registered";
+        return false;
+    }
+
+    m_watcher->setWatchedServices({ sender });
+    m_picker = sender;
+    m_pickerPath = path.path();
+
+    qCInfo(lcSelector) << "External picker" << sender << path.path();
+    traceEvent("picker-registered", sender);
+
+    // Likely to be asked for soon
+    m_catalog->fetch(this, [](const QVector<SourceSelector::Source> &) {});
+    return true;
+}
+
+void ExternalPicker::UnregisterPicker(const QDBusMessage &message)
+{
+    if (message.service() == m_picker) {
+        onPickerGone();
+    }
+}
+
+void ExternalPicker::onPickerGone()
+{
+    qCInfo(lcSelector) << "External picker" << m_picker << "is gone";
+    traceEvent("picker-gone", m_picker);
+
+    m_watcher->setWatchedServices({});
+    m_picker.clear();
+    m_pickerPath.clear();
+
+    // Whatever it was showing comes up in our own picker instead
+    const QStringList handles = m_pending.keys();
+    for (const QString &handle : handles) {
+        finish(handle, Unavailable);
+    }
+}
+
+void ExternalPicker::pick(const QString &handle, const QString &appId, uint types,
+                          QObject *context, Callback done)
+{
+    if (m_picker.isEmpty()) {
+        QMetaObject::invokeMethod(this, [context = QPointer<QObject>(context), done]() {
+            if (context) {
+                done(Unavailable, {});
+            }
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    m_pending.insert(handle, { context, std::move(done), appId, {}, false });
+    traceAsyncBegin("ExternalPicker", handle);
+
+    m_catalog->fetch(this, [this, handle, types](const QVector<SourceSelector::Source> &sources) {
+        auto it = m_pending.find(handle);
+        if (it == m_pending.end()) {
+            return;
+        }
+
+        for (const SourceSelector::Source &source : sources) {
+            const uint bit = source.type == SourceSelector::Window ? 2 : 1;
+            if (types == 0 || (types & bit)) {
+                it->sources.append(source);
+                it->sources.last().lastUsed = UsageStats::instance().lastUsed(it->appId, source.usageKey);
+            }
+        }
+        ask(handle);
+    });
+}
+
+void ExternalPicker::ask(const QString &handle)
+{
+    const Pending &pending = m_pending[handle];
+
+    QList<QVariantMap> sources;
+    sources.reserve(pending.sources.size());
+    for (const SourceSelector::Source &source : pending.sources) {
+        sources.append(QVariantMap{
+            { "type", uint(source.type) },
+            { "id", source.id },
+            { "name", source.displayName },
+            { "app_id", source.appId },
+            { "last_used", source.lastUsed },
+        });
+    }
+
+    QDBusMessage msg = QDBusMessage::createMethodCall(m_picker, m_pickerPath, PickerClientInterface, QStringLiteral("Pick"));
+    msg.setArguments({ QVariant::fromValue(QDBusObjectPath(handle)), pending.appId, QVariant::fromValue(sources), QVariantMap() });
+
+    auto *call = new QDBusPendingCallWatcher(m_bus.asyncCall(msg, PortalConfig::instance().pickerTimeoutMs), this);
+    connect(call, &QDBusPendingCallWatcher::finished, this, [this, call, handle]() {
+        call->deleteLater();
+
+        auto it = m_pending.find(handle);
+        if (it == m_pending.end()) {
+            return;
+        }
+
+        const QDBusMessage reply = call->reply();
+        if (reply.type() != QDBusMessage::ReplyMessage || !reply.arguments().value(0).toBool()) {
+            qCWarning(lcSelector) << "External picker didn't take" << handle << reply.errorMessage()
+                                  << "- using our own";
+            finish(handle, Unavailable);
+            return;
+        }
+        it->shown = true;
+    });
+}
+
+void ExternalPicker::Picked(const QDBusObjectPath &handle, uint response, const QString &sourceId,
+                            const QDBusMessage &message)
+{
+    // Only the picker we asked gets to answer
+    if (message.service() != m_picker) {
+        qCWarning(lcSelector) << "Ignoring Picked from" << message.service();
+        return;
+    }
+
+    auto it = m_pending.constFind(handle.path());
+    if (it == m_pending.cend()) {
+        return;
+    }
+
+    if (response != 0) {
+        finish(handle.path(), Cancelled);
+        return;
+    }
+
+    for (const SourceSelector::Source &source : it->sources) {
+        if (source.id == sourceId) {
+            UsageStats::instance().recordUse(it->appId, source.usageKey);
+            finish(handle.path(), Picked, source);
+            return;
+        }
+    }
+
+    qCWarning(lcSelector) << "External picker chose" << sourceId << "which it wasn't offered";
+    finish(handle.path(), Cancelled);
+}
+
+void ExternalPicker::cancel(const QString &handle)
+{
+    auto it = m_pending.find(handle);
+    if (it == m_pending.end()) {
+        return;
+    }
+
+    const bool shown = it->shown;
+    m_pending.erase(it);
+    traceAsyncEnd("ExternalPicker", handle);
+
+    if (shown && !m_picker.isEmpty()) {
+        QDBusMessage msg = QDBusMessage::createMethodCall(m_picker, m_pickerPath, PickerClientInterface, QStringLiteral("Cancel"));
+        msg.setArguments({ QVariant::fromValue(QDBusObjectPath(handle)) });
+        m_bus.send(msg);
+    }
+}
+
+void ExternalPicker::finish(const QString &handle, Outcome outcome, const SourceSelector::Source &source)
+{
+    Pending pending = m_pending.take(handle);
+    traceAsyncEnd("ExternalPicker", handle);
+    traceEvent("picker-outcome", handle, outcome);
+
+    if (pending.context && pending.done) {
+        pending.done(outcome, source);
+    }
+}
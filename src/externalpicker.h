@@ -0,0 +1,80 @@
+#ifndef EXTERNALPICKER_H
+#define EXTERNALPICKER_H
+
+#include "sourcecatalog.h"
+#include "sourceselector.h"
+#include <QDBusAbstractAdaptor>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusObjectPath>
+#include <QDBusServiceWatcher>
+#include <QHash>
+#include <QPointer>
+#include <functional>
+
+// Lets a running shell show source selection instead of our own QML window.
+// The shell registers an object implementing
+// org.freedesktop.impl.portal.desktop.uni.PickerClient:
+//
+//     Pick(o handle, s app_id, aa{sv} sources, a{sv} options) -> (b shown)
+//     Cancel(o handle)
+//
+// sources are the catalog's rows ("type" 0 monitor/1 window, "id", "name",
+// "app_id", "last_used" in ms). Pick has to answer within the configured
+// timeout; once it said it's shown, the shell reports the outcome through
+// Picked here, 0 with the chosen id or 1 for cancelled. Anything else (no
+// picker, a slow or failing Pick, the picker leaving the bus) ends up in
+// the built-in SourceSelector.
+//
+// One picker at a time: a second one is refused until the first is gone.
+class ExternalPicker : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.impl.portal.desktop.uni.Picker")
+
+public:
+    enum Outcome {
+        Picked,
+        Cancelled,
+        Unavailable, // use the built-in picker
+    };
+    using Callback = std::function<void(Outcome outcome, const SourceSelector::Source &source)>;
+
+    explicit ExternalPicker(QObject *parent = nullptr, const QDBusConnection &bus = QDBusConnection::sessionBus());
+
+    bool isRegistered() const { return !m_picker.isEmpty(); }
+    SourceCatalog *catalog() const { return m_catalog; }
+
+    // types is the portal's bitmask, 0 for both. done runs from the event
+    // loop, not at all once context is gone.
+    void pick(const QString &handle, const QString &appId, uint types, QObject *context, Callback done);
+    // The request was closed, the shell can take its picker down
+    void cancel(const QString &handle);
+
+public slots:
+    bool RegisterPicker(const QDBusObjectPath &path, const QDBusMessage &message);
+    void UnregisterPicker(const QDBusMessage &message);
+    void Picked(const QDBusObjectPath &handle, uint response, const QString &sourceId, const QDBusMessage &message);
+
+private:
+    struct Pending {
+        QPointer<QObject> context;
+        Callback done;
+        QString appId;
+        QVector<SourceSelector::Source> sources;
+        bool shown = false;
+    };
+
+    void ask(const QString &handle);
+    void finish(const QString &handle, Outcome outcome, const SourceSelector::Source &source = {});
+    void onPickerGone();
+
+    QDBusConnection m_bus;
+    SourceCatalog *m_catalog;
+    QDBusServiceWatcher *m_watcher;
+    QString m_picker; // unique name
+    QString m_pickerPath;
+    QHash<QString, Pending> m_pending; // by request handle
+};
+
+#endif // EXTERNALPICKER_H
@@ -0,0 +1,303 @@
+#include "framegrabber.h"
+#include "logging.h"
+#include "tracering.h"
+#include <functional>
+
+#ifdef HAVE_PIPEWIRE
+#include <pipewire/pipewire.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/param/buffers.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_PIPEWIRE
+
+struct FrameGrabber::Stream {
+    // Queues the result to the grabber's thread
+    std::function<void(const QImage &image, const QString &error)> deliver;
+    pw_thread_loop *loop = nullptr;
+    pw_context *context = nullptr;
+    pw_core *core = nullptr;
+    pw_stream *stream = nullptr;
+    spa_hook listener {};
+    spa_video_info_raw format {};
+    bool delivered = false; // PipeWire thread only
+};
+
+static QImage::Format imageFormat(spa_video_format format)
+{
+    // Byte order in memory, QImage's 32 bit formats are native endian words
+    switch (format) {
+    case SPA_VIDEO_FORMAT_BGRx: return QImage::Format_RGB32;
+    case SPA_VIDEO_FORMAT_BGRA: return QImage::Format_ARGB32;
+    case SPA_VIDEO_FORMAT_RGBx: return QImage::Format_RGBX8888;
+    case SPA_VIDEO_FORMAT_RGBA: return QImage::Format_RGBA8888;
+    default: return QImage::Format_Invalid;
+    }
+}
+
+// Copy the frame out, so the buffer can go straight back to the compositor
+static QImage copyFrame(const spa_video_info_raw &format, spa_data &data)
+{
+    const QImage::Format qformat = imageFormat(format.format);
+    if (qformat == QImage::Format_Invalid || !data.chunk || data.chunk->size == 0) {
+        return QImage();
+    }
+
+    const int width = int(format.size.width);
+    const int height = int(format.size.height);
+    const int stride = data.chunk->stride > 0 ? data.chunk->stride : width * 4;
+
+    // Without a modifier the compositor hands out linear DMA-BUFs, which can
+    // be read through a plain mapping. MemFd and MemPtr are mapped already.
+    void *mapped = nullptr;
+    const uchar *pixels = static_cast<const uchar *>(data.data);
+    if (!pixels && data.type == SPA_DATA_DmaBuf) {
+        mapped = mmap(nullptr, data.maxsize + data.mapoffset, PROT_READ, MAP_SHARED, int(data.fd), 0);
+        if (mapped == MAP_FAILED) {
+            return QImage();
+        }
+        pixels = static_cast<const uchar *>(mapped) + data.mapoffset;
+    }
+    if (!pixels) {
+        return QImage();
+    }
+
+    QImage image = QImage(pixels + data.chunk->offset, width, height, stride, qformat).copy();
+
+    if (mapped) {
+        munmap(mapped, data.maxsize + data.mapoffset);
+    }
+    return image;
+}
+
+static void onStateChanged(void *userdata, pw_stream_state old, pw_stream_state state, const char *error)
+{
+    Q_UNUSED(old)
+    auto *stream = static_cast<FrameGrabber::Stream *>(userdata);
+
+    if (state == PW_STREAM_STATE_ERROR && !stream->delivered) {
+        stream->delivered = true;
+        stream->deliver(QImage(), QString::fromUtf8(error ? error : "stream error"));
+    }
+}
+
+static void onParamChanged(void *userdata, uint32_t id, const spa_pod *param)
+{
+    auto *stream = static_cast<FrameGrabber::Stream *>(userdata);
+    if (!param || id != SPA_PARAM_Format) {
+        return;
+    }
+
+    spa_video_info_raw format {};
+    if (spa_format_video_raw_parse(param, &format) < 0) {
+        return;
+    }
+    stream->format = format;
+
+    // Only buffers we can read from the CPU
+    uint8_t buffer[256];
+    spa_pod_builder builder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+    const spa_pod *params[] = {
+        static_cast<const spa_pod *>(spa_pod_builder_add_object(&builder,
+            SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+            SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(
+                (1 << SPA_DATA_MemPtr) | (1 << SPA_DATA_MemFd) | (1 << SPA_DATA_DmaBuf)))),
+    };
+    pw_stream_update_params(stream->stream, params, 1);
+}
+
+static void onProcess(void *userdata)
+{
+    auto *stream = static_cast<FrameGrabber::Stream *>(userdata);
+
+    pw_buffer *buffer = pw_stream_dequeue_buffer(stream->stream);
+    if (!buffer) {
+        return;
+    }
+
+    if (!stream->delivered && buffer->buffer->n_datas > 0) {
+        spa_data &data = buffer->buffer->datas[0];
+        if (!data.chunk || !(data.chunk->flags & SPA_CHUNK_FLAG_CORRUPTED)) {
+            QImage image = copyFrame(stream->format, data);
+            if (!image.isNull()) {
+                stream->delivered = true;
+                stream->deliver(image, QString());
+            }
+        }
+    }
+
+    pw_stream_queue_buffer(stream->stream, buffer);
+}
+
+static const pw_stream_events streamEvents = {
+    .version = PW_VERSION_STREAM_EVENTS,
+    .state_changed = onStateChanged,
+    .param_changed = onParamChanged,
+    .process = onProcess,
+};
+
+#else
+
+struct FrameGrabber::Stream {};
+
+#endif // HAVE_PIPEWIRE
+
+FrameGrabber::FrameGrabber(QObject *parent)
+    : QObject(parent)
+{
+    m_timeout.setSingleShot(true);
+    connect(&m_timeout, &QTimer::timeout, this, [this]() {
+        finish(QImage(), QStringLiteral("Timed out waiting for a frame"));
+    });
+
+    // Whatever comes first wins, the rest is dropped in finish()
+    connect(this, &FrameGrabber::frameReady, this, [this]() { stop(); });
+    connect(this, &FrameGrabber::failed, this, [this]() { stop(); });
+}
+
+FrameGrabber::~FrameGrabber()
+{
+    stop();
+}
+
+bool FrameGrabber::isSupported()
+{
+#ifdef HAVE_PIPEWIRE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FrameGrabber::grab(uint nodeId, int timeoutMs)
+{
+    traceEvent("grab-frame", {}, nodeId);
+
+#ifdef HAVE_PIPEWIRE
+    static const bool initialized = [] {
+        pw_init(nullptr, nullptr);
+        return true;
+    }();
+    Q_UNUSED(initialized)
+
+    m_stream = new Stream;
+    m_stream->deliver = [this](const QImage &image, const QString &error) {
+        QMetaObject::invokeMethod(this, [this, image, error]() {
+            finish(image, error);
+        }, Qt::QueuedConnection);
+    };
+    m_stream->loop = pw_thread_loop_new("uni-screenshot", nullptr);
+    m_stream->context = pw_context_new(pw_thread_loop_get_loop(m_stream->loop), nullptr, 0);
+    if (!m_stream->context || pw_thread_loop_start(m_stream->loop) < 0) {
+        finish(QImage(), QStringLiteral("Failed to start the PipeWire loop"));
+        return;
+    }
+
+    pw_thread_loop_lock(m_stream->loop);
+
+    m_stream->core = pw_context_connect(m_stream->context, nullptr, 0);
+    if (!m_stream->core) {
+        pw_thread_loop_unlock(m_stream->loop);
+        finish(QImage(), QStringLiteral("Failed to connect to PipeWire"));
+        return;
+    }
+
+    m_stream->stream = pw_stream_new(m_stream->core, "uni-portal-screenshot",
+        pw_properties_new(PW_KEY_MEDIA_TYPE, "Video",
+                          PW_KEY_MEDIA_CATEGORY, "Capture",
+                          PW_KEY_MEDIA_ROLE, "Screen",
+                          nullptr));
+    pw_stream_add_listener(m_stream->stream, &m_stream->listener, &streamEvents, m_stream);
+
+    // Any size, packed 32 bit formats only
+    spa_rectangle defaultSize { 1920, 1080 };
+    spa_rectangle minSize { 1, 1 };
+    spa_rectangle maxSize { 16384, 16384 };
+    spa_fraction defaultRate { 0, 1 };
+    spa_fraction minRate { 0, 1 };
+    spa_fraction maxRate { 1000, 1 };
+
+    uint8_t buffer[1024];
+    spa_pod_builder builder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+    const spa_pod *params[] = {
+        static_cast<const spa_pod *>(spa_pod_builder_add_object(&builder,
+            SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+            SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
+            SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+            SPA_FORMAT_VIDEO_format, SPA_POD_CHOICE_ENUM_Id(5,
+                SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_BGRA,
+                SPA_VIDEO_FORMAT_RGBx, SPA_VIDEO_FORMAT_RGBA),
+            SPA_FORMAT_VIDEO_size, SPA_POD_CHOICE_RANGE_Rectangle(&defaultSize, &minSize, &maxSize),
+            SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(&defaultRate, &minRate, &maxRate))),
+    };
+
+    const int result = pw_stream_connect(m_stream->stream, PW_DIRECTION_INPUT, nodeId,
+        static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS),
+        params, 1);
+
+    pw_thread_loop_unlock(m_stream->loop);
+
+    if (result < 0) {
+        finish(QImage(), QStringLiteral("Failed to connect to node %1").arg(nodeId));
+        return;
+    }
+
+    m_timeout.start(timeoutMs);
+#else
+    Q_UNUSED(nodeId)
+    Q_UNUSED(timeoutMs)
+    // Queued, callers connect after calling grab()
+    QMetaObject::invokeMethod(this, [this]() {
+        finish(QImage(), QStringLiteral("Built without PipeWire"));
+    }, Qt::QueuedConnection);
+#endif
+}
+
+void FrameGrabber::finish(const QImage &image, const QString &error)
+{
+    if (m_finished) {
+        return;
+    }
+    m_finished = true;
+
+    if (image.isNull()) {
+        qCWarning(lcScreenshot) << "Frame grab failed:" << error;
+        emit failed(error);
+    } else {
+        emit frameReady(image);
+    }
+}
+
+void FrameGrabber::stop()
+{
+    m_timeout.stop();
+
+#ifdef HAVE_PIPEWIRE
+    if (!m_stream) {
+        return;
+    }
+
+    // Stopping the loop joins its thread, so no callback runs after this
+    if (m_stream->loop) {
+        pw_thread_loop_lock(m_stream->loop);
+        if (m_stream->stream) {
+            pw_stream_destroy(m_stream->stream);
+        }
+        if (m_stream->core) {
+            pw_core_disconnect(m_stream->core);
+        }
+        pw_thread_loop_unlock(m_stream->loop);
+        pw_thread_loop_stop(m_stream->loop);
+    }
+    if (m_stream->context) {
+        pw_context_destroy(m_stream->context);
+    }
+    if (m_stream->loop) {
+        pw_thread_loop_destroy(m_stream->loop);
+    }
+
+    delete m_stream;
+    m_stream = nullptr;
+#endif
+}
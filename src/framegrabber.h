@@ -0,0 +1,39 @@
+#ifndef FRAMEGRABBER_H
+#define FRAMEGRABBER_H
+
+#include <QImage>
+#include <QObject>
+#include <QTimer>
+
+// Pulls a single frame out of a PipeWire video node and disconnects again.
+// PipeWire is optional at build time; without it grabbing always fails.
+class FrameGrabber : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FrameGrabber(QObject *parent = nullptr);
+    ~FrameGrabber() override;
+
+    static bool isSupported();
+
+    // PipeWire state, so the header doesn't need its includes
+    struct Stream;
+
+    // Emits exactly one of frameReady or failed
+    void grab(uint nodeId, int timeoutMs = 3000);
+
+signals:
+    void frameReady(const QImage &image);
+    void failed(const QString &reason);
+
+private:
+    void stop();
+    void finish(const QImage &image, const QString &error);
+
+    Stream *m_stream = nullptr;
+    QTimer m_timeout;
+    bool m_finished = false;
+};
+
+#endif // FRAMEGRABBER_H
@@ -0,0 +1,139 @@
+#include "inputbatcher.h"
+#include <QGuiApplication>
+#include <QScreen>
+#include <cmath>
+
+// NotifyPointerAxis flags, see org.gnome.Mutter.RemoteDesktop.Session
+static constexpr uint AxisFlagFinish = 1 << 0;
+static constexpr uint AxisSourceFinger = 2 << 1;
+
+InputBatcher::InputBatcher(MutterRemoteDesktop *remoteDesktop, const QString &sessionPath, QObject *parent)
+    : QObject(parent)
+    , m_remoteDesktop(remoteDesktop)
+    , m_sessionPath(sessionPath)
+{
+    const QScreen *screen = QGuiApplication::primaryScreen();
+    const qreal refreshRate = screen && screen->refreshRate() > 1 ? screen->refreshRate() : 60.0;
+    m_frameIntervalMs = qMax(1, int(std::floor(1000.0 / refreshRate)));
+
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &InputBatcher::flush);
+}
+
+void InputBatcher::pointerMotion(double dx, double dy)
+{
+    ++m_eventsReceived;
+    switchTo(Motion);
+    m_hasMotion = true;
+    m_motionDx += dx;
+    m_motionDy += dy;
+    schedule();
+}
+
+void InputBatcher::pointerMotionAbsolute(const QString &streamPath, double x, double y)
+{
+    ++m_eventsReceived;
+    switchTo(Absolute);
+    if (m_hasAbsolute && m_absoluteStream != streamPath) {
+        flush();
+    }
+    m_hasAbsolute = true;
+    m_absoluteStream = streamPath;
+    m_absoluteX = x;
+    m_absoluteY = y;
+    schedule();
+}
+
+void InputBatcher::pointerAxis(double dx, double dy, bool finish)
+{
+    ++m_eventsReceived;
+    switchTo(Axis);
+    m_hasAxis = true;
+    m_axisDx += dx;
+    m_axisDy += dy;
+
+    // The end of a scroll sequence kicks off kinetic scrolling, don't sit on it
+    if (finish) {
+        m_axisFinish = true;
+        flush();
+        return;
+    }
+    schedule();
+}
+
+void InputBatcher::touchMotion(const QString &streamPath, uint slot, double x, double y)
+{
+    ++m_eventsReceived;
+    switchTo(Touch);
+    m_touchMotion.insert(slot, { streamPath, x, y });
+    schedule();
+}
+
+void InputBatcher::sendNow(const QString &method, const QVariantList &args)
+{
+    ++m_eventsReceived;
+    flush();
+    send(method, args);
+}
+
+void InputBatcher::switchTo(Kind kind)
+{
+    if (m_pending != Nothing && m_pending != kind) {
+        flush();
+    }
+    m_pending = kind;
+}
+
+void InputBatcher::schedule()
+{
+    if (m_timer.isActive()) {
+        return;
+    }
+
+    // Sparse input goes out immediately, bursts are held until the next frame
+    const qint64 elapsed = m_sinceFlush.isValid() ? m_sinceFlush.elapsed() : m_frameIntervalMs;
+    if (elapsed >= m_frameIntervalMs) {
+        flush();
+    } else {
+        m_timer.start(int(m_frameIntervalMs - elapsed));
+    }
+}
+
+void InputBatcher::flush()
+{
+    m_timer.stop();
+
+    if (m_hasMotion) {
+        send(QStringLiteral("NotifyPointerMotionRelative"), { m_motionDx, m_motionDy });
+        m_hasMotion = false;
+        m_motionDx = m_motionDy = 0;
+    }
+
+    if (m_hasAbsolute) {
+        send(QStringLiteral("NotifyPointerMotionAbsolute"), { m_absoluteStream, m_absoluteX, m_absoluteY });
+        m_hasAbsolute = false;
+    }
+
+    if (m_hasAxis) {
+        send(QStringLiteral("NotifyPointerAxis"),
+             { m_axisDx, m_axisDy, AxisSourceFinger | (m_axisFinish ? AxisFlagFinish : 0u) });
+        m_hasAxis = false;
+        m_axisFinish = false;
+        m_axisDx = m_axisDy = 0;
+    }
+
+    for (auto it = m_touchMotion.cbegin(); it != m_touchMotion.cend(); ++it) {
+        send(QStringLiteral("NotifyTouchMotion"), { it->streamPath, it.key(), it->x, it->y });
+    }
+    m_touchMotion.clear();
+
+    m_pending = Nothing;
+    m_sinceFlush.start();
+}
+
+void InputBatcher::send(const QString &method, const QVariantList &args)
+{
+    ++m_messagesSent;
+    m_remoteDesktop->notify(m_sessionPath, method, args);
+}
@@ -0,0 +1,85 @@
+#ifndef INPUTBATCHER_H
+#define INPUTBATCHER_H
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QObject>
+#include <QTimer>
+#include "mutterremotedesktop.h"
+
+// Coalesces high-rate input for one remote desktop session. Relative motion
+// and scroll deltas are summed, absolute and touch positions keep the latest
+// value, and the result goes out at most once per output frame. Only runs of
+// the same kind are coalesced: a different kind flushes what is pending, so
+// motion, scroll, motion still arrive in that order. Anything
+// order-sensitive (buttons, keys, touch down/up) flushes what is pending and is
+// sent right away. All calls are fire-and-forget, so a slow compositor can't
+// back up the portal.
+class InputBatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    InputBatcher(MutterRemoteDesktop *remoteDesktop, const QString &sessionPath, QObject *parent = nullptr);
+
+    void pointerMotion(double dx, double dy);
+    void pointerMotionAbsolute(const QString &streamPath, double x, double y);
+    void pointerAxis(double dx, double dy, bool finish);
+    void touchMotion(const QString &streamPath, uint slot, double x, double y);
+
+    // Flushes pending motion first so the compositor sees events in order
+    void sendNow(const QString &method, const QVariantList &args);
+
+    void flush();
+
+    quint64 eventsReceived() const { return m_eventsReceived; }
+    quint64 messagesSent() const { return m_messagesSent; }
+
+private:
+    enum Kind {
+        Nothing,
+        Motion,
+        Absolute,
+        Axis,
+        Touch,
+    };
+
+    // Flush whatever other kind is pending
+    void switchTo(Kind kind);
+    void schedule();
+    void send(const QString &method, const QVariantList &args);
+
+    MutterRemoteDesktop *m_remoteDesktop;
+    QString m_sessionPath;
+
+    QTimer m_timer;
+    QElapsedTimer m_sinceFlush;
+    int m_frameIntervalMs;
+    Kind m_pending = Nothing;
+
+    bool m_hasMotion = false;
+    double m_motionDx = 0;
+    double m_motionDy = 0;
+
+    bool m_hasAbsolute = false;
+    QString m_absoluteStream;
+    double m_absoluteX = 0;
+    double m_absoluteY = 0;
+
+    bool m_hasAxis = false;
+    double m_axisDx = 0;
+    double m_axisDy = 0;
+    bool m_axisFinish = false;
+
+    struct TouchPoint {
+        QString streamPath;
+        double x;
+        double y;
+    };
+    QMap<uint, TouchPoint> m_touchMotion;
+
+    quint64 m_eventsReceived = 0;
+    quint64 m_messagesSent = 0;
+};
+
+#endif // INPUTBATCHER_H
@@ -0,0 +1,7 @@
+#include "logging.h"
+
+Q_LOGGING_CATEGORY(lcPortal, "uni.portal", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcScreenCast, "uni.portal.screencast", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcNiri, "uni.portal.niri", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcSelector, "uni.portal.selector", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcScreenshot, "uni.portal.screenshot", QtWarningMsg)
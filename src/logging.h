@@ -0,0 +1,15 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <QLoggingCategory>
+
+// Everything below warning level is off by default, so qCInfo/qCDebug on the
+// hot paths cost one branch. Turn them on with e.g.
+// QT_LOGGING_RULES="uni.portal.*.debug=true"
+Q_DECLARE_LOGGING_CATEGORY(lcPortal)
+Q_DECLARE_LOGGING_CATEGORY(lcScreenCast)
+Q_DECLARE_LOGGING_CATEGORY(lcNiri)
+Q_DECLARE_LOGGING_CATEGORY(lcSelector)
+Q_DECLARE_LOGGING_CATEGORY(lcScreenshot)
+
+#endif // LOGGING_H
@@ -2,13 +2,21 @@
 #include <QDBusConnection>
 #include <QDebug>
 #include <QtDBus>
+#include <QtQml/qqmlextensionplugin.h>
+#include "callrecorder.h"
+#include "externalpicker.h"
 #include "screencast.h"
-#include <cstdlib>
+#include "portaldebug.h"
+#include "remotedesktop.h"
+#include "screenshot.h"
+#include "renderpacing.h"
+
+// uni-portal-core is static, so its QML module has to be pulled in explicitly
+Q_IMPORT_QML_PLUGIN(SourceSelectorModulePlugin)
 
 int main(int argc, char *argv[])
 {
-    setenv("QSG_RENDER_LOOP", "threaded", 1);
-    setenv("vblank_mode", "0", 1);
+    RenderPacing::configure();
 
     QApplication app(argc, argv);
     app.setQuitOnLastWindowClosed(false);
@@ -24,6 +32,10 @@ int main(int argc, char *argv[])
     // Create main object
     QObject *service = new QObject(&app);
     ScreenCast *screencast = new ScreenCast(service);
+    new RemoteDesktop(screencast, service);
+    new ScreenshotPortal(screencast->mutterScreenCast(), screencast->portalObjects(), service);
+    new PortalDebug(screencast, service);
+    screencast->setExternalPicker(new ExternalPicker(service));
 
 
     // Register object
@@ -34,6 +46,11 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // Input for uni-replay, see README
+    if (qEnvironmentVariableIsSet("UNI_PORTAL_RECORD")) {
+        CallRecorder::instance().open(qEnvironmentVariable("UNI_PORTAL_RECORD"));
+    }
+
     qInfo() << "ScreenCast portal backend started";
 
     return app.exec();
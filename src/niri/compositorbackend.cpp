@@ -0,0 +1,3 @@
+#include "compositorbackend.h"
+
+// Nothing but the signals, which moc generates from the header
@@ -0,0 +1,48 @@
+#ifndef COMPOSITORBACKEND_H
+#define COMPOSITORBACKEND_H
+
+#include <QDBusError>
+#include <QObject>
+#include <QString>
+#include <QVariantMap>
+#include <functional>
+
+// What ScreenCast and StartJob need from the compositor. MutterScreenCast
+// does it over D-Bus; the benchmarks plug in an in-process stand-in with
+// fixed delays so they measure the portal's own bookkeeping, not the bus.
+//
+// Async calls never call back from within themselves, and not at all once
+// context is gone.
+class CompositorBackend : public QObject
+{
+    Q_OBJECT
+
+public:
+    using PathCallback = std::function<void(const QString &path, const QDBusError &error)>;
+    using DoneCallback = std::function<void(const QDBusError &error)>;
+
+    using QObject::QObject;
+
+    virtual bool isAvailable() const = 0;
+
+    // Position and size, known by the time the stream path is handed out
+    virtual QVariantMap getStreamParameters(const QString &streamPath) = 0;
+
+    virtual void createSessionAsync(const QVariantMap &properties, int timeoutMs,
+                                    QObject *context, PathCallback done) = 0;
+    virtual void recordMonitorAsync(const QString &sessionPath, const QString &connector, uint cursorMode,
+                                    int timeoutMs, QObject *context, PathCallback done) = 0;
+    virtual void recordWindowAsync(const QString &sessionPath, uint64_t windowId, uint cursorMode,
+                                   int timeoutMs, QObject *context, PathCallback done) = 0;
+    virtual void startSessionAsync(const QString &sessionPath, int timeoutMs,
+                                   QObject *context, DoneCallback done) = 0;
+
+    // Fire and forget, no sessionClosed follows for it
+    virtual void stopSessionAsync(const QString &sessionPath) = 0;
+
+signals:
+    void sessionClosed(const QString &sessionPath);
+    void pipeWireStreamAdded(const QString &streamPath, uint nodeId);
+};
+
+#endif // COMPOSITORBACKEND_H
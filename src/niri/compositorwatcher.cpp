@@ -0,0 +1,62 @@
+#include "compositorwatcher.h"
+#include "logging.h"
+#include "tracering.h"
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusServiceWatcher>
+
+CompositorWatcher &CompositorWatcher::instance()
+{
+    static CompositorWatcher watcher;
+    return watcher;
+}
+
+const QStringList &CompositorWatcher::services()
+{
+    static const QStringList services = {
+        QStringLiteral("org.gnome.Mutter.ScreenCast"),
+        QStringLiteral("org.gnome.Mutter.RemoteDesktop"),
+        QStringLiteral("org.gnome.Mutter.DisplayConfig"),
+        QStringLiteral("org.gnome.Shell.Introspect"),
+    };
+    return services;
+}
+
+CompositorWatcher::CompositorWatcher()
+    : m_watcher(new QDBusServiceWatcher(this))
+{
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    m_watcher->setConnection(bus);
+    m_watcher->setWatchMode(QDBusServiceWatcher::WatchForOwnerChange);
+    m_watcher->setWatchedServices(services());
+
+    connect(m_watcher, &QDBusServiceWatcher::serviceOwnerChanged, this, &CompositorWatcher::onOwnerChanged);
+
+    // Asks the bus daemon, never the compositor, so this can't hang on it
+    for (const QString &service : services()) {
+        m_present.insert(service, bus.interface() && bus.interface()->isServiceRegistered(service));
+    }
+}
+
+bool CompositorWatcher::isPresent(const QString &service) const
+{
+    return m_present.value(service, false);
+}
+
+void CompositorWatcher::onOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner)
+{
+    // A restart can come as one change straight from the old owner to the new
+    if (!oldOwner.isEmpty()) {
+        m_present.insert(service, false);
+        qCWarning(lcNiri) << service << "went away";
+        traceEvent("compositor-lost", service);
+        emit serviceLost(service);
+    }
+
+    if (!newOwner.isEmpty()) {
+        m_present.insert(service, true);
+        qCInfo(lcNiri) << service << "is back";
+        traceEvent("compositor-returned", service);
+        emit serviceReturned(service);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef COMPOSITORWATCHER_H
+#define COMPOSITORWATCHER_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+class QDBusServiceWatcher;
+
+// Upper bound for any single call to the compositor. Niri answers within
+// milliseconds, the 25 s D-Bus default only ever hits a hung peer.
+constexpr int CompositorCallTimeoutMs = 2000;
+
+// Tracks which of the compositor's D-Bus names currently have an owner, from
+// NameOwnerChanged. Lets the Niri wrappers fail fast instead of sending
+// blocking calls to a compositor that is gone or restarting.
+class CompositorWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    static CompositorWatcher &instance();
+
+    static const QStringList &services();
+
+    // No D-Bus traffic, answered from the last NameOwnerChanged
+    bool isPresent(const QString &service) const;
+
+signals:
+    void serviceLost(const QString &service);
+    void serviceReturned(const QString &service);
+
+private:
+    CompositorWatcher();
+
+    void onOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner);
+
+    QDBusServiceWatcher *m_watcher;
+    QHash<QString, bool> m_present;
+};
+
+#endif // COMPOSITORWATCHER_H
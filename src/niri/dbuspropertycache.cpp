@@ -0,0 +1,131 @@
+#include "dbuspropertycache.h"
+#include "compositorwatcher.h"
+#include "logging.h"
+#include "nirisignalrouter.h"
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusVariant>
+
+static const QString PropertiesInterface = QStringLiteral("org.freedesktop.DBus.Properties");
+
+DBusPropertyCache::DBusPropertyCache(const QString &service, const QString &path,
+                                     const QString &interface, QObject *parent)
+    : QObject(parent)
+    , m_service(service)
+    , m_path(path)
+    , m_interface(interface)
+{
+    // Subscribe before asking, so no change falls in between
+    NiriSignalRouter::instance().listen(
+        m_service, m_path, PropertiesInterface, QStringLiteral("PropertiesChanged"),
+        this, [this](const QDBusMessage &message) {
+            const QVariantList args = message.arguments();
+            onPropertiesChanged(args.value(0).toString(),
+                                qdbus_cast<QVariantMap>(args.value(1)),
+                                qdbus_cast<QStringList>(args.value(2)));
+        });
+
+    fetchAll();
+}
+
+QVariant DBusPropertyCache::value(const QString &name)
+{
+    if (!m_ready) {
+        QDBusMessage msg = QDBusMessage::createMethodCall(m_service, m_path, PropertiesInterface,
+                                                          QStringLiteral("GetAll"));
+        msg.setArguments({ m_interface });
+
+        const QDBusMessage reply = QDBusConnection::sessionBus().call(msg, QDBus::Block, CompositorCallTimeoutMs);
+        if (reply.type() == QDBusMessage::ReplyMessage) {
+            store(qdbus_cast<QVariantMap>(reply.arguments().value(0)));
+            m_ready = true;
+        } else {
+            qCWarning(lcNiri) << "GetAll on" << m_path << "failed:" << reply.errorMessage();
+        }
+    }
+
+    return m_values.value(name);
+}
+
+void DBusPropertyCache::fetchAll()
+{
+    QDBusMessage msg = QDBusMessage::createMethodCall(m_service, m_path, PropertiesInterface,
+                                                      QStringLiteral("GetAll"));
+    msg.setArguments({ m_interface });
+
+    auto *watcher = new QDBusPendingCallWatcher(
+        QDBusConnection::sessionBus().asyncCall(msg, CompositorCallTimeoutMs), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, watcher]() {
+        watcher->deleteLater();
+
+        const QDBusMessage reply = watcher->reply();
+        if (reply.type() != QDBusMessage::ReplyMessage) {
+            qCWarning(lcNiri) << "GetAll on" << m_path << "failed:" << reply.errorMessage();
+            return;
+        }
+        // The blocking fallback got there first
+        if (m_ready) {
+            return;
+        }
+
+        // Anything cached so far came from PropertiesChanged, which is
+        // newer than this snapshot
+        const QVariantMap newer = m_values;
+        store(qdbus_cast<QVariantMap>(reply.arguments().value(0)));
+        store(newer);
+
+        m_ready = true;
+        emit ready();
+    });
+}
+
+void DBusPropertyCache::fetch(const QString &name)
+{
+    QDBusMessage msg = QDBusMessage::createMethodCall(m_service, m_path, PropertiesInterface,
+                                                      QStringLiteral("Get"));
+    msg.setArguments({ m_interface, name });
+
+    auto *watcher = new QDBusPendingCallWatcher(
+        QDBusConnection::sessionBus().asyncCall(msg, CompositorCallTimeoutMs), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, watcher, name]() {
+        watcher->deleteLater();
+
+        const QDBusMessage reply = watcher->reply();
+        if (reply.type() != QDBusMessage::ReplyMessage) {
+            m_values.remove(name);
+            return;
+        }
+
+        m_values.insert(name, qvariant_cast<QDBusVariant>(reply.arguments().value(0)).variant());
+        emit changed({ name });
+    });
+}
+
+void DBusPropertyCache::store(const QVariantMap &properties)
+{
+    for (auto it = properties.cbegin(); it != properties.cend(); ++it) {
+        m_values.insert(it.key(), it.value());
+    }
+}
+
+void DBusPropertyCache::onPropertiesChanged(const QString &interface, const QVariantMap &changed,
+                                            const QStringList &invalidated)
+{
+    if (interface != m_interface) {
+        return;
+    }
+
+    store(changed);
+
+    // Invalidated means "changed, ask if you care", and we do
+    for (const QString &name : invalidated) {
+        m_values.remove(name);
+        fetch(name);
+    }
+
+    if (!changed.isEmpty()) {
+        emit this->changed(changed.keys());
+    }
+}
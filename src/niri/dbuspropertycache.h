@@ -0,0 +1,49 @@
+#ifndef DBUSPROPERTYCACHE_H
+#define DBUSPROPERTYCACHE_H
+
+#include "objectcounter.h"
+#include <QObject>
+#include <QStringList>
+#include <QVariantMap>
+
+// Local copy of one remote object's properties. Filled by a single async
+// GetAll and kept current from PropertiesChanged, so reads are hash lookups
+// instead of a blocking Properties.Get each.
+//
+// Values are as they came off the bus: containers and structs are still
+// QDBusArguments, use qdbus_cast on them.
+class DBusPropertyCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    DBusPropertyCache(const QString &service, const QString &path, const QString &interface,
+                      QObject *parent = nullptr);
+
+    // GetAll replied, or a blocking fallback read filled the cache
+    bool isReady() const { return m_ready; }
+
+    // Before GetAll is back this blocks for it once, bounded by the
+    // compositor call timeout
+    QVariant value(const QString &name);
+
+signals:
+    void ready();
+    void changed(const QStringList &names);
+
+private:
+    void onPropertiesChanged(const QString &interface, const QVariantMap &changed,
+                             const QStringList &invalidated);
+    void fetchAll();
+    void fetch(const QString &name);
+    void store(const QVariantMap &properties);
+
+    QString m_service;
+    QString m_path;
+    QString m_interface;
+    QVariantMap m_values;
+    bool m_ready = false;
+    Counted<DBusPropertyCache> m_counted;
+};
+
+#endif // DBUSPROPERTYCACHE_H
@@ -1,4 +1,6 @@
 #include "mutterdisplayconfig.h"
+#include "compositorwatcher.h"
+#include "logging.h"
 #include <QDebug>
 #include <QDBusReply>
 
@@ -6,8 +8,16 @@ MutterDisplayConfig::MutterDisplayConfig(QObject *parent)
     : QObject(parent)
     , m_displayConfig(new MutterDisplayConfigInterface(this))
 {
+    // The old proxy resolved its owner against the dead instance
+    connect(&CompositorWatcher::instance(), &CompositorWatcher::serviceReturned, this, [this](const QString &service) {
+        if (service == QLatin1String(MutterDisplayConfigInterface::staticInterfaceName())) {
+            delete m_displayConfig;
+            m_displayConfig = new MutterDisplayConfigInterface(this);
+        }
+    });
+
     if (!m_displayConfig->isValid()) {
-        qWarning() << "Failed to connect to Mutter DisplayConfig interface";
+        qCWarning(lcNiri) << "Failed to connect to Mutter DisplayConfig interface";
     }
 }
 
@@ -17,26 +27,38 @@ MutterDisplayConfig::~MutterDisplayConfig()
 
 bool MutterDisplayConfig::isAvailable() const
 {
-    return m_displayConfig->isValid();
+    return CompositorWatcher::instance().isPresent(MutterDisplayConfigInterface::staticInterfaceName())
+        && m_displayConfig->isValid();
 }
 
 QVector<MonitorInfo> MutterDisplayConfig::getMonitors()
 {
     QVector<MonitorInfo> monitors;
 
+    // Niri is restarting, an empty picker beats a frozen one
+    if (!isAvailable()) {
+        qCWarning(lcNiri) << "GetCurrentState skipped, Niri's DisplayConfig is gone";
+        return monitors;
+    }
+
     QDBusPendingReply<> reply = m_displayConfig->GetCurrentState();
     reply.waitForFinished();
 
     if (!reply.isValid()) {
-        qWarning() << "GetCurrentState failed:" << reply.error().message();
+        qCWarning(lcNiri) << "GetCurrentState failed:" << reply.error().message();
         return monitors;
     }
 
-    QDBusMessage msg = reply.reply();
+    return parseMonitors(reply.reply());
+}
+
+QVector<MonitorInfo> MutterDisplayConfig::parseMonitors(const QDBusMessage &msg)
+{
+    QVector<MonitorInfo> monitors;
     QList<QVariant> args = msg.arguments();
 
     if (args.size() < 2) {
-        qWarning() << "Invalid reply structure - expected at least 2 arguments";
+        qCWarning(lcNiri) << "Invalid reply structure - expected at least 2 arguments";
         return monitors;
     }
 
@@ -118,13 +140,50 @@ QVector<MonitorInfo> MutterDisplayConfig::getMonitors()
             monitors.append(monitor);
 
         } catch (...) {
-            qWarning() << "Failed to parse monitor structure, skipping";
+            qCWarning(lcNiri) << "Failed to parse monitor structure, skipping";
             // Try to recover by ending the current structure
             try { monitorsArg.endStructure(); } catch (...) {}
         }
     }
     monitorsArg.endArray();
 
-    qInfo() << "Successfully parsed" << monitors.size() << "monitors";
+    // Argument 2 is the logical monitors: a(iiduba(ssss)a{sv})
+    if (args.size() >= 3) {
+        const QDBusArgument &logicalArg = args.at(2).value<QDBusArgument>();
+
+        logicalArg.beginArray();
+        while (!logicalArg.atEnd()) {
+            int x, y;
+            double scale;
+            uint transform;
+            bool primary;
+
+            logicalArg.beginStructure();
+            logicalArg >> x >> y >> scale >> transform >> primary;
+
+            logicalArg.beginArray();
+            while (!logicalArg.atEnd()) {
+                QString connector, vendor, product, serial;
+                logicalArg.beginStructure();
+                logicalArg >> connector >> vendor >> product >> serial;
+                logicalArg.endStructure();
+
+                for (MonitorInfo &monitor : monitors) {
+                    if (monitor.connector == connector) {
+                        monitor.logicalPosition = QPoint(x, y);
+                        monitor.scale = scale > 0 ? scale : 1.0;
+                    }
+                }
+            }
+            logicalArg.endArray();
+
+            QVariantMap properties;
+            logicalArg >> properties;
+            logicalArg.endStructure();
+        }
+        logicalArg.endArray();
+    }
+
+    qCDebug(lcNiri) << "Successfully parsed" << monitors.size() << "monitors";
     return monitors;
 }
@@ -1,7 +1,9 @@
 #ifndef MUTTERDISPLAYCONFIG_H
 #define MUTTERDISPLAYCONFIG_H
 
+#include "compositorwatcher.h"
 #include <QObject>
+#include <QPoint>
 #include <QDBusAbstractInterface>
 #include <QDBusConnection>
 #include <QDBusReply>
@@ -24,7 +26,9 @@ public:
               staticInterfaceName(),
               QDBusConnection::sessionBus(),
               parent)
-    {}
+    {
+        setTimeout(CompositorCallTimeoutMs);
+    }
 
 public slots:
     QDBusPendingReply<> GetCurrentState()
@@ -44,6 +48,9 @@ struct MonitorInfo {
     int currentHeight;
     double currentRefreshRate;
     bool isBuiltin;
+    // Where it sits in the logical layout, from the logical monitors
+    QPoint logicalPosition;
+    double scale = 1.0;
 };
 
 // Wrapper class to manage display config queries
@@ -57,6 +64,9 @@ public:
     bool isAvailable() const;
     QVector<MonitorInfo> getMonitors();
 
+    // Parse a GetCurrentState reply
+    static QVector<MonitorInfo> parseMonitors(const QDBusMessage &reply);
+
 private:
     MutterDisplayConfigInterface *m_displayConfig;
 };
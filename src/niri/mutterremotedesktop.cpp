@@ -0,0 +1,241 @@
+#include "mutterremotedesktop.h"
+#include "chrometrace.h"
+#include "compositorwatcher.h"
+#include "logging.h"
+#include "tracering.h"
+#include <QDBusPendingCallWatcher>
+#include <QDBusVariant>
+#include <QDeadlineTimer>
+#include <QDebug>
+#include <QPointer>
+
+MutterRemoteDesktop::MutterRemoteDesktop(QObject *parent)
+    : QObject(parent)
+    , m_remoteDesktop(new MutterRemoteDesktopInterface(this))
+{
+    if (!m_remoteDesktop->isValid()) {
+        qCWarning(lcNiri) << "Failed to connect to Mutter RemoteDesktop interface";
+    }
+
+    CompositorWatcher &watcher = CompositorWatcher::instance();
+    connect(&watcher, &CompositorWatcher::serviceLost, this, [this](const QString &service) {
+        if (service == QLatin1String(MutterRemoteDesktopInterface::staticInterfaceName())) {
+            onCompositorLost();
+        }
+    });
+    connect(&watcher, &CompositorWatcher::serviceReturned, this, [this](const QString &service) {
+        if (service == QLatin1String(MutterRemoteDesktopInterface::staticInterfaceName())) {
+            onCompositorReturned();
+        }
+    });
+}
+
+MutterRemoteDesktop::~MutterRemoteDesktop()
+{
+    // Nothing would be left to handle the replies, so don't ask for them
+    if (!CompositorWatcher::instance().isPresent(MutterRemoteDesktopInterface::staticInterfaceName())) {
+        return;
+    }
+    for (auto it = m_sessions.cbegin(); it != m_sessions.cend(); ++it) {
+        QDBusMessage msg = QDBusMessage::createMethodCall(
+            MutterRemoteDesktopInterface::staticInterfaceName(), it.key(),
+            MutterRemoteDesktopSessionInterface::staticInterfaceName(), QStringLiteral("Stop"));
+        msg.setAutoStartService(false);
+        QDBusConnection::sessionBus().send(msg);
+    }
+}
+
+bool MutterRemoteDesktop::isAvailable() const
+{
+    return CompositorWatcher::instance().isPresent(MutterRemoteDesktopInterface::staticInterfaceName())
+        && m_remoteDesktop->isValid();
+}
+
+bool MutterRemoteDesktop::compositorPresent(const char *call) const
+{
+    if (CompositorWatcher::instance().isPresent(MutterRemoteDesktopInterface::staticInterfaceName())) {
+        return true;
+    }
+
+    qCWarning(lcNiri) << call << "skipped, Niri's remote desktop service is gone";
+    return false;
+}
+
+void MutterRemoteDesktop::onCompositorLost()
+{
+    const auto sessions = std::exchange(m_sessions, {});
+    for (auto it = sessions.cbegin(); it != sessions.cend(); ++it) {
+        it.value()->deleteLater();
+        emit sessionClosed(it.key());
+    }
+}
+
+void MutterRemoteDesktop::onCompositorReturned()
+{
+    delete m_remoteDesktop;
+    m_remoteDesktop = new MutterRemoteDesktopInterface(this);
+}
+
+uint MutterRemoteDesktop::supportedDeviceTypes() const
+{
+    return isAvailable() ? m_remoteDesktop->supportedDeviceTypes() : 0;
+}
+
+MutterRemoteDesktopSessionInterface *MutterRemoteDesktop::addSession(const QString &sessionPath)
+{
+    auto *session = new MutterRemoteDesktopSessionInterface(sessionPath, this);
+    m_sessions[sessionPath] = session;
+
+    connect(session, &MutterRemoteDesktopSessionInterface::Closed, this, [this, sessionPath]() {
+        qCDebug(lcNiri) << "Remote desktop session closed:" << sessionPath;
+        traceEvent("niri-rd-session-closed", sessionPath);
+        emit sessionClosed(sessionPath);
+        if (auto *session = m_sessions.take(sessionPath)) {
+            session->deleteLater();
+        }
+    });
+
+    return session;
+}
+
+void MutterRemoteDesktop::callAsync(const QString &path, const char *interface, const char *method,
+                                    const QVariantList &args, int timeoutMs,
+                                    std::function<void(const QDBusMessage &reply)> handler)
+{
+    QDBusMessage msg = QDBusMessage::createMethodCall(
+        MutterRemoteDesktopInterface::staticInterfaceName(), path, QLatin1String(interface), QLatin1String(method));
+    msg.setArguments(args);
+
+    const quint64 traceId = ++m_callCount;
+    traceAsyncBegin(method, path, traceId);
+
+    auto *watcher = new QDBusPendingCallWatcher(
+        QDBusConnection::sessionBus().asyncCall(msg, timeoutMs), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [watcher, handler, method, path, traceId]() {
+        handler(watcher->reply());
+        traceAsyncEnd(method, path, traceId);
+        watcher->deleteLater();
+    });
+}
+
+static const QDBusError CompositorGone(QDBusError::ServiceUnknown, QStringLiteral("Niri's remote desktop service is gone"));
+static const QDBusError NoSuchSession(QDBusError::UnknownObject, QStringLiteral("No such session"));
+
+void MutterRemoteDesktop::createSessionAsync(int timeoutMs, QObject *context, SessionCallback done)
+{
+    // Failures still arrive from the event loop, never inside this call
+    if (!compositorPresent("CreateSession")) {
+        QMetaObject::invokeMethod(context, [done]() { done(QString(), QString(), CompositorGone); },
+                                  Qt::QueuedConnection);
+        return;
+    }
+
+    QDeadlineTimer deadline(timeoutMs);
+    callAsync(QStringLiteral("/org/gnome/Mutter/RemoteDesktop"), MutterRemoteDesktopInterface::staticInterfaceName(),
+              "CreateSession", {}, timeoutMs,
+              [this, context = QPointer<QObject>(context), done, deadline](const QDBusMessage &reply) {
+                  if (reply.type() == QDBusMessage::ErrorMessage) {
+                      qCWarning(lcNiri) << "RemoteDesktop CreateSession failed:" << reply.errorMessage();
+                      if (context) {
+                          done(QString(), QString(), QDBusError(reply));
+                      }
+                      return;
+                  }
+
+                  const QString sessionPath = reply.arguments().value(0).value<QDBusObjectPath>().path();
+                  addSession(sessionPath);
+                  traceEvent("niri-rd-session-created", sessionPath);
+
+                  if (!context) {
+                      stopSessionAsync(sessionPath);
+                      return;
+                  }
+
+                  // The id a screencast session links with
+                  const int left = int(qBound<qint64>(1, deadline.remainingTime(), CompositorCallTimeoutMs));
+                  callAsync(sessionPath, "org.freedesktop.DBus.Properties", "Get",
+                            { QLatin1String(MutterRemoteDesktopSessionInterface::staticInterfaceName()),
+                              QStringLiteral("SessionId") }, left,
+                            [this, context, done, sessionPath](const QDBusMessage &reply) {
+                                if (!context) {
+                                    stopSessionAsync(sessionPath);
+                                    return;
+                                }
+                                if (reply.type() == QDBusMessage::ErrorMessage) {
+                                    qCWarning(lcNiri) << "SessionId of" << sessionPath << "failed:" << reply.errorMessage();
+                                    stopSessionAsync(sessionPath);
+                                    done(QString(), QString(), QDBusError(reply));
+                                    return;
+                                }
+
+                                const QString sessionId = reply.arguments().value(0).value<QDBusVariant>().variant().toString();
+                                qCDebug(lcNiri) << "Created remote desktop session:" << sessionPath << sessionId;
+                                done(sessionPath, sessionId, QDBusError());
+                            });
+              });
+}
+
+void MutterRemoteDesktop::startSessionAsync(const QString &sessionPath, int timeoutMs,
+                                            QObject *context, DoneCallback done)
+{
+    const QDBusError error = !compositorPresent("Start") ? CompositorGone
+                           : !m_sessions.contains(sessionPath) ? NoSuchSession
+                           : QDBusError();
+    if (error.isValid()) {
+        QMetaObject::invokeMethod(context, [done, error]() { done(error); }, Qt::QueuedConnection);
+        return;
+    }
+
+    callAsync(sessionPath, MutterRemoteDesktopSessionInterface::staticInterfaceName(), "Start", {}, timeoutMs,
+              [context = QPointer<QObject>(context), done, sessionPath](const QDBusMessage &reply) {
+                  if (reply.type() == QDBusMessage::ErrorMessage) {
+                      qCWarning(lcNiri) << "RemoteDesktop Start failed:" << reply.errorMessage();
+                  } else {
+                      qCDebug(lcNiri) << "Started remote desktop session:" << sessionPath;
+                  }
+                  if (context) {
+                      done(reply.type() == QDBusMessage::ErrorMessage ? QDBusError(reply) : QDBusError());
+                  }
+              });
+}
+
+void MutterRemoteDesktop::stopSessionAsync(const QString &sessionPath)
+{
+    auto *session = m_sessions.take(sessionPath);
+    if (!session) {
+        return;
+    }
+    session->deleteLater();
+
+    if (!compositorPresent("Stop")) {
+        return;
+    }
+
+    traceEvent("niri-rd-session-stopped", sessionPath);
+    callAsync(sessionPath, MutterRemoteDesktopSessionInterface::staticInterfaceName(), "Stop", {},
+              CompositorCallTimeoutMs, [sessionPath](const QDBusMessage &reply) {
+                  if (reply.type() == QDBusMessage::ErrorMessage) {
+                      qCWarning(lcNiri) << "RemoteDesktop Stop of" << sessionPath << "failed:" << reply.errorMessage();
+                  }
+              });
+}
+
+void MutterRemoteDesktop::notify(const QString &sessionPath, const QString &method, const QVariantList &args)
+{
+    // Input for a session that died with the compositor, nobody to tell
+    if (!m_sessions.contains(sessionPath)) {
+        return;
+    }
+
+    QDBusMessage msg = QDBusMessage::createMethodCall(
+        "org.gnome.Mutter.RemoteDesktop",
+        sessionPath,
+        MutterRemoteDesktopSessionInterface::staticInterfaceName(),
+        method
+        );
+    msg.setArguments(args);
+    msg.setAutoStartService(false);
+
+    // send() doesn't wait, and the (empty) reply is simply dropped
+    QDBusConnection::sessionBus().send(msg);
+}
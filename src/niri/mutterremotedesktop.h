@@ -0,0 +1,129 @@
+#ifndef MUTTERREMOTEDESKTOP_H
+#define MUTTERREMOTEDESKTOP_H
+
+#include "compositorwatcher.h"
+#include "dbuspropertycache.h"
+#include "nirisignalrouter.h"
+#include <QDBusAbstractInterface>
+#include <QDBusConnection>
+#include <QDBusError>
+#include <QDBusObjectPath>
+#include <QObject>
+#include <QVariantMap>
+#include <functional>
+
+// Main RemoteDesktop interface
+class MutterRemoteDesktopInterface : public QDBusAbstractInterface
+{
+    Q_OBJECT
+    Q_PROPERTY(uint SupportedDeviceTypes READ supportedDeviceTypes)
+
+public:
+    static inline const char *staticInterfaceName()
+    { return "org.gnome.Mutter.RemoteDesktop"; }
+
+    MutterRemoteDesktopInterface(QObject *parent = nullptr)
+        : QDBusAbstractInterface(
+              "org.gnome.Mutter.RemoteDesktop",
+              "/org/gnome/Mutter/RemoteDesktop",
+              staticInterfaceName(),
+              QDBusConnection::sessionBus(),
+              parent)
+        , m_properties(new DBusPropertyCache(service(), path(), interface(), this))
+    {
+        setTimeout(CompositorCallTimeoutMs);
+    }
+
+    uint supportedDeviceTypes() const
+    {
+        return m_properties->value("SupportedDeviceTypes").toUInt();
+    }
+
+private:
+    DBusPropertyCache *m_properties;
+};
+
+// Session interface
+class MutterRemoteDesktopSessionInterface : public QDBusAbstractInterface
+{
+    Q_OBJECT
+
+public:
+    static inline const char *staticInterfaceName()
+    { return "org.gnome.Mutter.RemoteDesktop.Session"; }
+
+    MutterRemoteDesktopSessionInterface(const QString &path, QObject *parent = nullptr)
+        : QDBusAbstractInterface(
+              "org.gnome.Mutter.RemoteDesktop",
+              path,
+              staticInterfaceName(),
+              QDBusConnection::sessionBus(),
+              parent)
+    {
+        setTimeout(CompositorCallTimeoutMs);
+
+        // Through the shared subscription, no match rule of our own
+        NiriSignalRouter::instance().listen(
+            "org.gnome.Mutter.RemoteDesktop", path, staticInterfaceName(), "Closed",
+            this, [this](const QDBusMessage &) { emit Closed(); });
+    }
+
+signals:
+    void Closed();
+};
+
+// Wrapper class to manage the lifecycle
+class MutterRemoteDesktop : public QObject
+{
+    Q_OBJECT
+
+public:
+    // SupportedDeviceTypes bits, same as the portal's
+    enum DeviceType {
+        Keyboard = 1,
+        Pointer = 2,
+        Touchscreen = 4,
+    };
+
+    explicit MutterRemoteDesktop(QObject *parent = nullptr);
+    ~MutterRemoteDesktop();
+
+    bool isAvailable() const;
+    uint supportedDeviceTypes() const;
+
+    // The session calls behind portal Start, none of them block. Each is
+    // bounded by timeoutMs. createSessionAsync hands over the session id a
+    // screencast session links with ("remote-desktop-session-id"), and
+    // starting also starts any linked screencast session. done
+    // isn't called once context is gone; a session created for a context
+    // that went away meanwhile is stopped right away.
+    using SessionCallback = std::function<void(const QString &sessionPath, const QString &sessionId,
+                                               const QDBusError &error)>;
+    using DoneCallback = std::function<void(const QDBusError &error)>;
+    void createSessionAsync(int timeoutMs, QObject *context, SessionCallback done);
+    void startSessionAsync(const QString &sessionPath, int timeoutMs, QObject *context, DoneCallback done);
+    // Stop without waiting for the reply, no sessionClosed follows
+    void stopSessionAsync(const QString &sessionPath);
+
+    // Fire-and-forget input event, never waits for the compositor's reply
+    void notify(const QString &sessionPath, const QString &method, const QVariantList &args);
+
+signals:
+    void sessionClosed(const QString &sessionPath);
+
+private:
+    // Niri went away or came back, see CompositorWatcher
+    void onCompositorLost();
+    void onCompositorReturned();
+    bool compositorPresent(const char *call) const;
+    MutterRemoteDesktopSessionInterface *addSession(const QString &sessionPath);
+    void callAsync(const QString &path, const char *interface, const char *method,
+                   const QVariantList &args, int timeoutMs,
+                   std::function<void(const QDBusMessage &reply)> handler);
+
+    MutterRemoteDesktopInterface *m_remoteDesktop;
+    QMap<QString, MutterRemoteDesktopSessionInterface*> m_sessions;
+    quint64 m_callCount = 0;
+};
+
+#endif // MUTTERREMOTEDESKTOP_H
@@ -1,168 +1,362 @@
 #include "mutterscreencast.h"
+#include "compositorwatcher.h"
+#include "logging.h"
+#include "chrometrace.h"
+#include "tracering.h"
+#include <QDBusPendingCallWatcher>
 #include <QDebug>
+#include <QPointer>
+#include <QTimer>
+#include <memory>
 
 MutterScreenCast::MutterScreenCast(QObject *parent)
-    : QObject(parent)
+    : CompositorBackend(parent)
     , m_screencast(new MutterScreenCastInterface(this))
 {
     if (!m_screencast->isValid()) {
-        qWarning() << "Failed to connect to Mutter ScreenCast interface";
+        qCWarning(lcNiri) << "Failed to connect to Mutter ScreenCast interface";
     }
+
+    CompositorWatcher &watcher = CompositorWatcher::instance();
+    connect(&watcher, &CompositorWatcher::serviceLost, this, [this](const QString &service) {
+        if (service == QLatin1String(MutterScreenCastInterface::staticInterfaceName())) {
+            onCompositorLost();
+        }
+    });
+    connect(&watcher, &CompositorWatcher::serviceReturned, this, [this](const QString &service) {
+        if (service == QLatin1String(MutterScreenCastInterface::staticInterfaceName())) {
+            onCompositorReturned();
+        }
+    });
 }
 
 MutterScreenCast::~MutterScreenCast()
 {
-    // Clean up all sessions
-    for (auto it = m_sessions.begin(); it != m_sessions.end(); ++it) {
-        it.value()->Stop();
+    // Nothing would be left to handle the replies, so don't ask for them
+    if (!CompositorWatcher::instance().isPresent(MutterScreenCastInterface::staticInterfaceName())) {
+        return;
+    }
+    for (auto it = m_sessions.cbegin(); it != m_sessions.cend(); ++it) {
+        QDBusMessage msg = QDBusMessage::createMethodCall(
+            MutterScreenCastInterface::staticInterfaceName(), it.key(),
+            MutterScreenCastSessionInterface::staticInterfaceName(), QStringLiteral("Stop"));
+        msg.setAutoStartService(false);
+        QDBusConnection::sessionBus().send(msg);
     }
 }
 
 bool MutterScreenCast::isAvailable() const
 {
-    return m_screencast->isValid();
+    return CompositorWatcher::instance().isPresent(MutterScreenCastInterface::staticInterfaceName())
+        && m_screencast->isValid();
 }
 
-QString MutterScreenCast::createSession()
+bool MutterScreenCast::compositorPresent(const char *call) const
 {
-    QVariantMap properties;
+    if (CompositorWatcher::instance().isPresent(MutterScreenCastInterface::staticInterfaceName())) {
+        return true;
+    }
+
+    qCWarning(lcNiri) << call << "skipped, Niri's screencast service is gone";
+    return false;
+}
 
-    QDBusReply<QDBusObjectPath> reply = m_screencast->CreateSession(properties);
-    if (!reply.isValid()) {
-        qWarning() << "CreateSession failed:" << reply.error().message();
-        return QString();
+void MutterScreenCast::onCompositorLost()
+{
+    // Everything on the other side died with it, don't Stop() into the void
+    const auto sessions = std::exchange(m_sessions, {});
+    qDeleteAll(std::exchange(m_streams, {}));
+    m_sessionStreams.clear();
+
+    for (auto it = sessions.cbegin(); it != sessions.cend(); ++it) {
+        it.value()->deleteLater();
+        emit sessionClosed(it.key());
     }
+}
 
-    QString sessionPath = reply.value().path();
+void MutterScreenCast::onCompositorReturned()
+{
+    // The old proxy resolved its owner against the dead instance
+    delete m_screencast;
+    m_screencast = new MutterScreenCastInterface(this);
+}
 
+MutterScreenCastSessionInterface *MutterScreenCast::addSession(const QString &sessionPath)
+{
     auto *session = new MutterScreenCastSessionInterface(sessionPath, this);
     m_sessions[sessionPath] = session;
 
     connect(session, &MutterScreenCastSessionInterface::Closed, this, [this, sessionPath]() {
-        qInfo() << "Session closed:" << sessionPath;
+        qCDebug(lcNiri) << "Session closed:" << sessionPath;
+        traceEvent("niri-session-closed", sessionPath);
         emit sessionClosed(sessionPath);
-        m_sessions.remove(sessionPath);
+        forgetSession(sessionPath);
     });
 
-    qInfo() << "Created session:" << sessionPath;
-    return sessionPath;
+    qCDebug(lcNiri) << "Created session:" << sessionPath;
+    traceEvent("niri-session-created", sessionPath);
+    return session;
 }
 
-QString MutterScreenCast::recordMonitor(const QString &sessionPath,
-                                        const QString &connector,
-                                        uint cursorMode)
+void MutterScreenCast::forgetSession(const QString &sessionPath)
 {
-    auto *session = m_sessions.value(sessionPath);
-    if (!session) {
-        qWarning() << "No session found for path:" << sessionPath;
-        return QString();
+    if (MutterScreenCastSessionInterface *session = m_sessions.take(sessionPath)) {
+        session->deleteLater();
     }
 
-    QVariantMap properties;
-    properties["cursor-mode"] = cursorMode; // 0=Hidden, 1=Embedded, 2=Metadata
-
-    QDBusReply<QDBusObjectPath> reply = session->RecordMonitor(connector, properties);
-    if (!reply.isValid()) {
-        qWarning() << "RecordMonitor failed:" << reply.error().message();
-        return QString();
+    const QStringList streams = m_sessionStreams.values(sessionPath);
+    m_sessionStreams.remove(sessionPath);
+    for (const QString &streamPath : streams) {
+        if (MutterScreenCastStreamInterface *stream = m_streams.take(streamPath)) {
+            stream->deleteLater();
+        }
     }
+}
 
-    QString streamPath = reply.value().path();
-
+MutterScreenCastStreamInterface *MutterScreenCast::addStream(const QString &sessionPath, const QString &streamPath)
+{
     auto *stream = new MutterScreenCastStreamInterface(streamPath, this);
     m_streams[streamPath] = stream;
+    m_sessionStreams.insert(sessionPath, streamPath);
 
     // Connect PipeWire stream signal
     connect(stream, &MutterScreenCastStreamInterface::PipeWireStreamAdded,
             this, [this, streamPath](uint nodeId) {
-                qInfo() << "PipeWire stream added:" << streamPath << "node:" << nodeId;
+                qCDebug(lcNiri) << "PipeWire stream added:" << streamPath << "node:" << nodeId;
                 emit pipeWireStreamAdded(streamPath, nodeId);
             });
 
-    qInfo() << "Created stream:" << streamPath << "for monitor:" << connector;
-    return streamPath;
+    return stream;
 }
 
-QString MutterScreenCast::recordWindow(const QString &sessionPath,
-                                       uint64_t windowId,
-                                       uint cursorMode)
+QVariantMap MutterScreenCast::getStreamParameters(const QString &streamPath)
 {
-    auto *session = m_sessions.value(sessionPath);
-    if (!session) {
-        qWarning() << "No session found for path:" << sessionPath;
-        return QString();
+    if (!compositorPresent("Parameters")) {
+        return QVariantMap();
     }
 
-    qInfo() << "Window ID: " << windowId;
+    auto *stream = m_streams.value(streamPath);
+    if (!stream) {
+        qCWarning(lcNiri) << "No stream found for path:" << streamPath;
+        return QVariantMap();
+    }
 
-    QVariantMap properties;
-    properties["window-id"] = static_cast<qulonglong>(windowId);
-    properties["cursor-mode"] = cursorMode;
+    TraceSpan span("Parameters", streamPath);
+    return stream->parameters();
+}
 
-    QDBusReply<QDBusObjectPath> reply = session->RecordWindow(properties);
-    if (!reply.isValid()) {
-        qWarning() << "RecordWindow failed:" << reply.error().message();
-        return QString();
-    }
+void MutterScreenCast::callAsync(const QString &path, const char *interface, const char *method,
+                                 const QVariantList &args, int timeoutMs,
+                                 std::function<void(const QDBusMessage &reply)> handler)
+{
+    QDBusMessage msg = QDBusMessage::createMethodCall(
+        MutterScreenCastInterface::staticInterfaceName(), path, interface, QLatin1String(method));
+    msg.setArguments(args);
+
+    // From the call going out until its reply has been handled
+    const quint64 traceId = ++m_callCount;
+    traceAsyncBegin(method, path, traceId);
+
+    auto *watcher = new QDBusPendingCallWatcher(
+        QDBusConnection::sessionBus().asyncCall(msg, timeoutMs), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [watcher, handler, method, path, traceId]() {
+        handler(watcher->reply());
+        traceAsyncEnd(method, path, traceId);
+        watcher->deleteLater();
+    });
+}
 
-    QString streamPath = reply.value().path();
+// Failures before anything went out still arrive from the event loop, so
+// callers never see done() run inside their own call
+template<typename Callback, typename... Args>
+static void failLater(QObject *context, Callback done, Args... args)
+{
+    QMetaObject::invokeMethod(context, [done, args...]() { done(args...); }, Qt::QueuedConnection);
+}
 
-    auto *stream = new MutterScreenCastStreamInterface(streamPath, this);
-    m_streams[streamPath] = stream;
+static const QDBusError CompositorGone(QDBusError::ServiceUnknown, QStringLiteral("Niri's screencast service is gone"));
+static const QDBusError NoSuchSession(QDBusError::UnknownObject, QStringLiteral("No such session"));
 
-    connect(stream, &MutterScreenCastStreamInterface::PipeWireStreamAdded,
-            this, [this, streamPath](uint nodeId) {
-                qInfo() << "PipeWire stream added:" << streamPath << "node:" << nodeId;
-                emit pipeWireStreamAdded(streamPath, nodeId);
-            });
+// How long we keep listening for a CreateSession reply, well past the step
+static constexpr int LateReplyTimeoutMs = 25000;
 
-    qInfo() << "Created stream:" << streamPath << "for window:" << windowId;
-    return streamPath;
+void MutterScreenCast::createSessionAsync(const QVariantMap &properties, int timeoutMs,
+                                          QObject *context, PathCallback done)
+{
+    if (!compositorPresent("CreateSession")) {
+        failLater(context, done, QString(), CompositorGone);
+        return;
+    }
+
+    // The step gives up after timeoutMs, but the call itself waits longer: a
+    // session Niri creates after that is still seen, and stopped again
+    struct Step {
+        QTimer timer;
+        bool over = false;
+    };
+    auto step = std::make_shared<Step>();
+    step->timer.setSingleShot(true);
+    connect(&step->timer, &QTimer::timeout, this, [context = QPointer<QObject>(context), done, step]() {
+        step->over = true;
+        qCWarning(lcNiri) << "CreateSession timed out, a late session gets stopped";
+        if (context) {
+            done(QString(), QDBusError(QDBusError::Timeout, QStringLiteral("CreateSession timed out")));
+        }
+    });
+    step->timer.start(timeoutMs);
+
+    callAsync(QStringLiteral("/org/gnome/Mutter/ScreenCast"), MutterScreenCastInterface::staticInterfaceName(),
+              "CreateSession", { QVariant::fromValue(properties) }, LateReplyTimeoutMs,
+              [this, context = QPointer<QObject>(context), done, step](const QDBusMessage &reply) {
+                  // Always comes, if only as a timeout error; ends the cycle
+                  // between step and its timer's slot
+                  step->timer.stop();
+                  step->timer.disconnect();
+                  const bool late = std::exchange(step->over, true);
+
+                  if (reply.type() == QDBusMessage::ErrorMessage) {
+                      qCWarning(lcNiri) << "CreateSession failed:" << reply.errorMessage();
+                      if (context && !late) {
+                          done(QString(), QDBusError(reply));
+                      }
+                      return;
+                  }
+
+                  const QString sessionPath = reply.arguments().value(0).value<QDBusObjectPath>().path();
+                  addSession(sessionPath);
+
+                  if (!context || late) {
+                      qCDebug(lcNiri) << "Nobody waits for" << sessionPath << "anymore, stopping it";
+                      stopSessionAsync(sessionPath);
+                      return;
+                  }
+                  done(sessionPath, QDBusError());
+              });
 }
 
-bool MutterScreenCast::startSession(const QString &sessionPath)
+void MutterScreenCast::recordMonitorAsync(const QString &sessionPath, const QString &connector,
+                                          uint cursorMode, int timeoutMs,
+                                          QObject *context, PathCallback done)
 {
-    auto *session = m_sessions.value(sessionPath);
-    if (!session) {
-        qWarning() << "No session found for path:" << sessionPath;
-        return false;
+    if (!compositorPresent("RecordMonitor")) {
+        failLater(context, done, QString(), CompositorGone);
+        return;
     }
-
-    QDBusReply<void> reply = session->Start();
-    if (!reply.isValid()) {
-        qWarning() << "Start failed:" << reply.error().message();
-        return false;
+    if (!m_sessions.contains(sessionPath)) {
+        failLater(context, done, QString(), NoSuchSession);
+        return;
     }
 
-    qInfo() << "Started session:" << sessionPath;
-    return true;
+    QVariantMap properties;
+    properties["cursor-mode"] = cursorMode;
+
+    callAsync(sessionPath, MutterScreenCastSessionInterface::staticInterfaceName(),
+              "RecordMonitor", { connector, QVariant::fromValue(properties) }, timeoutMs,
+              [this, context = QPointer<QObject>(context), done, sessionPath, connector](const QDBusMessage &reply) {
+                  if (reply.type() == QDBusMessage::ErrorMessage) {
+                      qCWarning(lcNiri) << "RecordMonitor failed:" << reply.errorMessage();
+                      if (context) {
+                          done(QString(), QDBusError(reply));
+                      }
+                      return;
+                  }
+
+                  // The stream goes away with its session, no rollback of its own
+                  const QString streamPath = reply.arguments().value(0).value<QDBusObjectPath>().path();
+                  if (!context || !m_sessions.contains(sessionPath)) {
+                      return;
+                  }
+
+                  addStream(sessionPath, streamPath);
+                  qCDebug(lcNiri) << "Created stream:" << streamPath << "for monitor:" << connector;
+                  traceEvent("record-monitor", connector);
+                  done(streamPath, QDBusError());
+              });
 }
 
-bool MutterScreenCast::stopSession(const QString &sessionPath)
+void MutterScreenCast::recordWindowAsync(const QString &sessionPath, uint64_t windowId,
+                                         uint cursorMode, int timeoutMs,
+                                         QObject *context, PathCallback done)
 {
-    auto *session = m_sessions.value(sessionPath);
-    if (!session) {
-        qWarning() << "No session found for path:" << sessionPath;
-        return false;
+    if (!compositorPresent("RecordWindow")) {
+        failLater(context, done, QString(), CompositorGone);
+        return;
     }
+    if (!m_sessions.contains(sessionPath)) {
+        failLater(context, done, QString(), NoSuchSession);
+        return;
+    }
+
+    QVariantMap properties;
+    properties["window-id"] = static_cast<qulonglong>(windowId);
+    properties["cursor-mode"] = cursorMode;
+
+    callAsync(sessionPath, MutterScreenCastSessionInterface::staticInterfaceName(),
+              "RecordWindow", { QVariant::fromValue(properties) }, timeoutMs,
+              [this, context = QPointer<QObject>(context), done, sessionPath, windowId](const QDBusMessage &reply) {
+                  if (reply.type() == QDBusMessage::ErrorMessage) {
+                      qCWarning(lcNiri) << "RecordWindow failed:" << reply.errorMessage();
+                      if (context) {
+                          done(QString(), QDBusError(reply));
+                      }
+                      return;
+                  }
+
+                  const QString streamPath = reply.arguments().value(0).value<QDBusObjectPath>().path();
+                  if (!context || !m_sessions.contains(sessionPath)) {
+                      return;
+                  }
+
+                  addStream(sessionPath, streamPath);
+                  qCDebug(lcNiri) << "Created stream:" << streamPath << "for window:" << windowId;
+                  traceEvent("record-window", streamPath, qint64(windowId));
+                  done(streamPath, QDBusError());
+              });
+}
 
-    QDBusReply<void> reply = session->Stop();
-    if (!reply.isValid()) {
-        qWarning() << "Stop failed:" << reply.error().message();
-        return false;
+void MutterScreenCast::startSessionAsync(const QString &sessionPath, int timeoutMs,
+                                         QObject *context, DoneCallback done)
+{
+    if (!compositorPresent("Start")) {
+        failLater(context, done, CompositorGone);
+        return;
+    }
+    if (!m_sessions.contains(sessionPath)) {
+        failLater(context, done, NoSuchSession);
+        return;
     }
 
-    qInfo() << "Stopped session:" << sessionPath;
-    return true;
+    callAsync(sessionPath, MutterScreenCastSessionInterface::staticInterfaceName(),
+              "Start", {}, timeoutMs,
+              [context = QPointer<QObject>(context), done, sessionPath](const QDBusMessage &reply) {
+                  if (reply.type() == QDBusMessage::ErrorMessage) {
+                      qCWarning(lcNiri) << "Start failed:" << reply.errorMessage();
+                  } else {
+                      qCDebug(lcNiri) << "Started session:" << sessionPath;
+                  }
+                  if (context) {
+                      done(reply.type() == QDBusMessage::ErrorMessage ? QDBusError(reply) : QDBusError());
+                  }
+              });
 }
 
-QVariantMap MutterScreenCast::getStreamParameters(const QString &streamPath)
+void MutterScreenCast::stopSessionAsync(const QString &sessionPath)
 {
-    auto *stream = m_streams.value(streamPath);
-    if (!stream) {
-        qWarning() << "No stream found for path:" << streamPath;
-        return QVariantMap();
+    if (!m_sessions.contains(sessionPath)) {
+        return;
     }
+    forgetSession(sessionPath);
 
-    return stream->parameters();
+    if (!compositorPresent("Stop")) {
+        return;
+    }
+
+    traceEvent("niri-session-rollback", sessionPath);
+    callAsync(sessionPath, MutterScreenCastSessionInterface::staticInterfaceName(),
+              "Stop", {}, CompositorCallTimeoutMs,
+              [sessionPath](const QDBusMessage &reply) {
+                  if (reply.type() == QDBusMessage::ErrorMessage) {
+                      qCWarning(lcNiri) << "Stop of" << sessionPath << "failed:" << reply.errorMessage();
+                  }
+              });
 }
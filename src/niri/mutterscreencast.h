@@ -1,12 +1,19 @@
 #ifndef MUTTERSCREENCAST_H
 #define MUTTERSCREENCAST_H
 
+#include "compositorbackend.h"
+#include "compositorwatcher.h"
+#include "dbuspropertycache.h"
+#include "nirisignalrouter.h"
+#include "objectcounter.h"
 #include <QDBusAbstractInterface>
+#include <QDBusArgument>
 #include <QDBusConnection>
 #include <QDBusObjectPath>
-#include <QDBusReply>
+#include <QMultiHash>
 #include <QObject>
 #include <QVariantMap>
+#include <functional>
 
 // Main ScreenCast interface
 class MutterScreenCastInterface : public QDBusAbstractInterface
@@ -25,20 +32,18 @@ public:
               staticInterfaceName(),
               QDBusConnection::sessionBus(),
               parent)
-    {}
-
-    int version() const
+        , m_properties(new DBusPropertyCache(service(), path(), interface(), this))
     {
-        return property("version").toInt();
+        setTimeout(CompositorCallTimeoutMs);
     }
 
-public slots:
-    QDBusReply<QDBusObjectPath> CreateSession(const QVariantMap &properties)
+    int version() const
     {
-        QList<QVariant> args;
-        args << QVariant::fromValue(properties);
-        return callWithArgumentList(QDBus::Block, "CreateSession", args);
+        return m_properties->value("Version").toInt();
     }
+
+private:
+    DBusPropertyCache *m_properties;
 };
 
 // Session interface
@@ -58,44 +63,19 @@ public:
               QDBusConnection::sessionBus(),
               parent)
     {
-        // Connect to Closed signal
-        QDBusConnection::sessionBus().connect(
-            "org.gnome.Mutter.ScreenCast",
-            path,
-            staticInterfaceName(),
-            "Closed",
-            this,
-            SIGNAL(Closed())
-            );
-    }
+        setTimeout(CompositorCallTimeoutMs);
 
-public slots:
-    QDBusReply<void> Start()
-    {
-        return call(QDBus::Block, "Start");
-    }
-
-    QDBusReply<void> Stop()
-    {
-        return call(QDBus::Block, "Stop");
-    }
-
-    QDBusReply<QDBusObjectPath> RecordMonitor(const QString &connector, const QVariantMap &properties)
-    {
-        QList<QVariant> args;
-        args << connector << QVariant::fromValue(properties);
-        return callWithArgumentList(QDBus::Block, "RecordMonitor", args);
-    }
-
-    QDBusReply<QDBusObjectPath> RecordWindow(const QVariantMap &properties)
-    {
-        QList<QVariant> args;
-        args << QVariant::fromValue(properties);
-        return callWithArgumentList(QDBus::Block, "RecordWindow", args);
+        // Through the shared subscription, no match rule of our own
+        NiriSignalRouter::instance().listen(
+            "org.gnome.Mutter.ScreenCast", path, staticInterfaceName(), "Closed",
+            this, [this](const QDBusMessage &) { emit Closed(); });
     }
 
 signals:
     void Closed();
+
+private:
+    Counted<MutterScreenCastSessionInterface> m_counted;
 };
 
 // Stream interface
@@ -115,29 +95,33 @@ public:
               staticInterfaceName(),
               QDBusConnection::sessionBus(),
               parent)
+        , m_properties(new DBusPropertyCache(service(), path, interface(), this))
     {
-        // Connect to PipeWireStreamAdded signal
-        QDBusConnection::sessionBus().connect(
-            "org.gnome.Mutter.ScreenCast",
-            path,
-            staticInterfaceName(),
-            "PipeWireStreamAdded",
-            this,
-            SIGNAL(PipeWireStreamAdded(uint))
-            );
+        setTimeout(CompositorCallTimeoutMs);
+
+        NiriSignalRouter::instance().listen(
+            "org.gnome.Mutter.ScreenCast", path, staticInterfaceName(), "PipeWireStreamAdded",
+            this, [this](const QDBusMessage &message) {
+                emit PipeWireStreamAdded(message.arguments().value(0).toUInt());
+            });
     }
 
+    // Fetched along with the stream, usually there before its node is
     QVariantMap parameters() const
     {
-        return qvariant_cast<QVariantMap>(property("Parameters"));
+        return qdbus_cast<QVariantMap>(m_properties->value("Parameters"));
     }
 
 signals:
     void PipeWireStreamAdded(uint nodeId);
+
+private:
+    DBusPropertyCache *m_properties;
+    Counted<MutterScreenCastStreamInterface> m_counted;
 };
 
-// Wrapper class to manage the lifecycle
-class MutterScreenCast : public QObject
+// Wrapper class to manage the lifecycle, the real CompositorBackend
+class MutterScreenCast : public CompositorBackend
 {
     Q_OBJECT
 
@@ -145,36 +129,47 @@ public:
     explicit MutterScreenCast(QObject *parent = nullptr);
     ~MutterScreenCast();
 
-    bool isAvailable() const;
-
-    // Create a new screencast session
-    QString createSession();
-
-    // Record a monitor output
-    QString recordMonitor(const QString &sessionPath, const QString &connector,
-                          uint cursorMode = 0);
-
-    // Record a window
-    QString recordWindow(const QString &sessionPath, uint64_t windowId,
-                         uint cursorMode = 0);
-
-    // Start the session
-    bool startSession(const QString &sessionPath);
-
-    // Stop the session
-    bool stopSession(const QString &sessionPath);
+    bool isAvailable() const override;
 
     // Get stream parameters (position, size)
-    QVariantMap getStreamParameters(const QString &streamPath);
-
-signals:
-    void sessionClosed(const QString &sessionPath);
-    void pipeWireStreamAdded(const QString &streamPath, uint nodeId);
+    QVariantMap getStreamParameters(const QString &streamPath) override;
+
+    // The session calls behind portal Start, none of them block. Each is
+    // bounded by timeoutMs; properties can link the session to a remote
+    // desktop one with "remote-desktop-session-id". done isn't called once context is gone; a session that
+    // shows up after the step timed out or its context went away is stopped.
+    void createSessionAsync(const QVariantMap &properties, int timeoutMs,
+                            QObject *context, PathCallback done) override;
+    void recordMonitorAsync(const QString &sessionPath, const QString &connector, uint cursorMode,
+                            int timeoutMs, QObject *context, PathCallback done) override;
+    void recordWindowAsync(const QString &sessionPath, uint64_t windowId, uint cursorMode,
+                           int timeoutMs, QObject *context, PathCallback done) override;
+    void startSessionAsync(const QString &sessionPath, int timeoutMs,
+                           QObject *context, DoneCallback done) override;
+
+    // Rollback: Stop without waiting for the reply, and forget the session
+    // right away so no sessionClosed follows
+    void stopSessionAsync(const QString &sessionPath) override;
 
 private:
+    // Niri went away or came back, see CompositorWatcher
+    void onCompositorLost();
+    void onCompositorReturned();
+    bool compositorPresent(const char *call) const;
+
+    MutterScreenCastSessionInterface *addSession(const QString &sessionPath);
+    MutterScreenCastStreamInterface *addStream(const QString &sessionPath, const QString &streamPath);
+    // Drop the proxies of a session that's gone, its streams' too
+    void forgetSession(const QString &sessionPath);
+    void callAsync(const QString &path, const char *interface, const char *method,
+                   const QVariantList &args, int timeoutMs,
+                   std::function<void(const QDBusMessage &reply)> handler);
+
     MutterScreenCastInterface *m_screencast;
     QMap<QString, MutterScreenCastSessionInterface*> m_sessions;
     QMap<QString, MutterScreenCastStreamInterface*> m_streams;
+    QMultiHash<QString, QString> m_sessionStreams; // session path -> stream paths
+    quint64 m_callCount = 0;
 };
 
 #endif // MUTTERSCREENCAST_H
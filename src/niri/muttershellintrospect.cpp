@@ -1,4 +1,6 @@
 #include "muttershellintrospect.h"
+#include "compositorwatcher.h"
+#include "logging.h"
 #include <QDebug>
 #include <QDBusReply>
 
@@ -6,8 +8,16 @@ MutterShellIntrospect::MutterShellIntrospect(QObject *parent)
     : QObject(parent)
     , m_shellIntrospect(new MutterShellIntrospectInterface(this))
 {
+    // The old proxy resolved its owner against the dead instance
+    connect(&CompositorWatcher::instance(), &CompositorWatcher::serviceReturned, this, [this](const QString &service) {
+        if (service == QLatin1String(MutterShellIntrospectInterface::staticInterfaceName())) {
+            delete m_shellIntrospect;
+            m_shellIntrospect = new MutterShellIntrospectInterface(this);
+        }
+    });
+
     if (!m_shellIntrospect->isValid()) {
-        qWarning() << "Failed to connect to Mutter Shell Introspect interface";
+        qCWarning(lcNiri) << "Failed to connect to Mutter Shell Introspect interface";
     }
 }
 
@@ -17,13 +27,19 @@ MutterShellIntrospect::~MutterShellIntrospect()
 
 bool MutterShellIntrospect::isAvailable() const
 {
-    return m_shellIntrospect->isValid();
+    return CompositorWatcher::instance().isPresent(MutterShellIntrospectInterface::staticInterfaceName())
+        && m_shellIntrospect->isValid();
 }
 
 QVector<WindowInfo> MutterShellIntrospect::getWindows()
 {
     QVector<WindowInfo> windows;
 
+    if (!isAvailable()) {
+        qCWarning(lcNiri) << "GetWindows skipped, Niri's Introspect is gone";
+        return windows;
+    }
+
     QDBusMessage msg = QDBusMessage::createMethodCall(
         "org.gnome.Shell.Introspect",
         "/org/gnome/Shell/Introspect",
@@ -31,15 +47,22 @@ QVector<WindowInfo> MutterShellIntrospect::getWindows()
         "GetWindows"
         );
 
-    QDBusMessage reply = QDBusConnection::sessionBus().call(msg);
+    QDBusMessage reply = QDBusConnection::sessionBus().call(msg, QDBus::Block, CompositorCallTimeoutMs);
 
     if (reply.type() == QDBusMessage::ErrorMessage) {
-        qWarning() << "GetWindows failed:" << reply.errorMessage();
+        qCWarning(lcNiri) << "GetWindows failed:" << reply.errorMessage();
         return windows;
     }
 
+    return parseWindows(reply);
+}
+
+QVector<WindowInfo> MutterShellIntrospect::parseWindows(const QDBusMessage &reply)
+{
+    QVector<WindowInfo> windows;
+
     if (reply.arguments().isEmpty()) {
-        qWarning() << "GetWindows returned no arguments";
+        qCWarning(lcNiri) << "GetWindows returned no arguments";
         return windows;
     }
 
@@ -70,12 +93,12 @@ QVector<WindowInfo> MutterShellIntrospect::getWindows()
             windows.append(window);
 
         } catch (...) {
-            qWarning() << "Failed to parse window entry, skipping";
+            qCWarning(lcNiri) << "Failed to parse window entry, skipping";
             try { arg.endMapEntry(); } catch (...) {}
         }
     }
     arg.endMap();
 
-    qInfo() << "Successfully parsed" << windows.size() << "windows";
+    qCDebug(lcNiri) << "Successfully parsed" << windows.size() << "windows";
     return windows;
 }
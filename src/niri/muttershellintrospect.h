@@ -1,6 +1,7 @@
 #ifndef MUTTERSHELLINTROSPECT_H
 #define MUTTERSHELLINTROSPECT_H
 
+#include "compositorwatcher.h"
 #include <QObject>
 #include <QDBusAbstractInterface>
 #include <QDBusConnection>
@@ -24,7 +25,9 @@ public:
               staticInterfaceName(),
               QDBusConnection::sessionBus(),
               parent)
-    {}
+    {
+        setTimeout(CompositorCallTimeoutMs);
+    }
 
 public slots:
     QDBusReply<QVariantMap> GetWindows()
@@ -51,6 +54,9 @@ public:
     bool isAvailable() const;
     QVector<WindowInfo> getWindows();
 
+    // Parse a GetWindows reply
+    static QVector<WindowInfo> parseWindows(const QDBusMessage &reply);
+
 private:
     MutterShellIntrospectInterface *m_shellIntrospect;
 };
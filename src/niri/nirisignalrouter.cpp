@@ -0,0 +1,64 @@
+#include "nirisignalrouter.h"
+#include "logging.h"
+#include <QDBusConnection>
+
+NiriSignalRouter &NiriSignalRouter::instance()
+{
+    static NiriSignalRouter router;
+    return router;
+}
+
+void NiriSignalRouter::listen(const QString &service, const QString &path, const QString &interface,
+                              const QString &signal, QObject *owner, Handler handler)
+{
+    const QString key = service + u'|' + interface + u'|' + signal;
+
+    Subscription *&subscription = m_subscriptions[key];
+    if (!subscription) {
+        subscription = new Subscription(service, interface, signal, this);
+    }
+    subscription->add(path, owner, std::move(handler));
+}
+
+int NiriSignalRouter::listeners() const
+{
+    int count = 0;
+    for (const Subscription *subscription : m_subscriptions) {
+        count += subscription->count();
+    }
+    return count;
+}
+
+NiriSignalRouter::Subscription::Subscription(const QString &service, const QString &interface,
+                                             const QString &signal, QObject *parent)
+    : QObject(parent)
+{
+    // No path: every object of the service, filtered here
+    if (!QDBusConnection::sessionBus().connect(service, QString(), interface, signal,
+                                               this, SLOT(dispatch(QDBusMessage)))) {
+        qCWarning(lcNiri) << "Could not subscribe to" << interface << signal;
+    }
+}
+
+void NiriSignalRouter::Subscription::add(const QString &path, QObject *owner, Handler handler)
+{
+    m_listeners.insert(path, { owner, std::move(handler) });
+
+    // The QPointer is already null by the time destroyed() fires
+    connect(owner, &QObject::destroyed, this, [this, path]() {
+        for (auto it = m_listeners.find(path); it != m_listeners.end() && it.key() == path; ) {
+            it = it->owner.isNull() ? m_listeners.erase(it) : std::next(it);
+        }
+    });
+}
+
+void NiriSignalRouter::Subscription::dispatch(const QDBusMessage &message)
+{
+    // Handlers may add or drop listeners for this path
+    const QList<Listener> listeners = m_listeners.values(message.path());
+    for (const Listener &listener : listeners) {
+        if (listener.owner) {
+            listener.handler(message);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef NIRISIGNALROUTER_H
+#define NIRISIGNALROUTER_H
+
+#include <QDBusMessage>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <functional>
+
+// Signals of per-session and per-stream objects, without a match rule per
+// object. The first listener for a (service, interface, signal) adds one
+// rule that leaves the path out, after that signals are handed to the
+// listeners of their path through a hash lookup. Adding and removing a
+// listener never goes to the bus.
+class NiriSignalRouter : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Handler = std::function<void(const QDBusMessage &message)>;
+
+    static NiriSignalRouter &instance();
+
+    // handler runs for signal on path until owner is destroyed
+    void listen(const QString &service, const QString &path, const QString &interface,
+                const QString &signal, QObject *owner, Handler handler);
+
+    // Live listeners and match rules, for the benchmarks
+    int listeners() const;
+    int subscriptions() const { return int(m_subscriptions.size()); }
+
+    // One match rule each
+    class Subscription;
+
+private:
+    NiriSignalRouter() = default;
+
+    QHash<QString, Subscription *> m_subscriptions; // by service, interface and signal
+};
+
+class NiriSignalRouter::Subscription : public QObject
+{
+    Q_OBJECT
+
+public:
+    Subscription(const QString &service, const QString &interface, const QString &signal,
+                 QObject *parent);
+
+    void add(const QString &path, QObject *owner, Handler handler);
+    int count() const { return int(m_listeners.size()); }
+
+private slots:
+    void dispatch(const QDBusMessage &message);
+
+private:
+    struct Listener {
+        QPointer<QObject> owner;
+        Handler handler;
+    };
+
+    QMultiHash<QString, Listener> m_listeners; // by path
+};
+
+#endif // NIRISIGNALROUTER_H
@@ -0,0 +1,38 @@
+#include "objectcounter.h"
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+// Lookups only happen once per class, the hot path is the cached reference
+static QMutex s_mutex;
+static QHash<QByteArray, std::atomic<int> *> s_counters;
+
+std::atomic<int> &ObjectCounter::counter(const char *className)
+{
+    QMutexLocker locker(&s_mutex);
+
+    std::atomic<int> *&counter = s_counters[QByteArray(className)];
+    if (!counter) {
+        counter = new std::atomic<int>(0);
+    }
+    return *counter;
+}
+
+int ObjectCounter::count(const char *className)
+{
+    QMutexLocker locker(&s_mutex);
+
+    const std::atomic<int> *counter = s_counters.value(QByteArray(className));
+    return counter ? counter->load(std::memory_order_relaxed) : 0;
+}
+
+QVariantMap ObjectCounter::snapshot()
+{
+    QMutexLocker locker(&s_mutex);
+
+    QVariantMap counts;
+    for (auto it = s_counters.cbegin(); it != s_counters.cend(); ++it) {
+        counts.insert(QString::fromLatin1(it.key()), it.value()->load(std::memory_order_relaxed));
+    }
+    return counts;
+}
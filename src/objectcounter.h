@@ -0,0 +1,37 @@
+#ifndef OBJECTCOUNTER_H
+#define OBJECTCOUNTER_H
+
+#include <QVariantMap>
+#include <atomic>
+
+// Live instances of the per-request classes, to tell a leak from a slow
+// allocator when RSS creeps up. A class opts in with a Counted<Self> member;
+// the counts show up in Debug.LiveObjects and the soak test.
+class ObjectCounter
+{
+public:
+    static QVariantMap snapshot();
+    static int count(const char *className);
+
+    // The counter for a class, created on first use and never freed
+    static std::atomic<int> &counter(const char *className);
+};
+
+template<typename T>
+class Counted
+{
+public:
+    Counted() { live().fetch_add(1, std::memory_order_relaxed); }
+    Counted(const Counted &) : Counted() {}
+    ~Counted() { live().fetch_sub(1, std::memory_order_relaxed); }
+    Counted &operator=(const Counted &) { return *this; }
+
+private:
+    static std::atomic<int> &live()
+    {
+        static std::atomic<int> &counter = ObjectCounter::counter(T::staticMetaObject.className());
+        return counter;
+    }
+};
+
+#endif // OBJECTCOUNTER_H
@@ -0,0 +1,52 @@
+#include "portalconfig.h"
+#include "logging.h"
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+
+static PortalConfig *s_config = nullptr;
+
+const PortalConfig &PortalConfig::instance()
+{
+    if (!s_config) {
+        reload();
+    }
+    return *s_config;
+}
+
+void PortalConfig::reload()
+{
+    delete s_config;
+    s_config = new PortalConfig;
+    s_config->load();
+}
+
+QString PortalConfig::path()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation)
+        + QStringLiteral("/xdg-desktop-portal-uni/config.ini");
+}
+
+void PortalConfig::load()
+{
+    const QString file = path();
+    if (!QFileInfo::exists(file)) {
+        return;
+    }
+
+    QSettings settings(file, QSettings::IniFormat);
+    shareStreams = settings.value("ScreenCast/share_streams", shareStreams).toBool();
+
+    auto readLimits = [&settings](Limits &limits, const QString &suffix) {
+        limits.sessions = settings.value("Limits/sessions" + suffix, 0).toInt();
+        limits.streams = settings.value("Limits/streams" + suffix, 0).toInt();
+        limits.rate = settings.value("Limits/requests_per_second" + suffix, 0).toDouble();
+        limits.burst = settings.value("Limits/burst" + suffix, 0).toInt();
+    };
+    readLimits(perAppLimits, QStringLiteral("_per_app"));
+    readLimits(globalLimits, QString());
+
+    pickerTimeoutMs = qMax(1, settings.value("Picker/timeout_ms", pickerTimeoutMs).toInt());
+
+    qCDebug(lcPortal) << "Config from" << file << "share_streams" << shareStreams;
+}
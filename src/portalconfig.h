@@ -0,0 +1,52 @@
+#ifndef PORTALCONFIG_H
+#define PORTALCONFIG_H
+
+#include <QString>
+
+// Settings from $XDG_CONFIG_HOME/xdg-desktop-portal-uni/config.ini, read once
+// at startup. Everything is optional and defaults to the behaviour without a
+// config file, e.g.
+//
+//     [ScreenCast]
+//     share_streams=true
+//
+//     [Limits]
+//     sessions_per_app=4
+//     requests_per_second_per_app=5
+//
+//     [Picker]
+//     timeout_ms=500
+class PortalConfig
+{
+public:
+    static const PortalConfig &instance();
+
+    // Re-read the file, for tests
+    static void reload();
+    static QString path();
+
+    // Hand out one Niri stream to every session capturing the same source
+    // with the same cursor mode, instead of one stream each
+    bool shareStreams = false;
+
+    // Admission limits on screencast requests, 0 means no limit. Unsandboxed
+    // apps all come in with an empty app id and share one allowance.
+    struct Limits {
+        int sessions = 0;       // concurrent portal sessions
+        int streams = 0;        // concurrent started streams
+        double rate = 0;        // requests per second, token bucket
+        int burst = 0;          // bucket size, defaults to the rate
+    };
+    Limits perAppLimits;
+    Limits globalLimits;
+
+    // How long a registered external picker gets to say it's showing the
+    // sources before the built-in one comes up instead
+    int pickerTimeoutMs = 1000;
+
+private:
+    PortalConfig() = default;
+    void load();
+};
+
+#endif // PORTALCONFIG_H
@@ -0,0 +1,40 @@
+#include "portaldebug.h"
+#include "chrometrace.h"
+#include "objectcounter.h"
+#include "screencast.h"
+#include "tracering.h"
+
+PortalDebug::PortalDebug(ScreenCast *screencast, QObject *parent)
+    : QDBusAbstractAdaptor{parent}
+    , m_screencast(screencast)
+{}
+
+QStringList PortalDebug::DumpTrace()
+{
+    return TraceRing::instance().dump();
+}
+
+QVariantMap PortalDebug::StreamStats()
+{
+    return m_screencast->streamStats();
+}
+
+QVariantMap PortalDebug::LiveObjects()
+{
+    return ObjectCounter::snapshot();
+}
+
+QVariantMap PortalDebug::AdmissionStats()
+{
+    return m_screencast->admissionStats();
+}
+
+void PortalDebug::SetTracing(bool enabled)
+{
+    ChromeTrace::instance().setEnabled(enabled);
+}
+
+bool PortalDebug::WriteTrace(const QString &path)
+{
+    return ChromeTrace::instance().write(path);
+}
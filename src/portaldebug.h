@@ -0,0 +1,38 @@
+#ifndef PORTALDEBUG_H
+#define PORTALDEBUG_H
+
+#include <QObject>
+#include <QDBusAbstractAdaptor>
+#include <QStringList>
+#include <QVariantMap>
+
+class ScreenCast;
+
+// Post-mortem helpers, e.g.
+// busctl --user call org.freedesktop.impl.portal.desktop.uni /org/freedesktop/portal/desktop \
+//     org.freedesktop.impl.portal.desktop.uni.Debug DumpTrace
+class PortalDebug : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.impl.portal.desktop.uni.Debug")
+
+public:
+    explicit PortalDebug(ScreenCast *screencast, QObject *parent = nullptr);
+
+public slots:
+    QStringList DumpTrace();
+    // Per session: the streams handed out and how they're doing
+    QVariantMap StreamStats();
+    // Live instances per class of the per-request objects, for leak hunting
+    QVariantMap LiveObjects();
+    // Requests refused by the [Limits] in config.ini, and current usage
+    QVariantMap AdmissionStats();
+    // Chrome trace of everything between turning it on and writing it out
+    void SetTracing(bool enabled);
+    bool WriteTrace(const QString &path);
+
+private:
+    ScreenCast *m_screencast;
+};
+
+#endif // PORTALDEBUG_H
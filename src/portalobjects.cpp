@@ -0,0 +1,176 @@
+#include "portalobjects.h"
+#include "callrecorder.h"
+#include "logging.h"
+#include "objectcounter.h"
+#include <QDBusMessage>
+#include <QDBusVariant>
+
+const QString PortalObjects::RequestRoot = QStringLiteral("/org/freedesktop/portal/desktop/request");
+const QString PortalObjects::SessionRoot = QStringLiteral("/org/freedesktop/portal/desktop/session");
+
+static const QString RequestInterface = QStringLiteral("org.freedesktop.impl.portal.Request");
+static const QString SessionInterface = QStringLiteral("org.freedesktop.impl.portal.Session");
+static const QString PropertiesInterface = QStringLiteral("org.freedesktop.DBus.Properties");
+static constexpr uint SessionVersion = 4;
+
+static std::atomic<int> &liveCounter(bool isSession)
+{
+    static std::atomic<int> &requests = ObjectCounter::counter("PortalRequest");
+    static std::atomic<int> &sessions = ObjectCounter::counter("PortalSession");
+    return isSession ? sessions : requests;
+}
+
+PortalObjects::PortalObjects(const QDBusConnection &bus, QObject *parent)
+    : QDBusVirtualObject(parent)
+    , m_bus(bus)
+{
+    // Nothing to serve on a bus that isn't there, the table still works
+    for (const QString &root : { RequestRoot, SessionRoot }) {
+        if (m_bus.isConnected() && !m_bus.registerVirtualObject(root, this, QDBusConnection::SubPath)) {
+            qCWarning(lcPortal) << "Could not register" << root << m_bus.lastError().message();
+        }
+    }
+}
+
+PortalObjects::~PortalObjects()
+{
+    for (const QString &root : { RequestRoot, SessionRoot }) {
+        m_bus.unregisterObject(root);
+    }
+    for (const Entry &entry : std::as_const(m_objects)) {
+        liveCounter(entry.isSession).fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void PortalObjects::insert(const QString &path, Entry entry)
+{
+    Entry old;
+    take(path, old); // a client reusing a token replaces the old one
+
+    liveCounter(entry.isSession).fetch_add(1, std::memory_order_relaxed);
+    m_requests += entry.isSession ? 0 : 1;
+    m_objects.insert(path, std::move(entry));
+}
+
+bool PortalObjects::take(const QString &path, Entry &entry)
+{
+    auto it = m_objects.find(path);
+    if (it == m_objects.end()) {
+        return false;
+    }
+
+    entry = std::move(it.value());
+    m_objects.erase(it);
+    liveCounter(entry.isSession).fetch_sub(1, std::memory_order_relaxed);
+    m_requests -= entry.isSession ? 0 : 1;
+    return true;
+}
+
+void PortalObjects::addRequest(const QString &path, CloseHandler onClose)
+{
+    insert(path, { false, std::move(onClose) });
+}
+
+void PortalObjects::addRequestUntilReplied(const QString &path)
+{
+    addRequest(path);
+
+    // The reply goes out once the call returns, this runs right after
+    QMetaObject::invokeMethod(this, [this, path]() { remove(path); }, Qt::QueuedConnection);
+}
+
+void PortalObjects::addSession(const QString &path, CloseHandler onClose)
+{
+    insert(path, { true, std::move(onClose) });
+}
+
+void PortalObjects::remove(const QString &path)
+{
+    Entry entry;
+    take(path, entry);
+}
+
+void PortalObjects::closeSession(const QString &path)
+{
+    Entry entry;
+    if (!take(path, entry)) {
+        return;
+    }
+
+    if (entry.isSession) {
+        m_bus.send(QDBusMessage::createSignal(path, SessionInterface, QStringLiteral("Closed")));
+    }
+    if (entry.onClose) {
+        entry.onClose();
+    }
+}
+
+QString PortalObjects::introspect(const QString &path) const
+{
+    const auto it = m_objects.constFind(path);
+    if (it == m_objects.cend()) {
+        return QString();
+    }
+
+    if (!it->isSession) {
+        return QStringLiteral("  <interface name=\"%1\">\n"
+                              "    <method name=\"Close\"/>\n"
+                              "  </interface>\n").arg(RequestInterface);
+    }
+    return QStringLiteral("  <interface name=\"%1\">\n"
+                          "    <method name=\"Close\"/>\n"
+                          "    <signal name=\"Closed\"/>\n"
+                          "    <property name=\"version\" type=\"u\" access=\"read\"/>\n"
+                          "  </interface>\n").arg(SessionInterface);
+}
+
+bool PortalObjects::handleMessage(const QDBusMessage &message, const QDBusConnection &connection)
+{
+    const QString path = message.path();
+    const auto it = m_objects.constFind(path);
+    if (it == m_objects.cend()) {
+        if (message.interface() == QLatin1String("org.freedesktop.DBus.Introspectable")) {
+            return false; // the roots themselves, Qt lists the children
+        }
+        connection.send(message.createErrorReply(QDBusError::UnknownObject,
+                                                 QStringLiteral("No such object path '%1'").arg(path)));
+        return true;
+    }
+
+    const QString interface = message.interface();
+    const QString member = message.member();
+    const bool isSession = it->isSession;
+
+    if (member == QLatin1String("Close")
+        && (interface.isEmpty() || interface == (isSession ? SessionInterface : RequestInterface))) {
+        // Replied first, the handler may send a reply of its own to the call
+        // this request belongs to
+        connection.send(message.createReply());
+        if (isSession) {
+            CallRecorder::instance().record(message, path);
+            closeSession(path);
+        } else {
+            Entry entry;
+            take(path, entry);
+            if (entry.onClose) {
+                entry.onClose();
+            }
+        }
+        return true;
+    }
+
+    if (isSession && interface == PropertiesInterface) {
+        const QString property = message.arguments().value(1).toString();
+        if (member == QLatin1String("Get") && property == QLatin1String("version")) {
+            connection.send(message.createReply(QVariant::fromValue(QDBusVariant(SessionVersion))));
+            return true;
+        }
+        if (member == QLatin1String("GetAll")) {
+            connection.send(message.createReply(QVariant::fromValue(QVariantMap{ { "version", SessionVersion } })));
+            return true;
+        }
+    }
+
+    // Introspect is Qt's, anything else an error from it
+    return false;
+}
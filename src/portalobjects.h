@@ -0,0 +1,65 @@
+#ifndef PORTALOBJECTS_H
+#define PORTALOBJECTS_H
+
+#include <QDBusConnection>
+#include <QDBusVirtualObject>
+#include <QHash>
+#include <QString>
+#include <functional>
+
+// The Request and Session objects of every portal call, served from one
+// table. One virtual object sits on each of the request and session
+// subtrees and answers Close (and the Session's version property) for the
+// paths in the table, so a call costs a hash insert rather than a QObject,
+// an adaptor and a registerObject/unregisterObject pair.
+//
+// Close from the client and close() from our side both drop the entry
+// before running its handler, so a handler may add or remove freely. The
+// entries count towards Debug.LiveObjects as PortalRequest/PortalSession.
+class PortalObjects : public QDBusVirtualObject
+{
+    Q_OBJECT
+
+public:
+    using CloseHandler = std::function<void()>;
+
+    static const QString RequestRoot;
+    static const QString SessionRoot;
+
+    explicit PortalObjects(const QDBusConnection &bus, QObject *parent = nullptr);
+    ~PortalObjects() override;
+
+    // onClose runs when the client closes it, may be empty
+    void addRequest(const QString &path, CloseHandler onClose = {});
+    // For calls that reply right away: gone once the reply is out
+    void addRequestUntilReplied(const QString &path);
+    // onClose runs when either side closes it
+    void addSession(const QString &path, CloseHandler onClose);
+
+    bool contains(const QString &path) const { return m_objects.contains(path); }
+    // Drop without running the handler, the request got its answer
+    void remove(const QString &path);
+    // Our side ending a session: Closed goes out, then its handler runs
+    void closeSession(const QString &path);
+
+    int requests() const { return m_requests; }
+    int sessions() const { return int(m_objects.size()) - m_requests; }
+
+    QString introspect(const QString &path) const override;
+    bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override;
+
+private:
+    struct Entry {
+        bool isSession = false;
+        CloseHandler onClose;
+    };
+
+    void insert(const QString &path, Entry entry);
+    bool take(const QString &path, Entry &entry);
+
+    QDBusConnection m_bus;
+    QHash<QString, Entry> m_objects;
+    int m_requests = 0;
+};
+
+#endif // PORTALOBJECTS_H
@@ -0,0 +1,344 @@
+#include "remotedesktop.h"
+#include "logging.h"
+#include "chrometrace.h"
+#include "portalobjects.h"
+#include "startjob.h"
+#include "tracering.h"
+#include <QDBusConnection>
+
+RemoteDesktop::RemoteDesktop(ScreenCast *screencast, QObject *parent)
+    : QDBusAbstractAdaptor{parent}
+    , m_screencast(screencast)
+    , m_mutterRemoteDesktop(new MutterRemoteDesktop(this))
+{
+    if (!m_mutterRemoteDesktop->isAvailable()) {
+        qCWarning(lcPortal) << "Niri remote desktop is not available!";
+    }
+
+    // The compositor ended it, e.g. the linked stream went away
+    connect(m_mutterRemoteDesktop, &MutterRemoteDesktop::sessionClosed, this, [this](const QString &niriPath) {
+        for (auto it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+            if (it->niriSessionPath == niriPath) {
+                // Already gone on the Niri side, just tell the client
+                it->niriSessionPath.clear();
+                m_screencast->portalObjects()->closeSession(it.key());
+                return;
+            }
+        }
+    });
+
+    // The monitor gave up on the stream we hand out with this session
+    connect(m_screencast->streamMonitor(), &StreamMonitor::stalled, this, [this](uint nodeId, const QString &reason) {
+        auto it = m_sessions.find(m_screencast->sessionForNode(nodeId));
+        if (it != m_sessions.end()) {
+            qCWarning(lcPortal) << "Closing remote desktop session after its stream stalled:" << reason;
+            m_screencast->portalObjects()->closeSession(it.key());
+        }
+    });
+}
+
+uint RemoteDesktop::availableDeviceTypes() const
+{
+    return m_mutterRemoteDesktop->supportedDeviceTypes();
+}
+
+uint RemoteDesktop::CreateSession(
+    const QDBusObjectPath &handle,
+    const QDBusObjectPath &session_handle,
+    const QString &app_id,
+    const QVariantMap &options,
+    QVariantMap &results)
+{
+    Q_UNUSED(app_id)
+    Q_UNUSED(options)
+    Q_UNUSED(results)
+
+    qCDebug(lcPortal) << "RemoteDesktop CreateSession" << session_handle.path();
+    traceEvent("rd-CreateSession", session_handle.path());
+
+    // Same Session object as a screencast session, which is what lets
+    // ScreenCast.SelectSources work on it
+    PortalObjects *objects = m_screencast->portalObjects();
+    objects->addRequestUntilReplied(handle.path());
+    objects->addSession(session_handle.path(), [this, sessionHandle = session_handle.path()]() {
+        closeSession(sessionHandle);
+    });
+
+    m_sessions.insert(session_handle.path(), Session());
+
+    return 0;
+}
+
+uint RemoteDesktop::SelectDevices(
+    const QDBusObjectPath &handle,
+    const QDBusObjectPath &session_handle,
+    const QString &app_id,
+    const QVariantMap &options,
+    QVariantMap &results)
+{
+    Q_UNUSED(handle)
+    Q_UNUSED(app_id)
+    Q_UNUSED(results)
+
+    auto it = m_sessions.find(session_handle.path());
+    if (it == m_sessions.end()) {
+        qCWarning(lcPortal) << "SelectDevices on unknown session" << session_handle.path();
+        return 2;
+    }
+
+    // Everything we have unless told otherwise
+    const uint available = availableDeviceTypes();
+    it->deviceTypes = options.value("types", available).toUInt() & available;
+
+    traceEvent("rd-SelectDevices", session_handle.path(), it->deviceTypes);
+    return 0;
+}
+
+uint RemoteDesktop::Start(
+    const QDBusObjectPath &handle,
+    const QDBusObjectPath &session_handle,
+    const QString &app_id,
+    const QString &parent_window,
+    const QVariantMap &options,
+    const QDBusMessage &message,
+    QVariantMap &results)
+{
+    Q_UNUSED(app_id)
+    Q_UNUSED(parent_window)
+    Q_UNUSED(options)
+    Q_UNUSED(results)
+
+    const QString sessionHandle = session_handle.path();
+    qCDebug(lcPortal) << "RemoteDesktop Start" << sessionHandle;
+    traceEvent("rd-Start", sessionHandle);
+
+    auto it = m_sessions.find(sessionHandle);
+    if (it == m_sessions.end() || it->starting || it->batcher) {
+        qCWarning(lcPortal) << "Start on unknown or already started session" << sessionHandle;
+        return 2;
+    }
+
+    // Taken before anything goes out, a second Start is refused above
+    it->starting = true;
+    it->startMessage = message;
+    it->startHandle = handle.path();
+    traceAsyncBegin("rd-Start", sessionHandle);
+
+    // The client gave up, whatever Niri made so far goes away
+    m_screencast->portalObjects()->addRequest(handle.path(), [this, sessionHandle]() {
+        finishStart(sessionHandle, 2);
+    });
+
+    message.setDelayedReply(true);
+    m_mutterRemoteDesktop->createSessionAsync(CompositorCallTimeoutMs, this,
+        [this, sessionHandle](const QString &niriPath, const QString &niriSessionId, const QDBusError &error) {
+            auto it = m_sessions.find(sessionHandle);
+            if (it == m_sessions.end() || !it->starting) {
+                m_mutterRemoteDesktop->stopSessionAsync(niriPath);
+                return;
+            }
+            if (error.isValid()) {
+                finishStart(sessionHandle, 2);
+                return;
+            }
+
+            it->niriSessionPath = niriPath;
+            startSession(sessionHandle, niriSessionId);
+        });
+
+    // The real reply goes out from finishStart()
+    return 0;
+}
+
+void RemoteDesktop::startSession(const QString &sessionHandle, const QString &niriSessionId)
+{
+    auto it = m_sessions.find(sessionHandle);
+    const QString niriPath = it->niriSessionPath;
+
+    // Input only
+    if (!m_screencast->hasSelectedSource(sessionHandle)) {
+        m_mutterRemoteDesktop->startSessionAsync(niriPath, CompositorCallTimeoutMs, this,
+            [this, sessionHandle](const QDBusError &error) {
+                finishStart(sessionHandle, error.isValid() ? 2 : 0);
+            });
+        return;
+    }
+
+    // Screencast and input share one compositor session: the screencast
+    // session is linked to ours and starts along with it
+    it->job = new StartJob(m_screencast->compositor(), m_screencast->selectedJobSource(sessionHandle),
+                           StartJob::DeadlineMs, this);
+    it->job->linkTo({ { "remote-desktop-session-id", niriSessionId } },
+                    [this, niriPath](int timeoutMs, QObject *context, std::function<void(const QDBusError &)> done) {
+                        m_mutterRemoteDesktop->startSessionAsync(niriPath, timeoutMs, context, std::move(done));
+                    });
+    it->job->start([this, sessionHandle](uint response) {
+        finishStart(sessionHandle, response);
+    });
+}
+
+void RemoteDesktop::finishStart(const QString &sessionHandle, uint response)
+{
+    auto it = m_sessions.find(sessionHandle);
+    if (it == m_sessions.end() || !it->starting) {
+        return;
+    }
+
+    it->starting = false;
+    StartJob *job = std::exchange(it->job, nullptr);
+
+    QVariantMap results;
+    if (response == 0) {
+        if (job) {
+            m_screencast->adoptStream(sessionHandle, job->streamPath(), job->nodeId(), results);
+        }
+        it->batcher = new InputBatcher(m_mutterRemoteDesktop, it->niriSessionPath, this);
+        results["devices"] = it->deviceTypes;
+    } else {
+        // Rolls back the linked screencast, then our own session
+        if (job) {
+            job->cancel();
+        }
+        if (!it->niriSessionPath.isEmpty()) {
+            m_mutterRemoteDesktop->stopSessionAsync(std::exchange(it->niriSessionPath, QString()));
+        }
+    }
+    if (job) {
+        job->deleteLater();
+    }
+
+    qCDebug(lcPortal) << "RemoteDesktop Start" << sessionHandle << "done, response" << response;
+    traceEvent("rd-start-done", sessionHandle, response);
+    traceAsyncEnd("rd-Start", sessionHandle);
+
+    QDBusConnection::sessionBus().send(
+        it->startMessage.createReply({ response, QVariant::fromValue(results) }));
+    m_screencast->portalObjects()->remove(it->startHandle);
+}
+
+RemoteDesktop::Session *RemoteDesktop::startedSession(const QDBusObjectPath &sessionHandle, uint deviceType)
+{
+    auto it = m_sessions.find(sessionHandle.path());
+    if (it == m_sessions.end() || !it->batcher || !(it->deviceTypes & deviceType)) {
+        return nullptr;
+    }
+    return &it.value();
+}
+
+void RemoteDesktop::closeSession(const QString &sessionHandle)
+{
+    // A Start still running answers 2 and rolls back
+    finishStart(sessionHandle, 2);
+
+    Session session = m_sessions.take(sessionHandle);
+    m_screencast->forgetStreams(sessionHandle);
+    m_screencast->dropSelectedSource(sessionHandle);
+
+    if (session.batcher) {
+        session.batcher->flush();
+        traceEvent("rd-input-coalesced", sessionHandle, qint64(session.batcher->eventsReceived() - session.batcher->messagesSent()));
+        session.batcher->deleteLater();
+    }
+
+    if (!session.niriSessionPath.isEmpty()) {
+        m_mutterRemoteDesktop->stopSessionAsync(session.niriSessionPath);
+    }
+}
+
+void RemoteDesktop::NotifyPointerMotion(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                        double dx, double dy)
+{
+    Q_UNUSED(options)
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Pointer)) {
+        session->batcher->pointerMotion(dx, dy);
+    }
+}
+
+void RemoteDesktop::NotifyPointerMotionAbsolute(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                                uint stream, double x, double y)
+{
+    Q_UNUSED(options)
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Pointer)) {
+        const QString streamPath = m_screencast->streamPathForNode(stream);
+        if (!streamPath.isEmpty()) {
+            session->batcher->pointerMotionAbsolute(streamPath, x, y);
+        }
+    }
+}
+
+void RemoteDesktop::NotifyPointerButton(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                        int button, uint state)
+{
+    Q_UNUSED(options)
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Pointer)) {
+        session->batcher->sendNow(QStringLiteral("NotifyPointerButton"), { button, state != 0 });
+    }
+}
+
+void RemoteDesktop::NotifyPointerAxis(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                      double dx, double dy)
+{
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Pointer)) {
+        session->batcher->pointerAxis(dx, dy, options.value("finish").toBool());
+    }
+}
+
+void RemoteDesktop::NotifyPointerAxisDiscrete(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                              uint axis, int steps)
+{
+    Q_UNUSED(options)
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Pointer)) {
+        session->batcher->sendNow(QStringLiteral("NotifyPointerAxisDiscrete"), { axis, steps });
+    }
+}
+
+void RemoteDesktop::NotifyKeyboardKeycode(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                          int keycode, uint state)
+{
+    Q_UNUSED(options)
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Keyboard)) {
+        session->batcher->sendNow(QStringLiteral("NotifyKeyboardKeycode"), { uint(keycode), state != 0 });
+    }
+}
+
+void RemoteDesktop::NotifyKeyboardKeysym(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                         int keysym, uint state)
+{
+    Q_UNUSED(options)
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Keyboard)) {
+        session->batcher->sendNow(QStringLiteral("NotifyKeyboardKeysym"), { uint(keysym), state != 0 });
+    }
+}
+
+void RemoteDesktop::NotifyTouchDown(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                    uint stream, uint slot, double x, double y)
+{
+    Q_UNUSED(options)
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Touchscreen)) {
+        const QString streamPath = m_screencast->streamPathForNode(stream);
+        if (!streamPath.isEmpty()) {
+            session->batcher->sendNow(QStringLiteral("NotifyTouchDown"), { streamPath, slot, x, y });
+        }
+    }
+}
+
+void RemoteDesktop::NotifyTouchMotion(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                      uint stream, uint slot, double x, double y)
+{
+    Q_UNUSED(options)
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Touchscreen)) {
+        const QString streamPath = m_screencast->streamPathForNode(stream);
+        if (!streamPath.isEmpty()) {
+            session->batcher->touchMotion(streamPath, slot, x, y);
+        }
+    }
+}
+
+void RemoteDesktop::NotifyTouchUp(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                  uint slot)
+{
+    Q_UNUSED(options)
+    if (Session *session = startedSession(session_handle, MutterRemoteDesktop::Touchscreen)) {
+        session->batcher->sendNow(QStringLiteral("NotifyTouchUp"), { slot });
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef REMOTEDESKTOP_H
+#define REMOTEDESKTOP_H
+
+#include <QObject>
+#include <QDBusAbstractAdaptor>
+#include <QDBusMessage>
+#include <QDBusObjectPath>
+#include <QHash>
+#include "mutterremotedesktop.h"
+#include "inputbatcher.h"
+#include "screencast.h"
+
+class RemoteDesktop : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.impl.portal.RemoteDesktop")
+    Q_PROPERTY(uint AvailableDeviceTypes READ availableDeviceTypes)
+    Q_PROPERTY(uint version READ version)
+
+public:
+    // Screen sources for a remote desktop session are picked through the
+    // ScreenCast interface on the same session handle
+    explicit RemoteDesktop(ScreenCast *screencast, QObject *parent = nullptr);
+
+    uint availableDeviceTypes() const;
+    uint version() const { return 2; }
+
+public slots:
+    uint CreateSession(
+        const QDBusObjectPath &handle,
+        const QDBusObjectPath &session_handle,
+        const QString &app_id,
+        const QVariantMap &options,
+        QVariantMap &results
+    );
+
+    uint SelectDevices(
+        const QDBusObjectPath &handle,
+        const QDBusObjectPath &session_handle,
+        const QString &app_id,
+        const QVariantMap &options,
+        QVariantMap &results
+    );
+
+    // Replies once Niri started the session and handed over the stream,
+    // if a source was selected
+    uint Start(
+        const QDBusObjectPath &handle,
+        const QDBusObjectPath &session_handle,
+        const QString &app_id,
+        const QString &parent_window,
+        const QVariantMap &options,
+        const QDBusMessage &message,
+        QVariantMap &results
+    );
+
+    void NotifyPointerMotion(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                             double dx, double dy);
+    void NotifyPointerMotionAbsolute(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                     uint stream, double x, double y);
+    void NotifyPointerButton(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                             int button, uint state);
+    void NotifyPointerAxis(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                           double dx, double dy);
+    void NotifyPointerAxisDiscrete(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                                   uint axis, int steps);
+    void NotifyKeyboardKeycode(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                               int keycode, uint state);
+    void NotifyKeyboardKeysym(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                              int keysym, uint state);
+    void NotifyTouchDown(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                         uint stream, uint slot, double x, double y);
+    void NotifyTouchMotion(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                           uint stream, uint slot, double x, double y);
+    void NotifyTouchUp(const QDBusObjectPath &session_handle, const QVariantMap &options,
+                       uint slot);
+
+private:
+    struct Session {
+        QString niriSessionPath;
+        uint deviceTypes = 0;
+        InputBatcher *batcher = nullptr;
+
+        // While Start runs, from the first call going out
+        bool starting = false;
+        QDBusMessage startMessage;
+        QString startHandle;
+        StartJob *job = nullptr; // the linked screencast, if a source was selected
+    };
+
+    // Started session that allows deviceType, or nullptr
+    Session *startedSession(const QDBusObjectPath &sessionHandle, uint deviceType);
+    void closeSession(const QString &sessionHandle);
+    // Niri's remote desktop session is there, start it with or without a stream
+    void startSession(const QString &sessionHandle, const QString &niriSessionId);
+    void finishStart(const QString &sessionHandle, uint response);
+
+    ScreenCast *m_screencast;
+    MutterRemoteDesktop *m_mutterRemoteDesktop;
+    QHash<QString, Session> m_sessions;
+};
+
+#endif // REMOTEDESKTOP_H
@@ -0,0 +1,101 @@
+#include "renderpacing.h"
+#include "chrometrace.h"
+#include "logging.h"
+#include "tracering.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QQuickWindow>
+#include <QSGRendererInterface>
+#include <QSurfaceFormat>
+#include <atomic>
+#include <memory>
+
+static RenderPacing::Backend s_backend = RenderPacing::Hardware;
+
+bool RenderPacing::hasRenderNode()
+{
+    return !QDir(QStringLiteral("/dev/dri")).entryList({ QStringLiteral("renderD*") }, QDir::System).isEmpty();
+}
+
+RenderPacing::Backend RenderPacing::configure()
+{
+    const QByteArray requested = qgetenv("QT_QUICK_BACKEND");
+
+    // Without a GPU Mesa falls back to llvmpipe, which burns far more CPU
+    // than QtQuick's own software renderer for a list like ours
+    if (requested == "software"
+        || (requested.isEmpty() && (!hasRenderNode() || qEnvironmentVariableIntValue("LIBGL_ALWAYS_SOFTWARE")))) {
+        s_backend = Software;
+    } else {
+        s_backend = Hardware;
+    }
+
+    if (s_backend == Software) {
+        QQuickWindow::setGraphicsApi(QSGRendererInterface::Software);
+        if (!qEnvironmentVariableIsSet("QSG_RENDER_LOOP")) {
+            qputenv("QSG_RENDER_LOOP", "basic");
+        }
+    } else {
+        if (!qEnvironmentVariableIsSet("QSG_RENDER_LOOP")) {
+            qputenv("QSG_RENDER_LOOP", "threaded");
+        }
+
+        // Block on vsync so animations run at the output's refresh rate and no faster
+        QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+        format.setSwapInterval(1);
+        QSurfaceFormat::setDefaultFormat(format);
+    }
+
+    qCDebug(lcPortal) << "Rendering with" << (s_backend == Software ? "software" : "hardware")
+                      << "backend, render loop" << qgetenv("QSG_RENDER_LOOP");
+    return s_backend;
+}
+
+RenderPacing::Backend RenderPacing::backend()
+{
+    return s_backend;
+}
+
+void RenderPacing::attach(QQuickWindow *window)
+{
+    if (!window) {
+        return;
+    }
+
+    // Frames per shown period, so a picker that never goes idle shows up in the trace
+    struct FrameStats {
+        std::atomic<int> frames{0};
+        QElapsedTimer shown;
+    };
+    auto stats = std::make_shared<FrameStats>();
+
+    // Both come from the render thread with the threaded loop. A frame's
+    // span starts at the sync with the GUI thread and ends at the swap.
+    QObject::connect(window, &QQuickWindow::beforeSynchronizing, window, []() {
+        if (ChromeTrace::enabled()) {
+            ChromeTrace::instance().begin("frame");
+        }
+    }, Qt::DirectConnection);
+    QObject::connect(window, &QQuickWindow::frameSwapped, window, [stats]() {
+        stats->frames.fetch_add(1, std::memory_order_relaxed);
+        if (ChromeTrace::enabled()) {
+            ChromeTrace::instance().end("frame");
+        }
+    }, Qt::DirectConnection);
+
+    QObject::connect(window, &QWindow::visibleChanged, window, [window, stats](bool visible) {
+        if (visible) {
+            stats->frames = 0;
+            stats->shown.start();
+            return;
+        }
+
+        const int frames = stats->frames.load();
+        traceEvent("picker-frames", {}, frames);
+        qCDebug(lcSelector) << "Picker rendered" << frames << "frames in" << stats->shown.elapsed() << "ms";
+
+        // Nothing is going to be drawn until the next picker, give back the
+        // scene graph's textures and buffers right away
+        window->releaseResources();
+    });
+}
@@ -0,0 +1,30 @@
+#ifndef RENDERPACING_H
+#define RENDERPACING_H
+
+class QQuickWindow;
+
+// How the picker gets rendered. Qt Quick only renders when something changed,
+// so as long as frames are tied to the output's refresh (vsync, or Wayland
+// frame callbacks for the software renderer) the picker costs nothing once
+// its entry animations are over.
+class RenderPacing
+{
+public:
+    enum Backend {
+        Hardware, // RHI with the threaded render loop, vsync'd
+        Software, // QtQuick's software renderer with the basic loop
+    };
+
+    // Pick a backend and render loop, before QApplication is created.
+    // QT_QUICK_BACKEND / QSG_RENDER_LOOP set by the user win.
+    static Backend configure();
+    static Backend backend();
+
+    // Per picker window: frame accounting and dropping resources when hidden
+    static void attach(QQuickWindow *window);
+
+private:
+    static bool hasRenderNode();
+};
+
+#endif // RENDERPACING_H
@@ -1,26 +1,67 @@
 #include "screencast.h"
-#include "screencastrequest.h"
-#include "screencastsession.h"
+#include "callrecorder.h"
+#include "chrometrace.h"
+#include "logging.h"
+#include "portalconfig.h"
+#include "compositorwatcher.h"
+#include "muttershellintrospect.h"
+#include "nirisignalrouter.h"
+#include "tracering.h"
 #include <QDBusConnection>
 #include <QTimer>
 #include <QUuid>
 #include <QPoint>
 #include <QSize>
 #include <QDBusArgument>
+#include <QSet>
 #include <QtDBus>
+#include <utility>
 
-ScreenCast::ScreenCast(QObject *parent)
+ScreenCast::ScreenCast(QObject *parent, CompositorBackend *compositor, const QDBusConnection &bus)
     : QDBusAbstractAdaptor{parent}
-    , m_mutterScreencast(new MutterScreenCast(this))
+    , m_compositor(compositor ? compositor : new MutterScreenCast(this))
+    , m_bus(bus)
+    , m_objects(new PortalObjects(m_bus, this))
+    , m_streamMonitor(new StreamMonitor(this))
+    , m_admission(PortalConfig::instance().perAppLimits, PortalConfig::instance().globalLimits)
+    , m_clientWatcher(new QDBusServiceWatcher(this))
 {
     qDBusRegisterMetaType<ScreenCastStream>();
     qDBusRegisterMetaType<QList<ScreenCastStream>>();
 
-    if (!m_mutterScreencast->isAvailable()) {
-        qWarning() << "Niri screencast is not available!";
+    if (!m_compositor->isAvailable()) {
+        qCWarning(lcScreenCast) << "Niri screencast is not available!";
     }
 
-    connect(m_mutterScreencast, &MutterScreenCast::pipeWireStreamAdded, this, &ScreenCast::onPipeWireStreamAdded);
+    connect(m_compositor, &CompositorBackend::pipeWireStreamAdded, this, &ScreenCast::onPipeWireStreamAdded);
+    connect(m_streamMonitor, &StreamMonitor::stalled, this, &ScreenCast::onStreamStalled);
+
+    // Niri closed it, or went away altogether
+    connect(m_compositor, &CompositorBackend::sessionClosed, this, [this](const QString &niriPath) {
+        // Everyone sharing it goes down with it
+        for (auto it = m_sharedStreams.begin(); it != m_sharedStreams.end(); ++it) {
+            if (it->niriSessionPath == niriPath) {
+                m_sharedStreams.erase(it);
+                break;
+            }
+        }
+
+        const QStringList sessionHandles = m_portalToNiriSession.keys(niriPath);
+        for (const QString &sessionHandle : sessionHandles) {
+            m_portalToNiriSession.remove(sessionHandle);
+            teardownSession(sessionHandle);
+        }
+    });
+
+    m_clientWatcher->setConnection(m_bus);
+    m_clientWatcher->setWatchMode(QDBusServiceWatcher::WatchForUnregistration);
+    connect(m_clientWatcher, &QDBusServiceWatcher::serviceUnregistered, this, &ScreenCast::onClientGone);
+
+    // Fires on focus and title changes too, so only look when windows are captured
+    NiriSignalRouter::instance().listen(
+        QStringLiteral("org.gnome.Shell.Introspect"), QStringLiteral("/org/gnome/Shell/Introspect"),
+        QStringLiteral("org.gnome.Shell.Introspect"), QStringLiteral("WindowsChanged"),
+        this, [this](const QDBusMessage &) { checkCapturedWindows(); });
 }
 
 uint ScreenCast::CreateSession(
@@ -28,46 +69,54 @@ uint ScreenCast::CreateSession(
     const QDBusObjectPath &session_handle,
     const QString &app_id,
     const QVariantMap &options,
+    const QDBusMessage &message,
     QVariantMap &results)
 {
-    Q_UNUSED(app_id)
-    Q_UNUSED(options)
+    CallRecorder::instance().record(message, session_handle.path(), app_id, options);
+    TraceSpan span("CreateSession", session_handle.path());
 
-    QDBusConnection bus = QDBusConnection::sessionBus();
-
-    // Create and export Request
-    QObject *requestObj = new QObject(this);
-    ScreenCastRequest *request = new ScreenCastRequest(requestObj);
-    bus.registerObject(handle.path(), requestObj, QDBusConnection::ExportAdaptors);
+    // Before anything is exported or asked of Niri
+    if (m_admission.admitSession(app_id) != AdmissionControl::Admitted) {
+        return 2;
+    }
 
-    // Create and export Session
-    QObject *sessionObj = new QObject(this);
-    ScreenCastSession *session = new ScreenCastSession(sessionObj);
-    bus.registerObject(session_handle.path(), sessionObj, QDBusConnection::ExportAdaptors);
+    // The request is done once we reply, the session outlives it
+    const QString sessionHandle = session_handle.path();
+    m_objects->addRequestUntilReplied(handle.path());
+    m_objects->addSession(sessionHandle, [this, sessionHandle]() {
+        finishStart(sessionHandle, 2);
+        unwatchClient(sessionHandle);
+        const QString appId = m_sessionApps.take(sessionHandle);
+        if (m_streamSlots.remove(sessionHandle)) {
+            m_admission.releaseStream(appId);
+        }
+        m_admission.releaseSession(appId);
+        forgetStreams(sessionHandle);
+        releaseNiriSession(sessionHandle);
+        m_selectedSources.remove(sessionHandle);
+        m_sessions.remove(sessionHandle);
+
+        // Nothing left to pick for, take its picker down
+        QStringList selects;
+        for (auto it = m_pendingSelects.cbegin(); it != m_pendingSelects.cend(); ++it) {
+            if (it->sessionHandle == sessionHandle) {
+                selects.append(it.key());
+            }
+        }
+        for (const QString &requestHandle : std::as_const(selects)) {
+            finishSelect(requestHandle, 2);
+        }
+    });
 
     // Store session
-    m_sessions[session_handle.path()] = session;
+    m_sessions.insert(sessionHandle);
+    m_sessionApps.insert(sessionHandle, app_id);
+    watchClient(message.service(), sessionHandle);
 
     // Return session ID
     QString sessionId = QUuid::createUuid().toString();
     results["session_id"] = sessionId;
 
-    // Cleanup Request after success
-    connect(request, &ScreenCastRequest::closed, requestObj, [=]() {
-        QDBusConnection::sessionBus().unregisterObject(handle.path());
-        m_sessions.remove(session_handle.path());
-        requestObj->deleteLater();
-    });
-
-    // Cleanup Session when closed
-    connect(session, &ScreenCastSession::Closed, sessionObj, [=]() {
-        QDBusConnection::sessionBus().unregisterObject(session_handle.path());
-        m_sessions.remove(session_handle.path());
-        sessionObj->deleteLater();
-    });
-
-    QTimer::singleShot(0, request, &ScreenCastRequest::closed);
-
     return 0; // Success
 }
 
@@ -76,60 +125,109 @@ uint ScreenCast::SelectSources(
     const QDBusObjectPath &session_handle,
     const QString &app_id,
     const QVariantMap &options,
+    const QDBusMessage &message,
     QVariantMap &results)
 {
-    qInfo() << "SelectSources called!";
-
-    Q_UNUSED(options)
+    CallRecorder::instance().record(message, session_handle.path(), app_id, options);
+    qCDebug(lcScreenCast) << "SelectSources" << handle.path() << app_id;
+    traceEvent("SelectSources", session_handle.path());
 
-    QDBusConnection bus = QDBusConnection::sessionBus();
-    QObject *requestObj = new QObject(this);
-    ScreenCastRequest *request = new ScreenCastRequest(requestObj);
-    bus.registerObject(handle.path(), requestObj, QDBusConnection::ExportAdaptors);
+    if (m_admission.admitRequest(app_id) != AdmissionControl::Admitted) {
+        return 2;
+    }
 
-    // Create source selector dialog
-    SourceSelector *dialog = new SourceSelector(this, app_id);
+    const QString requestHandle = handle.path();
+    const QString sessionHandle = session_handle.path();
 
-    // Handle accepted (user selected a source)
-    connect(dialog, &SourceSelector::accepted, this, [=]() {
-        SourceSelector::Source selected = dialog->getSelectedSource();
+    // Ends in finishSelect(), the reply goes out once a picker answered
+    traceAsyncBegin("SelectSources", sessionHandle);
 
-        // Store selection for Start method
-        SelectedSource source;
-        source.sourceId = selected.id;
-        source.isWindow = (selected.type == SourceSelector::Window);
-        source.sessionHandle = session_handle.path();
-        m_selectedSources[session_handle.path()] = source;
+    message.setDelayedReply(true);
+    m_pendingSelects.insert(requestHandle, { message, sessionHandle, options.value("cursor_mode").toUInt(), {} });
 
-        qInfo() << "User selected:" << selected.displayName;
+    // The client gave up, whichever picker is up goes away
+    m_objects->addRequest(requestHandle, [this, requestHandle]() {
+        finishSelect(requestHandle, 2);
+    });
 
-        // Complete the request
-        QMetaObject::invokeMethod(request, &ScreenCastRequest::closed, Qt::QueuedConnection);
+    if (!m_picker || !m_picker->isRegistered()) {
+        showSelector(requestHandle, app_id);
+        return 0;
+    }
 
-        // Safe cleanup
-        // dialog->deleteLater();
+    m_picker->pick(requestHandle, app_id, options.value("types").toUInt(), this,
+                   [this, requestHandle, app_id](ExternalPicker::Outcome outcome, const SourceSelector::Source &source) {
+        switch (outcome) {
+        case ExternalPicker::Picked:
+            finishSelect(requestHandle, 0, source);
+            break;
+        case ExternalPicker::Cancelled:
+            finishSelect(requestHandle, 0);
+            break;
+        case ExternalPicker::Unavailable:
+            showSelector(requestHandle, app_id);
+            break;
+        }
     });
 
-    // Handle rejected (user cancelled)
-    connect(dialog, &SourceSelector::rejected, this, [=]() {
-        qInfo() << "User cancelled source selection";
+    // The real reply goes out from finishSelect()
+    return 0;
+}
+
+void ScreenCast::showSelector(const QString &requestHandle, const QString &appId)
+{
+    auto it = m_pendingSelects.find(requestHandle);
+    if (it == m_pendingSelects.end()) {
+        return;
+    }
 
-        // Still need to complete the request
-        QMetaObject::invokeMethod(request, &ScreenCastRequest::closed, Qt::QueuedConnection);
+    SourceSelector *dialog = new SourceSelector(this, appId);
+    it->dialog = dialog;
 
-        // Safe cleanup
-        // dialog->deleteLater();
+    connect(dialog, &SourceSelector::accepted, this, [this, dialog, requestHandle]() {
+        finishSelect(requestHandle, 0, dialog->getSelectedSource());
     });
-
-    // Setup request cleanup
-    connect(request, &ScreenCastRequest::closed, requestObj, [=]() {
-        QDBusConnection::sessionBus().unregisterObject(handle.path());
-        requestObj->deleteLater();
+    connect(dialog, &SourceSelector::rejected, this, [this, requestHandle]() {
+        finishSelect(requestHandle, 0);
     });
 
-    int result = dialog->exec(); // lol just shut up
+    dialog->show();
+}
 
-    return 0;
+void ScreenCast::finishSelect(const QString &requestHandle, uint response, const SourceSelector::Source &picked)
+{
+    auto it = m_pendingSelects.find(requestHandle);
+    if (it == m_pendingSelects.end()) {
+        return;
+    }
+
+    PendingSelect pending = *it;
+    m_pendingSelects.erase(it);
+
+    if (!picked.id.isEmpty() && m_sessions.contains(pending.sessionHandle)) {
+        // Store selection for Start method
+        selectSource(pending.sessionHandle, picked.id, picked.type == SourceSelector::Window, pending.cursorMode);
+
+        qCInfo(lcScreenCast) << "User selected:" << picked.displayName;
+        traceEvent("source-selected", picked.id, picked.type);
+    } else {
+        // A cancelled picker still answers 0, as it always did
+        qCInfo(lcScreenCast) << "Source selection ended without a source, response" << response;
+        traceEvent("selection-cancelled", pending.sessionHandle);
+    }
+
+    if (pending.dialog) {
+        pending.dialog->deleteLater();
+    }
+    if (m_picker) {
+        // Only does something if the shell is still showing it
+        m_picker->cancel(requestHandle);
+    }
+
+    traceAsyncEnd("SelectSources", pending.sessionHandle);
+
+    m_bus.send(pending.message.createReply({ response, QVariant::fromValue(QVariantMap()) }));
+    m_objects->remove(requestHandle);
 }
 
 uint ScreenCast::Start(
@@ -138,73 +236,224 @@ uint ScreenCast::Start(
     const QString &app_id,
     const QString &parent_window,
     const QVariantMap &options,
+    const QDBusMessage &message,
     QVariantMap &results)
 {
-    Q_UNUSED(app_id)
     Q_UNUSED(parent_window)
 
-    QDBusConnection bus = QDBusConnection::sessionBus();
-    QObject *requestObj = new QObject(this);
-    ScreenCastRequest *request = new ScreenCastRequest(requestObj);
-    bus.registerObject(handle.path(), requestObj, QDBusConnection::ExportAdaptors);
+    CallRecorder::instance().record(message, session_handle.path(), app_id, options);
+    qCDebug(lcScreenCast) << "Start" << session_handle.path();
+    traceEvent("Start", session_handle.path());
+
+    // Don't make the client wait on a compositor that isn't there
+    if (!m_compositor->isAvailable()) {
+        qCWarning(lcScreenCast) << "Start failed, Niri's screencast service is not available";
+        return 2;
+    }
+
+    const QString sessionHandle = session_handle.path();
+    if (!m_sessions.contains(sessionHandle) || !m_selectedSources.contains(sessionHandle)
+        || m_pendingStarts.contains(sessionHandle)) {
+        qCWarning(lcScreenCast) << "Start without a session and a selected source:" << sessionHandle;
+        return 2;
+    }
+
+    // A shared stream counts too, it's one more consumer of the compositor's frames
+    if (!m_streamSlots.contains(sessionHandle)) {
+        if (m_admission.admitStream(m_sessionApps.value(sessionHandle)) != AdmissionControl::Admitted) {
+            return 2;
+        }
+        m_streamSlots.insert(sessionHandle);
+    }
+
+    // Ends in finishStart(), or right here for a shared stream
+    traceAsyncBegin("Start", sessionHandle);
+
+    const SelectedSource selected = m_selectedSources.value(sessionHandle);
+
+    // Someone already captures this, hand out the same node
+    if (PortalConfig::instance().shareStreams) {
+        auto shared = m_sharedStreams.find(shareKey(selected));
+        if (shared != m_sharedStreams.end()) {
+            ++shared->refs;
+            m_portalToNiriSession[sessionHandle] = shared->niriSessionPath;
+            m_streamSessions.insert(shared->streamPath, sessionHandle);
+            buildStreamResults(shared->streamPath, shared->nodeId, results);
+
+            qCDebug(lcScreenCast) << "Start" << sessionHandle << "shares node" << shared->nodeId
+                                  << "with" << shared->refs - 1 << "other sessions";
+            traceEvent("start-shared", sessionHandle, shared->nodeId);
+            traceAsyncEnd("Start", sessionHandle);
+            return 0;
+        }
+    }
+
+    StartJob *job = new StartJob(m_compositor, selectedJobSource(sessionHandle), StartJob::DeadlineMs, this);
+    m_pendingStarts.insert(sessionHandle, { message, handle.path(), job });
+
+    // The client gave up, whatever Niri made so far goes away with the job
+    m_objects->addRequest(handle.path(), [this, sessionHandle]() {
+        finishStart(sessionHandle, 2);
+    });
 
-    // Create Niri session
-    QString niriSessionPath = m_mutterScreencast->createSession();
-    m_portalToNiriSession[session_handle.path()] = niriSessionPath;
+    message.setDelayedReply(true);
+    job->start([this, sessionHandle](uint response) {
+        finishStart(sessionHandle, response);
+    });
+
+    // The real reply goes out from finishStart()
+    return 0;
+}
+
+void ScreenCast::finishStart(const QString &sessionHandle, uint response)
+{
+    auto it = m_pendingStarts.find(sessionHandle);
+    if (it == m_pendingStarts.end()) {
+        return;
+    }
+
+    PendingStart pending = *it;
+    m_pendingStarts.erase(it);
 
-    SelectedSource source = m_selectedSources.value(session_handle.path());
-    QString streamPath;
+    QVariantMap results;
+    if (response == 0) {
+        const QString streamPath = pending.job->streamPath();
+        const uint nodeId = pending.job->nodeId();
 
-    if (source.isWindow) {
-        streamPath = m_mutterScreencast->recordWindow(
-            niriSessionPath, source.sourceId.toULongLong(), 1);
+        m_portalToNiriSession[sessionHandle] = pending.job->niriSessionPath();
+        m_streamSessions.insert(streamPath, sessionHandle);
+        m_streamNodeIds[streamPath] = nodeId;
+        m_streamMonitor->watch(nodeId);
+        buildStreamResults(streamPath, nodeId, results);
+
+        // Two Starts for the same source racing each other keep their own
+        const QString key = shareKey(m_selectedSources.value(sessionHandle));
+        if (PortalConfig::instance().shareStreams && !m_sharedStreams.contains(key)) {
+            m_sharedStreams.insert(key, { pending.job->niriSessionPath(), streamPath, nodeId, 1 });
+        }
     } else {
-        streamPath = m_mutterScreencast->recordMonitor(
-            niriSessionPath, source.sourceId, 1);
+        // Not finished means cancelled, which rolls back
+        pending.job->cancel();
+
+        if (m_streamSlots.remove(sessionHandle)) {
+            m_admission.releaseStream(m_sessionApps.value(sessionHandle));
+        }
+    }
+
+    qCDebug(lcScreenCast) << "Start" << sessionHandle << "done, response" << response
+                          << "after" << pending.job->attempts() << "attempts";
+    traceEvent("start-done", sessionHandle, response);
+    traceAsyncEnd("Start", sessionHandle);
+
+    m_bus.send(
+        pending.message.createReply({ response, QVariant::fromValue(results) }));
+
+    pending.job->deleteLater();
+    m_objects->remove(pending.handle);
+}
+
+bool ScreenCast::hasSelectedSource(const QString &sessionHandle) const
+{
+    return m_selectedSources.contains(sessionHandle);
+}
+
+void ScreenCast::selectSource(const QString &sessionHandle, const QString &sourceId, bool isWindow, uint cursorMode)
+{
+    SelectedSource source;
+    source.sourceId = sourceId;
+    source.isWindow = isWindow;
+    source.sessionHandle = sessionHandle;
+
+    // Portal cursor modes are a bitmask, Niri's an enum
+    switch (cursorMode) {
+    case 1: source.cursorMode = 0; break; // hidden
+    case 4: source.cursorMode = 2; break; // metadata
+    default: break;
     }
 
-    // Start session BEFORE building results
-    m_mutterScreencast->startSession(niriSessionPath);
+    m_selectedSources[sessionHandle] = source;
+}
+
+StartJob::Source ScreenCast::selectedJobSource(const QString &sessionHandle) const
+{
+    const SelectedSource selected = m_selectedSources.value(sessionHandle);
+
+    StartJob::Source source;
+    source.id = selected.sourceId;
+    source.isWindow = selected.isWindow;
+    source.cursorMode = selected.cursorMode;
+    return source;
+}
+
+void ScreenCast::adoptStream(const QString &sessionHandle, const QString &streamPath, uint nodeId,
+                             QVariantMap &results)
+{
+    m_streamSessions.insert(streamPath, sessionHandle);
+    m_streamNodeIds[streamPath] = nodeId;
+    m_streamMonitor->watch(nodeId);
+    buildStreamResults(streamPath, nodeId, results);
+}
+
+// Parameters hold (ii) structs, which come off the bus as QDBusArguments.
+// An in-process compositor hands over QPoint and QSize instead.
+static bool readPair(const QVariant &value, int &first, int &second)
+{
+    switch (value.userType()) {
+    case QMetaType::QPoint:
+        first = value.toPoint().x();
+        second = value.toPoint().y();
+        return true;
+    case QMetaType::QSize:
+        first = value.toSize().width();
+        second = value.toSize().height();
+        return true;
+    default:
+        break;
+    }
 
-    // wait till pipewire stream lol
-    QEventLoop loop;
-    QTimer timeout;
-    timeout.setSingleShot(true);
-    timeout.setInterval(1000); // MAGIC NUMBERS! :D
+    if (value.userType() != qMetaTypeId<QDBusArgument>()) {
+        return false;
+    }
 
-    connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
-    connect(m_mutterScreencast, &MutterScreenCast::pipeWireStreamAdded,
-            &loop, &QEventLoop::quit);
+    const QDBusArgument arg = value.value<QDBusArgument>();
+    arg.beginStructure();
+    arg >> first >> second;
+    arg.endStructure();
+    return true;
+}
 
-    timeout.start();
-    loop.exec(); // Wait for signal or timeout
+void ScreenCast::buildStreamResults(const QString &streamPath, uint nodeId, QVariantMap &results) const
+{
+    // A memory lookup, the stream's properties were fetched when it was recorded
+    const QVariantMap parameters = m_compositor->getStreamParameters(streamPath);
 
-    // NOW build results with whatever we have
-    uint nodeId = m_streamNodeIds.value(streamPath, 0);
+    int x = 0, y = 0;
+    readPair(parameters.value("position"), x, y);
 
-    if (nodeId == 0) {
-        qWarning() << "No PipeWire node ID received!";
-        request->Close();
-        return 1; // Return error
+    int width = 1920, height = 1080;
+    if (!readPair(parameters.value("size"), width, height)) {
+        qCWarning(lcScreenCast) << "No size for stream" << streamPath << "- guessing";
     }
 
+    const bool isWindow = m_selectedSources.value(m_streamSessions.value(streamPath)).isWindow;
+
     QVariantMap streamProperties;
 
     // Create position struct
     QDBusArgument posArg;
     posArg.beginStructure();
-    posArg << 0 << 0;
+    posArg << x << y;
     posArg.endStructure();
     streamProperties["position"] = QVariant::fromValue(posArg);
 
     // Create size struct
     QDBusArgument sizeArg;
     sizeArg.beginStructure();
-    sizeArg << 1920 << 1080;
+    sizeArg << width << height;
     sizeArg.endStructure();
     streamProperties["size"] = QVariant::fromValue(sizeArg);
 
-    streamProperties["source_type"] = QVariant::fromValue<uint>(1);
+    streamProperties["source_type"] = QVariant::fromValue<uint>(isWindow ? 2 : 1);
 
     // Create stream list
     QList<ScreenCastStream> streams;
@@ -214,53 +463,238 @@ uint ScreenCast::Start(
     streams.append(stream);
 
     results["streams"] = QVariant::fromValue(streams);
+}
+
+QString ScreenCast::streamPathForNode(uint nodeId) const
+{
+    return m_streamNodeIds.key(nodeId);
+}
+
+void ScreenCast::onPipeWireStreamAdded(const QString &streamPath, uint nodeId)
+{
+    qCDebug(lcScreenCast) << "PipeWire node ID" << nodeId << "for stream" << streamPath;
+    traceEvent("pipewire-node", streamPath, nodeId);
+
+    // Only streams handed out to clients, not e.g. screenshot ones or
+    // rolled back Start attempts, which would never be forgotten
+    if (m_streamSessions.contains(streamPath)) {
+        m_streamNodeIds[streamPath] = nodeId;
+        m_streamMonitor->watch(nodeId);
+    }
+}
 
+QVariantMap ScreenCast::streamStats() const
+{
+    QVariantMap stats;
 
-    connect(request, &ScreenCastRequest::closed, requestObj, [=]() {
-        QDBusConnection::sessionBus().unregisterObject(handle.path());
-        m_sessions.remove(session_handle.path());
-        QString niriPath = m_portalToNiriSession.value(session_handle.path());
-        if (!niriPath.isEmpty()) {
-            m_mutterScreencast->stopSession(niriPath);
+    for (auto it = m_streamSessions.cbegin(); it != m_streamSessions.cend(); ++it) {
+        const uint nodeId = m_streamNodeIds.value(it.key());
+        if (nodeId == 0) {
+            continue;
         }
-        requestObj->deleteLater();
-    });
 
-    // QTimer::singleShot(0, request, &ScreenCastRequest::closed);
-    return 0;
+        QVariantMap stream = StreamMonitor::toVariant(m_streamMonitor->stats(nodeId));
+        stream["stream_path"] = it.key();
+
+        QVariantList streams = stats.value(it.value()).toList();
+        streams.append(stream);
+        stats[it.value()] = streams;
+    }
+
+    return stats;
 }
 
+void ScreenCast::forgetStreams(const QString &sessionHandle)
+{
+    for (auto it = m_streamSessions.begin(); it != m_streamSessions.end(); ) {
+        if (it.value() != sessionHandle) {
+            ++it;
+            continue;
+        }
 
-void ScreenCast::onPipeWireStreamAdded(const QString &streamPath, uint nodeId)
+        const QString streamPath = it.key();
+        it = m_streamSessions.erase(it);
+
+        // Still handed out to someone else
+        if (m_streamSessions.contains(streamPath)) {
+            continue;
+        }
+
+        const uint nodeId = m_streamNodeIds.take(streamPath);
+        if (nodeId != 0) {
+            m_streamMonitor->unwatch(nodeId);
+        }
+    }
+}
+
+QString ScreenCast::sessionForNode(uint nodeId) const
 {
-    qInfo() << "PipeWire node ID" << nodeId << "for stream" << streamPath;
+    return m_streamSessions.value(streamPathForNode(nodeId));
+}
 
-    m_streamNodeIds[streamPath] = nodeId;
+QStringList ScreenCast::sessionsForNode(uint nodeId) const
+{
+    return m_streamSessions.values(streamPathForNode(nodeId));
+}
 
-    // Check if this is for a pending Start request
-    if (!m_pendingStarts.contains(streamPath)) {
+QString ScreenCast::shareKey(const SelectedSource &source)
+{
+    return QStringLiteral("%1:%2:%3").arg(source.isWindow ? QLatin1String("w") : QLatin1String("m")).arg(source.sourceId).arg(source.cursorMode);
+}
+
+void ScreenCast::releaseNiriSession(const QString &sessionHandle)
+{
+    const QString niriPath = m_portalToNiriSession.take(sessionHandle);
+    if (niriPath.isEmpty()) {
         return;
     }
 
-    PendingStart pending = m_pendingStarts.take(streamPath);
+    for (auto it = m_sharedStreams.begin(); it != m_sharedStreams.end(); ++it) {
+        if (it->niriSessionPath != niriPath) {
+            continue;
+        }
+        if (--it->refs > 0) {
+            qCDebug(lcScreenCast) << "Upstream" << niriPath << "still used by" << it->refs << "sessions";
+            return;
+        }
+        m_sharedStreams.erase(it);
+        break;
+    }
 
-    QVariantList streams;
-    QVariantMap streamProperties;
+    m_compositor->stopSessionAsync(niriPath);
+}
+
+void ScreenCast::onStreamStalled(uint nodeId, const QString &reason)
+{
+    // A shared stream takes all of its sessions with it
+    const QStringList sessionHandles = sessionsForNode(nodeId);
+    for (const QString &sessionHandle : sessionHandles) {
+        if (!m_sessions.contains(sessionHandle)) {
+            continue;
+        }
 
-    QVariantMap streamParams = m_mutterScreencast->getStreamParameters(streamPath);
+        qCWarning(lcScreenCast) << "Closing session" << sessionHandle << "after its stream stalled:" << reason;
+        teardownSession(sessionHandle);
+    }
+}
+
+void ScreenCast::teardownSession(const QString &sessionHandle)
+{
+    forgetStreams(sessionHandle);
+    releaseNiriSession(sessionHandle);
+    m_selectedSources.remove(sessionHandle);
+
+    // Tells the client and runs the cleanup set up in CreateSession
+    if (m_sessions.contains(sessionHandle)) {
+        m_objects->closeSession(sessionHandle);
+    }
+}
+
+void ScreenCast::watchClient(const QString &client, const QString &sessionHandle)
+{
+    // Direct calls in tests and tools have no sender
+    if (client.isEmpty()) {
+        return;
+    }
+
+    if (!m_clientSessions.contains(client)) {
+        m_clientWatcher->addWatchedService(client);
+    }
+    m_clientSessions.insert(client, sessionHandle);
+    m_sessionClients.insert(sessionHandle, client);
+}
+
+void ScreenCast::unwatchClient(const QString &sessionHandle)
+{
+    const QString client = m_sessionClients.take(sessionHandle);
+    if (client.isEmpty()) {
+        return;
+    }
 
-    streamProperties["position"] = QVariant::fromValue(QPoint(0, 0));
-    streamProperties["size"] = QVariant::fromValue(QSize(1920, 1080));
-    streamProperties["source_type"] = 1;
+    m_clientSessions.remove(client, sessionHandle);
+    if (!m_clientSessions.contains(client)) {
+        m_clientWatcher->removeWatchedService(client);
+    }
+}
 
-    QVariantList stream;
-    stream << nodeId;
-    stream << streamProperties;
+void ScreenCast::onClientGone(const QString &client)
+{
+    const QStringList sessionHandles = m_clientSessions.values(client);
+    if (sessionHandles.isEmpty()) {
+        return;
+    }
 
-    streams << QVariant::fromValue(stream);
-    (*pending.results)["streams"] = streams;
+    qCInfo(lcScreenCast) << client << "left the bus, closing its" << sessionHandles.size() << "sessions";
+    traceEvent("client-gone", client, sessionHandles.size());
 
-    QTimer::singleShot(0, pending.request, &ScreenCastRequest::closed);
+    for (const QString &sessionHandle : sessionHandles) {
+        teardownSession(sessionHandle);
+    }
+}
+
+void ScreenCast::checkCapturedWindows()
+{
+    bool capturing = false;
+    for (auto it = m_selectedSources.cbegin(); it != m_selectedSources.cend(); ++it) {
+        if (it->isWindow && m_portalToNiriSession.contains(it.key())) {
+            capturing = true;
+            break;
+        }
+    }
+    if (!capturing || !CompositorWatcher::instance().isPresent(MutterShellIntrospectInterface::staticInterfaceName())) {
+        return;
+    }
+
+    // A burst of changes makes one more lookup, not one each
+    if (m_windowCheckRunning) {
+        m_windowCheckAgain = true;
+        return;
+    }
+    m_windowCheckRunning = true;
+
+    QDBusMessage msg = QDBusMessage::createMethodCall(
+        "org.gnome.Shell.Introspect", "/org/gnome/Shell/Introspect",
+        "org.gnome.Shell.Introspect", "GetWindows");
+    auto *call = new QDBusPendingCallWatcher(
+        m_bus.asyncCall(msg, CompositorCallTimeoutMs), this);
+    connect(call, &QDBusPendingCallWatcher::finished, this, [this, call]() {
+        call->deleteLater();
+        m_windowCheckRunning = false;
+
+        // Not knowing is no reason to close anything
+        const QDBusMessage reply = call->reply();
+        if (reply.type() == QDBusMessage::ReplyMessage) {
+            closeSessionsWithoutWindow(MutterShellIntrospect::parseWindows(reply));
+        } else {
+            qCDebug(lcScreenCast) << "GetWindows failed, keeping window captures:" << reply.errorMessage();
+        }
+
+        if (std::exchange(m_windowCheckAgain, false)) {
+            checkCapturedWindows();
+        }
+    });
+}
+
+void ScreenCast::closeSessionsWithoutWindow(const QVector<WindowInfo> &windows)
+{
+    QSet<QString> present;
+    present.reserve(windows.size());
+    for (const WindowInfo &window : windows) {
+        present.insert(QString::number(window.windowId));
+    }
+
+    QStringList orphans;
+    for (auto it = m_selectedSources.cbegin(); it != m_selectedSources.cend(); ++it) {
+        if (it->isWindow && m_portalToNiriSession.contains(it.key()) && !present.contains(it->sourceId)) {
+            orphans.append(it.key());
+        }
+    }
+
+    for (const QString &sessionHandle : std::as_const(orphans)) {
+        qCInfo(lcScreenCast) << "Captured window of" << sessionHandle << "is gone, closing the session";
+        traceEvent("window-gone", sessionHandle);
+        teardownSession(sessionHandle);
+    }
 }
 
 QDBusArgument &operator<<(QDBusArgument &arg, const ScreenCastStream &stream) {
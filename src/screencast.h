@@ -5,10 +5,20 @@
 #include <QDBusAbstractAdaptor>
 #include <QDBusVariant>
 #include <QDBusObjectPath>
-#include "screencastsession.h"
+#include <QDBusMessage>
+#include <QHash>
+#include <QSet>
+#include <QDBusServiceWatcher>
+#include <QDBusConnection>
+#include <QPointer>
+#include "admissioncontrol.h"
+#include "compositorbackend.h"
+#include "externalpicker.h"
+#include "portalobjects.h"
 #include "mutterscreencast.h"
-#include "screencastrequest.h"
 #include "sourceselector.h"
+#include "startjob.h"
+#include "streammonitor.h"
 
 
 class ScreenCast : public QDBusAbstractAdaptor
@@ -20,7 +30,14 @@ class ScreenCast : public QDBusAbstractAdaptor
     Q_PROPERTY(uint version READ version)
 
 public:
-    explicit ScreenCast(QObject *parent = nullptr);
+    // Niri over the session bus unless told otherwise. The benchmarks pass
+    // an in-process compositor (kept by them) and a bus that isn't connected,
+    // so only the portal's own work is measured.
+    explicit ScreenCast(QObject *parent = nullptr, CompositorBackend *compositor = nullptr,
+                        const QDBusConnection &bus = QDBusConnection::sessionBus());
+
+    // Source selection goes to the shell's picker while one is registered
+    void setExternalPicker(ExternalPicker *picker) { m_picker = picker; }
 
     uint availableSourceTypes() const { return 1 | 2; } // mon|win
     uint availableCursorModes() const { return 1 | 2 | 4; } // everything
@@ -32,6 +49,7 @@ public slots:
         const QDBusObjectPath& session_handle,
         const QString &app_id,
         const QVariantMap& options,
+        const QDBusMessage& message,
         QVariantMap& results
     );
 
@@ -40,42 +58,134 @@ public slots:
         const QDBusObjectPath& session_handle,
         const QString& app_id,
         const QVariantMap& options,
+        const QDBusMessage& message,
         QVariantMap& results
     );
 
+    // Replies once Niri handed over the stream, or the deadline passed
     uint Start(
         const QDBusObjectPath& handle,
         const QDBusObjectPath& session_handle,
         const QString& app_id,
         const QString& parent_window,
         const QVariantMap& options,
+        const QDBusMessage& message,
         QVariantMap& results
     );
 
     void onPipeWireStreamAdded(const QString &streamPath, uint nodeId);
 
+public:
+    // Shared with RemoteDesktop, which links a screencast session to its own
+    // Niri session and records the source picked in SelectSources into it.
+    // Null with any other compositor backend.
+    MutterScreenCast *mutterScreenCast() const { return qobject_cast<MutterScreenCast *>(m_compositor); }
+    CompositorBackend *compositor() const { return m_compositor; }
+    // Request and Session objects, RemoteDesktop's and Screenshot's too
+    PortalObjects *portalObjects() const { return m_objects; }
+    bool hasSelectedSource(const QString &sessionHandle) const;
+    // What SelectSources keeps once the user picked, for Start to record.
+    // cursorMode is the portal's bitmask.
+    void selectSource(const QString &sessionHandle, const QString &sourceId, bool isWindow, uint cursorMode);
+    // RemoteDesktop's sessions are gone, their pick with them
+    void dropSelectedSource(const QString &sessionHandle) { m_selectedSources.remove(sessionHandle); }
+    // The selection as a StartJob takes it
+    StartJob::Source selectedJobSource(const QString &sessionHandle) const;
+    // A stream RemoteDesktop started for the session: watched and forgotten
+    // like our own, and put into results["streams"]
+    void adoptStream(const QString &sessionHandle, const QString &streamPath, uint nodeId, QVariantMap &results);
+    QString streamPathForNode(uint nodeId) const;
+
+    // Health of the streams handed out per session, for the Debug interface
+    QVariantMap streamStats() const;
+    // Refused requests and what's held against the limits, same
+    QVariantMap admissionStats() const { return m_admission.stats(); }
+    // Stop watching a session's streams once it's over
+    void forgetStreams(const QString &sessionHandle);
+    // Stalled streams of ScreenCast sessions close them, RemoteDesktop
+    // listens too and closes its own
+    StreamMonitor *streamMonitor() const { return m_streamMonitor; }
+    QString sessionForNode(uint nodeId) const;
+    QStringList sessionsForNode(uint nodeId) const;
+
 private:
+    void onStreamStalled(uint nodeId, const QString &reason);
+    void teardownSession(const QString &sessionHandle);
+    // Drop the session's hold on its Niri session, stopping it once nobody
+    // else shares it
+    void releaseNiriSession(const QString &sessionHandle);
+    void finishStart(const QString &sessionHandle, uint response);
+    // Our own picker, when there's no external one or it didn't take the request
+    void showSelector(const QString &requestHandle, const QString &appId);
+    // Replies to SelectSources, recording picked unless it's empty
+    void finishSelect(const QString &requestHandle, uint response, const SourceSelector::Source &picked = {});
+
+    // Orphaned sessions: the caller left the bus, or the captured window closed
+    void watchClient(const QString &client, const QString &sessionHandle);
+    void unwatchClient(const QString &sessionHandle);
+    void onClientGone(const QString &client);
+    void checkCapturedWindows();
+    void closeSessionsWithoutWindow(const QVector<WindowInfo> &windows);
+    // position, size and source_type from the stream's cached Parameters
+    void buildStreamResults(const QString &streamPath, uint nodeId, QVariantMap &results) const;
+
+    // Start requests waiting on Niri, by session handle
     struct PendingStart {
-        QObject *requestObj;
-        ScreenCastRequest *request;
-        QString streamPath;
-        QVariantMap *results;
+        QDBusMessage message;
+        QString handle;
+        StartJob *job;
+    };
+
+    // SelectSources requests waiting on a picker, by request handle
+    struct PendingSelect {
+        QDBusMessage message;
+        QString sessionHandle;
+        uint cursorMode = 0;
+        QPointer<SourceSelector> dialog; // once it came to the built-in one
     };
 
-    QMap<QString, ScreenCastSession*> m_sessions;
-    MutterScreenCast* m_mutterScreencast;
+    QSet<QString> m_sessions;
+    CompositorBackend *m_compositor;
+    QDBusConnection m_bus;
+    PortalObjects *m_objects;
 
     QMap<QString, QString> m_portalToNiriSession;
     QMap<QString, uint> m_streamNodeIds;
-    QMap<QString, PendingStart> m_pendingStarts;
+    QMultiMap<QString, QString> m_streamSessions; // stream path -> portal sessions
+    StreamMonitor *m_streamMonitor;
+    QHash<QString, PendingStart> m_pendingStarts;
+    QHash<QString, PendingSelect> m_pendingSelects;
+    ExternalPicker *m_picker = nullptr;
 
     struct SelectedSource {
         QString sessionHandle;
         QString sourceId;
         bool isWindow;
+        uint cursorMode = 1; // Niri's numbering, embedded unless asked otherwise
     };
 
     QMap<QString, SelectedSource> m_selectedSources;
+
+    // Upstream Niri streams handed out to several sessions, with share_streams
+    struct SharedStream {
+        QString niriSessionPath;
+        QString streamPath;
+        uint nodeId = 0;
+        int refs = 0;
+    };
+
+    static QString shareKey(const SelectedSource &source);
+    QHash<QString, SharedStream> m_sharedStreams; // by shareKey
+
+    AdmissionControl m_admission;
+    QHash<QString, QString> m_sessionApps; // session handle -> app id, for releasing its slots
+    QSet<QString> m_streamSlots;           // sessions holding a stream slot
+
+    QDBusServiceWatcher *m_clientWatcher;
+    QMultiHash<QString, QString> m_clientSessions; // caller's unique name -> session handles
+    QHash<QString, QString> m_sessionClients;      // session handle -> caller
+    bool m_windowCheckRunning = false;
+    bool m_windowCheckAgain = false;
 };
 
 struct ScreenCastStream {
@@ -1,14 +0,0 @@
-#include "screencastrequest.h"
-
-ScreenCastRequest::ScreenCastRequest(QObject *parent)
-    : QDBusAbstractAdaptor{parent}
-{}
-
-ScreenCastRequest::~ScreenCastRequest()
-{
-}
-
-void ScreenCastRequest::Close()
-{
-    emit closed();
-}
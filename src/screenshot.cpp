@@ -0,0 +1,263 @@
+#include "screenshot.h"
+#include "compositorwatcher.h"
+#include "framegrabber.h"
+#include "logging.h"
+#include "portalobjects.h"
+#include "startjob.h"
+#include "tracering.h"
+#include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
+#include <QUrl>
+
+ScreenshotPortal::ScreenshotPortal(MutterScreenCast *mutterScreenCast, PortalObjects *objects, QObject *parent)
+    : QDBusAbstractAdaptor(parent)
+    , m_mutterScreencast(mutterScreenCast)
+    , m_objects(objects)
+{
+    // Niri went away before handing over a frame
+    connect(m_mutterScreencast, &MutterScreenCast::sessionClosed, this, [this](const QString &niriPath) {
+        for (auto it = m_shots.begin(); it != m_shots.end(); ++it) {
+            for (Capture &capture : it->captures) {
+                if (capture.niriSessionPath == niriPath) {
+                    capture.niriSessionPath.clear();
+                    // finish() erases the entry the key lives in
+                    const QString handle = it.key();
+                    finish(handle, 2);
+                    return;
+                }
+            }
+        }
+    });
+}
+
+uint ScreenshotPortal::Screenshot(
+    const QDBusObjectPath &handle,
+    const QString &app_id,
+    const QString &parent_window,
+    const QVariantMap &options,
+    const QDBusMessage &message,
+    QVariantMap &results)
+{
+    Q_UNUSED(parent_window)
+    Q_UNUSED(results)
+
+    qCDebug(lcScreenshot) << "Screenshot" << handle.path() << app_id << options;
+    traceEvent("Screenshot", handle.path());
+
+    if (!FrameGrabber::isSupported()) {
+        qCWarning(lcScreenshot) << "Screenshots need PipeWire support, which this build lacks";
+        return 2;
+    }
+
+    const QString path = handle.path();
+
+    m_objects->addRequest(path, [this, path]() {
+        finish(path, 2);
+    });
+
+    message.setDelayedReply(true);
+
+    Shot shot;
+    shot.message = message;
+    m_shots.insert(path, shot);
+
+    if (options.value("interactive").toBool()) {
+        // Gone in finish(), also when the client closes the request first
+        SourceSelector *dialog = new SourceSelector(this, app_id);
+        m_shots[path].dialog = dialog;
+
+        connect(dialog, &SourceSelector::accepted, this, [this, dialog, path]() {
+            Capture selected;
+            selected.source = dialog->getSelectedSource();
+            capture(path, { selected });
+            dialog->deleteLater();
+        });
+        connect(dialog, &SourceSelector::rejected, this, [this, path]() {
+            finish(path, 1);
+        });
+
+        dialog->show();
+        return 0;
+    }
+
+    captureAllMonitors(path);
+
+    // The real reply goes out from finish()
+    return 0;
+}
+
+void ScreenshotPortal::captureAllMonitors(const QString &handle)
+{
+    if (!CompositorWatcher::instance().isPresent(MutterDisplayConfigInterface::staticInterfaceName())) {
+        qCWarning(lcScreenshot) << "No display config to find the monitors in";
+        finish(handle, 2);
+        return;
+    }
+
+    QDBusMessage msg = QDBusMessage::createMethodCall(
+        "org.gnome.Mutter.DisplayConfig", "/org/gnome/Mutter/DisplayConfig",
+        "org.gnome.Mutter.DisplayConfig", "GetCurrentState");
+    auto *call = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(msg, CompositorCallTimeoutMs), this);
+    connect(call, &QDBusPendingCallWatcher::finished, this, [this, call, handle]() {
+        call->deleteLater();
+
+        const QVector<MonitorInfo> monitors = MutterDisplayConfig::parseMonitors(call->reply());
+        if (monitors.isEmpty()) {
+            qCWarning(lcScreenshot) << "No monitors to take a screenshot of" << call->reply().errorMessage();
+            finish(handle, 2);
+            return;
+        }
+
+        QList<Capture> captures;
+        for (const MonitorInfo &monitor : monitors) {
+            Capture entry;
+            entry.source.type = SourceSelector::Monitor;
+            entry.source.id = monitor.connector;
+            entry.source.displayName = monitor.displayName;
+            entry.piece.logicalPosition = monitor.logicalPosition;
+            entry.piece.scale = monitor.scale;
+            captures.append(entry);
+        }
+        capture(handle, captures);
+    });
+}
+
+void ScreenshotPortal::capture(const QString &handle, const QList<Capture> &captures)
+{
+    auto it = m_shots.find(handle);
+    if (it == m_shots.end()) {
+        return;
+    }
+
+    it->captures = captures;
+
+    // All sources at once, each through its own session
+    for (int i = 0; i < captures.size(); ++i) {
+        const SourceSelector::Source &source = captures.at(i).source;
+        traceEvent("screenshot-capture", source.id, source.type);
+
+        // Cursor hidden, like a printed screen
+        StartJob::Source target;
+        target.id = source.id;
+        target.isWindow = source.type == SourceSelector::Window;
+        target.cursorMode = 0;
+
+        StartJob *job = new StartJob(m_mutterScreencast, target, StartJob::DeadlineMs, this);
+        it->captures[i].job = job;
+        job->start([this, handle, i](uint response) {
+            auto shot = m_shots.find(handle);
+            if (shot == m_shots.end()) {
+                return;
+            }
+            if (response != 0) {
+                finish(handle, response);
+                return;
+            }
+
+            Capture &capture = shot->captures[i];
+            capture.niriSessionPath = capture.job->niriSessionPath();
+            grab(handle, i, capture.job->nodeId());
+        });
+    }
+}
+
+void ScreenshotPortal::grab(const QString &handle, int index, uint nodeId)
+{
+    auto it = m_shots.find(handle);
+    if (it == m_shots.end()) {
+        return;
+    }
+
+    FrameGrabber *grabber = new FrameGrabber(this);
+    it->captures[index].grabber = grabber;
+
+    connect(grabber, &FrameGrabber::frameReady, this, [this, handle, index](const QImage &image) {
+        frameReady(handle, index, image);
+    });
+    connect(grabber, &FrameGrabber::failed, this, [this, handle]() {
+        finish(handle, 2);
+    });
+
+    grabber->grab(nodeId);
+}
+
+void ScreenshotPortal::frameReady(const QString &handle, int index, const QImage &image)
+{
+    auto it = m_shots.find(handle);
+    if (it == m_shots.end()) {
+        return;
+    }
+
+    // Got the pixels, the compositor can stop streaming while we wait for
+    // the rest and encode
+    Capture &capture = it->captures[index];
+    capture.piece.frame = image;
+    if (!capture.niriSessionPath.isEmpty()) {
+        m_mutterScreencast->stopSessionAsync(std::exchange(capture.niriSessionPath, QString()));
+    }
+
+    QList<ScreenshotEncoder::Piece> pieces;
+    for (const Capture &c : std::as_const(it->captures)) {
+        if (c.piece.frame.isNull()) {
+            return; // more to come
+        }
+        pieces.append(c.piece);
+    }
+
+    save(handle, pieces);
+}
+
+void ScreenshotPortal::save(const QString &handle, const QList<ScreenshotEncoder::Piece> &pieces)
+{
+    auto it = m_shots.find(handle);
+    if (it == m_shots.end()) {
+        return;
+    }
+
+    ScreenshotEncoder::saveAsync(pieces, this, [this, handle](const QString &path) {
+        if (path.isEmpty()) {
+            finish(handle, 2);
+            return;
+        }
+
+        QVariantMap results;
+        results["uri"] = QUrl::fromLocalFile(path).toString();
+        finish(handle, 0, results);
+    });
+}
+
+void ScreenshotPortal::finish(const QString &handle, uint response, const QVariantMap &results)
+{
+    auto it = m_shots.find(handle);
+    if (it == m_shots.end()) {
+        return;
+    }
+
+    Shot shot = *it;
+    m_shots.erase(it);
+
+    qCDebug(lcScreenshot) << "Screenshot" << handle << "done, response" << response << results;
+    traceEvent("screenshot-done", handle, response);
+
+    QDBusConnection::sessionBus().send(
+        shot.message.createReply({ response, QVariant::fromValue(results) }));
+
+    for (const Capture &capture : std::as_const(shot.captures)) {
+        if (!capture.niriSessionPath.isEmpty()) {
+            m_mutterScreencast->stopSessionAsync(capture.niriSessionPath);
+        }
+        if (capture.job) {
+            // Rolls back whatever a Start still in flight created
+            capture.job->cancel();
+            capture.job->deleteLater();
+        }
+        if (capture.grabber) {
+            capture.grabber->deleteLater();
+        }
+    }
+    if (shot.dialog) {
+        shot.dialog->deleteLater();
+    }
+
+    m_objects->remove(handle);
+}
@@ -0,0 +1,76 @@
+#ifndef SCREENSHOT_H
+#define SCREENSHOT_H
+
+#include <QObject>
+#include <QDBusAbstractAdaptor>
+#include <QDBusMessage>
+#include <QDBusObjectPath>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include "mutterscreencast.h"
+#include "screenshotencoder.h"
+#include "sourceselector.h"
+
+class FrameGrabber;
+class PortalObjects;
+class StartJob;
+
+// Named so it doesn't clash with the Screenshot method
+class ScreenshotPortal : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.impl.portal.Screenshot")
+    Q_PROPERTY(uint version READ version)
+
+public:
+    // Frames come from a one-off screencast session on the shared Niri
+    // proxy, requests live in ScreenCast's table
+    ScreenshotPortal(MutterScreenCast *mutterScreenCast, PortalObjects *objects, QObject *parent = nullptr);
+
+    // Version 2 adds PickColor, which we don't have
+    uint version() const { return 1; }
+
+public slots:
+    // Replies later: picking, waiting for a frame and encoding never block
+    // the bus
+    uint Screenshot(
+        const QDBusObjectPath &handle,
+        const QString &app_id,
+        const QString &parent_window,
+        const QVariantMap &options,
+        const QDBusMessage &message,
+        QVariantMap &results
+    );
+
+private:
+    // One source of a shot, non-interactive shots have one per monitor
+    struct Capture {
+        SourceSelector::Source source;
+        ScreenshotEncoder::Piece piece; // frame filled in once grabbed
+        QString niriSessionPath;
+        StartJob *job = nullptr;
+        FrameGrabber *grabber = nullptr;
+    };
+
+    struct Shot {
+        QDBusMessage message;
+        QList<Capture> captures;
+        QPointer<SourceSelector> dialog; // interactive shots
+    };
+
+    // Non-interactive shots are of every monitor, laid out like the desktop
+    void captureAllMonitors(const QString &handle);
+    void capture(const QString &handle, const QList<Capture> &captures);
+    void grab(const QString &handle, int index, uint nodeId);
+    void frameReady(const QString &handle, int index, const QImage &image);
+    void save(const QString &handle, const QList<ScreenshotEncoder::Piece> &pieces);
+    // Send the delayed reply and tear everything down
+    void finish(const QString &handle, uint response, const QVariantMap &results = QVariantMap());
+
+    MutterScreenCast *m_mutterScreencast;
+    PortalObjects *m_objects;
+    QHash<QString, Shot> m_shots;
+};
+
+#endif // SCREENSHOT_H
@@ -0,0 +1,113 @@
+#include "screenshotencoder.h"
+#include "logging.h"
+#include "tracering.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QPainter>
+#include <QPointer>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+
+bool ScreenshotEncoder::writePng(const QImage &image, QIODevice *device)
+{
+    QImageWriter writer(device, "png");
+    writer.setCompression(PngCompression);
+
+    if (!writer.write(image)) {
+        qCWarning(lcScreenshot) << "Failed to encode screenshot:" << writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+QImage ScreenshotEncoder::composite(const QList<Piece> &pieces)
+{
+    if (pieces.size() == 1) {
+        return pieces.first().frame;
+    }
+
+    QRectF bounds;
+    double scale = 1.0;
+    for (const Piece &piece : pieces) {
+        bounds |= QRectF(piece.logicalPosition, QSizeF(piece.frame.size()) / piece.scale);
+        scale = qMax(scale, piece.scale);
+    }
+
+    QImage image((bounds.size() * scale).toSize(), QImage::Format_RGB32);
+    image.fill(Qt::black); // gaps between monitors
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    for (const Piece &piece : pieces) {
+        const QPointF position = (QPointF(piece.logicalPosition) - bounds.topLeft()) * scale;
+        painter.drawImage(QRectF(position, QSizeF(piece.frame.size()) * (scale / piece.scale)), piece.frame);
+    }
+    return image;
+}
+
+QString ScreenshotEncoder::claimPath()
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::PicturesLocation);
+    if (dir.isEmpty()) {
+        dir = QDir::homePath();
+    }
+    dir += QStringLiteral("/Screenshots");
+    QDir().mkpath(dir);
+
+    const QString base = dir + QStringLiteral("/Screenshot from ")
+                       + QDateTime::currentDateTime().toString(QStringLiteral("yyyy-MM-dd hh-mm-ss"));
+
+    // NewOnly fails when the name is taken, so two shots within a second
+    // can't both end up with it
+    QString path = base + QStringLiteral(".png");
+    for (int i = 2; i < 1000; ++i) {
+        QFile file(path);
+        if (file.open(QIODevice::WriteOnly | QIODevice::NewOnly)) {
+            return path;
+        }
+        if (!QFileInfo::exists(path)) { // failed for another reason
+            qCWarning(lcScreenshot) << "Can't create" << path << file.errorString();
+            return QString();
+        }
+        path = base + QStringLiteral(" (%1).png").arg(i);
+    }
+    return QString();
+}
+
+void ScreenshotEncoder::saveAsync(const QList<Piece> &pieces, QObject *context,
+                                  std::function<void(const QString &path)> done)
+{
+    QThreadPool::globalInstance()->start([pieces, context = QPointer<QObject>(context), done] {
+        QElapsedTimer timer;
+        timer.start();
+
+        const QImage image = composite(pieces);
+
+        QString path = claimPath();
+        if (!path.isEmpty()) {
+            // Never leave a half-written file behind, the placeholder is
+            // replaced in one go
+            QSaveFile file(path);
+            if (!file.open(QIODevice::WriteOnly) || !writePng(image, &file) || !file.commit()) {
+                qCWarning(lcScreenshot) << "Failed to save screenshot to" << path << file.errorString();
+                QFile::remove(path);
+                path.clear();
+            }
+        }
+
+        traceEvent("screenshot-encoded", path, timer.elapsed());
+
+        // context can only be checked safely on the thread it's deleted on
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [context, done, path] {
+            if (context) {
+                done(path);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
@@ -0,0 +1,46 @@
+#ifndef SCREENSHOTENCODER_H
+#define SCREENSHOTENCODER_H
+
+#include <QImage>
+#include <QList>
+#include <QPoint>
+#include <QString>
+#include <functional>
+
+class QIODevice;
+class QObject;
+
+// PNG encoding for screenshots. A 4K frame takes far longer to deflate than
+// to capture, so this runs on a worker thread and uses zlib level 1: a few
+// times faster than the default for a slightly bigger file.
+class ScreenshotEncoder
+{
+public:
+    static constexpr int PngCompression = 1;
+
+    // One monitor's frame and where it sits in the logical layout
+    struct Piece {
+        QImage frame;
+        QPoint logicalPosition;
+        double scale = 1.0;
+    };
+
+    static bool writePng(const QImage &image, QIODevice *device);
+
+    // The pieces laid out like the desktop, at the highest scale among them
+    // so no monitor loses detail. A single piece comes back as is.
+    static QImage composite(const QList<Piece> &pieces);
+
+    // Creates an empty ~/Pictures/Screenshots/Screenshot from <date>.png,
+    // with " (n)" added until the name is free, and returns its path. Empty
+    // when nothing could be created. Blocks on the disk, worker thread only.
+    static QString claimPath();
+
+    // Composite, pick a name, encode and save on the thread pool, then call
+    // done on the main thread with where it went, empty on failure. Nothing
+    // is called if context is gone by then.
+    static void saveAsync(const QList<Piece> &pieces, QObject *context,
+                          std::function<void(const QString &path)> done);
+};
+
+#endif // SCREENSHOTENCODER_H
@@ -0,0 +1,134 @@
+#include "sourcecatalog.h"
+#include "chrometrace.h"
+#include "compositorwatcher.h"
+#include "logging.h"
+#include "nirisignalrouter.h"
+#include "tracering.h"
+#include <QDBusPendingCallWatcher>
+
+SourceCatalog::SourceCatalog(const QDBusConnection &bus, QObject *parent)
+    : QObject(parent)
+    , m_bus(bus)
+{
+    NiriSignalRouter &router = NiriSignalRouter::instance();
+    router.listen(QStringLiteral("org.gnome.Mutter.DisplayConfig"), QStringLiteral("/org/gnome/Mutter/DisplayConfig"),
+                  QStringLiteral("org.gnome.Mutter.DisplayConfig"), QStringLiteral("MonitorsChanged"),
+                  this, [this](const QDBusMessage &) { invalidate(); });
+    router.listen(QStringLiteral("org.gnome.Shell.Introspect"), QStringLiteral("/org/gnome/Shell/Introspect"),
+                  QStringLiteral("org.gnome.Shell.Introspect"), QStringLiteral("WindowsChanged"),
+                  this, [this](const QDBusMessage &) { invalidate(); });
+
+    // A new compositor instance has new ids
+    connect(&CompositorWatcher::instance(), &CompositorWatcher::serviceLost, this, &SourceCatalog::invalidate);
+    connect(&CompositorWatcher::instance(), &CompositorWatcher::serviceReturned, this, &SourceCatalog::invalidate);
+}
+
+void SourceCatalog::invalidate()
+{
+    m_fresh = false;
+    if (m_pendingLookups > 0) {
+        m_staleAgain = true;
+    }
+}
+
+void SourceCatalog::fetch(QObject *context, Callback done)
+{
+    if (m_fresh) {
+        QMetaObject::invokeMethod(this, [this, context = QPointer<QObject>(context), done]() {
+            if (context) {
+                done(m_sources);
+            }
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    m_waiters.append({ context, std::move(done) });
+    refresh();
+}
+
+void SourceCatalog::refresh()
+{
+    if (m_pendingLookups > 0) {
+        return;
+    }
+
+    ++m_refreshes;
+    m_pendingLookups = 2;
+    m_staleAgain = false;
+    m_lookupFailed = false;
+    traceAsyncBegin("SourceCatalog", {}, quintptr(this));
+
+    CompositorWatcher &watcher = CompositorWatcher::instance();
+
+    if (watcher.isPresent(MutterDisplayConfigInterface::staticInterfaceName())) {
+        QDBusMessage msg = QDBusMessage::createMethodCall(
+            "org.gnome.Mutter.DisplayConfig", "/org/gnome/Mutter/DisplayConfig",
+            "org.gnome.Mutter.DisplayConfig", "GetCurrentState");
+        auto *call = new QDBusPendingCallWatcher(m_bus.asyncCall(msg, CompositorCallTimeoutMs), this);
+        connect(call, &QDBusPendingCallWatcher::finished, this, [this, call]() {
+            call->deleteLater();
+            m_lookupFailed |= call->reply().type() != QDBusMessage::ReplyMessage;
+            onMonitors(MutterDisplayConfig::parseMonitors(call->reply()));
+        });
+    } else {
+        m_lookupFailed = true;
+        QMetaObject::invokeMethod(this, [this]() { onMonitors({}); }, Qt::QueuedConnection);
+    }
+
+    if (watcher.isPresent(MutterShellIntrospectInterface::staticInterfaceName())) {
+        QDBusMessage msg = QDBusMessage::createMethodCall(
+            "org.gnome.Shell.Introspect", "/org/gnome/Shell/Introspect",
+            "org.gnome.Shell.Introspect", "GetWindows");
+        auto *call = new QDBusPendingCallWatcher(m_bus.asyncCall(msg, CompositorCallTimeoutMs), this);
+        connect(call, &QDBusPendingCallWatcher::finished, this, [this, call]() {
+            call->deleteLater();
+            m_lookupFailed |= call->reply().type() != QDBusMessage::ReplyMessage;
+            onWindows(MutterShellIntrospect::parseWindows(call->reply()));
+        });
+    } else {
+        m_lookupFailed = true;
+        QMetaObject::invokeMethod(this, [this]() { onWindows({}); }, Qt::QueuedConnection);
+    }
+}
+
+void SourceCatalog::onMonitors(const QVector<MonitorInfo> &monitors)
+{
+    m_monitors = monitors;
+    lookupDone();
+}
+
+void SourceCatalog::onWindows(const QVector<WindowInfo> &windows)
+{
+    m_windows = windows;
+    lookupDone();
+}
+
+void SourceCatalog::lookupDone()
+{
+    if (--m_pendingLookups > 0) {
+        return;
+    }
+
+    // Monitors first, like the built-in picker
+    m_sources.clear();
+    m_sources.reserve(m_monitors.size() + m_windows.size());
+    for (const MonitorInfo &monitor : std::as_const(m_monitors)) {
+        m_sources.append(SourceSelector::monitorSource(monitor));
+    }
+    for (const WindowInfo &window : std::as_const(m_windows)) {
+        m_sources.append(SourceSelector::windowSource(window));
+    }
+
+    // Something changed while we asked, or a call failed or timed out: still
+    // the best these waiters get, the next fetch asks again
+    m_fresh = !m_staleAgain && !m_lookupFailed;
+    qCDebug(lcSelector) << "Source catalog has" << m_sources.size() << "sources" << (m_fresh ? "" : "(stale)");
+    traceAsyncEnd("SourceCatalog", {}, quintptr(this));
+
+    const QList<Waiter> waiters = std::exchange(m_waiters, {});
+    for (const Waiter &waiter : waiters) {
+        if (waiter.context) {
+            waiter.done(m_sources);
+        }
+    }
+}
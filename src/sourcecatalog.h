@@ -0,0 +1,56 @@
+#ifndef SOURCECATALOG_H
+#define SOURCECATALOG_H
+
+#include "sourceselector.h"
+#include <QDBusConnection>
+#include <QObject>
+#include <QPointer>
+#include <functional>
+
+// Monitors and windows as picker rows, kept between requests. Niri's
+// MonitorsChanged and WindowsChanged mark it stale, the next fetch asks
+// again; until then a fetch is answered from memory.
+//
+// Untitled windows are named by their app id, no desktop file lookups:
+// whoever shows them knows the app names better than we do.
+class SourceCatalog : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Callback = std::function<void(const QVector<SourceSelector::Source> &sources)>;
+
+    explicit SourceCatalog(const QDBusConnection &bus = QDBusConnection::sessionBus(), QObject *parent = nullptr);
+
+    // done runs from the event loop, not at all once context is gone.
+    // Concurrent fetches share one round of calls.
+    void fetch(QObject *context, Callback done);
+
+    bool isFresh() const { return m_fresh; }
+    void invalidate();
+    quint64 refreshes() const { return m_refreshes; }
+
+private:
+    void refresh();
+    void onMonitors(const QVector<MonitorInfo> &monitors);
+    void onWindows(const QVector<WindowInfo> &windows);
+    void lookupDone();
+
+    struct Waiter {
+        QPointer<QObject> context;
+        Callback done;
+    };
+
+    QDBusConnection m_bus;
+    QVector<MonitorInfo> m_monitors;
+    QVector<WindowInfo> m_windows;
+    QVector<SourceSelector::Source> m_sources;
+    QList<Waiter> m_waiters;
+    int m_pendingLookups = 0;
+    bool m_fresh = false;
+    bool m_staleAgain = false; // changed while we were asking
+    bool m_lookupFailed = false; // an empty list from an error isn't news
+    quint64 m_refreshes = 0;
+};
+
+#endif // SOURCECATALOG_H
@@ -0,0 +1,183 @@
+#include "sourcemodel.h"
+#include <algorithm>
+
+static QStringList searchFields(const SourceSelector::Source &source)
+{
+    return { source.displayName, source.appId, source.id };
+}
+
+SourceModel::SourceModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+}
+
+int SourceModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_visible.size();
+}
+
+QVariant SourceModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_visible.size()) {
+        return QVariant();
+    }
+
+    const int sourceIndex = m_visible[index.row()];
+    const SourceSelector::Source &source = m_sources[sourceIndex];
+
+    switch (role) {
+    case TypeRole:
+        return static_cast<int>(source.type);
+    case SourceIdRole:
+        return source.id;
+    case Qt::DisplayRole:
+    case DisplayNameRole:
+        return source.displayName;
+    case SourceIndexRole:
+        return sourceIndex;
+    case IconNameRole:
+        // Resolved by AppIconProvider, which also takes plain icon names
+        if (source.type == SourceSelector::Monitor) {
+            return QStringLiteral("video-display");
+        }
+        return source.appId.isEmpty() ? QStringLiteral("application-x-executable") : source.appId;
+    }
+
+    return QVariant();
+}
+
+QHash<int, QByteArray> SourceModel::roleNames() const
+{
+    return {
+        { TypeRole, "type" },
+        { SourceIdRole, "sourceId" },
+        { DisplayNameRole, "displayName" },
+        { SourceIndexRole, "sourceIndex" },
+        { IconNameRole, "iconName" },
+    };
+}
+
+void SourceModel::setSources(const QVector<SourceSelector::Source> &sources)
+{
+    beginResetModel();
+
+    m_sources = sources;
+    m_index.clear();
+    m_ranked = false;
+    for (const auto &source : m_sources) {
+        m_index.add(searchFields(source));
+        m_ranked |= source.lastUsed != 0;
+    }
+    m_visible = ordered(m_index.query(m_filterText));
+
+    endResetModel();
+    emit countChanged();
+}
+
+void SourceModel::appendSource(const SourceSelector::Source &source)
+{
+    m_sources.append(source);
+    const int id = m_index.add(searchFields(source));
+    m_ranked |= source.lastUsed != 0;
+
+    if (!m_index.refine({ id }, m_filterText).isEmpty()) {
+        // Usually the end, unless it was shared before
+        const int row = int(std::lower_bound(m_visible.cbegin(), m_visible.cend(), id,
+                                             [this](int a, int b) { return before(a, b); })
+                            - m_visible.cbegin());
+        beginInsertRows(QModelIndex(), row, row);
+        m_visible.insert(row, id);
+        endInsertRows();
+        emit countChanged();
+    }
+}
+
+void SourceModel::setFilter(const QString &text)
+{
+    if (text == m_filterText) {
+        return;
+    }
+
+    // Typing more only ever narrows the previous result
+    const bool narrowing = !m_filterText.trimmed().isEmpty()
+                           && text.trimmed().toLower().startsWith(m_filterText.trimmed().toLower());
+
+    m_filterText = text;
+    // refine() keeps the order it's given, query() hands out ascending ids
+    applyVisible(narrowing ? m_index.refine(m_visible, text) : ordered(m_index.query(text)));
+    emit filterTextChanged();
+}
+
+int SourceModel::sourceIndex(int row) const
+{
+    return row >= 0 && row < m_visible.size() ? m_visible[row] : -1;
+}
+
+bool SourceModel::before(int a, int b) const
+{
+    const qint64 usedA = m_sources[a].lastUsed;
+    const qint64 usedB = m_sources[b].lastUsed;
+    return usedA != usedB ? usedA > usedB : a < b;
+}
+
+QVector<int> SourceModel::ordered(QVector<int> ids) const
+{
+    if (m_ranked) {
+        std::sort(ids.begin(), ids.end(), [this](int a, int b) { return before(a, b); });
+    }
+    return ids;
+}
+
+void SourceModel::applyVisible(const QVector<int> &visible)
+{
+    // Both lists are in row order, so instead of resetting (and recreating
+    // every delegate) we remove the rows that went away and insert the new ones.
+    const int oldCount = m_visible.size();
+
+    QVector<QPair<int, int>> removed;
+    for (int i = 0, j = 0; i < m_visible.size(); ++i) {
+        while (j < visible.size() && before(visible[j], m_visible[i])) {
+            ++j;
+        }
+        if (j < visible.size() && visible[j] == m_visible[i]) {
+            continue;
+        }
+        if (!removed.isEmpty() && removed.last().second == i - 1) {
+            removed.last().second = i;
+        } else {
+            removed.append({ i, i });
+        }
+    }
+
+    for (auto it = removed.crbegin(); it != removed.crend(); ++it) {
+        beginRemoveRows(QModelIndex(), it->first, it->second);
+        m_visible.remove(it->first, it->second - it->first + 1);
+        endRemoveRows();
+    }
+
+    // m_visible is now an ordered subset of visible
+    for (int row = 0; row < visible.size();) {
+        if (row < m_visible.size() && m_visible[row] == visible[row]) {
+            ++row;
+            continue;
+        }
+
+        // Insert everything up to the next surviving old row in one go
+        const int next = row < m_visible.size() ? m_visible[row] : -1;
+        int last = row;
+        while (last + 1 < visible.size() && visible[last + 1] != next) {
+            ++last;
+        }
+
+        beginInsertRows(QModelIndex(), row, last);
+        m_visible.insert(row, last - row + 1, 0);
+        std::copy(visible.cbegin() + row, visible.cbegin() + last + 1, m_visible.begin() + row);
+        endInsertRows();
+
+        row = last + 1;
+    }
+
+    if (m_visible.size() != oldCount) {
+        emit countChanged();
+    }
+}
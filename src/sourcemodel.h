@@ -0,0 +1,64 @@
+#ifndef SOURCEMODEL_H
+#define SOURCEMODEL_H
+
+#include <QAbstractListModel>
+#include <QQmlEngine>
+#include <QVector>
+#include "sourceselector.h"
+#include "sourcesearchindex.h"
+#include "objectcounter.h"
+
+// Picker rows with type-to-filter. Rows are a filtered view of the sources,
+// sourceIndex() maps a visible row back to SourceSelector's source list.
+// Sources the app shared before come first, most recent on top, so row 0 is
+// the likely choice; the rest keep the order they came in.
+class SourceModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Provided by SourceSelector")
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+    Q_PROPERTY(QString filterText READ filterText WRITE setFilter NOTIFY filterTextChanged)
+
+public:
+    enum Roles {
+        TypeRole = Qt::UserRole + 1,
+        SourceIdRole,
+        DisplayNameRole,
+        SourceIndexRole,
+        IconNameRole,
+    };
+
+    explicit SourceModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    void setSources(const QVector<SourceSelector::Source> &sources);
+    void appendSource(const SourceSelector::Source &source);
+
+    QString filterText() const { return m_filterText; }
+    void setFilter(const QString &text);
+
+    Q_INVOKABLE int sourceIndex(int row) const;
+
+signals:
+    void countChanged();
+    void filterTextChanged();
+
+private:
+    void applyVisible(const QVector<int> &visible);
+    // Row order of two source ids
+    bool before(int a, int b) const;
+    QVector<int> ordered(QVector<int> ids) const;
+
+    QVector<SourceSelector::Source> m_sources;
+    SourceSearchIndex m_index;
+    QVector<int> m_visible;
+    QString m_filterText;
+    bool m_ranked = false; // any source with a lastUsed, otherwise ids are the order
+    Counted<SourceModel> m_counted;
+};
+
+#endif // SOURCEMODEL_H
@@ -0,0 +1,83 @@
+#include "sourcesearchindex.h"
+#include <algorithm>
+#include <iterator>
+
+void SourceSearchIndex::clear()
+{
+    m_haystacks.clear();
+    m_trigrams.clear();
+}
+
+int SourceSearchIndex::add(const QStringList &fields)
+{
+    const int id = m_haystacks.size();
+
+    // Fields are joined with a newline so no trigram spans two of them
+    QString haystack = fields.join(QLatin1Char('\n')).toLower();
+
+    for (qsizetype i = 0; i + 3 <= haystack.size(); ++i) {
+        QVector<int> &postings = m_trigrams[trigramKey(haystack.constData() + i)];
+        if (postings.isEmpty() || postings.last() != id) {
+            postings.append(id);
+        }
+    }
+
+    m_haystacks.append(std::move(haystack));
+    return id;
+}
+
+QVector<int> SourceSearchIndex::query(const QString &text) const
+{
+    const QString needle = text.trimmed().toLower();
+
+    if (needle.size() < 3) {
+        // Too short for trigrams, a straight scan is cheap enough
+        QVector<int> result;
+        for (int id = 0; id < m_haystacks.size(); ++id) {
+            if (needle.isEmpty() || m_haystacks[id].contains(needle)) {
+                result.append(id);
+            }
+        }
+        return result;
+    }
+
+    // Collect the posting lists, smallest first
+    QVector<const QVector<int> *> lists;
+    for (qsizetype i = 0; i + 3 <= needle.size(); ++i) {
+        auto it = m_trigrams.constFind(trigramKey(needle.constData() + i));
+        if (it == m_trigrams.constEnd()) {
+            return {};
+        }
+        lists.append(&it.value());
+    }
+    std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) {
+        return a->size() < b->size();
+    });
+
+    QVector<int> candidates = *lists.first();
+    QVector<int> scratch;
+    for (qsizetype i = 1; i < lists.size() && !candidates.isEmpty(); ++i) {
+        scratch.clear();
+        std::set_intersection(candidates.cbegin(), candidates.cend(),
+                              lists[i]->cbegin(), lists[i]->cend(),
+                              std::back_inserter(scratch));
+        candidates.swap(scratch);
+    }
+
+    // Having all trigrams doesn't mean they are adjacent
+    return refine(candidates, needle);
+}
+
+QVector<int> SourceSearchIndex::refine(const QVector<int> &candidates, const QString &text) const
+{
+    const QString needle = text.trimmed().toLower();
+
+    QVector<int> result;
+    result.reserve(candidates.size());
+    for (int id : candidates) {
+        if (id >= 0 && id < m_haystacks.size() && m_haystacks[id].contains(needle)) {
+            result.append(id);
+        }
+    }
+    return result;
+}
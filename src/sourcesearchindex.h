@@ -0,0 +1,37 @@
+#ifndef SOURCESEARCHINDEX_H
+#define SOURCESEARCHINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Case-insensitive substring search over picker rows. Each row's fields are
+// lowercased once and broken into trigrams; a query intersects the posting
+// lists of its own trigrams and only verifies the few survivors, so typing
+// stays well under a millisecond with a thousand rows.
+class SourceSearchIndex
+{
+public:
+    void clear();
+    int size() const { return m_haystacks.size(); }
+
+    // Index a row, returns its id (ids are dense and ascending)
+    int add(const QStringList &fields);
+
+    // Ids of all rows containing text, ascending
+    QVector<int> query(const QString &text) const;
+    // Same, but only among candidates (e.g. the result for a shorter prefix)
+    QVector<int> refine(const QVector<int> &candidates, const QString &text) const;
+
+private:
+    static quint64 trigramKey(const QChar *c)
+    {
+        return (quint64(c[0].unicode()) << 32) | (quint64(c[1].unicode()) << 16) | c[2].unicode();
+    }
+
+    QVector<QString> m_haystacks;
+    QHash<quint64, QVector<int>> m_trigrams;
+};
+
+#endif // SOURCESEARCHINDEX_H
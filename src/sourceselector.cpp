@@ -1,14 +1,22 @@
-#include <fstream>
-#include <string>
-#include <vector>
-#include <filesystem>
-#include <cstdlib>
 #include "sourceselector.h"
+#include "desktopentry.h"
+#include "sourcemodel.h"
+#include "appiconprovider.h"
+#include "renderpacing.h"
 #include "mutterdisplayconfig.h"
 #include "muttershellintrospect.h"
+#include "compositorwatcher.h"
+#include "chrometrace.h"
+#include "logging.h"
+#include "tracering.h"
+#include "usagestats.h"
+#include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
+#include <QPointer>
 #include <QQmlContext>
 #include <QQuickItem>
 #include <QQmlListProperty>
+#include <QThreadPool>
 #include <qlogging.h>
 #include <systemsettings.h>
 
@@ -16,9 +24,9 @@ SourceSelector::SourceSelector(QObject *parent, QString requestAppId)
     : QObject(parent)
     , m_view(nullptr)
     , m_engine(nullptr)
+    , m_model(nullptr)
     , m_requestAppId(requestAppId)
 {
-    populateSources();
 }
 
 SourceSelector::~SourceSelector()
@@ -28,81 +36,6 @@ SourceSelector::~SourceSelector()
     }
 }
 
-std::string parseNameFromFile(const std::filesystem::path& path) {
-    std::ifstream file(path);
-    std::string line;
-    bool inDesktopEntry = false;
-    
-    while (std::getline(file, line)) {
-        line.erase(0, line.find_first_not_of(" \t"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
-        
-        if (line == "[Desktop Entry]") {
-            inDesktopEntry = true;
-        } else if (line[0] == '[') {
-            inDesktopEntry = false;
-        } else if (inDesktopEntry && line.find("Name=") == 0) {
-            return line.substr(5);
-        }
-    }
-    return "";
-}
-
-std::string parseWMClassFromFile(const std::filesystem::path& path) {
-    std::ifstream file(path);
-    std::string line;
-    bool inDesktopEntry = false;
-    
-    while (std::getline(file, line)) {
-        line.erase(0, line.find_first_not_of(" \t"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
-        
-        if (line == "[Desktop Entry]") {
-            inDesktopEntry = true;
-        } else if (line[0] == '[') {
-            inDesktopEntry = false;
-        } else if (inDesktopEntry && line.find("StartupWMClass=") == 0) {
-            return line.substr(15);
-        }
-    }
-    return "";
-}
-
-std::string findDisplayName(const std::string& identifier) {
-    // Build search paths
-    std::vector<std::string> searchPaths;
-    
-    if (const char* home = std::getenv("HOME")) {
-        searchPaths.push_back(std::string(home) + "/.local/share/applications/");
-    }
-    searchPaths.push_back("/usr/local/share/applications/");
-    searchPaths.push_back("/usr/share/applications/");
-    
-    // Search through all desktop files
-    for (const auto& searchPath : searchPaths) {
-        if (!std::filesystem::exists(searchPath)) continue;
-        
-        for (const auto& entry : std::filesystem::directory_iterator(searchPath)) {
-            if (entry.path().extension() != ".desktop") continue;
-            
-            std::string filename = entry.path().filename().string();
-            
-            // Check if filename matches (desktop ID)
-            if (filename == identifier || filename == identifier + ".desktop") {
-                return parseNameFromFile(entry.path());
-            }
-            
-            // Check if StartupWMClass matches
-            std::string wmClass = parseWMClassFromFile(entry.path());
-            if (wmClass == identifier) {
-                return parseNameFromFile(entry.path());
-            }
-        }
-    }
-    
-    return identifier;
-}
-
 QString SourceSelector::getAppDisplayName(QString appId) {
     auto displayName = findDisplayName(appId.toStdString());
     return displayName == "" ? appId : QString::fromStdString(displayName);
@@ -115,188 +48,346 @@ void SourceSelector::setupUI()
     connect(m_engine, &QQmlApplicationEngine::warnings, this,
             [](const QList<QQmlError> &warnings) {
                 for (const auto &warning : warnings) {
-                    qWarning() << "QML Warning:" << warning.toString();
+                    qCWarning(lcSelector) << "QML Warning:" << warning.toString();
                 }
             });
 
     connect(m_engine, &QQmlApplicationEngine::objectCreated, this,
-            [](QObject *obj, const QUrl &url) {
+            [this](QObject *obj, const QUrl &url) {
                 if (!obj) {
-                    qCritical() << "Failed to create QML object from:" << url;
+                    qCCritical(lcSelector) << "Failed to create QML object from:" << url;
                 } else {
-                    qInfo() << "Successfully created QML object from:" << url;
+                    qCDebug(lcSelector) << "Successfully created QML object from:" << url;
+                    if (auto *window = qobject_cast<QQuickWindow *>(obj)) {
+                        emit windowCreated(window);
+                    }
                 }
             });
 
     // Create QML model and store it as member
-    m_sourceObjects.clear();
-    for (const auto &source : m_sources) {
-        m_sourceObjects.append(new SourceItem(
-            static_cast<int>(source.type),
-            source.id,
-            source.displayName,
-            this  // Changed parent to 'this' instead of m_engine
-            ));
-    }
+    m_model = buildModel(m_sources, this);
+
+    // The engine owns the provider, decoded icons outlive it in AppIconCache
+    m_engine->addImageProvider(QStringLiteral("appicon"), new AppIconProvider);
 
     m_engine->rootContext()->setContextProperty("SystemSettings", SystemSettings::instance());
 
-    // Set context property BEFORE loading QML
-    m_engine->rootContext()->setContextProperty("requestAppId", QVariant::fromValue(m_requestAppId));
-    m_engine->rootContext()->setContextProperty("sourceModel", QVariant::fromValue(m_sourceObjects));
-    m_engine->rootContext()->setContextProperty("selectorApi", this);
+    // Typed required properties rather than context properties, so that
+    // qmlcachegen can compile the bindings that use them
+    m_engine->setInitialProperties({
+        { QStringLiteral("requestAppId"), m_requestAppId },
+        { QStringLiteral("sourceModel"), QVariant::fromValue(m_model) },
+        { QStringLiteral("selectorApi"), QVariant::fromValue(this) },
+    });
 
     // Load the QML file
-    m_engine->load(QUrl(QStringLiteral("qrc:/SourceSelectorModule/qml/SourceSelector.qml")));
-
-    qInfo() << "Loaded SourceSelector.qml";
+    {
+        TraceSpan span("SourceSelector.qml", m_requestAppId);
+        m_engine->load(QUrl(QStringLiteral("qrc:/SourceSelectorModule/qml/SourceSelector.qml")));
+    }
 
     // Check if loading succeeded
     if (m_engine->rootObjects().isEmpty()) {
-        qWarning() << "Failed to load QML file";
+        qCWarning(lcSelector) << "Failed to load QML file";
         return;
     }
 
     QObject *root = m_engine->rootObjects().first();
+    qCDebug(lcSelector) << "Loaded SourceSelector.qml, root is" << root;
 
-    qInfo() << "root is " << &root;
+    RenderPacing::attach(qobject_cast<QQuickWindow *>(root));
 
     // Connect signals
     QObject::connect(root, SIGNAL(sourceSelected(int)),
                      this, SLOT(onSourceSelected(int)));
     QObject::connect(root, SIGNAL(cancelled()),
                      this, SLOT(onCancelled()));
+}
+
+QQuickWindow *SourceSelector::window() const
+{
+    if (!m_engine || m_engine->rootObjects().isEmpty()) {
+        return nullptr;
+    }
+    return qobject_cast<QQuickWindow *>(m_engine->rootObjects().first());
+}
+
+void SourceSelector::populateSources()
+{
+    if (m_populating) {
+        return;
+    }
+    m_populating = true;
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    CompositorWatcher &watcher = CompositorWatcher::instance();
+
+    // Both asked at once, answers come back on the GUI thread
+    m_pendingLookups = 2;
+    traceAsyncBegin("populateSources", m_requestAppId, quintptr(this));
+
+    if (watcher.isPresent(MutterDisplayConfigInterface::staticInterfaceName())) {
+        QDBusMessage msg = QDBusMessage::createMethodCall(
+            "org.gnome.Mutter.DisplayConfig", "/org/gnome/Mutter/DisplayConfig",
+            "org.gnome.Mutter.DisplayConfig", "GetCurrentState");
+        auto *call = new QDBusPendingCallWatcher(bus.asyncCall(msg, CompositorCallTimeoutMs), this);
+        connect(call, &QDBusPendingCallWatcher::finished, this, [this, call]() {
+            call->deleteLater();
+            onMonitors(MutterDisplayConfig::parseMonitors(call->reply()));
+        });
+    } else {
+        qCWarning(lcSelector) << "Hell no, display config is not available...";
+        QMetaObject::invokeMethod(this, [this]() { onMonitors({}); }, Qt::QueuedConnection);
+    }
 
-    qInfo() << "Connected sourceSelected and onCancelled";
+    if (watcher.isPresent(MutterShellIntrospectInterface::staticInterfaceName())) {
+        QDBusMessage msg = QDBusMessage::createMethodCall(
+            "org.gnome.Shell.Introspect", "/org/gnome/Shell/Introspect",
+            "org.gnome.Shell.Introspect", "GetWindows");
+        auto *call = new QDBusPendingCallWatcher(bus.asyncCall(msg, CompositorCallTimeoutMs), this);
+        connect(call, &QDBusPendingCallWatcher::finished, this, [this, call]() {
+            call->deleteLater();
+            onWindows(MutterShellIntrospect::parseWindows(call->reply()));
+        });
+    } else {
+        qCWarning(lcSelector) << "Sorry, no windows for you, I guess.";
+        QMetaObject::invokeMethod(this, [this]() { onWindows({}); }, Qt::QueuedConnection);
+    }
 }
 
-int SourceSelector::exec()
+void SourceSelector::onMonitors(const QVector<MonitorInfo> &monitors)
 {
-    if (!m_engine) {
-        setupUI();
+    qCDebug(lcSelector) << "Found" << monitors.size() << "monitors";
+    traceEvent("monitors", {}, monitors.size());
+
+    for (const MonitorInfo &monitor : monitors) {
+        addSource(monitorSource(monitor));
     }
 
-    if (m_engine->rootObjects().isEmpty()) {
-        return 0;
+    // Windows that beat the monitors here go below them
+    m_monitorsDone = true;
+    if (!m_heldWindows.isEmpty()) {
+        onWindows(std::exchange(m_heldWindows, {}));
     }
+    lookupDone();
+}
 
-    QObject *root = m_engine->rootObjects().first();
+void SourceSelector::onWindows(const QVector<WindowInfo> &windows)
+{
+    if (!m_monitorsDone) {
+        m_heldWindows = windows;
+        if (windows.isEmpty()) {
+            lookupDone();
+        }
+        return;
+    }
 
-    // Make it modal - set the modality property
-    root->setProperty("modality", Qt::ApplicationModal);
+    qCDebug(lcSelector) << "Found" << windows.size() << "windows";
+    traceEvent("windows", {}, windows.size());
 
-    // Show and activate the window
-    root->setProperty("visible", true);
-    root->setProperty("modality", Qt::ApplicationModal);
-    QMetaObject::invokeMethod(root, "raise");
-    QMetaObject::invokeMethod(root, "requestActivate");
+    // Titled windows go in right away, untitled ones once their app's name
+    // is looked up. One lookup per app, off the GUI thread.
+    QHash<QString, QVector<WindowInfo>> byApp;
+    for (const WindowInfo &window : windows) {
+        if (needsDisplayName(window)) {
+            byApp[window.appId].append(window);
+        } else {
+            addSource(windowSource(window));
+        }
+    }
 
-    // Create event loop for modal behavior
-    QEventLoop loop;
-    connect(this, &SourceSelector::accepted, &loop, [&loop]() { loop.exit(1); });
-    connect(this, &SourceSelector::rejected, &loop, [&loop]() { loop.exit(0); });
+    for (auto it = byApp.cbegin(); it != byApp.cend(); ++it) {
+        ++m_pendingLookups;
+        QThreadPool::globalInstance()->start([appId = it.key(), group = it.value(),
+                                              context = QPointer<SourceSelector>(this)] {
+            const QString displayName = QString::fromStdString(findDisplayName(appId.toStdString()));
+
+            // context can only be checked safely on the thread it's deleted on
+            QMetaObject::invokeMethod(QCoreApplication::instance(), [context, group, displayName] {
+                if (!context) {
+                    return;
+                }
+                for (const WindowInfo &window : group) {
+                    context->addSource(windowSource(window, displayName));
+                }
+                context->lookupDone();
+            }, Qt::QueuedConnection);
+        });
+    }
 
-    return loop.exec();
+    lookupDone();
 }
 
-void SourceSelector::populateSources()
+void SourceSelector::addSource(Source source)
 {
-    m_sources.clear();
+    source.lastUsed = UsageStats::instance().lastUsed(m_requestAppId, source.usageKey);
 
-    MutterDisplayConfig displayConfig;
+    m_sources.append(source);
+    if (m_model) {
+        m_model->appendSource(source);
+    }
+}
 
-    if (!displayConfig.isAvailable()) {
-        qWarning() << "Hell no, display config is not available...";
+void SourceSelector::lookupDone()
+{
+    if (--m_pendingLookups > 0) {
         return;
     }
 
-    QVector<MonitorInfo> monitors = displayConfig.getMonitors();
-    qInfo() << "Found " << monitors.size() << " monitors.";
+    traceEvent("sources-complete", m_requestAppId, m_sources.size());
+    traceAsyncEnd("populateSources", m_requestAppId, quintptr(this));
+    emit sourcesComplete();
 
-    for (const auto& monitor : monitors) {
-        Source source;
-        source.type = Monitor;
-        source.id = monitor.connector;
-
-        if (!monitor.displayName.isEmpty()) {
-            source.displayName = QString("%1 (%2x%3 @ %4 Hz)")
-            .arg(monitor.displayName)
-                .arg(monitor.currentWidth)
-                .arg(monitor.currentHeight)
-                .arg(monitor.currentRefreshRate, 0, 'f', 2); // didn't know Qt has string formatting built-in, I was gonna use fmt or smth like that lol
+    if (!m_autoConfirmId.isNull()) {
+        int index = 0;
+        for (int i = 0; i < m_sources.size(); ++i) {
+            if (m_sources[i].id == m_autoConfirmId) {
+                index = i;
+                break;
+            }
         }
-        else {
-            source.displayName = QString("%1 (%2x%3)")
-            .arg(monitor.connector)
-                .arg(monitor.currentWidth)
-                .arg(monitor.currentHeight);
+
+        if (m_sources.isEmpty()) {
+            onCancelled();
+        } else {
+            onSourceSelected(index);
         }
+    }
+}
 
-        m_sources.append(source);
-        qInfo() << "Added monitor: " << source.displayName;
+SourceSelector::Source SourceSelector::monitorSource(const MonitorInfo &monitor)
+{
+    Source source;
+    source.type = Monitor;
+    source.id = monitor.connector;
+
+    // Connectors move around with docks and cable swaps, the monitor doesn't
+    if (monitor.vendor.isEmpty() && monitor.product.isEmpty() && monitor.serial.isEmpty()) {
+        source.usageKey = QStringLiteral("monitor:") + monitor.connector;
+    } else {
+        source.usageKey = QStringLiteral("monitor:%1/%2/%3").arg(monitor.vendor, monitor.product, monitor.serial);
     }
 
-    MutterShellIntrospect shellIntrospect;
-    if (!shellIntrospect.isAvailable()) {
-        qWarning() << "Sorry, no windows for you, I guess.";
-        return;
+    if (!monitor.displayName.isEmpty()) {
+        source.displayName = QString("%1 (%2x%3 @ %4 Hz)")
+        .arg(monitor.displayName)
+            .arg(monitor.currentWidth)
+            .arg(monitor.currentHeight)
+            .arg(monitor.currentRefreshRate, 0, 'f', 2); // didn't know Qt has string formatting built-in, I was gonna use fmt or smth like that lol
+    }
+    else {
+        source.displayName = QString("%1 (%2x%3)")
+        .arg(monitor.connector)
+            .arg(monitor.currentWidth)
+            .arg(monitor.currentHeight);
     }
 
-    QVector<WindowInfo> windows = shellIntrospect.getWindows();
-    qInfo() << "Found" << windows.size() << "windows";
+    qCDebug(lcSelector) << "Added monitor:" << source.displayName;
+    return source;
+}
 
-    for (const auto &window : windows) {
-        Source source;
-        source.type = Window;
-        source.id = QString::number(window.windowId);
-
-        if (!window.title.isEmpty()) {
-            source.displayName = window.title;
-        } else if (!window.appId.isEmpty()) {
-            source.displayName = getAppDisplayName(window.appId);
-        } else {
-            source.displayName = QString("Window %1").arg(window.windowId);
-        }
+bool SourceSelector::needsDisplayName(const WindowInfo &window)
+{
+    return window.title.isEmpty() && !window.appId.isEmpty();
+}
+
+SourceSelector::Source SourceSelector::windowSource(const WindowInfo &window, const QString &displayName)
+{
+    Source source;
+    source.type = Window;
+    source.id = QString::number(window.windowId);
+    source.appId = window.appId;
+    if (!window.appId.isEmpty()) {
+        source.usageKey = QStringLiteral("window:") + window.appId;
+    }
+
+    if (!window.title.isEmpty()) {
+        source.displayName = window.title;
+    } else if (!window.appId.isEmpty()) {
+        source.displayName = displayName.isEmpty() ? window.appId : displayName;
+    } else {
+        source.displayName = QString("Window %1").arg(window.windowId);
+    }
+
+    qCDebug(lcSelector) << "Added window:" << source.displayName;
+    return source;
+}
 
-        m_sources.append(source);
-        qInfo() << "Added window:" << source.displayName;
+QVector<SourceSelector::Source> SourceSelector::buildSources(const QVector<MonitorInfo> &monitors,
+                                                             const QVector<WindowInfo> &windows)
+{
+    QVector<Source> sources;
+    sources.reserve(monitors.size() + windows.size());
+
+    for (const auto &monitor : monitors) {
+        sources.append(monitorSource(monitor));
+    }
+
+    for (const auto &window : windows) {
+        const QString displayName = needsDisplayName(window)
+            ? QString::fromStdString(findDisplayName(window.appId.toStdString()))
+            : QString();
+        sources.append(windowSource(window, displayName));
     }
+
+    return sources;
+}
+
+SourceModel *SourceSelector::buildModel(const QVector<Source> &sources, QObject *parent)
+{
+    auto *model = new SourceModel(parent);
+    model->setSources(sources);
+    return model;
 }
 
 void SourceSelector::show()
 {
-    qInfo() << "SourceSelector::show() ENTERED";
+    traceEvent("selector-show", m_requestAppId, m_sources.size());
 
     if (!m_engine) {
-        qInfo() << "Creating engine";
         setupUI();
     }
 
-    qInfo() << "Engine exists:" << (m_engine != nullptr);
-    qInfo() << "Root objects count:" << (m_engine ? m_engine->rootObjects().size() : -1);
-
     if (!m_engine->rootObjects().isEmpty()) {
         QObject *root = m_engine->rootObjects().first();
 
-        qInfo() << "Root object before show:" << root;
-        qInfo() << "Visible before:" << root->property("visible").toBool();
-
         QMetaObject::invokeMethod(root, "show");
         QMetaObject::invokeMethod(root, "raise");
         QMetaObject::invokeMethod(root, "requestActivate");
 
-        qInfo() << "Visible after show():" << root->property("visible").toBool();
-        qInfo() << "Window flags:" << root->property("flags");
+        qCDebug(lcSelector) << "Shown" << root << "visible:" << root->property("visible").toBool()
+                            << "flags:" << root->property("flags");
+        populateSources();
+        autoConfirm();
     }
     else {
-        qInfo() << "NO ROOT OBJECTS - QML FAILED TO LOAD!";
+        qCWarning(lcSelector) << "NO ROOT OBJECTS - QML FAILED TO LOAD!";
+        // Whoever waits on us still needs an answer
+        QMetaObject::invokeMethod(this, &SourceSelector::rejected, Qt::QueuedConnection);
     }
 }
 
+void SourceSelector::autoConfirm()
+{
+#ifdef UNI_PORTAL_TEST_HOOKS
+    // Picked once every source is in, see lookupDone()
+    const QString wanted = qEnvironmentVariable("UNI_PORTAL_AUTOCONFIRM");
+    if (!wanted.isEmpty()) {
+        qCWarning(lcSelector) << "Confirming the picker by itself, UNI_PORTAL_AUTOCONFIRM is set";
+        m_autoConfirmId = wanted;
+    }
+#endif
+}
+
 void SourceSelector::onSourceSelected(int index)
 {
     if (index >= 0 && index < m_sources.size()) {
         m_selectedSource = m_sources[index];
+
+        // Headless runs would only teach it their own script
+        if (m_autoConfirmId.isNull()) {
+            UsageStats::instance().recordUse(m_requestAppId, m_selectedSource.usageKey);
+        }
         emit accepted();
     }
 }
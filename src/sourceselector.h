@@ -7,12 +7,19 @@
 #include <QQmlEngine>
 #include <QQuickView>
 #include <QQmlApplicationEngine>
+#include <QQuickWindow>
 #include <qtmetamacros.h>
+#include "mutterdisplayconfig.h"
+#include "muttershellintrospect.h"
+#include "objectcounter.h"
+
+class SourceModel;
 
 class SourceSelector : public QObject
 {
     Q_OBJECT
     QML_ELEMENT
+    QML_UNCREATABLE("Created by the portal for each SelectSources call")
 
 public:
     enum SourceType {
@@ -25,20 +32,45 @@ public:
         SourceType type;
         QString id;
         QString displayName;
+        QString appId;
+        // Same source across restarts, see UsageStats
+        QString usageKey;
+        // When the requesting app last shared it, 0 if never. Rows sort by it.
+        qint64 lastUsed = 0;
     };
 
     explicit SourceSelector(QObject* parent = nullptr, QString requestAppId = "");
     ~SourceSelector();
 
+    // Emits accepted or rejected later, rejected right away if the QML
+    // didn't load
     void show();
-    int exec();
     Source getSelectedSource() const { return m_selectedSource; }
+    // The picker window, once the QML has been loaded
+    QQuickWindow *window() const;
 
     Q_INVOKABLE QString getAppDisplayName(QString appId);
 
+    // Turn enumerated monitors and windows into picker rows, monitors first.
+    // Blocks on desktop file lookups, the picker itself streams rows in.
+    static QVector<Source> buildSources(const QVector<MonitorInfo> &monitors,
+                                       const QVector<WindowInfo> &windows);
+    static Source monitorSource(const MonitorInfo &monitor);
+    // displayName is what findDisplayName() made of the app id, if needed
+    static Source windowSource(const WindowInfo &window, const QString &displayName = QString());
+    // Titled windows are ready as they are, the rest need their app's name
+    static bool needsDisplayName(const WindowInfo &window);
+    // QML-side model for the rows, owned by parent
+    static SourceModel *buildModel(const QVector<Source> &sources, QObject *parent);
+
 signals:
     void accepted();
     void rejected();
+    // Every source is in the model, names resolved
+    void sourcesComplete();
+    // From inside show(), before the window is shown, so its first frame
+    // can't be missed
+    void windowCreated(QQuickWindow *window);
 
 private slots:
     void onSourceSelected(int index);
@@ -46,36 +78,30 @@ private slots:
 
 private:
     void setupUI();
+    // Ask for monitors and windows without blocking, rows arrive later
     void populateSources();
+    void onMonitors(const QVector<MonitorInfo> &monitors);
+    void onWindows(const QVector<WindowInfo> &windows);
+    void addSource(Source source);
+    void lookupDone();
+    // Headless runs: UNI_PORTAL_AUTOCONFIRM picks the source with that id,
+    // or the first one for any other value. Only in benchmark builds
+    // (UNI_PORTAL_TEST_HOOKS), the daemon we ship always asks.
+    void autoConfirm();
 
     QQuickView *m_view;
     QQmlApplicationEngine *m_engine;
     QVector<Source> m_sources;
     Source m_selectedSource;
-    QObjectList m_sourceObjects;
+    SourceModel *m_model;
     QString m_requestAppId;
-};
-
-// QML-compatible model item
-class SourceItem : public QObject
-{
-    Q_OBJECT
-    Q_PROPERTY(int type READ type CONSTANT)
-    Q_PROPERTY(QString id READ id CONSTANT)
-    Q_PROPERTY(QString displayName READ displayName CONSTANT)
-
-public:
-    SourceItem(int type, const QString& id, const QString& displayName, QObject* parent = nullptr)
-        : QObject(parent), m_type(type), m_id(id), m_displayName(displayName) {}
 
-    int type() const { return m_type; }
-    QString id() const { return m_id; }
-    QString displayName() const { return m_displayName; }
-
-private:
-    int m_type;
-    QString m_id;
-    QString m_displayName;
+    bool m_populating = false;
+    bool m_monitorsDone = false;
+    int m_pendingLookups = 0;
+    QVector<WindowInfo> m_heldWindows; // until the monitors are in
+    QString m_autoConfirmId;
+    Counted<SourceSelector> m_counted;
 };
 
 #endif // SOURCESELECTOR_H
@@ -0,0 +1,237 @@
+#include "startjob.h"
+#include "compositorbackend.h"
+#include "compositorwatcher.h"
+#include "logging.h"
+#include "tracering.h"
+
+// Not worth another round with less than this left
+static constexpr int MinAttemptMs = 200;
+
+StartJob::StartJob(CompositorBackend *mutter, const Source &source, int deadlineMs, QObject *parent)
+    : QObject(parent)
+    , m_mutter(mutter)
+    , m_source(source)
+    , m_deadline(deadlineMs)
+{
+    m_streamTimer.setSingleShot(true);
+    connect(&m_streamTimer, &QTimer::timeout, this, [this]() {
+        qCWarning(lcScreenCast) << "No PipeWire node for" << m_streamPath << "after attempt" << m_attempts;
+        traceEvent("start-no-node", m_streamPath, m_attempts);
+        retry("no PipeWire node");
+    });
+
+    connect(m_mutter, &CompositorBackend::pipeWireStreamAdded, this, &StartJob::onNode);
+
+    // Niri closed the session under us, e.g. it restarted
+    connect(m_mutter, &CompositorBackend::sessionClosed, this, [this](const QString &niriPath) {
+        if (!m_over && niriPath == m_niriSessionPath) {
+            m_niriSessionPath.clear();
+            retry("session closed by Niri");
+        }
+    });
+}
+
+StartJob::~StartJob()
+{
+    if (!m_over) {
+        cancel();
+    }
+}
+
+void StartJob::linkTo(const QVariantMap &sessionProperties, Starter start)
+{
+    m_sessionProperties = sessionProperties;
+    m_starter = std::move(start);
+}
+
+void StartJob::start(std::function<void(uint)> done)
+{
+    m_done = std::move(done);
+    attempt();
+}
+
+void StartJob::cancel()
+{
+    if (m_over) {
+        return;
+    }
+
+    traceEvent("start-cancelled", m_niriSessionPath, m_attempts);
+    m_over = true;
+    m_done = nullptr;
+    m_streamTimer.stop();
+    rollback();
+}
+
+bool StartJob::isCurrent(int attempt) const
+{
+    return !m_over && attempt == m_attempts;
+}
+
+int StartJob::stepTimeout() const
+{
+    return int(qBound<qint64>(1, m_deadline.remainingTime(), CompositorCallTimeoutMs));
+}
+
+void StartJob::attempt()
+{
+    if (m_deadline.hasExpired()) {
+        finish(2);
+        return;
+    }
+
+    const int attempt = ++m_attempts;
+    m_started = false;
+    traceEvent("start-attempt", m_source.id, attempt);
+
+    m_mutter->createSessionAsync(m_sessionProperties, stepTimeout(), this,
+        [this, attempt](const QString &sessionPath, const QDBusError &error) {
+            if (!isCurrent(attempt)) {
+                // Ours, but nobody needs it anymore
+                m_mutter->stopSessionAsync(sessionPath);
+                return;
+            }
+            if (error.isValid()) {
+                onError("CreateSession", error);
+                return;
+            }
+
+            m_niriSessionPath = sessionPath;
+            record(attempt);
+        });
+}
+
+void StartJob::record(int attempt)
+{
+    auto done = [this, attempt](const QString &streamPath, const QDBusError &error) {
+        if (!isCurrent(attempt)) {
+            return;
+        }
+        if (error.isValid()) {
+            onError(m_source.isWindow ? "RecordWindow" : "RecordMonitor", error);
+            return;
+        }
+
+        m_streamPath = streamPath;
+        startSession(attempt);
+    };
+
+    if (m_source.isWindow) {
+        m_mutter->recordWindowAsync(m_niriSessionPath, m_source.id.toULongLong(),
+                                    m_source.cursorMode, stepTimeout(), this, done);
+    } else {
+        m_mutter->recordMonitorAsync(m_niriSessionPath, m_source.id,
+                                     m_source.cursorMode, stepTimeout(), this, done);
+    }
+}
+
+void StartJob::startSession(int attempt)
+{
+    auto done = [this, attempt](const QDBusError &error) {
+        if (!isCurrent(attempt)) {
+            return;
+        }
+        if (error.isValid()) {
+            onError("Start", error);
+            return;
+        }
+
+        m_started = true;
+        waitForNode();
+    };
+
+    if (m_starter) {
+        m_starter(stepTimeout(), this, done);
+    } else {
+        m_mutter->startSessionAsync(m_niriSessionPath, stepTimeout(), this, done);
+    }
+}
+
+void StartJob::waitForNode()
+{
+    // Niri may well announce the node before Start replies
+    if (m_nodeId != 0) {
+        finish(0);
+        return;
+    }
+
+    m_streamTimer.start(int(qMin<qint64>(StreamTimeoutMs, m_deadline.remainingTime())));
+}
+
+void StartJob::onNode(const QString &streamPath, uint nodeId)
+{
+    if (m_over || streamPath.isEmpty() || streamPath != m_streamPath) {
+        return;
+    }
+
+    m_nodeId = nodeId;
+    if (m_started) {
+        finish(0);
+    }
+}
+
+void StartJob::onError(const char *step, const QDBusError &error)
+{
+    qCWarning(lcScreenCast) << step << "failed on attempt" << m_attempts << ":" << error.message();
+
+    // Slow or missing compositor is worth another try, a refusal is not
+    switch (error.type()) {
+    case QDBusError::NoReply:
+    case QDBusError::Timeout:
+    case QDBusError::TimedOut:
+    case QDBusError::Disconnected:
+    case QDBusError::ServiceUnknown:
+        retry(step);
+        break;
+    default:
+        finish(2);
+        break;
+    }
+}
+
+void StartJob::retry(const char *reason)
+{
+    rollback();
+
+    const int maxAttempts = m_starter ? 1 : MaxAttempts;
+    if (m_attempts >= maxAttempts || m_deadline.remainingTime() < MinAttemptMs) {
+        qCWarning(lcScreenCast) << "Giving up on Start after" << m_attempts << "attempts, last:" << reason;
+        finish(2);
+        return;
+    }
+
+    qCDebug(lcScreenCast) << "Retrying Start," << reason;
+    attempt();
+}
+
+void StartJob::rollback()
+{
+    m_streamTimer.stop();
+
+    if (!m_niriSessionPath.isEmpty()) {
+        m_mutter->stopSessionAsync(m_niriSessionPath);
+    }
+    m_niriSessionPath.clear();
+    m_streamPath.clear();
+    m_nodeId = 0;
+    m_started = false;
+}
+
+void StartJob::finish(uint response)
+{
+    if (m_over) {
+        return;
+    }
+
+    m_streamTimer.stop();
+    if (response != 0) {
+        rollback();
+    }
+
+    m_over = true;
+    traceEvent("start-finished", m_streamPath, response);
+
+    if (auto done = std::exchange(m_done, nullptr)) {
+        done(response);
+    }
+}
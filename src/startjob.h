@@ -0,0 +1,93 @@
+#ifndef STARTJOB_H
+#define STARTJOB_H
+
+#include "objectcounter.h"
+#include <QDBusError>
+#include <QDeadlineTimer>
+#include <QObject>
+#include <QTimer>
+#include <QVariantMap>
+#include <functional>
+
+class CompositorBackend;
+
+// One portal Start against Niri: CreateSession, Record*, Start, then wait
+// for the PipeWire node. Every step is asynchronous and bounded by what is
+// left of the request's deadline, so a hung compositor costs the client the
+// deadline and not the D-Bus default of 25 s per call.
+//
+// A missing node or a timed out call is retried from scratch a couple of
+// times, anything Niri actively refused is not. Whatever a failed or
+// cancelled attempt created on the Niri side is stopped again.
+class StartJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DeadlineMs = 8000;
+    static constexpr int StreamTimeoutMs = 1500; // per attempt
+    static constexpr int MaxAttempts = 3;
+
+    struct Source {
+        QString id; // connector or window id
+        bool isWindow = false;
+        uint cursorMode = 1;
+    };
+
+    StartJob(CompositorBackend *mutter, const Source &source,
+             int deadlineMs = DeadlineMs, QObject *parent = nullptr);
+    ~StartJob() override;
+
+    // done gets 0 once the node is there, 2 on failure. It's called exactly
+    // once, unless the job is cancelled first.
+    void start(std::function<void(uint response)> done);
+
+    // Request or session closed: roll back, done won't be called
+    void cancel();
+
+    // Remote desktop: the screencast session is created with
+    // sessionProperties (its "remote-desktop-session-id") and starts along
+    // with the remote desktop session, through start. That one only starts
+    // once, so a linked job doesn't retry.
+    using Starter = std::function<void(int timeoutMs, QObject *context,
+                                       std::function<void(const QDBusError &error)> done)>;
+    void linkTo(const QVariantMap &sessionProperties, Starter start);
+
+    QString niriSessionPath() const { return m_niriSessionPath; }
+    QString streamPath() const { return m_streamPath; }
+    uint nodeId() const { return m_nodeId; }
+    int attempts() const { return m_attempts; }
+
+private:
+    void attempt();
+    void record(int attempt);
+    void startSession(int attempt);
+    void waitForNode();
+    void onNode(const QString &streamPath, uint nodeId);
+    void onError(const char *step, const QDBusError &error);
+    void retry(const char *reason);
+    void rollback();
+    void finish(uint response);
+
+    // Replies of an earlier attempt, or after we're done, are stale
+    bool isCurrent(int attempt) const;
+    int stepTimeout() const;
+
+    CompositorBackend *m_mutter;
+    Source m_source;
+    QDeadlineTimer m_deadline;
+    QTimer m_streamTimer;
+    std::function<void(uint)> m_done;
+    QVariantMap m_sessionProperties;
+    Starter m_starter;
+
+    QString m_niriSessionPath;
+    QString m_streamPath;
+    uint m_nodeId = 0;
+    int m_attempts = 0;
+    bool m_started = false; // Niri's Start replied
+    bool m_over = false;
+    Counted<StartJob> m_counted;
+};
+
+#endif // STARTJOB_H
@@ -0,0 +1,512 @@
+#include "streammonitor.h"
+#include "logging.h"
+#include "tracering.h"
+#include <QSet>
+#include <chrono>
+#include <cstring>
+
+#ifdef HAVE_PIPEWIRE
+#include <pipewire/pipewire.h>
+#include <pipewire/extensions/profiler.h>
+#include <spa/debug/types.h>
+#include <spa/param/format-utils.h>
+#include <spa/param/profiler.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/param/video/type-info.h>
+#include <spa/pod/parser.h>
+#endif
+
+static qint64 nowMs()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef HAVE_PIPEWIRE
+
+// pw_node_activation status for a node that got through its cycle
+static constexpr int ActivationFinished = 3;
+
+struct NodeWatch {
+    StreamMonitor::Client *client = nullptr;
+    uint id = 0;
+    pw_proxy *proxy = nullptr;
+    spa_hook listener {};
+};
+
+// Everything in here belongs to the PipeWire thread, other threads take the
+// loop lock first
+struct StreamMonitor::Client {
+    pw_thread_loop *loop = nullptr;
+    pw_context *context = nullptr;
+    pw_core *core = nullptr;
+    pw_registry *registry = nullptr;
+    spa_hook registryListener {};
+    // Bound only while nodes are watched: as long as anyone listens,
+    // PipeWire profiles every graph cycle, audio included
+    uint32_t profilerId = SPA_ID_INVALID;
+    pw_proxy *profiler = nullptr;
+    spa_hook profilerListener {};
+
+    QSet<uint> knownNodes;
+    QHash<uint, NodeWatch *> nodes;
+    QHash<uint, StreamMonitor::Stats> stats;
+    QHash<uint, qint64> lastFrameMs;
+
+    void bind(uint id);
+    void release(uint id);
+    void bindProfiler();
+    void releaseProfiler();
+};
+
+static void onNodeInfo(void *data, const pw_node_info *info)
+{
+    auto *watch = static_cast<NodeWatch *>(data);
+    auto it = watch->client->stats.find(watch->id);
+    if (it == watch->client->stats.end()) {
+        return;
+    }
+
+    if (info->change_mask & PW_NODE_CHANGE_MASK_STATE) {
+        it->state = QString::fromUtf8(pw_node_state_as_string(info->state));
+        it->error = info->error ? QString::fromUtf8(info->error) : QString();
+        traceEvent("node-state", it->state, watch->id);
+    }
+}
+
+static void onNodeParam(void *data, int seq, uint32_t id, uint32_t index, uint32_t next, const spa_pod *param)
+{
+    Q_UNUSED(seq)
+    Q_UNUSED(index)
+    Q_UNUSED(next)
+
+    auto *watch = static_cast<NodeWatch *>(data);
+    auto it = watch->client->stats.find(watch->id);
+    if (it == watch->client->stats.end() || id != SPA_PARAM_Format || !param) {
+        return;
+    }
+
+    uint32_t mediaType = 0;
+    uint32_t mediaSubtype = 0;
+    if (spa_format_parse(param, &mediaType, &mediaSubtype) < 0
+        || mediaType != SPA_MEDIA_TYPE_video || mediaSubtype != SPA_MEDIA_SUBTYPE_raw) {
+        return;
+    }
+
+    spa_video_info_raw format {};
+    if (spa_format_video_raw_parse(param, &format) < 0) {
+        return;
+    }
+
+    const char *name = spa_debug_type_find_short_name(spa_type_video_format, format.format);
+    it->format = QString::fromUtf8(name ? name : "unknown");
+    it->size = QSize(int(format.size.width), int(format.size.height));
+
+    // Screencasts are usually variable rate, 0/1 with a max
+    const spa_fraction rate = format.framerate.num ? format.framerate : format.max_framerate;
+    it->negotiatedFps = rate.denom ? double(rate.num) / rate.denom : 0;
+}
+
+static const pw_node_events nodeEvents = {
+    .version = PW_VERSION_NODE_EVENTS,
+    .info = onNodeInfo,
+    .param = onNodeParam,
+};
+
+void StreamMonitor::Client::bind(uint id)
+{
+    if (nodes.contains(id) || !knownNodes.contains(id)) {
+        return;
+    }
+
+    auto *watch = new NodeWatch;
+    watch->client = this;
+    watch->id = id;
+    watch->proxy = static_cast<pw_proxy *>(
+        pw_registry_bind(registry, id, PW_TYPE_INTERFACE_Node, PW_VERSION_NODE, 0));
+    if (!watch->proxy) {
+        delete watch;
+        return;
+    }
+
+    pw_node_add_listener(reinterpret_cast<pw_node *>(watch->proxy), &watch->listener, &nodeEvents, watch);
+    uint32_t params[] = { SPA_PARAM_Format };
+    pw_node_subscribe_params(reinterpret_cast<pw_node *>(watch->proxy), params, 1);
+
+    nodes.insert(id, watch);
+}
+
+void StreamMonitor::Client::release(uint id)
+{
+    NodeWatch *watch = nodes.take(id);
+    if (!watch) {
+        return;
+    }
+
+    spa_hook_remove(&watch->listener);
+    pw_proxy_destroy(watch->proxy);
+    delete watch;
+}
+
+void StreamMonitor::Client::releaseProfiler()
+{
+    if (!profiler) {
+        return;
+    }
+
+    spa_hook_remove(&profilerListener);
+    pw_proxy_destroy(profiler);
+    profiler = nullptr;
+}
+
+struct Block {
+    int32_t id = -1;
+    int64_t signal = 0;
+    int64_t finish = 0;
+    int32_t status = 0;
+    int32_t xruns = -1; // only sent by newer PipeWire
+
+    bool finished() const { return status == ActivationFinished || finish > signal; }
+};
+
+static bool parseBlock(const spa_pod *pod, Block &block)
+{
+    const char *name = nullptr;
+    int64_t prevSignal = 0;
+    int64_t awake = 0;
+    spa_fraction latency {};
+
+    return spa_pod_parse_struct(pod,
+        SPA_POD_Int(&block.id),
+        SPA_POD_String(&name),
+        SPA_POD_Long(&prevSignal),
+        SPA_POD_Long(&block.signal),
+        SPA_POD_Long(&awake),
+        SPA_POD_Long(&block.finish),
+        SPA_POD_Int(&block.status),
+        SPA_POD_Fraction(&latency),
+        SPA_POD_OPT_Int(&block.xruns)) >= 0;
+}
+
+static void account(StreamMonitor::Client *client, const Block &block)
+{
+    auto it = client->stats.find(uint(block.id));
+    if (it == client->stats.end()) {
+        return;
+    }
+
+    it->cycles++;
+    if (block.finished()) {
+        it->frames++;
+        client->lastFrameMs.insert(uint(block.id), nowMs());
+    }
+    if (block.xruns >= 0) {
+        it->xruns = quint64(block.xruns);
+    }
+}
+
+// One profiler object per driver cycle: the driver block, then its followers
+static void onProfile(void *data, const spa_pod *pod)
+{
+    auto *client = static_cast<StreamMonitor::Client *>(data);
+
+    spa_pod *object;
+    SPA_POD_STRUCT_FOREACH(pod, object) {
+        if (!spa_pod_is_object_type(object, SPA_TYPE_OBJECT_Profiler)) {
+            continue;
+        }
+
+        spa_pod_prop *prop;
+        SPA_POD_OBJECT_FOREACH(reinterpret_cast<spa_pod_object *>(object), prop) {
+            if (prop->key != SPA_PROFILER_driverBlock && prop->key != SPA_PROFILER_followerBlock) {
+                continue;
+            }
+
+            Block block;
+            if (parseBlock(&prop->value, block)) {
+                account(client, block);
+            }
+        }
+    }
+}
+
+static const pw_profiler_events profilerEvents = {
+    .version = PW_VERSION_PROFILER_EVENTS,
+    .profile = onProfile,
+};
+
+static void onGlobal(void *data, uint32_t id, uint32_t permissions, const char *type, uint32_t version,
+                     const spa_dict *props)
+{
+    Q_UNUSED(permissions)
+    Q_UNUSED(version)
+    Q_UNUSED(props)
+
+    auto *client = static_cast<StreamMonitor::Client *>(data);
+
+    if (strcmp(type, PW_TYPE_INTERFACE_Node) == 0) {
+        client->knownNodes.insert(id);
+        // Watched before PipeWire told us about it
+        if (client->stats.contains(id)) {
+            client->bind(id);
+        }
+    } else if (strcmp(type, PW_TYPE_INTERFACE_Profiler) == 0 && client->profilerId == SPA_ID_INVALID) {
+        client->profilerId = id;
+        if (!client->stats.isEmpty()) {
+            client->bindProfiler();
+        }
+    }
+}
+
+void StreamMonitor::Client::bindProfiler()
+{
+    if (profiler || profilerId == SPA_ID_INVALID) {
+        return;
+    }
+
+    // Frames and xruns for every node come through this one object
+    profiler = static_cast<pw_proxy *>(
+        pw_registry_bind(registry, profilerId, PW_TYPE_INTERFACE_Profiler, PW_VERSION_PROFILER, 0));
+    if (profiler) {
+        pw_profiler_add_listener(reinterpret_cast<pw_profiler *>(profiler),
+                                 &profilerListener, &profilerEvents, this);
+    }
+}
+
+static void onGlobalRemove(void *data, uint32_t id)
+{
+    auto *client = static_cast<StreamMonitor::Client *>(data);
+    client->knownNodes.remove(id);
+
+    if (id == client->profilerId) {
+        client->releaseProfiler();
+        client->profilerId = SPA_ID_INVALID;
+        return;
+    }
+
+    auto it = client->stats.find(id);
+    if (it != client->stats.end()) {
+        it->state = QStringLiteral("removed");
+        client->release(id);
+    }
+}
+
+static const pw_registry_events registryEvents = {
+    .version = PW_VERSION_REGISTRY_EVENTS,
+    .global = onGlobal,
+    .global_remove = onGlobalRemove,
+};
+
+#else
+
+struct StreamMonitor::Client {};
+
+#endif // HAVE_PIPEWIRE
+
+StreamMonitor::StreamMonitor(QObject *parent)
+    : QObject(parent)
+{
+    m_sampleTimer.setInterval(1000);
+    connect(&m_sampleTimer, &QTimer::timeout, this, &StreamMonitor::sample);
+
+#ifdef HAVE_PIPEWIRE
+    pw_init(nullptr, nullptr);
+
+    m_client = new Client;
+    m_client->loop = pw_thread_loop_new("uni-stream-monitor", nullptr);
+    m_client->context = pw_context_new(pw_thread_loop_get_loop(m_client->loop), nullptr, 0);
+    if (!m_client->context || pw_thread_loop_start(m_client->loop) < 0) {
+        qCWarning(lcScreenCast) << "Stream monitor could not start its PipeWire loop";
+        return;
+    }
+
+    pw_thread_loop_lock(m_client->loop);
+
+    m_client->core = pw_context_connect(m_client->context, nullptr, 0);
+    if (m_client->core) {
+        m_client->registry = pw_core_get_registry(m_client->core, PW_VERSION_REGISTRY, 0);
+        pw_registry_add_listener(m_client->registry, &m_client->registryListener, &registryEvents, m_client);
+    } else {
+        qCWarning(lcScreenCast) << "Stream monitor could not connect to PipeWire";
+    }
+
+    pw_thread_loop_unlock(m_client->loop);
+#endif
+}
+
+StreamMonitor::~StreamMonitor()
+{
+#ifdef HAVE_PIPEWIRE
+    if (m_client->loop) {
+        pw_thread_loop_lock(m_client->loop);
+        for (uint id : m_client->nodes.keys()) {
+            m_client->release(id);
+        }
+        m_client->releaseProfiler();
+        if (m_client->registry) {
+            spa_hook_remove(&m_client->registryListener);
+            pw_proxy_destroy(reinterpret_cast<pw_proxy *>(m_client->registry));
+        }
+        if (m_client->core) {
+            pw_core_disconnect(m_client->core);
+        }
+        pw_thread_loop_unlock(m_client->loop);
+        pw_thread_loop_stop(m_client->loop);
+    }
+    if (m_client->context) {
+        pw_context_destroy(m_client->context);
+    }
+    if (m_client->loop) {
+        pw_thread_loop_destroy(m_client->loop);
+    }
+#endif
+    delete m_client;
+}
+
+bool StreamMonitor::isSupported()
+{
+#ifdef HAVE_PIPEWIRE
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool StreamMonitor::isConnected() const
+{
+#ifdef HAVE_PIPEWIRE
+    return m_client && m_client->core;
+#else
+    return false;
+#endif
+}
+
+void StreamMonitor::watch(uint nodeId)
+{
+    if (!isConnected()) {
+        return;
+    }
+
+#ifdef HAVE_PIPEWIRE
+    pw_thread_loop_lock(m_client->loop);
+    Stats stats;
+    stats.nodeId = nodeId;
+    m_client->stats.insert(nodeId, stats);
+    m_client->bind(nodeId);
+    m_client->bindProfiler();
+    pw_thread_loop_unlock(m_client->loop);
+#endif
+
+    m_samples.insert(nodeId, Sample());
+    if (!m_sampleTimer.isActive()) {
+        m_sampleTimer.start();
+    }
+}
+
+void StreamMonitor::unwatch(uint nodeId)
+{
+    if (!m_samples.remove(nodeId)) {
+        return;
+    }
+
+#ifdef HAVE_PIPEWIRE
+    pw_thread_loop_lock(m_client->loop);
+    m_client->release(nodeId);
+    m_client->stats.remove(nodeId);
+    m_client->lastFrameMs.remove(nodeId);
+    if (m_client->stats.isEmpty()) {
+        m_client->releaseProfiler();
+    }
+    pw_thread_loop_unlock(m_client->loop);
+#endif
+
+    if (m_samples.isEmpty()) {
+        m_sampleTimer.stop();
+    }
+}
+
+StreamMonitor::Stats StreamMonitor::stats(uint nodeId) const
+{
+    Stats stats;
+
+#ifdef HAVE_PIPEWIRE
+    if (!isConnected()) {
+        return stats;
+    }
+
+    pw_thread_loop_lock(m_client->loop);
+    stats = m_client->stats.value(nodeId);
+    const qint64 lastFrame = m_client->lastFrameMs.value(nodeId, -1);
+    pw_thread_loop_unlock(m_client->loop);
+
+    stats.lastFrameAgoMs = lastFrame < 0 ? -1 : nowMs() - lastFrame;
+#else
+    Q_UNUSED(nodeId)
+#endif
+
+    return stats;
+}
+
+QVariantMap StreamMonitor::toVariant(const Stats &stats)
+{
+    return {
+        { "node_id", stats.nodeId },
+        { "state", stats.state },
+        { "error", stats.error },
+        { "format", stats.format },
+        { "width", stats.size.width() },
+        { "height", stats.size.height() },
+        { "negotiated_fps", stats.negotiatedFps },
+        { "measured_fps", stats.measuredFps },
+        { "cycles", stats.cycles },
+        { "frames", stats.frames },
+        { "xruns", stats.xruns },
+        { "last_frame_ago_ms", stats.lastFrameAgoMs },
+    };
+}
+
+void StreamMonitor::sample()
+{
+    const int interval = m_sampleTimer.interval();
+    QList<QPair<uint, QString>> stalledNodes;
+
+    for (auto it = m_samples.begin(); it != m_samples.end(); ++it) {
+        const Stats current = stats(it.key());
+        Sample &previous = it.value();
+
+        const quint64 newCycles = current.cycles - previous.cycles;
+        const quint64 newFrames = current.frames - previous.frames;
+        previous.cycles = current.cycles;
+        previous.frames = current.frames;
+
+#ifdef HAVE_PIPEWIRE
+        // Written here on the main thread only, next to the PipeWire-side stats
+        pw_thread_loop_lock(m_client->loop);
+        auto stored = m_client->stats.find(it.key());
+        if (stored != m_client->stats.end()) {
+            stored->measuredFps = newFrames * 1000.0 / interval;
+        }
+        pw_thread_loop_unlock(m_client->loop);
+#endif
+
+        if (current.state == QLatin1String("error")) {
+            stalledNodes.append({ it.key(), QStringLiteral("node error: %1").arg(current.error) });
+        } else if (current.state == QLatin1String("removed")) {
+            stalledNodes.append({ it.key(), QStringLiteral("node removed") });
+        } else if (newCycles > 0 && newFrames == 0) {
+            previous.stuckMs += interval;
+            if (previous.stuckMs >= m_stallTimeoutMs) {
+                stalledNodes.append({ it.key(), QStringLiteral("no frame completed in %1 ms").arg(previous.stuckMs) });
+            }
+        } else {
+            previous.stuckMs = 0;
+        }
+    }
+
+    for (const auto &node : std::as_const(stalledNodes)) {
+        qCWarning(lcScreenCast) << "Stream" << node.first << "stalled:" << node.second;
+        traceEvent("stream-stalled", node.second, node.first);
+        unwatch(node.first);
+        emit stalled(node.first, node.second);
+    }
+}
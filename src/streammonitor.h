@@ -0,0 +1,76 @@
+#ifndef STREAMMONITOR_H
+#define STREAMMONITOR_H
+
+#include <QHash>
+#include <QObject>
+#include <QSize>
+#include <QTimer>
+#include <QVariantMap>
+
+// Keeps an eye on the PipeWire nodes we hand out. Node state and the
+// negotiated format come from the node itself, frames and xruns from the
+// PipeWire profiler (module-profiler, loaded by default), which we only
+// listen to while a node is watched. Optional like the frame grabber:
+// without PipeWire nothing is watched.
+//
+// Niri only produces frames on damage, so a silent stream is normal for an
+// idle screen. A stream counts as stalled when its node errors out or goes
+// away, or when cycles keep running but none of them completes.
+class StreamMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats {
+        uint nodeId = 0;
+        QString state; // PipeWire node state, or "removed"
+        QString error;
+        QString format;
+        QSize size;
+        double negotiatedFps = 0; // max framerate for variable rate streams
+        double measuredFps = 0;   // over the last sample
+        quint64 cycles = 0;       // graph cycles the node took part in
+        quint64 frames = 0;       // cycles that completed
+        quint64 xruns = 0;
+        qint64 lastFrameAgoMs = -1;
+    };
+
+    explicit StreamMonitor(QObject *parent = nullptr);
+    ~StreamMonitor() override;
+
+    static bool isSupported();
+    bool isConnected() const;
+
+    void watch(uint nodeId);
+    void unwatch(uint nodeId);
+    Stats stats(uint nodeId) const;
+
+    static QVariantMap toVariant(const Stats &stats);
+
+    // How long cycles may run without a completed frame, default 5 s
+    void setStallTimeout(int ms) { m_stallTimeoutMs = ms; }
+    void setSampleInterval(int ms) { m_sampleTimer.setInterval(ms); }
+
+    // PipeWire state, so the header doesn't need its includes
+    struct Client;
+
+signals:
+    // Emitted once per node, which is unwatched by then
+    void stalled(uint nodeId, const QString &reason);
+
+private:
+    void sample();
+
+    struct Sample {
+        quint64 cycles = 0;
+        quint64 frames = 0;
+        qint64 stuckMs = 0; // cycles without frames for this long
+    };
+
+    Client *m_client = nullptr;
+    QTimer m_sampleTimer;
+    QHash<uint, Sample> m_samples;
+    int m_stallTimeoutMs = 5000;
+};
+
+#endif // STREAMMONITOR_H
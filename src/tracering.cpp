@@ -0,0 +1,90 @@
+#include "tracering.h"
+#include <QString>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+qint64 nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+TraceRing &TraceRing::instance()
+{
+    static TraceRing ring;
+    return ring;
+}
+
+void TraceRing::record(const char *event, QStringView subject, qint64 value)
+{
+    const quint64 index = m_head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = m_slots[index % Capacity];
+
+    // Per-slot seqlock: odd while writing, even (and unique per lap) when done
+    slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Entry &entry = slot.entry;
+    entry.timestampNs = nowNs();
+    entry.event = event;
+    entry.value = value;
+
+    // Object paths and connectors are ASCII, anything else just gets a '?'
+    const qsizetype length = std::min<qsizetype>(subject.size(), SubjectSize - 1);
+    for (qsizetype i = 0; i < length; ++i) {
+        const char16_t c = subject[i].unicode();
+        entry.subject[i] = c < 0x80 ? char(c) : '?';
+    }
+    entry.subject[length] = '\0';
+
+    slot.sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+QList<TraceRing::Entry> TraceRing::snapshot() const
+{
+    QList<Entry> entries;
+    const quint64 head = m_head.load(std::memory_order_acquire);
+    const quint64 first = head > Capacity ? head - Capacity : 0;
+    entries.reserve(int(head - first));
+
+    for (quint64 index = first; index < head; ++index) {
+        const Slot &slot = m_slots[index % Capacity];
+
+        const quint64 before = slot.sequence.load(std::memory_order_acquire);
+        if (before != index * 2 + 2) {
+            continue; // still being written, or already overwritten by a newer lap
+        }
+
+        Entry copy = slot.entry;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before) {
+            continue;
+        }
+
+        entries.append(copy);
+    }
+
+    return entries;
+}
+
+QStringList TraceRing::dump() const
+{
+    const QList<Entry> entries = snapshot();
+    QStringList lines;
+    lines.reserve(entries.size());
+
+    const qint64 now = nowNs();
+    for (const Entry &entry : entries) {
+        lines.append(QStringLiteral("-%1ms %2 %3 %4")
+                         .arg((now - entry.timestampNs) / 1e6, 0, 'f', 3)
+                         .arg(QLatin1String(entry.event))
+                         .arg(QLatin1String(entry.subject))
+                         .arg(entry.value));
+    }
+
+    return lines;
+}
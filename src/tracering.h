@@ -0,0 +1,54 @@
+#ifndef TRACERING_H
+#define TRACERING_H
+
+#include "chrometrace.h"
+#include <QStringList>
+#include <QStringView>
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+
+// Fixed-size, lock-free ring of the last few hundred portal events.
+// Recording is a couple of atomic ops and a short copy, no allocation and no
+// I/O; the ring is only formatted when someone asks for it (Debug.DumpTrace).
+class TraceRing
+{
+public:
+    static constexpr int Capacity = 512;
+    static constexpr int SubjectSize = 64;
+
+    struct Entry {
+        qint64 timestampNs;
+        const char *event; // must be a string literal
+        qint64 value;
+        char subject[SubjectSize];
+    };
+
+    static TraceRing &instance();
+
+    void record(const char *event, QStringView subject = {}, qint64 value = 0);
+    QList<Entry> snapshot() const;
+    QStringList dump() const;
+
+private:
+    TraceRing() = default;
+
+    struct Slot {
+        std::atomic<quint64> sequence{0};
+        Entry entry{};
+    };
+
+    std::array<Slot, Capacity> m_slots;
+    std::atomic<quint64> m_head{0};
+};
+
+// Also shows up as an instant event in the Chrome trace, when that's on
+inline void traceEvent(const char *event, QStringView subject = {}, qint64 value = 0)
+{
+    TraceRing::instance().record(event, subject, value);
+    if (ChromeTrace::enabled()) {
+        ChromeTrace::instance().instant(event, subject, value);
+    }
+}
+
+#endif // TRACERING_H
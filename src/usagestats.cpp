@@ -0,0 +1,175 @@
+#include "usagestats.h"
+#include "logging.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <algorithm>
+#include <functional>
+
+UsageStats &UsageStats::instance()
+{
+    static UsageStats stats;
+    if (!stats.m_loaded) {
+        stats.load();
+    }
+    return stats;
+}
+
+UsageStats::UsageStats()
+{
+    // One at a time, so an older snapshot never lands after a newer one
+    m_writer.setMaxThreadCount(1);
+    m_writer.setObjectName(QStringLiteral("UsageStatsWriter"));
+}
+
+QString UsageStats::path()
+{
+    // QStandardPaths only knows the state dir from Qt 6.7 on
+    QString state = qEnvironmentVariable("XDG_STATE_HOME");
+    if (state.isEmpty()) {
+        state = QDir::homePath() + QStringLiteral("/.local/state");
+    }
+    return state + QStringLiteral("/xdg-desktop-portal-uni/usage.json");
+}
+
+qint64 UsageStats::lastUsed(const QString &appId, const QString &sourceKey) const
+{
+    const auto app = m_apps.constFind(appId);
+    return app == m_apps.cend() ? 0 : app->value(sourceKey).lastUsed;
+}
+
+int UsageStats::useCount(const QString &appId, const QString &sourceKey) const
+{
+    const auto app = m_apps.constFind(appId);
+    return app == m_apps.cend() ? 0 : app->value(sourceKey).count;
+}
+
+// Keep the n most recently used of a hash of things with a lastUsed
+template<typename Hash, typename LastUsed>
+static void trim(Hash &hash, int n, LastUsed lastUsed)
+{
+    if (hash.size() <= n) {
+        return;
+    }
+
+    QList<qint64> times;
+    times.reserve(hash.size());
+    for (auto it = hash.cbegin(); it != hash.cend(); ++it) {
+        times.append(lastUsed(it.value()));
+    }
+    std::nth_element(times.begin(), times.begin() + n - 1, times.end(), std::greater<qint64>());
+    const qint64 cutoff = times.at(n - 1);
+
+    for (auto it = hash.begin(); it != hash.end() && hash.size() > n; ) {
+        it = lastUsed(it.value()) < cutoff ? hash.erase(it) : std::next(it);
+    }
+}
+
+void UsageStats::recordUse(const QString &appId, const QString &sourceKey)
+{
+    if (sourceKey.isEmpty()) {
+        return;
+    }
+
+    AppEntries &app = m_apps[appId];
+    Entry &entry = app[sourceKey];
+    entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+    ++entry.count;
+
+    trim(app, MaxSourcesPerApp, [](const Entry &e) { return e.lastUsed; });
+    trim(m_apps, MaxApps, [](const AppEntries &entries) {
+        qint64 latest = 0;
+        for (const Entry &e : entries) {
+            latest = qMax(latest, e.lastUsed);
+        }
+        return latest;
+    });
+
+    scheduleSave();
+}
+
+void UsageStats::scheduleSave()
+{
+    if (!QCoreApplication::instance()) {
+        save(); // no event loop to wait for
+        return;
+    }
+    if (!m_saveTimer) {
+        // Parented to the app so it goes away with the event loop, and a
+        // pick made just before quitting still gets written
+        m_saveTimer = new QTimer(QCoreApplication::instance());
+        m_saveTimer->setSingleShot(true);
+        m_saveTimer->setInterval(SaveDelayMs);
+        QObject::connect(m_saveTimer, &QTimer::timeout, [this] { save(); });
+        QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, [this] { flush(); });
+    }
+    if (!m_saveTimer->isActive()) {
+        m_saveTimer->start();
+    }
+}
+
+void UsageStats::flush()
+{
+    if (m_saveTimer && m_saveTimer->isActive()) {
+        m_saveTimer->stop();
+        save();
+    }
+    m_writer.waitForDone();
+}
+
+void UsageStats::reload()
+{
+    flush();
+    m_apps.clear();
+    load();
+}
+
+void UsageStats::load()
+{
+    m_loaded = true;
+
+    QFile file(path());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return; // nothing shared yet
+    }
+
+    const QJsonObject apps = QJsonDocument::fromJson(file.readAll()).object();
+    for (auto app = apps.begin(); app != apps.end(); ++app) {
+        const QJsonObject sources = app.value().toObject();
+        AppEntries &entries = m_apps[app.key()];
+        for (auto source = sources.begin(); source != sources.end(); ++source) {
+            const QJsonObject entry = source.value().toObject();
+            entries.insert(source.key(), { qint64(entry.value("last").toDouble()), entry.value("count").toInt() });
+        }
+    }
+}
+
+void UsageStats::save()
+{
+    QJsonObject apps;
+    for (auto app = m_apps.cbegin(); app != m_apps.cend(); ++app) {
+        QJsonObject sources;
+        for (auto source = app->cbegin(); source != app->cend(); ++source) {
+            sources.insert(source.key(), QJsonObject{
+                { "last", double(source->lastUsed) },
+                { "count", source->count },
+            });
+        }
+        apps.insert(app.key(), sources);
+    }
+
+    // Serialized here, only the disk part goes to the worker
+    m_writer.start([data = QJsonDocument(apps).toJson(QJsonDocument::Compact), file = path()] {
+        QDir().mkpath(QFileInfo(file).absolutePath());
+
+        QSaveFile out(file);
+        if (!out.open(QIODevice::WriteOnly) || out.write(data) < 0 || !out.commit()) {
+            qCWarning(lcSelector) << "Could not save source usage to" << file << out.errorString();
+        }
+    });
+}
@@ -0,0 +1,62 @@
+#ifndef USAGESTATS_H
+#define USAGESTATS_H
+
+#include <QHash>
+#include <QPointer>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+
+// Which sources each app shared, and when, so the picker can put the likely
+// choice on top. Kept in $XDG_STATE_HOME/xdg-desktop-portal-uni/usage.json,
+// trimmed to the most recent apps and sources so it stays a few kB.
+//
+// Keys have to survive reconnects and restarts: monitors go by vendor,
+// product and serial rather than connector, windows by app id since their
+// ids are only good for one session.
+//
+// recordUse only touches memory; the file is written a moment later on a
+// worker thread, so a burst of picks is one write and none of them waits on
+// the disk.
+class UsageStats
+{
+public:
+    static constexpr int MaxApps = 64;
+    static constexpr int MaxSourcesPerApp = 16;
+
+    static UsageStats &instance();
+    static QString path();
+
+    // Milliseconds since the epoch, 0 when appId never shared it
+    qint64 lastUsed(const QString &appId, const QString &sourceKey) const;
+    int useCount(const QString &appId, const QString &sourceKey) const;
+
+    void recordUse(const QString &appId, const QString &sourceKey);
+
+    // Write out a pending save now and wait for it
+    void flush();
+
+    // Drop what's in memory and read the file again, for tests
+    void reload();
+
+private:
+    struct Entry {
+        qint64 lastUsed = 0;
+        int count = 0;
+    };
+    using AppEntries = QHash<QString, Entry>;
+
+    static constexpr int SaveDelayMs = 1000;
+
+    UsageStats();
+    void load();
+    void scheduleSave();
+    void save();
+
+    QHash<QString, AppEntries> m_apps;
+    bool m_loaded = false;
+    QPointer<QTimer> m_saveTimer;
+    QThreadPool m_writer;
+};
+
+#endif // USAGESTATS_H